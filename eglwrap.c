@@ -34,6 +34,8 @@ eglSwapBuffers (EGLDisplay dpy, EGLSurface surface)
 {
 	EGLBoolean ret;
 
+	on_swap_buffers();
+
 	FIPS_DEFER_WITH_RETURN (ret, eglSwapBuffers, dpy, surface);
 
 	context_counter_stop ();
@@ -63,3 +65,34 @@ eglMakeCurrent (EGLDisplay display, EGLSurface draw, EGLSurface read,
 
 	return ret;
 }
+
+EGLContext
+eglCreateContext (EGLDisplay display, EGLConfig config,
+		  EGLContext share_context, const EGLint *attrib_list)
+{
+	EGLContext ret;
+
+	FIPS_DEFER_WITH_RETURN (ret, eglCreateContext, display, config,
+				share_context, attrib_list);
+
+	if (ret != EGL_NO_CONTEXT) {
+		/* publishers must exist to see the share group of the
+		 * first contexts, which are created before any is made
+		 * current. */
+		fips_dispatch_init (FIPS_API_EGL);
+		publish_create_context (ret, share_context);
+	}
+	return ret;
+}
+
+EGLBoolean
+eglDestroyContext (EGLDisplay display, EGLContext context)
+{
+	EGLBoolean ret;
+
+	publish_destroy_context (context);
+
+	FIPS_DEFER_WITH_RETURN (ret, eglDestroyContext, display, context);
+
+	return ret;
+}
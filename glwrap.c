@@ -190,6 +190,8 @@ glBufferData (GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage)
 
 	FIPS_DEFER (glBufferData, target, size, data, usage);
 
+	on_buffer_data (target, size);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -201,6 +203,21 @@ glNamedBufferDataEXT (GLuint buffer, GLsizeiptr size, const GLvoid *data,
 
 	FIPS_DEFER (glNamedBufferDataEXT, buffer, size, data, usage);
 
+	on_named_buffer_data (buffer, size);
+
+	RESTORE_METRICS_OP ();
+}
+
+void
+glBufferStorage (GLenum target, GLsizeiptr size, const GLvoid *data,
+		 GLbitfield flags)
+{
+	SAVE_THEN_SWITCH_METRICS_OP (METRICS_OP_BUFFER_DATA);
+
+	FIPS_DEFER (glBufferStorage, target, size, data, flags);
+
+	on_buffer_data (target, size);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -981,6 +998,8 @@ glTexImage1D (GLenum target, GLint level, GLint internalFormat,
 	FIPS_DEFER (glTexImage1D, target, level, internalFormat, width,
 		      border, format, type, pixels);
 
+	on_tex_image (target, level, internalFormat, width, 1, 1, 1);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -994,6 +1013,8 @@ glTexImage2D (GLenum target, GLint level, GLint internalFormat,
 	FIPS_DEFER (glTexImage2D, target, level, internalFormat,
 		      width, height, border, format, type, pixels);
 
+	on_tex_image (target, level, internalFormat, width, height, 1, 1);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1009,6 +1030,9 @@ glTexImage2DMultisample (GLenum target, GLsizei samples,
 	FIPS_DEFER (glTexImage2DMultisample, target, samples,
 		      internalformat, width, height, fixedsamplelocations);
 
+	on_tex_image (target, 0, internalformat, width, height, 1,
+		      samples);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1037,6 +1061,9 @@ glTexImage3D (GLenum target, GLint level, GLint internalformat,
 	FIPS_DEFER (glTexImage3D, target, level, internalformat,
 		      width, height, depth, border, format, type, pixels);
 
+	on_tex_image (target, level, internalformat, width, height, depth,
+		      1);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1050,6 +1077,9 @@ glTexImage3DEXT (GLenum target, GLint level, GLenum internalformat,
 	FIPS_DEFER (glTexImage3DEXT, target, level, internalformat,
 		      width, height, depth, border, format, type, pixels);
 
+	on_tex_image (target, level, internalformat, width, height, depth,
+		      1);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1065,6 +1095,9 @@ glTexImage3DMultisample (GLenum target, GLsizei samples,
 		      internalformat, width, height, depth,
 		      fixedsamplelocations);
 
+	on_tex_image (target, 0, internalformat, width, height, depth,
+		      samples);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1098,6 +1131,81 @@ glTexImage4DSGIS (GLenum target, GLint level, GLenum internalformat,
 	RESTORE_METRICS_OP ();
 }
 
+void
+glTexStorage1D (GLenum target, GLsizei levels, GLenum internalformat,
+		GLsizei width)
+{
+	SAVE_THEN_SWITCH_METRICS_OP (METRICS_OP_TEX_IMAGE);
+
+	FIPS_DEFER (glTexStorage1D, target, levels, internalformat, width);
+
+	on_tex_storage (target, levels, internalformat, width, 1, 1, 1);
+
+	RESTORE_METRICS_OP ();
+}
+
+void
+glTexStorage2D (GLenum target, GLsizei levels, GLenum internalformat,
+		GLsizei width, GLsizei height)
+{
+	SAVE_THEN_SWITCH_METRICS_OP (METRICS_OP_TEX_IMAGE);
+
+	FIPS_DEFER (glTexStorage2D, target, levels, internalformat,
+		      width, height);
+
+	on_tex_storage (target, levels, internalformat, width, height, 1, 1);
+
+	RESTORE_METRICS_OP ();
+}
+
+void
+glTexStorage3D (GLenum target, GLsizei levels, GLenum internalformat,
+		GLsizei width, GLsizei height, GLsizei depth)
+{
+	SAVE_THEN_SWITCH_METRICS_OP (METRICS_OP_TEX_IMAGE);
+
+	FIPS_DEFER (glTexStorage3D, target, levels, internalformat,
+		      width, height, depth);
+
+	on_tex_storage (target, levels, internalformat, width, height,
+			depth, 1);
+
+	RESTORE_METRICS_OP ();
+}
+
+void
+glTexStorage2DMultisample (GLenum target, GLsizei samples,
+			   GLenum internalformat, GLsizei width,
+			   GLsizei height, GLboolean fixedsamplelocations)
+{
+	SAVE_THEN_SWITCH_METRICS_OP (METRICS_OP_TEX_IMAGE);
+
+	FIPS_DEFER (glTexStorage2DMultisample, target, samples,
+		      internalformat, width, height, fixedsamplelocations);
+
+	on_tex_storage (target, 1, internalformat, width, height, 1, samples);
+
+	RESTORE_METRICS_OP ();
+}
+
+void
+glTexStorage3DMultisample (GLenum target, GLsizei samples,
+			   GLenum internalformat, GLsizei width,
+			   GLsizei height, GLsizei depth,
+			   GLboolean fixedsamplelocations)
+{
+	SAVE_THEN_SWITCH_METRICS_OP (METRICS_OP_TEX_IMAGE);
+
+	FIPS_DEFER (glTexStorage3DMultisample, target, samples,
+		      internalformat, width, height, depth,
+		      fixedsamplelocations);
+
+	on_tex_storage (target, 1, internalformat, width, height, depth,
+			samples);
+
+	RESTORE_METRICS_OP ();
+}
+
 void
 glTexSubImage1D (GLenum target, GLint level, GLint xoffset,
 		 GLsizei width, GLenum format, GLenum type,
@@ -1287,6 +1395,8 @@ glCompressedTexImage1D (GLenum target, GLint level, GLenum internalformat,
 	FIPS_DEFER (glCompressedTexImage1D, target, level,
 		      internalformat, width, border, imageSize, data);
 
+	on_compressed_tex_image (target, level, imageSize);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1300,6 +1410,8 @@ glCompressedTexImage1DARB (GLenum target, GLint level, GLenum internalformat,
 	FIPS_DEFER (glCompressedTexImage1DARB, target, level, internalformat,
 		      width, border, imageSize, data);
 
+	on_compressed_tex_image (target, level, imageSize);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1313,6 +1425,8 @@ glCompressedTexImage2D (GLenum target, GLint level, GLenum internalformat,
 	FIPS_DEFER (glCompressedTexImage2D, target, level, internalformat,
 		      width, height, border, imageSize, data);
 
+	on_compressed_tex_image (target, level, imageSize);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1326,6 +1440,8 @@ glCompressedTexImage2DARB (GLenum target, GLint level, GLenum internalformat,
 	FIPS_DEFER (glCompressedTexImage2DARB, target, level, internalformat,
 		      width, height, border, imageSize, data);
 
+	on_compressed_tex_image (target, level, imageSize);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1339,6 +1455,8 @@ glCompressedTexImage3D (GLenum target, GLint level, GLenum internalformat,
 	FIPS_DEFER (glCompressedTexImage3D, target, level, internalformat,
 		      width, height, depth, border, imageSize, data);
 
+	on_compressed_tex_image (target, level, imageSize);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1352,6 +1470,8 @@ glCompressedTexImage3DARB (GLenum target, GLint level, GLenum internalformat,
 	FIPS_DEFER (glCompressedTexImage3DARB, target, level, internalformat,
 		      width, height, depth, border, imageSize, data);
 
+	on_compressed_tex_image (target, level, imageSize);
+
 	RESTORE_METRICS_OP ();
 }
 
@@ -1771,3 +1891,32 @@ void glLinkProgram (GLuint program)
 	on_link_program(program);
 }
 
+void glRenderbufferStorage (GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	FIPS_DEFER(glRenderbufferStorage, target, internalformat, width, height);
+	on_renderbuffer_storage(target, 1, internalformat, width, height);
+}
+
+void glRenderbufferStorageMultisample (GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	FIPS_DEFER(glRenderbufferStorageMultisample, target, samples, internalformat, width, height);
+	on_renderbuffer_storage(target, samples, internalformat, width, height);
+}
+
+void glDeleteTextures (GLsizei n, const GLuint *textures)
+{
+	FIPS_DEFER(glDeleteTextures, n, textures);
+	on_delete_textures(n, textures);
+}
+
+void glDeleteBuffers (GLsizei n, const GLuint *buffers)
+{
+	FIPS_DEFER(glDeleteBuffers, n, buffers);
+	on_delete_buffers(n, buffers);
+}
+
+void glDeleteRenderbuffers (GLsizei n, const GLuint *renderbuffers)
+{
+	FIPS_DEFER(glDeleteRenderbuffers, n, renderbuffers);
+	on_delete_renderbuffers(n, renderbuffers);
+}
@@ -25,6 +25,7 @@
 
 #include <X11/Xlib.h>
 #include <GL/gl.h>
+#define GLX_GLXEXT_PROTOTYPES
 #include <GL/glx.h>
 
 #include "context.h"
@@ -35,6 +36,8 @@
 void
 glXSwapBuffers (Display *dpy, GLXDrawable drawable)
 {
+	on_swap_buffers();
+
 	FIPS_DEFER (glXSwapBuffers, dpy, drawable);
 
 	context_counter_stop ();
@@ -73,3 +76,55 @@ glXMakeContextCurrent (Display *dpy, GLXDrawable drawable, GLXDrawable read, GLX
 	return ret;
 }
 
+GLXContext
+glXCreateContext (Display *dpy, XVisualInfo *vis, GLXContext shareList,
+		  Bool direct)
+{
+	GLXContext ret;
+
+	FIPS_DEFER_WITH_RETURN (ret, glXCreateContext, dpy, vis, shareList,
+				direct);
+
+	/* publishers must exist to see the share group of the first
+	 * contexts, which are created before any is made current. */
+	fips_dispatch_init (FIPS_API_GLX);
+	publish_create_context (ret, shareList);
+	return ret;
+}
+
+GLXContext
+glXCreateNewContext (Display *dpy, GLXFBConfig config, int renderType,
+		     GLXContext shareList, Bool direct)
+{
+	GLXContext ret;
+
+	FIPS_DEFER_WITH_RETURN (ret, glXCreateNewContext, dpy, config,
+				renderType, shareList, direct);
+
+	fips_dispatch_init (FIPS_API_GLX);
+	publish_create_context (ret, shareList);
+	return ret;
+}
+
+GLXContext
+glXCreateContextAttribsARB (Display *dpy, GLXFBConfig config,
+			    GLXContext share_context, Bool direct,
+			    const int *attrib_list)
+{
+	GLXContext ret;
+
+	FIPS_DEFER_WITH_RETURN (ret, glXCreateContextAttribsARB, dpy, config,
+				share_context, direct, attrib_list);
+
+	fips_dispatch_init (FIPS_API_GLX);
+	publish_create_context (ret, share_context);
+	return ret;
+}
+
+void
+glXDestroyContext (Display *dpy, GLXContext ctx)
+{
+	publish_destroy_context (ctx);
+
+	FIPS_DEFER (glXDestroyContext, dpy, ctx);
+}
@@ -29,15 +29,17 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <string>
 
 #include "controls/gfcontrol_stub.h"
 #include "error/gflog.h"
 
 using Grafips::ControlRouterTarget;
+using Grafips::ControlSubscriberInterface;
+using Grafips::ScopedLock;
 
-ControlRouterTarget::ControlRouterTarget()
-    : m_subscriber(NULL) {}
+ControlRouterTarget::ControlRouterTarget() {}
 
 bool
 ControlRouterTarget::Set(const std::string &key, const std::string &value) {
@@ -63,17 +65,27 @@ void
 ControlRouterTarget::Subscribe(ControlSubscriberInterface *sub) {
   // might need to cache all publications, to send initial state on a
   // tardy subscribe
-  m_subscriber = sub;
+  ScopedLock s(&m_protect);
+  m_subscribers.push_back(sub);
   for (auto i = m_current_state.begin(); i != m_current_state.end(); ++i)
     sub->OnControlChanged(i->first, i->second);
 }
 
+void
+ControlRouterTarget::Unsubscribe(ControlSubscriberInterface *sub) {
+  ScopedLock s(&m_protect);
+  m_subscribers.erase(std::remove(m_subscribers.begin(),
+                                  m_subscribers.end(), sub),
+                      m_subscribers.end());
+}
+
 void
 ControlRouterTarget::OnControlChanged(const std::string &key,
                                       const std::string &value) {
+  ScopedLock s(&m_protect);
   m_current_state[key] = value;
-  if (m_subscriber)
-    m_subscriber->OnControlChanged(key, value);
+  for (auto i = m_subscribers.begin(); i != m_subscribers.end(); ++i)
+    (*i)->OnControlChanged(key, value);
 }
 
 
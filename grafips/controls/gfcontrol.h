@@ -30,8 +30,10 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "controls/gficontrol.h"
+#include "os/gfmutex.h"
 
 // UI
 //   widget   widget
@@ -58,12 +60,13 @@ namespace Grafips {
 // key.  ControlRouterTarget will forward any observed control changes
 // to its subscriber, which is intended to be a
 // ControlSubscriberInterface stub passing the data over the socket to
-// the UI.
+// the UI.  Each connected UI has its own subscriber.
 class ControlRouterTarget : public ControlSubscriberInterface {
  public:
   ControlRouterTarget();
   void AddControl(const std::string &key, ControlInterface* target);
   void Subscribe(ControlSubscriberInterface *sub);
+  void Unsubscribe(ControlSubscriberInterface *sub);
   bool Set(const std::string &key, const std::string &value);
 
   void OnControlChanged(const std::string &key,
@@ -73,9 +76,10 @@ class ControlRouterTarget : public ControlSubscriberInterface {
   std::map<std::string, ControlInterface *> m_targets;
   std::map<std::string, std::string> m_current_state;
 
-  // this is a stub, to be instantiated by the skeleton that owns the
+  // these are stubs, to be instantiated by the skeletons that own the
   // ControlRouterTarget
-  ControlSubscriberInterface *m_subscriber;
+  std::vector<ControlSubscriberInterface *> m_subscribers;
+  Mutex m_protect;
 };
 
 }  // namespace Grafips
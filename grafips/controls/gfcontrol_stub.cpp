@@ -45,6 +45,7 @@ using Grafips::ControlSubscriberStub;
 using Grafips::Error;
 using Grafips::NoError;
 using Grafips::Raise;
+using Grafips::ScopedLock;
 using Grafips::kSocketWriteFail;
 using GrafipsControlProto::ControlInvocation;
 using google::protobuf::io::ArrayInputStream;
@@ -209,6 +210,7 @@ ControlSkel::Run() {
 
   // clean up subscriber stub
   if (m_subscriber) {
+    m_target->Unsubscribe(m_subscriber);
     delete m_subscriber;
     m_subscriber = NULL;
   }
@@ -216,11 +218,19 @@ ControlSkel::Run() {
 
 ControlSubscriberStub::ControlSubscriberStub(const std::string &address,
                                              int port)
-    : m_socket(new Socket(address, port)) {
+    : m_socket(new Socket(address, port)),
+      m_writer(new SessionWriter(m_socket)) {
+}
+
+ControlSubscriberStub::ControlSubscriberStub(SessionWriter *writer)
+    : m_socket(NULL), m_writer(writer) {
 }
 
 ControlSubscriberStub::~ControlSubscriberStub() {
-  delete(m_socket);
+  if (m_socket) {
+    delete m_writer;
+    delete m_socket;
+  }
 }
 
 void
@@ -241,23 +251,16 @@ ControlSubscriberStub::OnControlChanged(const std::string &key,
 void
 ControlSubscriberStub::WriteMessage(const ControlInvocation &m) const {
   const uint32_t write_size = m.ByteSize();
-  m_protect.Lock();
-  if (!m_socket->Write(write_size)) {
-    Raise(Error(kSocketWriteFail, ERROR,
-                "ControlSubscriberStub wrote to closed socket"));
-    return;
-  }
-
+  ScopedLock s(&m_protect);
   m_buf.resize(write_size);
   ArrayOutputStream array_out(m_buf.data(), write_size);
   CodedOutputStream coded_out(&array_out);
   m.SerializeToCodedStream(&coded_out);
-  if (!m_socket->Write(m_buf.data(), write_size)) {
+  if (!m_writer->Write(kControlSubscriberChannel, m_buf)) {
     Raise(Error(kSocketWriteFail, ERROR,
                 "ControlSubscriberStub wrote to closed socket"));
     return;
   }
-  m_protect.Unlock();
 }
 
 
@@ -330,6 +333,9 @@ ControlSubscriberStub::Flush() {
 
   request.set_method(ControlInvocation::kFlush);
   WriteMessage(request);
+  // on a multiplexed session, the response is read by the skeleton
+  if (!m_socket)
+    return;
   int response;
   if (!m_socket->Read(&response)) {
     Raise(Error(kSocketReadFail, ERROR,
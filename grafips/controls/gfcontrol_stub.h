@@ -35,6 +35,7 @@
 #include "os/gfsocket.h"
 #include "os/gfmutex.h"
 #include "os/gfthread.h"
+#include "remote/gfsession.h"
 #include "./gfcontrol.pb.h"
 
 namespace GrafipsControlProto {
@@ -84,14 +85,19 @@ class ControlSkel : public Thread {
 
 class ControlSubscriberStub : public ControlSubscriberInterface {
  public:
+  // opens a connection to the subscriber
   ControlSubscriberStub(const std::string &address, int port);
+  // writes to a multiplexed session connection
+  explicit ControlSubscriberStub(SessionWriter *writer);
   ~ControlSubscriberStub();
   void OnControlChanged(const std::string &key,
                         const std::string &value);
   void Flush();
  private:
   void WriteMessage(const GrafipsControlProto::ControlInvocation &m) const;
+  // NULL for multiplexed sessions
   mutable Socket *m_socket;
+  SessionWriter *m_writer;
   mutable std::vector<unsigned char> m_buf;
   mutable Mutex m_protect;
 };
@@ -0,0 +1,167 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "os/gfproc_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+using Grafips::ProcFile;
+
+namespace {
+const size_t kInitialBufSize = 4096;
+}  // namespace
+
+ProcFile::ProcFile(const std::string &path)
+    : m_fd(open(path.c_str(), O_RDONLY | O_CLOEXEC)),
+      m_buf(kInitialBufSize), m_size(0) {
+  m_buf[0] = '\0';
+}
+
+ProcFile::~ProcFile() {
+  if (m_fd >= 0)
+    close(m_fd);
+}
+
+bool
+ProcFile::Read() {
+  m_size = 0;
+  m_buf[0] = '\0';
+  if (m_fd < 0)
+    return false;
+  while (true) {
+    // room for the terminator
+    if (m_size + 1 >= m_buf.size())
+      m_buf.resize(m_buf.size() * 2);
+    const ssize_t bytes = pread(m_fd, &m_buf[m_size],
+                                m_buf.size() - m_size - 1, m_size);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes < 0) {
+      m_size = 0;
+      m_buf[0] = '\0';
+      return false;
+    }
+    if (bytes == 0)
+      break;
+    m_size += bytes;
+  }
+  m_buf[m_size] = '\0';
+  return m_size > 0;
+}
+
+bool
+ProcFile::Value(const char *key, int64_t *value) const {
+  const size_t key_size = strlen(key);
+  const char *line = Data();
+  const char *end = End();
+  while (line < end) {
+    if (static_cast<size_t>(end - line) > key_size &&
+        memcmp(line, key, key_size) == 0 &&
+        (line[key_size] == ':' || line[key_size] == ' ')) {
+      const char *p = line + key_size + 1;
+      while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+      *value = ParseInt(&p, end);
+      return true;
+    }
+    line = static_cast<const char *>(memchr(line, '\n', end - line));
+    if (line == NULL)
+      break;
+    ++line;
+  }
+  return false;
+}
+
+bool
+ProcFile::ReadUint(uint64_t *value) {
+  if (!Read())
+    return false;
+  const char *p = Data();
+  const char *end = End();
+  while (p < end && *p == ' ')
+    ++p;
+  if (p == end || *p < '0' || *p > '9')
+    return false;
+  *value = ParseUint(&p, end);
+  return true;
+}
+
+bool
+ProcFile::ReadInt(int64_t *value) {
+  if (!Read())
+    return false;
+  const char *p = Data();
+  const char *end = End();
+  while (p < end && *p == ' ')
+    ++p;
+  const char *digit = (p < end && *p == '-') ? p + 1 : p;
+  if (digit == end || *digit < '0' || *digit > '9')
+    return false;
+  *value = ParseInt(&p, end);
+  return true;
+}
+
+std::string
+ProcFile::ReadLine(const std::string &path) {
+  ProcFile f(path);
+  if (!f.Read())
+    return "";
+  const char *data = f.Data();
+  return std::string(data, strcspn(data, "\n"));
+}
+
+uint64_t
+ProcFile::ParseUint(const char **p, const char *end) {
+  const char *c = *p;
+  while (c < end && *c == ' ')
+    ++c;
+  uint64_t value = 0;
+  while (c < end && *c >= '0' && *c <= '9') {
+    value = value * 10 + (*c - '0');
+    ++c;
+  }
+  *p = c;
+  return value;
+}
+
+int64_t
+ProcFile::ParseInt(const char **p, const char *end) {
+  const char *c = *p;
+  while (c < end && *c == ' ')
+    ++c;
+  const bool negative = (c < end && *c == '-');
+  if (negative)
+    ++c;
+  const int64_t value = ParseUint(&c, end);
+  *p = c;
+  return negative ? -value : value;
+}
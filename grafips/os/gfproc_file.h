@@ -0,0 +1,78 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef OS_GFPROC_FILE_H_
+#define OS_GFPROC_FILE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "os/gftraits.h"
+
+namespace Grafips {
+
+// A file in /proc or /sys, which is kept open between reads.  These
+// files are regenerated when read from offset 0, so each Read() sees
+// current contents without reopening the file.  The buffer grows to
+// hold the file and is reused, so steady state reads do not allocate.
+class ProcFile : NoCopy, NoAssign, NoMove {
+ public:
+  explicit ProcFile(const std::string &path);
+  ~ProcFile();
+  bool IsOpen() const { return m_fd >= 0; }
+  // false if the file could not be read
+  bool Read();
+  // contents of the last Read(), followed by a terminating 0
+  const char *Data() const { return &m_buf[0]; }
+  const char *End() const { return &m_buf[0] + m_size; }
+  size_t Size() const { return m_size; }
+  // Finds a line of the form "<key>: <value>" or "<key> <value>", as
+  // in /proc/self/status or cgroup stat files.  false if not present.
+  bool Value(const char *key, int64_t *value) const;
+  // Read() a file holding a single integer, as most sysfs attributes
+  // do.  false if it can't be read, or does not start with one.
+  bool ReadUint(uint64_t *value);
+  bool ReadInt(int64_t *value);
+  // first line of a file, eg a sysfs name.  "" if it can't be read.
+  static std::string ReadLine(const std::string &path);
+
+  // Parse a decimal integer at *p, skipping leading spaces, and
+  // advance *p past it.  0 if there is no integer at *p.
+  static uint64_t ParseUint(const char **p, const char *end);
+  static int64_t ParseInt(const char **p, const char *end);
+
+ private:
+  int m_fd;
+  std::vector<char> m_buf;
+  size_t m_size;
+};
+
+}  // namespace Grafips
+
+#endif  // OS_GFPROC_FILE_H_
@@ -29,11 +29,14 @@
 
 #include <arpa/inet.h>
 #include <assert.h>
+#include <errno.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <string>
@@ -55,6 +58,16 @@ Socket::Read(void * buf, int size) {
   return true;
 }
 
+int
+Socket::ReadSome(void * buf, int size) {
+  while (true) {
+    const ssize_t bytes_read = ::recv(m_socket_fd, buf, size, 0);
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    return bytes_read;
+  }
+}
+
 bool
 Socket::Write(const void * buf, int size) {
   int bytes_remaining = size;
@@ -63,6 +76,7 @@ Socket::Write(const void * buf, int size) {
     ssize_t bytes_written = ::send(m_socket_fd, curPtr,
                                    bytes_remaining,
                                    0);  // default flags
+    ++m_send_count;
 
     if (bytes_written < 0) {
       if (errno == EINTR)
@@ -76,6 +90,74 @@ Socket::Write(const void * buf, int size) {
   return true;
 }
 
+bool
+Socket::Write(const void * header, int header_size,
+              const void * buf, int size) {
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<void *>(header);
+  iov[0].iov_len = header_size;
+  iov[1].iov_base = const_cast<void *>(buf);
+  iov[1].iov_len = size;
+  struct iovec *cur_iov = iov;
+  int iov_count = 2;
+  while (iov_count > 0) {
+    ssize_t bytes_written = ::writev(m_socket_fd, cur_iov, iov_count);
+    ++m_send_count;
+
+    if (bytes_written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    while (iov_count > 0 &&
+           static_cast<size_t>(bytes_written) >= cur_iov->iov_len) {
+      bytes_written -= cur_iov->iov_len;
+      ++cur_iov;
+      --iov_count;
+    }
+    if (iov_count > 0) {
+      cur_iov->iov_base = reinterpret_cast<char*>(cur_iov->iov_base)
+                          + bytes_written;
+      cur_iov->iov_len -= bytes_written;
+    }
+  }
+  return true;
+}
+
+int
+Socket::WriteSome(const struct iovec *iov, int count) {
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<struct iovec *>(iov);
+  msg.msg_iovlen = count;
+  while (true) {
+    const ssize_t bytes_written = ::sendmsg(m_socket_fd, &msg,
+                                            MSG_DONTWAIT | MSG_NOSIGNAL);
+    ++m_send_count;
+    if (bytes_written >= 0)
+      return bytes_written;
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    return -1;
+  }
+}
+
+bool
+Socket::WaitWritable() {
+  struct pollfd p;
+  p.fd = m_socket_fd;
+  p.events = POLLOUT;
+  while (true) {
+    p.revents = 0;
+    const int ready = poll(&p, 1, -1);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    return ready > 0 && !(p.revents & (POLLHUP | POLLERR));
+  }
+}
+
 class FreeAddrInfo {
  public:
   explicit FreeAddrInfo(addrinfo *p) : m_p(p) {}
@@ -85,7 +167,7 @@ class FreeAddrInfo {
 };
 
 Socket::Socket(const std::string &address, int port)
-    : m_address(address) {
+    : m_address(address), m_send_count(0) {
   struct addrinfo hints;
   memset(&hints, 0, sizeof (hints));
   hints.ai_family = AF_INET;
@@ -125,7 +207,7 @@ Socket::~Socket() {
   close(m_socket_fd);
 }
 
-ServerSocket::ServerSocket(int port) {
+ServerSocket::ServerSocket(int port, int backlog) {
   m_server_fd = socket(PF_INET, SOCK_STREAM, 0);
   assert(m_server_fd != -1);
 
@@ -152,7 +234,6 @@ ServerSocket::ServerSocket(int port) {
   assert(bind_result != -1);
   // todo raise on error
 
-  const int backlog = 1;  // single connection
   const int listen_result = listen(m_server_fd, backlog);
   assert(listen_result != -1);
   // todo raise on error
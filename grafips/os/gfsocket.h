@@ -28,61 +28,92 @@
 #ifndef OS_GFSOCKET_H_
 #define OS_GFSOCKET_H_
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
 #include "./gftraits.h"
 
+struct iovec;
+
 namespace Grafips {
 
+// Other transports (see gftransport.h) derive from Socket, and
+// override the virtual methods.
 class Socket : NoAssign, NoCopy, NoMove {
  public:
   // Client-side constructor: connects to server.  For server-side
   // sockets, use the ServerSocket class
   Socket(const std::string &address, int port);
-  ~Socket();
+  virtual ~Socket();
 
-  bool Read(void * buf, int size);
+  virtual bool Read(void * buf, int size);
   template <typename T> bool Read(T *val) { return Read(val, sizeof(T)); }
   template <typename T> bool ReadVec(std::vector<T> *vec) {
     return Read(vec->data(), vec->size() * sizeof(T));
   }
-  bool Write(const void * buf, int size);
+  virtual bool Write(const void * buf, int size);
   template <typename T> bool Write(const T &val) {
     return Write(&val, sizeof(val));
   }
   template <typename T> bool WriteVec(const std::vector<T> &vec) {
     return Write(vec.data(), sizeof(T) * vec.size());
   }
+  // writes header followed by buf, with a single writev() unless the
+  // socket accepts a partial write.
+  virtual bool Write(const void * header, int header_size,
+                     const void * buf, int size);
+
+  // a single recv(), returning the number of bytes read.  0 indicates
+  // that the peer closed the socket.
+  virtual int ReadSome(void * buf, int size);
+
+  // writes as much of iov as the socket accepts without blocking.
+  // Returns the number of bytes written, or -1 if the peer is closed.
+  virtual int WriteSome(const struct iovec *iov, int count);
+  // blocks until WriteSome can make progress.  false if the peer is
+  // closed.
+  virtual bool WaitWritable();
 
   const std::string &Address() const { return m_address; }
+  int Fd() const { return m_socket_fd; }
+
+  // number of send() / writev() system calls made on the socket
+  uint64_t SendCount() const { return m_send_count; }
 
- private:
+ protected:
   friend class ServerSocket;
   // this constructor only called by ServerSocket, when connection is
-  // accepted.
+  // accepted, and by other transports.
   Socket(int fd, const std::string &address)
-      : m_address(address), m_socket_fd(fd) {}
+      : m_address(address), m_socket_fd(fd), m_send_count(0) {}
 
   // address is stored so a server process can query the address of a
   // connected client.
   const std::string m_address;
   int m_socket_fd;
+  uint64_t m_send_count;
 };
 
 
 class ServerSocket : NoAssign, NoCopy, NoMove {
  public:
-  // establishes a server, waits for a client to connect
-  explicit ServerSocket(int port);
-  ~ServerSocket();
+  // establishes a server, waits for a client to connect.  backlog
+  // connections may be pending acceptance.
+  explicit ServerSocket(int port, int backlog = 1);
+  virtual ~ServerSocket();
 
-  Socket *Accept();
+  virtual Socket *Accept();
 
   // if 0 is passed as port, to choose an unused ephemeral port, then the
-  // chosen port can be retrieved with GetPort
-  int GetPort() const;
- private:
+  // chosen port can be retrieved with GetPort.  Transports which are not
+  // bound to a port return 0.
+  virtual int GetPort() const;
+  int Fd() const { return m_server_fd; }
+ protected:
+  // for other transports, which create their own listening socket
+  ServerSocket() : m_server_fd(-1) {}
   int m_server_fd;
 };
 
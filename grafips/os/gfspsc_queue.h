@@ -0,0 +1,93 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef OS_GFSPSC_QUEUE_H_
+#define OS_GFSPSC_QUEUE_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+#include "os/gftraits.h"
+
+namespace Grafips {
+
+// Bounded lock-free queue for a single producer thread and a single
+// consumer thread.  Push() never blocks: it fails when the queue is
+// full, and the producer decides what to do with the element.
+template <typename T>
+class SpscQueue : NoCopy, NoAssign, NoMove {
+ public:
+  // one slot is left empty to distinguish a full queue from an empty
+  // one.
+  explicit SpscQueue(size_t capacity)
+      : m_buf(capacity + 1), m_head(0), m_tail(0) {}
+
+  // called only by the producer
+  bool Push(const T &val) {
+    const size_t tail = m_tail.load(std::memory_order_relaxed);
+    const size_t next = Next(tail);
+    if (next == m_head.load(std::memory_order_acquire))
+      return false;
+    m_buf[tail] = val;
+    m_tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // called only by the consumer
+  bool Pop(T *val) {
+    const size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+      return false;
+    *val = m_buf[head];
+    m_head.store(Next(head), std::memory_order_release);
+    return true;
+  }
+
+  bool Empty() const {
+    return (m_head.load(std::memory_order_acquire) ==
+            m_tail.load(std::memory_order_acquire));
+  }
+
+ private:
+  size_t Next(size_t i) const { return (i + 1) % m_buf.size(); }
+
+  static const size_t kCacheLine = 64;
+
+  std::vector<T> m_buf;
+  // producer and consumer indices are kept on separate cache lines.
+  // Padding rather than alignas, which operator new does not honor
+  // before C++17.
+  std::atomic<size_t> m_head;
+  char m_pad[kCacheLine - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> m_tail;
+};
+
+}  // namespace Grafips
+
+#endif  // OS_GFSPSC_QUEUE_H_
@@ -28,20 +28,69 @@
 #include "os/gfthread.h"
 
 #include <assert.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 #include <string>
+#include <vector>
 
 #include "error/gflog.h"
+#include "os/gfmutex.h"
 
+using Grafips::Mutex;
+using Grafips::ScopedLock;
 using Grafips::Thread;
 
+static std::atomic<int> running_count(0);
+
+// Threads may run while the process exits, so the list of their tids
+// is never destroyed.
+struct RunningTids {
+  Mutex protect;
+  std::vector<pid_t> tids;
+};
+
+static RunningTids *
+running_tids() {
+  static RunningTids *tids = new RunningTids;
+  return tids;
+}
+
 Thread::Thread(const std::string &name) : m_name(name) {}
 
 void *start_thread(void*ctx);
 void *start_thread(void*ctx) {
+  ++running_count;
+  const pid_t tid = syscall(SYS_gettid);
+  RunningTids *running = running_tids();
+  {
+    ScopedLock l(&running->protect);
+    running->tids.push_back(tid);
+  }
   reinterpret_cast<Thread*>(ctx)->Run();
+  {
+    ScopedLock l(&running->protect);
+    running->tids.erase(std::find(running->tids.begin(), running->tids.end(),
+                                  tid));
+  }
+  --running_count;
   return NULL;
 }
 
+int
+Thread::RunningCount() {
+  return running_count;
+}
+
+void
+Thread::Tids(std::vector<pid_t> *tids) {
+  RunningTids *running = running_tids();
+  ScopedLock l(&running->protect);
+  *tids = running->tids;
+}
+
 void
 Thread::Start() {
   GFLOGF("thread started: %s", m_name.c_str());
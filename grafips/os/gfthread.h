@@ -29,7 +29,10 @@
 #define OS_GFTHREAD_H_
 
 #include <pthread.h>
+#include <sys/types.h>
+
 #include <string>
+#include <vector>
 
 #include "os/gftraits.h"
 
@@ -42,6 +45,11 @@ class Thread : NoCopy, NoAssign, NoMove {
   virtual void Run() = 0;
   void Start();
   void Join();
+  // number of Threads whose Run() has not returned
+  static int RunningCount();
+  // replaces tids with the kernel thread ids of the Threads whose
+  // Run() has not returned, eg to exclude their io from the process's
+  static void Tids(std::vector<pid_t> *tids);
  private:
   const std::string m_name;
   pthread_t m_thread;
@@ -0,0 +1,603 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "os/gftransport.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <string>
+
+#include "os/gfsocket.h"
+
+using Grafips::ServerSocket;
+using Grafips::Socket;
+
+namespace {
+
+const char kUnixPrefix[] = "unix:";
+const char kShmPrefix[] = "shm:";
+
+// data sent by the target is buffered in the ring, so a host which
+// reads in bursts does not stall the publisher.  Must be a power of 2.
+const uint32_t kShmRingSize = 1 << 20;
+const uint32_t kShmMagic = 0x67667368;  // "gfsh"
+
+bool
+HasPrefix(const std::string &s, const char *prefix) {
+  return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// The ring at the start of each shared memory segment.  Head and
+// tail are free-running byte counts, written by the target and host
+// respectively, and are kept on separate cache lines.
+struct ShmRing {
+  std::atomic<uint64_t> head;
+  char pad0[64 - sizeof(std::atomic<uint64_t>)];
+  std::atomic<uint64_t> tail;
+  char pad1[64 - sizeof(std::atomic<uint64_t>)];
+  uint32_t magic;
+  uint32_t capacity;
+  char pad2[64 - 2 * sizeof(uint32_t)];
+
+  // capacity bytes follow the header
+  char *Data() { return reinterpret_cast<char *>(this + 1); }
+};
+
+// Fills in an AF_UNIX address.  Paths beginning with '@' are in the
+// abstract namespace, and are not visible in the filesystem.
+socklen_t
+UnixAddress(const std::string &path, struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path))
+    return 0;
+  memcpy(addr->sun_path, path.data(), path.size());
+  if (path[0] != '@')
+    // include the terminator
+    return offsetof(struct sockaddr_un, sun_path) + path.size() + 1;
+  addr->sun_path[0] = '\0';
+  return offsetof(struct sockaddr_un, sun_path) + path.size();
+}
+
+std::string
+ShmSocketPath(const std::string &name) {
+  return "@grafips-shm-" + name;
+}
+
+bool
+ReadAll(int fd, void *buf, size_t size) {
+  char *dest = reinterpret_cast<char *>(buf);
+  while (size > 0) {
+    const ssize_t bytes = read(fd, dest, size);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes <= 0)
+      return false;
+    dest += bytes;
+    size -= bytes;
+  }
+  return true;
+}
+
+int
+ConnectUnix(const std::string &path) {
+  struct sockaddr_un addr;
+  const socklen_t len = UnixAddress(path, &addr);
+  if (len == 0)
+    return -1;
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), len) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// AF_UNIX connections.  The peer is reported as localhost, so that
+// hosts which ask the target to connect back to them still work.
+class LocalSocket : public Socket {
+ public:
+  explicit LocalSocket(int fd) : Socket(fd, "localhost") {}
+};
+
+class UnixServerSocket : public ServerSocket {
+ public:
+  UnixServerSocket(const std::string &path, int backlog);
+  ~UnixServerSocket();
+  Socket *Accept();
+  int GetPort() const { return 0; }
+
+ protected:
+  // -1 on failure
+  int AcceptFd();
+
+ private:
+  const std::string m_path;
+};
+
+UnixServerSocket::UnixServerSocket(const std::string &path, int backlog)
+    : m_path(path) {
+  struct sockaddr_un addr;
+  const socklen_t len = UnixAddress(path, &addr);
+  if (len == 0) {
+    fprintf(stderr, "grafips: invalid socket path: %s\n", path.c_str());
+    return;
+  }
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  assert(fd != -1);
+
+  // a previous target may have exited without removing the path
+  if (path[0] != '@')
+    unlink(path.c_str());
+
+  if ((bind(fd, reinterpret_cast<struct sockaddr *>(&addr), len) != 0) ||
+      (listen(fd, backlog) != 0)) {
+    perror("grafips: unix socket bind failure");
+    close(fd);
+    return;
+  }
+  m_server_fd = fd;
+}
+
+UnixServerSocket::~UnixServerSocket() {
+  if ((m_server_fd != -1) && (m_path[0] != '@'))
+    unlink(m_path.c_str());
+}
+
+int
+UnixServerSocket::AcceptFd() {
+  while (true) {
+    const int fd = accept4(m_server_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd == -1 && errno == EINTR)
+      continue;
+    return fd;
+  }
+}
+
+Socket *
+UnixServerSocket::Accept() {
+  const int fd = AcceptFd();
+  if (fd == -1)
+    return NULL;
+  return new LocalSocket(fd);
+}
+
+// Connection to a shared memory ring.  On the target, Write() copies
+// into the ring, and Read() receives requests from the socket.  On the
+// host, Read() copies from the ring, and Write() sends requests on the
+// socket.
+//
+// The target only wakes the host with a single byte on the socket
+// when the host has consumed everything previously written, so that
+// a steady stream of samples costs few system calls.
+class ShmSocket : public Socket {
+ public:
+  // target side: creates a segment for the accepted fd, and sends its
+  // name to the host.
+  static ShmSocket *Create(int fd, const std::string &name);
+  // host side: maps the segment named by the target.
+  static ShmSocket *Open(int fd);
+  ~ShmSocket();
+
+  bool Read(void * buf, int size);
+  int ReadSome(void * buf, int size);
+  bool Write(const void * buf, int size);
+  bool Write(const void * header, int header_size,
+             const void * buf, int size);
+  int WriteSome(const struct iovec *iov, int count);
+  bool WaitWritable();
+
+ private:
+  ShmSocket(int fd, ShmRing *ring, size_t mapping_size,
+            const std::string &shm_name, bool producer);
+  // returns bytes written, or -1 if the host closed the connection.
+  // If block is false, writes only what fits in the ring.
+  int Produce(const struct iovec *iov, int count, bool block);
+  // blocks until data is available.  Returns bytes read, or 0 if the
+  // target closed the connection.
+  int Consume(void * buf, int size);
+  bool WaitForSpace();
+  bool WaitForData();
+  void Doorbell();
+
+  ShmRing *m_ring;
+  const size_t m_mapping_size;
+  const std::string m_shm_name;
+  const bool m_producer;
+};
+
+ShmSocket::ShmSocket(int fd, ShmRing *ring, size_t mapping_size,
+                     const std::string &shm_name, bool producer)
+    : Socket(fd, "localhost"), m_ring(ring), m_mapping_size(mapping_size),
+      m_shm_name(shm_name), m_producer(producer) {}
+
+ShmSocket::~ShmSocket() {
+  munmap(m_ring, m_mapping_size);
+  // the host unlinks the segment once mapped, but may never have
+  // connected.
+  if (m_producer)
+    shm_unlink(m_shm_name.c_str());
+}
+
+ShmSocket *
+ShmSocket::Create(int fd, const std::string &name) {
+  static std::atomic<unsigned int> segment_count(0);
+  std::stringstream shm_name;
+  shm_name << "/grafips-" << name << "-" << getpid() << "-" << segment_count++;
+
+  const int shm_fd = shm_open(shm_name.str().c_str(),
+                              O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+  if (shm_fd == -1) {
+    perror("grafips: shm_open failure");
+    return NULL;
+  }
+  const size_t mapping_size = sizeof(ShmRing) + kShmRingSize;
+  void *mapping = MAP_FAILED;
+  if (ftruncate(shm_fd, mapping_size) == 0)
+    mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   shm_fd, 0);
+  close(shm_fd);
+  if (mapping == MAP_FAILED) {
+    perror("grafips: shm mapping failure");
+    shm_unlink(shm_name.str().c_str());
+    return NULL;
+  }
+
+  // the new segment is zero-filled, which initializes head and tail
+  ShmRing *ring = reinterpret_cast<ShmRing *>(mapping);
+  ring->capacity = kShmRingSize;
+  ring->magic = kShmMagic;
+
+  ShmSocket *s = new ShmSocket(fd, ring, mapping_size, shm_name.str(), true);
+  const std::string &n = s->m_shm_name;
+  const uint32_t len = n.size();
+  if (!s->Socket::Write(&len, sizeof(len), n.data(), len)) {
+    delete s;
+    return NULL;
+  }
+  return s;
+}
+
+ShmSocket *
+ShmSocket::Open(int fd) {
+  uint32_t len = 0;
+  char name[NAME_MAX];
+  if (!ReadAll(fd, &len, sizeof(len)) || len == 0 || len >= sizeof(name) ||
+      !ReadAll(fd, name, len)) {
+    close(fd);
+    return NULL;
+  }
+  name[len] = '\0';
+
+  const int shm_fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+  if (shm_fd == -1) {
+    close(fd);
+    return NULL;
+  }
+  // the name is no longer needed once both sides have mapped the
+  // segment, and would otherwise leak if the target exits abnormally.
+  shm_unlink(name);
+
+  struct stat st;
+  void *mapping = MAP_FAILED;
+  if ((fstat(shm_fd, &st) == 0) &&
+      (static_cast<size_t>(st.st_size) > sizeof(ShmRing)))
+    mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   shm_fd, 0);
+  close(shm_fd);
+  if (mapping == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  ShmRing *ring = reinterpret_cast<ShmRing *>(mapping);
+  const uint32_t capacity = ring->capacity;
+  if ((ring->magic != kShmMagic) || (capacity & (capacity - 1)) ||
+      (sizeof(ShmRing) + capacity != static_cast<size_t>(st.st_size))) {
+    munmap(mapping, st.st_size);
+    close(fd);
+    return NULL;
+  }
+  return new ShmSocket(fd, ring, st.st_size, name, false);
+}
+
+bool
+ShmSocket::Read(void * buf, int size) {
+  if (m_producer)
+    return Socket::Read(buf, size);
+  char *dest = reinterpret_cast<char *>(buf);
+  while (size > 0) {
+    const int bytes = Consume(dest, size);
+    if (bytes == 0)
+      return false;
+    dest += bytes;
+    size -= bytes;
+  }
+  return true;
+}
+
+int
+ShmSocket::ReadSome(void * buf, int size) {
+  if (m_producer)
+    return Socket::ReadSome(buf, size);
+  return Consume(buf, size);
+}
+
+bool
+ShmSocket::Write(const void * buf, int size) {
+  if (!m_producer)
+    return Socket::Write(buf, size);
+  struct iovec iov;
+  iov.iov_base = const_cast<void *>(buf);
+  iov.iov_len = size;
+  return Produce(&iov, 1, true) == size;
+}
+
+bool
+ShmSocket::Write(const void * header, int header_size,
+                 const void * buf, int size) {
+  if (!m_producer)
+    return Socket::Write(header, header_size, buf, size);
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<void *>(header);
+  iov[0].iov_len = header_size;
+  iov[1].iov_base = const_cast<void *>(buf);
+  iov[1].iov_len = size;
+  return Produce(iov, 2, true) == header_size + size;
+}
+
+int
+ShmSocket::WriteSome(const struct iovec *iov, int count) {
+  if (!m_producer)
+    return Socket::WriteSome(iov, count);
+  return Produce(iov, count, false);
+}
+
+bool
+ShmSocket::WaitWritable() {
+  if (!m_producer)
+    return Socket::WaitWritable();
+  while (m_ring->head.load(std::memory_order_relaxed) -
+         m_ring->tail.load(std::memory_order_acquire) == m_ring->capacity)
+    if (!WaitForSpace())
+      return false;
+  return true;
+}
+
+int
+ShmSocket::Produce(const struct iovec *iov, int count, bool block) {
+  // Everything that fits is published together, so the host is woken
+  // at most once per message.
+  const uint64_t capacity = m_ring->capacity;
+  char *data = m_ring->Data();
+  int current = 0;
+  size_t current_offset = 0;
+  int total = 0;
+  while (current < count) {
+    const uint64_t head = m_ring->head.load(std::memory_order_relaxed);
+    const uint64_t tail = m_ring->tail.load(std::memory_order_acquire);
+    uint64_t space = capacity - (head - tail);
+    if (space == 0) {
+      if (!block)
+        return total;
+      if (!WaitForSpace())
+        return -1;
+      continue;
+    }
+    uint64_t written = 0;
+    while (current < count && space > 0) {
+      const char *src = reinterpret_cast<const char *>(iov[current].iov_base)
+                        + current_offset;
+      const uint64_t bytes = std::min<uint64_t>(
+          iov[current].iov_len - current_offset, space);
+      const uint64_t offset = (head + written) & (capacity - 1);
+      const uint64_t first = std::min(bytes, capacity - offset);
+      memcpy(data + offset, src, first);
+      memcpy(data, src + first, bytes - first);
+      current_offset += bytes;
+      written += bytes;
+      space -= bytes;
+      if (current_offset == iov[current].iov_len) {
+        ++current;
+        current_offset = 0;
+      }
+    }
+    m_ring->head.store(head + written, std::memory_order_release);
+
+    // Pairs with the fence in Consume(): either the host sees the new
+    // head, or the doorbell is rung.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_ring->tail.load(std::memory_order_relaxed) == head)
+      Doorbell();
+    total += written;
+  }
+  return total;
+}
+
+int
+ShmSocket::Consume(void * buf, int size) {
+  const uint64_t capacity = m_ring->capacity;
+  const char *data = m_ring->Data();
+  while (true) {
+    const uint64_t tail = m_ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = m_ring->head.load(std::memory_order_acquire);
+    if (head == tail) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      head = m_ring->head.load(std::memory_order_acquire);
+    }
+    if (head == tail) {
+      if (WaitForData())
+        continue;
+      // deliver anything written before the target closed
+      if (m_ring->head.load(std::memory_order_acquire) == tail)
+        return 0;
+      continue;
+    }
+    const uint64_t count = std::min<uint64_t>(size, head - tail);
+    const uint64_t offset = tail & (capacity - 1);
+    const uint64_t first = std::min(count, capacity - offset);
+    memcpy(buf, data + offset, first);
+    memcpy(reinterpret_cast<char *>(buf) + first, data, count - first);
+    m_ring->tail.store(tail + count, std::memory_order_release);
+    return count;
+  }
+}
+
+void
+ShmSocket::Doorbell() {
+  // If the socket buffer is full, the host has not yet consumed
+  // previous doorbells, and does not need another.
+  const char bell = 0;
+  send(m_socket_fd, &bell, sizeof(bell), MSG_DONTWAIT | MSG_NOSIGNAL);
+  ++m_send_count;
+}
+
+bool
+ShmSocket::WaitForSpace() {
+  // the host has fallen a full ring behind.  Wait for it to consume,
+  // failing if it disconnects.
+  struct pollfd p;
+  p.fd = m_socket_fd;
+  p.events = POLLRDHUP;
+  p.revents = 0;
+  if (poll(&p, 1, 1) > 0 && (p.revents & (POLLRDHUP | POLLHUP | POLLERR)))
+    return false;
+  return true;
+}
+
+bool
+ShmSocket::WaitForData() {
+  // drain any doorbells which accumulated while the host was busy
+  char bells[64];
+  while (true) {
+    const ssize_t bytes = recv(m_socket_fd, bells, sizeof(bells), 0);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    return bytes > 0;
+  }
+}
+
+class ShmServerSocket : public UnixServerSocket {
+ public:
+  ShmServerSocket(const std::string &name, int backlog)
+      : UnixServerSocket(ShmSocketPath(name), backlog), m_name(name) {}
+  Socket *Accept();
+ private:
+  const std::string m_name;
+};
+
+Socket *
+ShmServerSocket::Accept() {
+  const int fd = AcceptFd();
+  if (fd == -1)
+    return NULL;
+  ShmSocket *s = ShmSocket::Create(fd, m_name);
+  if (s == NULL)
+    close(fd);
+  return s;
+}
+
+}  // namespace
+
+bool
+Grafips::IsTcpTransport(const std::string &spec) {
+  return !HasPrefix(spec, kUnixPrefix) && !HasPrefix(spec, kShmPrefix);
+}
+
+int
+Grafips::TransportPort(const std::string &spec) {
+  if (!IsTcpTransport(spec))
+    return 0;
+  const size_t colon = spec.rfind(':');
+  if (colon == std::string::npos)
+    return atoi(spec.c_str());
+  return atoi(spec.c_str() + colon + 1);
+}
+
+ServerSocket *
+Grafips::ListenTransport(const std::string &spec, int backlog) {
+  ServerSocket *s = NULL;
+  if (HasPrefix(spec, kUnixPrefix)) {
+    s = new UnixServerSocket(spec.substr(strlen(kUnixPrefix)), backlog);
+  } else if (HasPrefix(spec, kShmPrefix)) {
+    s = new ShmServerSocket(spec.substr(strlen(kShmPrefix)), backlog);
+  } else {
+    // port 0 selects an ephemeral port
+    if (spec.empty() ||
+        spec.find_first_not_of("0123456789") != std::string::npos)
+      return NULL;
+    return new ServerSocket(TransportPort(spec), backlog);
+  }
+  if (s->Fd() == -1) {
+    delete s;
+    return NULL;
+  }
+  return s;
+}
+
+Socket *
+Grafips::ConnectTransport(const std::string &spec) {
+  if (HasPrefix(spec, kUnixPrefix)) {
+    const int fd = ConnectUnix(spec.substr(strlen(kUnixPrefix)));
+    if (fd == -1)
+      return NULL;
+    return new LocalSocket(fd);
+  }
+  if (HasPrefix(spec, kShmPrefix)) {
+    const int fd = ConnectUnix(ShmSocketPath(spec.substr(strlen(kShmPrefix))));
+    if (fd == -1)
+      return NULL;
+    return ShmSocket::Open(fd);
+  }
+  const int port = TransportPort(spec);
+  if (port <= 0)
+    return NULL;
+  const size_t colon = spec.rfind(':');
+  const std::string address = (colon == std::string::npos) ?
+                              "localhost" : spec.substr(0, colon);
+  return new Socket(address, port);
+}
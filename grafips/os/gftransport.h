@@ -0,0 +1,68 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef OS_GFTRANSPORT_H_
+#define OS_GFTRANSPORT_H_
+
+#include <string>
+
+namespace Grafips {
+
+class ServerSocket;
+class Socket;
+
+// Hosts on the same machine as the target can avoid the TCP stack.
+// Transports are selected by a specification string, as found in
+// FIPS_PORT:
+//
+//   "<port>"        TCP, on all interfaces.  Hosts connect to
+//                   "<address>:<port>", or "<port>" on localhost.
+//   "unix:<path>"   AF_UNIX stream socket, bound to path
+//   "shm:<name>"    each host is given a shared memory ring, which
+//                   carries all data sent by the target.  Requests
+//                   from the host, and wakeups, are carried on an
+//                   AF_UNIX socket in the abstract namespace.
+//
+// Both local transports present Socket/ServerSocket, so that the
+// PublisherSkeleton and SessionWriter are unchanged.
+
+// true if spec selects TCP, which listens on consecutive ports for
+// the control connection.
+bool IsTcpTransport(const std::string &spec);
+
+// for TCP specifications, the port.  0 for other transports.
+int TransportPort(const std::string &spec);
+
+// Target side: listen for hosts.  Returns NULL if spec is malformed.
+ServerSocket *ListenTransport(const std::string &spec, int backlog);
+
+// Host side: connect to a target.  Returns NULL on failure.
+Socket *ConnectTransport(const std::string &spec);
+
+}  // namespace Grafips
+
+#endif  // OS_GFTRANSPORT_H_
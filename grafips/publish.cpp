@@ -1,68 +1,328 @@
 #include "publish.h"
 
+#include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
 
 #include "gfapi_control.h"
 #include "gfcontrol.h"
 #include "gfcontrol_stub.h"
+#include "gfcgroup_source.h"
 #include "gfcpu_clock_source.h"
 #include "gfcpu_freq_control.h"
 #include "gfcpu_source.h"
 #include "gferror.h"
+#include "gfgl_memory_source.h"
 #include "gfgl_source.h"
 #include "gfgpu_perf_functions.h"
 #include "gfgpu_perf_source.h"
 #include "gflog.h"
+#include "gfmetric_queue.h"
+#include "gfmetric_recorder.h"
+#include "gfperf_event_source.h"
+#include "gfpower_source.h"
+#include "gfproc_io_source.h"
 #include "gfproc_self_source.h"
+#include "gfpsi_source.h"
 #include "gfpublisher.h"
 #include "gfpublisher_skel.h"
+#include "gfsampling_scheduler.h"
+#include "gfself_source.h"
+#include "gfsend_queue.h"
+#include "gfsocket.h"
+#include "gfthermal_source.h"
+#include "gfthread.h"
+#include "gfthread_source.h"
+#include "gftransport.h"
 #include "glwrap.h"
 
 using Grafips::ApiControl;
+using Grafips::CgroupSource;
 using Grafips::ControlRouterTarget;
 using Grafips::ControlSkel;
 using Grafips::CpuFreqControl;
 using Grafips::CpuFreqSource;
 using Grafips::CpuSource;
+using Grafips::DropPolicy;
 using Grafips::ErrorHandler;
 using Grafips::ErrorInterface;
+using Grafips::GlMemorySource;
 using Grafips::GlSource;
 using Grafips::GpuPerfSource;
+using Grafips::IsTcpTransport;
+using Grafips::ListenTransport;
+using Grafips::MetricQueue;
+using Grafips::MetricRecorder;
 using Grafips::NoError;
+using Grafips::ParseDropPolicy;
+using Grafips::PerfEventSource;
 using Grafips::PerfFunctions;
+using Grafips::PowerSource;
+using Grafips::ProcIoSource;
 using Grafips::ProcSelfSource;
+using Grafips::PsiSource;
 using Grafips::PublisherImpl;
 using Grafips::PublisherSkeleton;
+using Grafips::SamplingScheduler;
+using Grafips::SelfSource;
+using Grafips::ServerSocket;
+using Grafips::ThermalSource;
+using Grafips::Thread;
+using Grafips::ThreadSource;
+using Grafips::TransportPort;
+using Grafips::kDropOldest;
 using Grafips::kSocketReadFail;
 using Grafips::kSocketWriteFail;
 
 
-class GrafipsPublishers {
+class DetectClosedHost : public ErrorHandler {
+  public:
+	bool OnError(const ErrorInterface &e) {
+		if ((e.Type() == kSocketWriteFail) || 
+		    (e.Type() == kSocketReadFail)) {
+			printf("ERROR: %s\n", e.ToString());
+			return true;
+		    }
+		return false;
+	}
+};
+
+// true if s is a base 10 integer in [min, max]
+static bool ParseInt(const std::string &s, int min, int max, int *value)
+{
+	if (s.empty())
+		return false;
+	char *end;
+	errno = 0;
+	const long v = strtol(s.c_str(), &end, 10);
+	if (errno != 0 || *end != '\0' || v < min || v > max)
+		return false;
+	*value = v;
+	return true;
+}
+
+// the integer value of the environment variable name, or def if it is
+// unset or malformed.
+static int EnvInt(const char *name, int def, int min, int max)
+{
+	const char *env = getenv(name);
+	if (env == NULL)
+		return def;
+	int value;
+	if (ParseInt(env, min, max, &value))
+		return value;
+	printf("ERROR: invalid %s=%s, expected %d to %d\n",
+	       name, env, min, max);
+	return def;
+}
+
+// the non-empty entries of a comma separated list
+static std::vector<std::string> SplitList(const std::string &list)
+{
+	std::vector<std::string> entries;
+	size_t start = 0;
+	while (start < list.size()) {
+		size_t end = list.find(',', start);
+		if (end == std::string::npos)
+			end = list.size();
+		if (end > start)
+			entries.push_back(list.substr(start, end - start));
+		start = end + 1;
+	}
+	return entries;
+}
+
+// Sources which make GL calls are polled on the render thread, and
+// queue their samples.  Everything else, including draining the queue
+// and writing to the socket, happens on the publisher thread.
+class GrafipsPublishers : public Thread {
 public:
-	GrafipsPublishers() {
+	GrafipsPublishers() : Thread("grafips_publisher"),
+			      m_running(true), m_failed(false) {
 		printf("publishers construct\n");
 		void *get_proc = fips_lookup("glXGetProcAddress");
 		PerfFunctions::Init(get_proc);
 		m_prov = new CpuSource;
 		m_gl_source = new GlSource(100);
+		m_gl_memory_source = new GlMemorySource;
 		m_gpu_source = new GpuPerfSource;
+		// FIPS_GPU_SLICE_FRAMES sets the frames measured by each
+		// GPU query group before the counters pass to the next
+		// group with active metrics.
+		m_gpu_source->SetSliceFrames(
+			EnvInt("FIPS_GPU_SLICE_FRAMES",
+			       GpuPerfSource::kDefaultSliceFrames, 1, 1000));
 		m_cpu_freq_source = new CpuFreqSource;
 		m_proc_self_source = new ProcSelfSource;
+		m_self_source = new SelfSource;
+		m_thread_source = new ThreadSource;
+		m_perf_event_source = new PerfEventSource;
+		m_power_source = new PowerSource;
+		m_thermal_source = new ThermalSource;
+		m_cgroup_source = new CgroupSource;
+		m_psi_source = new PsiSource;
+		m_proc_io_source = new ProcIoSource;
+		// FIPS_PSI_TRIGGERS lists pressure stall triggers, as
+		// resource/kind:stall_ms[:window_ms],...  eg
+		// memory/some:150:2000 counts each 2s window in which
+		// tasks stalled on memory for over 150ms.
+		const char *env_psi = getenv("FIPS_PSI_TRIGGERS");
+		const std::vector<std::string> triggers =
+			SplitList(env_psi != NULL ? env_psi : "");
+		for (size_t i = 0; i < triggers.size(); ++i) {
+			const std::string &t = triggers[i];
+			const size_t slash = t.find('/');
+			const size_t colon = t.find(':');
+			const size_t window = colon == std::string::npos ?
+				colon : t.find(':', colon + 1);
+			int stall_ms = 0, window_ms = 2000;
+			if (colon == std::string::npos ||
+			    slash > colon ||
+			    !ParseInt(t.substr(colon + 1, window - colon - 1),
+				      1, 1000000, &stall_ms) ||
+			    (window != std::string::npos &&
+			     !ParseInt(t.substr(window + 1),
+				       1, 1000000, &window_ms)) ||
+			    !m_psi_source->AddTrigger(
+				    t.substr(0, slash),
+				    t.substr(slash + 1, colon - slash - 1),
+				    stall_ms * 1000, window_ms * 1000))
+				printf("ERROR: invalid FIPS_PSI_TRIGGERS "
+				       "entry %s\n", t.c_str());
+		}
 
 		m_pub = new PublisherImpl;
-		m_pub->RegisterSource(m_prov);
-		m_pub->RegisterSource(m_gl_source);
-		m_pub->RegisterSource(m_gpu_source);
-		m_pub->RegisterSource(m_cpu_freq_source);
-		m_pub->RegisterSource(m_proc_self_source);
+		// FIPS_AGGREGATE_MS sets the interval of the count, min,
+		// max, mean, p50 and p99 metrics derived from each source
+		// metric.  0 disables them.
+		m_pub->SetAggregationInterval(
+			EnvInt("FIPS_AGGREGATE_MS", 1000, 0, 3600000));
+		// FIPS_HISTORY lists metrics which are recorded before any
+		// host connects, as path[:seconds],...  Each new host
+		// receives the recorded samples, at FIPS_HISTORY_RESOLUTION_MS.
+		std::string history = "gl/frame_time,gl/fps";
+		const char *env_history = getenv("FIPS_HISTORY");
+		if (env_history != NULL)
+			history = env_history;
+		m_pub->SetHistoryResolution(
+			EnvInt("FIPS_HISTORY_RESOLUTION_MS",
+			       PublisherImpl::kDefaultHistoryResolutionMs,
+			       1, 60000));
+		const std::vector<std::string> paths = SplitList(history);
+		for (size_t i = 0; i < paths.size(); ++i) {
+			std::string path = paths[i];
+			int seconds = 60;
+			const size_t colon = path.find(':');
+			if (colon != std::string::npos) {
+				if (!ParseInt(path.substr(colon + 1), 1, 86400,
+					      &seconds)) {
+					printf("ERROR: invalid FIPS_HISTORY "
+					       "entry %s\n", path.c_str());
+					continue;
+				}
+				path.resize(colon);
+			}
+			if (!path.empty())
+				m_pub->RecordHistory(path, seconds);
+		}
+		// FIPS_RECORD writes every published sample to a file, which
+		// grafips-dump reads.  FIPS_RECORD_METRICS lists metrics to
+		// publish without a host, as path,...
+		m_recorder = NULL;
+		const char *env_record = getenv("FIPS_RECORD");
+		if (env_record != NULL) {
+			m_recorder = new MetricRecorder;
+			if (m_recorder->Open(env_record)) {
+				m_recorder->Start();
+				m_pub->SetRecorder(m_recorder);
+			} else {
+				printf("ERROR: could not open FIPS_RECORD=%s\n",
+				       env_record);
+				delete m_recorder;
+				m_recorder = NULL;
+			}
+		}
+		const char *env_record_metrics = getenv("FIPS_RECORD_METRICS");
+		if (m_recorder != NULL && env_record_metrics != NULL) {
+			const std::vector<std::string> metrics =
+				SplitList(env_record_metrics);
+			for (size_t i = 0; i < metrics.size(); ++i)
+				m_pub->KeepActive(metrics[i]);
+		}
+		m_gl_queue = new MetricQueue(m_pub);
+		m_pub->RegisterSource(m_gl_source, m_gl_queue);
+		m_pub->RegisterSource(m_gl_memory_source, m_gl_queue);
+		m_pub->RegisterSource(m_gpu_source, m_gl_queue);
+		// sources which make no GL calls are polled by the
+		// scheduler, at the default interval of their metrics.
+		// Hosts may change the interval of each metric with the
+		// SampleInterval control.
+		m_scheduler = new SamplingScheduler;
+		m_pub->RegisterSource(m_scheduler->Schedule(m_prov, 300));
+		m_pub->RegisterSource(m_scheduler->Schedule(m_cpu_freq_source,
+							    300));
+		m_pub->RegisterSource(m_scheduler->Schedule(m_proc_self_source,
+							    300));
+		m_pub->RegisterSource(m_scheduler->Schedule(m_self_source, 300));
+		// new threads are discovered while no metric is active
+		m_pub->RegisterSource(m_scheduler->Schedule(m_thread_source,
+							    100, 1000));
+		m_pub->RegisterSource(m_scheduler->Schedule(m_perf_event_source,
+							    300));
+		m_pub->RegisterSource(m_scheduler->Schedule(m_power_source,
+							    300));
+		m_pub->RegisterSource(m_scheduler->Schedule(m_thermal_source,
+							    300));
+		// cpu.stat is updated each CFS period, 100ms by default
+		m_pub->RegisterSource(m_scheduler->Schedule(m_cgroup_source,
+							    100));
+		m_pub->RegisterSource(m_scheduler->Schedule(m_psi_source, 300));
+		m_pub->RegisterSource(m_scheduler->Schedule(m_proc_io_source,
+							    300));
 
-		int port = 53136;  // default port
+		// FIPS_PORT selects the transport: a TCP port, or
+		// unix:<path> or shm:<name> for hosts on this machine.
+		std::string transport = "53136";  // default port
 		const char *env_port = getenv("FIPS_PORT");
 		if (env_port != NULL)
-			port = atoi(env_port);
-		m_skel = new PublisherSkeleton(port, m_pub);
-		m_skel->Start();
+			transport = env_port;
+		// the control port is port + 1
+		int port;
+		if (IsTcpTransport(transport) &&
+		    !ParseInt(transport, 1, 65534, &port)) {
+			printf("ERROR: invalid FIPS_PORT=%s, expected %d to %d\n",
+			       transport.c_str(), 1, 65534);
+			transport = "53136";
+		}
+		ServerSocket *server = ListenTransport(
+			transport, PublisherSkeleton::kBacklog);
+		if (server == NULL) {
+			printf("ERROR: could not listen on FIPS_PORT=%s, "
+			       "using default port\n", transport.c_str());
+			transport = "53136";
+			server = ListenTransport(transport,
+						 PublisherSkeleton::kBacklog);
+		}
+		// FIPS_FLUSH_MS holds metrics for up to the given interval,
+		// so they can be sent to the subscriber in fewer messages.
+		m_pub->SetFlushInterval(EnvInt("FIPS_FLUSH_MS", 0, 0, 60000));
+		// FIPS_SEND_QUEUE_KB bounds the data queued for a host
+		// which is not keeping up, and FIPS_DROP_POLICY (oldest,
+		// newest or downsample) selects which samples to discard.
+		const size_t queue_bytes = 1024 * static_cast<size_t>(
+			EnvInt("FIPS_SEND_QUEUE_KB", 1024, 1, 1024 * 1024));
+		DropPolicy drop_policy = kDropOldest;
+		const char *env_drop = getenv("FIPS_DROP_POLICY");
+		if (env_drop != NULL && !ParseDropPolicy(env_drop, &drop_policy))
+			printf("ERROR: unknown FIPS_DROP_POLICY=%s\n", env_drop);
 
 		m_freq_control = new CpuFreqControl;
 		m_api_control = new ApiControl;
@@ -73,23 +333,69 @@ public:
 		m_target->AddControl("SimpleShaderExperiment", m_api_control);
 		m_target->AddControl("DisableDrawExperiment", m_api_control);
 		m_target->AddControl("WireframeExperiment", m_api_control);
-		m_control_skel = new ControlSkel(port + 1, m_target);
-		m_control_skel->Start();
+		m_target->AddControl("SampleInterval", m_scheduler);
+
+		// hosts with a multiplexed session send controls on the
+		// publisher connection.  Others connect to port + 1, which
+		// is only available over TCP.
+		m_skel = NULL;
+		if (server == NULL) {
+			// metrics are still recorded, if FIPS_RECORD is set
+			printf("ERROR: could not listen on %s, hosts can not "
+			       "connect\n", transport.c_str());
+		} else {
+			m_skel = new PublisherSkeleton(server, m_pub, m_target);
+			m_skel->SetSendQueue(queue_bytes, drop_policy);
+			m_skel->Start();
+		}
+		m_control_skel = NULL;
+		if (IsTcpTransport(transport)) {
+			m_control_skel = new ControlSkel(
+				TransportPort(transport) + 1, m_target);
+			m_control_skel->Start();
+		}
+
+		Start();
 	}
 	~GrafipsPublishers() {
 		printf("publishers destroy\n");
-		m_control_skel->Join();
-		delete m_control_skel;
+		m_running = false;
+		Join();
+
+		if (m_skel != NULL) {
+			m_skel->Stop();
+			m_skel->Join();
+			delete m_skel;
+		}
+
+		if (m_control_skel != NULL) {
+			m_control_skel->Join();
+			delete m_control_skel;
+		}
 		delete m_target;
 		delete m_freq_control;
 		delete m_api_control;
-		
-		m_skel->Join();
-		delete m_skel;
 
+		// stops the trigger thread, which publishes
+		delete m_psi_source;
 		delete m_pub;
+		delete m_scheduler;
+		if (m_recorder != NULL) {
+			m_recorder->Close();
+			delete m_recorder;
+		}
+		delete m_gl_queue;
+		delete m_proc_io_source;
+		delete m_cgroup_source;
+		delete m_thermal_source;
+		delete m_power_source;
+		delete m_perf_event_source;
+		delete m_thread_source;
+		delete m_self_source;
+		delete m_proc_self_source;
 		delete m_cpu_freq_source;
 		delete m_gpu_source;
+		delete m_gl_memory_source;
 		delete m_gl_source;
 		delete m_prov;
 	}
@@ -108,52 +414,130 @@ public:
 
 	void OnContext(void *context) {
 		m_api_control->OnContext(context);
+		m_gl_memory_source->OnContext(context);
+		m_gl_source->OnContext(context);
+	}
+	void OnCreateContext(void *context, void *share_context) {
+		m_gl_memory_source->OnCreateContext(context, share_context);
+	}
+	void OnDestroyContext(void *context) {
+		m_gl_memory_source->OnDestroyContext(context);
+		m_gl_source->OnDestroyContext(context);
+	}
+
+	void OnSwapBuffers() {
+		m_gl_source->OnSwapBuffers();
+	}
+
+	GlMemorySource *MemorySource() {
+		return m_gl_memory_source;
+	}
+
+	// writes the final chunk of the FIPS_RECORD file
+	void CloseRecorder() {
+		if (m_recorder != NULL)
+			m_recorder->Close();
 	}
 
 	void Publish() {
-		if (NoError())
-			m_prov->Poll();
-		if (NoError())
-			m_gl_source->glSwapBuffers();
-		if (NoError())
-			m_gpu_source->glSwapBuffers();
-		if (NoError())
-			m_cpu_freq_source->Poll();
-		if (NoError())
-			m_proc_self_source->Poll();
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		m_thread_source->SetRenderThread();
+		m_power_source->OnFrame();
+		m_cgroup_source->OnFrame();
+		m_proc_io_source->OnFrame();
+		m_gl_source->glSwapBuffers();
+		m_gl_memory_source->glSwapBuffers();
+		m_gpu_source->glSwapBuffers();
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		m_self_source->RecordPublishTime(
+			(end.tv_sec - start.tv_sec) * 1000000000ULL +
+			end.tv_nsec - start.tv_nsec);
+	}
+
+	// true after the publisher thread lost its connection
+	bool Failed() const {
+		return m_failed;
+	}
+
+	void Run() {
+		DetectClosedHost handler;
+		while (m_running) {
+			m_gl_queue->Drain();
+			uint64_t messages = 0, syscalls = 0, dropped = 0;
+			int sessions = 0;
+			float setup_ms = 0;
+			if (m_skel != NULL) {
+				m_skel->TransportCounts(&messages, &syscalls);
+				m_skel->SessionStats(&sessions, &setup_ms);
+				dropped = m_skel->DroppedSamples();
+			}
+			m_self_source->RecordTransport(messages, syscalls);
+			m_self_source->RecordSessions(sessions, setup_ms,
+						      Thread::RunningCount());
+			m_self_source->RecordDropped(
+				dropped +
+				m_gl_queue->DroppedCount() +
+				(m_recorder ? m_recorder->DroppedSamples() : 0));
+			unsigned int next_tick_ms = 10;
+			if (NoError())
+				next_tick_ms = m_scheduler->Run();
+			if (NoError())
+				m_pub->Flush();
+			if (!NoError()) {
+				m_failed = true;
+				return;
+			}
+			// woken at each tick, so that polls are on time.  The
+			// GL queue is drained at least every 10ms.
+			usleep(std::min(next_tick_ms, 10u) * 1000);
+		}
 	}
 private:
 	PublisherImpl *m_pub;
+	SamplingScheduler *m_scheduler;
 	CpuSource *m_prov;
 	GlSource *m_gl_source;
+	GlMemorySource *m_gl_memory_source;
 	GpuPerfSource *m_gpu_source;
 	CpuFreqSource *m_cpu_freq_source;
 	ProcSelfSource *m_proc_self_source;
+	SelfSource *m_self_source;
+	ThreadSource *m_thread_source;
+	PerfEventSource *m_perf_event_source;
+	PowerSource *m_power_source;
+	ThermalSource *m_thermal_source;
+	CgroupSource *m_cgroup_source;
+	PsiSource *m_psi_source;
+	ProcIoSource *m_proc_io_source;
+	MetricQueue *m_gl_queue;
+	MetricRecorder *m_recorder;
 	PublisherSkeleton *m_skel;
 	CpuFreqControl *m_freq_control;
 	ApiControl *m_api_control;
 	ControlRouterTarget *m_target;
 	ControlSkel *m_control_skel;
+	std::atomic<bool> m_running, m_failed;
 };
 
 
 GrafipsPublishers *publishers = NULL;
 
-class DetectClosedHost : public ErrorHandler {
-  public:
-	bool OnError(const ErrorInterface &e) {
-		if ((e.Type() == kSocketWriteFail) || 
-		    (e.Type() == kSocketReadFail)) {
-			printf("ERROR: %s\n", e.ToString());
-			return true;
-		    }
-		return false;
-	}
-};
+// publishers are not destroyed when the application exits
+static void close_recorder()
+{
+	if (publishers)
+		publishers->CloseRecorder();
+}
 
 void create_publishers()
 {
+	static bool registered = false;
 	publishers = new GrafipsPublishers;
+	if (!registered) {
+		atexit(close_recorder);
+		registered = true;
+	}
 }
 
 void publish()
@@ -161,13 +545,19 @@ void publish()
 	if (!publishers)
 		return;
 
-	DetectClosedHost handler;
-	publishers->Publish();
-	if (!NoError()) {
+	if (publishers->Failed()) {
 		printf("deleting publishers\n");
 		delete publishers;
 		publishers = NULL;
+		return;
 	}
+	publishers->Publish();
+}
+
+void on_swap_buffers()
+{
+	if (publishers)
+		publishers->OnSwapBuffers();
 }
 
 void grafips_context_init()
@@ -199,3 +589,84 @@ void publish_context(void* context)
 	if(publishers)
 	 	publishers->OnContext(context);
 }
+
+void publish_create_context(void *context, void *share_context)
+{
+	if (publishers)
+		publishers->OnCreateContext(context, share_context);
+}
+
+void publish_destroy_context(void *context)
+{
+	if (publishers)
+		publishers->OnDestroyContext(context);
+}
+
+void on_tex_image(GLenum target, GLint level, GLenum internalformat,
+		  GLsizei width, GLsizei height, GLsizei depth,
+		  GLsizei samples)
+{
+	if (publishers)
+		publishers->MemorySource()->OnTexImage(target, level,
+						       internalformat,
+						       width, height, depth,
+						       samples);
+}
+
+void on_compressed_tex_image(GLenum target, GLint level, GLsizei image_size)
+{
+	if (publishers)
+		publishers->MemorySource()->OnCompressedTexImage(target, level,
+								 image_size);
+}
+
+void on_tex_storage(GLenum target, GLsizei levels, GLenum internalformat,
+		    GLsizei width, GLsizei height, GLsizei depth,
+		    GLsizei samples)
+{
+	if (publishers)
+		publishers->MemorySource()->OnTexStorage(target, levels,
+							 internalformat,
+							 width, height, depth,
+							 samples);
+}
+
+void on_buffer_data(GLenum target, GLsizeiptr size)
+{
+	if (publishers)
+		publishers->MemorySource()->OnBufferData(target, size);
+}
+
+void on_named_buffer_data(GLuint buffer, GLsizeiptr size)
+{
+	if (publishers)
+		publishers->MemorySource()->OnNamedBufferData(buffer, size);
+}
+
+void on_renderbuffer_storage(GLenum target, GLsizei samples,
+			     GLenum internalformat,
+			     GLsizei width, GLsizei height)
+{
+	if (publishers)
+		publishers->MemorySource()->OnRenderbufferStorage(
+			target, samples, internalformat, width, height);
+}
+
+void on_delete_textures(GLsizei n, const GLuint *textures)
+{
+	if (publishers)
+		publishers->MemorySource()->OnDeleteTextures(n, textures);
+}
+
+void on_delete_buffers(GLsizei n, const GLuint *buffers)
+{
+	if (publishers)
+		publishers->MemorySource()->OnDeleteBuffers(n, buffers);
+}
+
+void on_delete_renderbuffers(GLsizei n, const GLuint *renderbuffers)
+{
+	if (publishers)
+		publishers->MemorySource()->OnDeleteRenderbuffers(n,
+								  renderbuffers);
+}
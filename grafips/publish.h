@@ -8,12 +8,31 @@ extern "C" {
 #endif
 	void create_publishers();
 	void publish();
+	void on_swap_buffers();
 	void grafips_context_init();
 	bool perform_draw_experiments();
 	void perform_bind_texture_experiment(GLenum target);
 	void publish_context(void *context);
+	void publish_create_context(void *context, void *share_context);
+	void publish_destroy_context(void *context);
 	void on_link_program(GLint program);
 	void on_use_program(GLint program);
+	void on_tex_image(GLenum target, GLint level, GLenum internalformat,
+			  GLsizei width, GLsizei height, GLsizei depth,
+			  GLsizei samples);
+	void on_compressed_tex_image(GLenum target, GLint level,
+				     GLsizei image_size);
+	void on_tex_storage(GLenum target, GLsizei levels,
+			    GLenum internalformat, GLsizei width,
+			    GLsizei height, GLsizei depth, GLsizei samples);
+	void on_buffer_data(GLenum target, GLsizeiptr size);
+	void on_named_buffer_data(GLuint buffer, GLsizeiptr size);
+	void on_renderbuffer_storage(GLenum target, GLsizei samples,
+				     GLenum internalformat,
+				     GLsizei width, GLsizei height);
+	void on_delete_textures(GLsizei n, const GLuint *textures);
+	void on_delete_buffers(GLsizei n, const GLuint *buffers);
+	void on_delete_renderbuffers(GLsizei n, const GLuint *renderbuffers);
 #ifdef __cplusplus
 }
 #endif
@@ -30,6 +30,7 @@
 
 #include <vector>
 #include <map>
+#include <string>
 
 #include "remote/gfmetric.h"
 
@@ -45,6 +46,9 @@ class PublisherInterface {
   virtual void Activate(int id) = 0;
   virtual void Deactivate(int id) = 0;
   virtual void Subscribe(SubscriberInterface *s) = 0;
+  // appends the ids of described metrics whose paths match the glob
+  // pattern, eg "cpu/core/*"
+  virtual void Match(const std::string &pattern, std::vector<int> *ids) = 0;
 };
 }  // namespace Grafips
 
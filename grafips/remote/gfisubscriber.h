@@ -38,6 +38,9 @@ class SubscriberInterface {
   virtual void Clear(int id) = 0;
   virtual void OnMetric(const DataSet &d) = 0;
   virtual void OnDescriptions(const MetricDescriptionSet &descriptions) = 0;
+  // samples recorded before the subscriber connected, including
+  // metrics it has not activated.  Sent once, after descriptions.
+  virtual void OnHistory(const DataSet &d) = 0;
 };
 }
 
@@ -29,12 +29,15 @@
 
 #include <string>
 
+#include "remote/gfmetric_registry.h"
+
 using Grafips::MetricDescription;
+using Grafips::MetricRegistry;
 
 MetricDescription::MetricDescription(const MetricDescription &o)
     : path(o.path), help_text(o.help_text),
       display_name(o.display_name), type(o.type),
-      enabled(o.enabled) {}
+      enabled(o.enabled), m_id(o.m_id) {}
 
 MetricDescription::MetricDescription(const std::string &_path,
                                      const std::string &_help_text,
@@ -42,21 +45,13 @@ MetricDescription::MetricDescription(const std::string &_path,
                                      MetricType _type,
                                      bool _enabled)
     : path(_path), help_text(_help_text),
-      display_name(_display_name), type(_type), enabled(_enabled)
+      display_name(_display_name), type(_type), enabled(_enabled),
+      m_id(MetricRegistry::Instance().Intern(_path))
 {}
 
-int
-MetricDescription::id() const {
-    // hash the path
-    int hash = 0;
-    for (unsigned int i = 0; i < path.length(); ++i) {
-        const char c = path[i];
-        hash = 31 * hash + c;
-    }
-    return hash;
-}
-
-MetricDescription::MetricDescription() { }
+MetricDescription::MetricDescription()
+    : type(GR_METRIC_COUNT), enabled(false),
+      m_id(MetricRegistry::kInvalidId) { }
 
 MetricDescription &
 MetricDescription::operator=(const MetricDescription &o) {
@@ -65,5 +60,6 @@ MetricDescription::operator=(const MetricDescription &o) {
   display_name = o.display_name;
   type = o.type;
   enabled = o.enabled;
+  m_id = o.m_id;
   return *this;
 }
@@ -28,6 +28,7 @@
 #ifndef REMOTE_GFMETRIC_H_
 #define REMOTE_GFMETRIC_H_
 
+#include <stdint.h>
 #include <time.h>
 #include <string>
 #include <vector>
@@ -50,12 +51,16 @@ class MetricDescription {
                     bool _enabled = true);
   MetricDescription();
   MetricDescription &operator=(const MetricDescription &o);
-  int id() const;
+  // interned when the description is constructed.
+  // MetricRegistry::kInvalidId if the path collides with another.
+  int id() const { return m_id; }
   std::string path;
   std::string help_text;
   std::string display_name;
   MetricType type;
   bool enabled;
+ private:
+  int m_id;
 };
 
 inline unsigned int
@@ -67,11 +72,31 @@ get_ms_time() {
   return ms;
 }
 
+inline uint64_t
+get_ns_time() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+  return static_cast<uint64_t>(t.tv_sec) * 1000000000ULL + t.tv_nsec;
+}
+
 struct DataPoint {
-  DataPoint(unsigned int t, int i, float d) : time_val(t), id(i), data(d) {}
+  DataPoint() : time_val(0), id(0), data(0), time_ns(0), int_data(0),
+                integral(false) {}
+  DataPoint(unsigned int t, int i, double d)
+      : time_val(t), id(i), data(d), time_ns(0), int_data(0),
+        integral(false) {}
+  // integer samples, such as GPU counters, are transmitted without
+  // loss of precision to hosts that support it.
+  DataPoint(uint64_t ns, int i, int64_t v)
+      : time_val(ns / 1000000), id(i), data(v), time_ns(ns), int_data(v),
+        integral(true) {}
   unsigned int   time_val;
   int   id;
-  float data;
+  double data;
+  // 0 if the sample only carries a millisecond time_val
+  uint64_t time_ns;
+  int64_t int_data;
+  bool integral;
 };
 
 typedef std::vector<MetricDescription> MetricDescriptionSet;
@@ -0,0 +1,254 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfmetric_aggregator.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "remote/gfmetric_registry.h"
+
+using Grafips::DataPoint;
+using Grafips::DataSet;
+using Grafips::MetricAggregator;
+using Grafips::MetricDescription;
+using Grafips::MetricDescriptionSet;
+using Grafips::MetricRegistry;
+using Grafips::StreamingHistogram;
+
+namespace {
+const int kSubBuckets = 32;
+// buckets cover 2^-24 (about 6e-8) to 2^40 (about 1e12)
+const int kMinExponent = -24;
+const int kMaxExponent = 40;
+const int kBucketCount = 1 + (kMaxExponent - kMinExponent + 1) * kSubBuckets;
+
+struct StatisticDescription {
+  const char *suffix;
+  const char *display;
+  const char *help;
+};
+
+const StatisticDescription kStatistics[] = {
+  { "count", "Count", "number of samples of %s in each interval" },
+  { "min", "Min", "minimum of %s over each interval" },
+  { "max", "Max", "maximum of %s over each interval" },
+  { "mean", "Mean", "mean of %s over each interval" },
+  { "p50", "p50", "median of %s over each interval" },
+  { "p99", "p99", "99th percentile of %s over each interval" },
+};
+
+std::string
+Format(const char *format, const std::string &arg) {
+  std::string s(format);
+  const size_t pos = s.find("%s");
+  return s.replace(pos, 2, arg);
+}
+}  // namespace
+
+StreamingHistogram::StreamingHistogram()
+    : m_buckets(kBucketCount, 0), m_low(kBucketCount), m_high(-1),
+      m_count(0), m_min(0), m_max(0), m_sum(0) {
+}
+
+int
+StreamingHistogram::Bucket(double value) {
+  if (!(value > 0))
+    return 0;
+  int exponent;
+  // mantissa is in [0.5, 1)
+  const double mantissa = frexp(value, &exponent);
+  if (exponent < kMinExponent)
+    return 0;
+  if (exponent > kMaxExponent)
+    return kBucketCount - 1;
+  const int sub = (mantissa - 0.5) * 2 * kSubBuckets;
+  return 1 + (exponent - kMinExponent) * kSubBuckets + sub;
+}
+
+double
+StreamingHistogram::BucketValue(int bucket) {
+  // midpoint of the bucket
+  const int exponent = (bucket - 1) / kSubBuckets + kMinExponent;
+  const int sub = (bucket - 1) % kSubBuckets;
+  return ldexp(0.5 + (sub + 0.5) / (2 * kSubBuckets), exponent);
+}
+
+void
+StreamingHistogram::Add(double value) {
+  const int bucket = Bucket(value);
+  ++m_buckets[bucket];
+  m_low = std::min(m_low, bucket);
+  m_high = std::max(m_high, bucket);
+  if (m_count == 0) {
+    m_min = m_max = value;
+  } else {
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+  }
+  m_sum += value;
+  ++m_count;
+}
+
+void
+StreamingHistogram::Reset() {
+  // only the buckets that were used need to be cleared
+  if (m_low <= m_high)
+    memset(&m_buckets[m_low], 0, (m_high - m_low + 1) * sizeof(uint32_t));
+  m_low = kBucketCount;
+  m_high = -1;
+  m_count = 0;
+  m_min = m_max = m_sum = 0;
+}
+
+double
+StreamingHistogram::Percentile(double p) const {
+  if (!m_count)
+    return 0;
+  const uint64_t rank = std::max<uint64_t>(1, ceil(p * m_count));
+  uint64_t seen = 0;
+  for (int i = m_low; i <= m_high; ++i) {
+    seen += m_buckets[i];
+    if (seen < rank)
+      continue;
+    if (i == 0)
+      return m_min;
+    return std::min(m_max, std::max(m_min, BucketValue(i)));
+  }
+  return m_max;
+}
+
+MetricAggregator::MetricAggregator() {
+}
+
+MetricAggregator::~MetricAggregator() {
+  for (std::map<int, Accumulator *>::iterator i = m_accumulators.begin();
+       i != m_accumulators.end(); ++i)
+    delete i->second;
+}
+
+void
+MetricAggregator::AddDescriptions(const MetricDescriptionSet &descriptions,
+                                  MetricDescriptionSet *derived) {
+  for (MetricDescriptionSet::const_iterator i = descriptions.begin();
+       i != descriptions.end(); ++i) {
+    // a path which collides is not published, nor are its statistics
+    if (i->id() == MetricRegistry::kInvalidId)
+      continue;
+    for (int s = 0; s < kStatisticCount; ++s) {
+      const StatisticDescription &stat = kStatistics[s];
+      const MetricDescription d(
+          i->path + "/" + stat.suffix,
+          Format(stat.help, i->display_name),
+          i->display_name + " (" + stat.display + ")",
+          s == kCount ? GR_METRIC_COUNT : i->type,
+          i->enabled);
+      if (d.id() == MetricRegistry::kInvalidId)
+        continue;
+      Derived &entry = m_derived[d.id()];
+      entry.base = i->id();
+      entry.statistic = static_cast<Statistic>(s);
+      derived->push_back(d);
+    }
+  }
+}
+
+bool
+MetricAggregator::Base(int id, int *base) const {
+  std::map<int, Derived>::const_iterator i = m_derived.find(id);
+  if (i == m_derived.end())
+    return false;
+  *base = i->second.base;
+  return true;
+}
+
+bool
+MetricAggregator::Activate(int derived_id) {
+  std::map<int, Derived>::const_iterator d = m_derived.find(derived_id);
+  if (d == m_derived.end())
+    return false;
+  Accumulator *&a = m_accumulators[d->second.base];
+  if (!a)
+    a = new Accumulator;
+  const Statistic s = d->second.statistic;
+  if (a->active[s])
+    return false;
+  a->active[s] = true;
+  a->ids[s] = derived_id;
+  ++a->active_count;
+  return true;
+}
+
+bool
+MetricAggregator::Deactivate(int derived_id) {
+  std::map<int, Derived>::const_iterator d = m_derived.find(derived_id);
+  if (d == m_derived.end())
+    return false;
+  std::map<int, Accumulator *>::iterator a =
+      m_accumulators.find(d->second.base);
+  if (a == m_accumulators.end())
+    return false;
+  const Statistic s = d->second.statistic;
+  if (!a->second->active[s])
+    return false;
+  a->second->active[s] = false;
+  if (--a->second->active_count == 0) {
+    delete a->second;
+    m_accumulators.erase(a);
+  }
+  return true;
+}
+
+void
+MetricAggregator::Add(const DataPoint &p) {
+  std::map<int, Accumulator *>::iterator a = m_accumulators.find(p.id);
+  if (a != m_accumulators.end())
+    a->second->histogram.Add(p.data);
+}
+
+void
+MetricAggregator::Emit(unsigned int ms, DataSet *d) {
+  for (std::map<int, Accumulator *>::iterator i = m_accumulators.begin();
+       i != m_accumulators.end(); ++i) {
+    Accumulator &a = *i->second;
+    StreamingHistogram &h = a.histogram;
+    if (!h.Count())
+      continue;
+    const double values[kStatisticCount] = {
+      static_cast<double>(h.Count()), h.Min(), h.Max(), h.Mean(),
+      h.Percentile(0.5), h.Percentile(0.99)
+    };
+    for (int s = 0; s < kStatisticCount; ++s) {
+      if (a.active[s])
+        d->push_back(DataPoint(ms, a.ids[s], values[s]));
+    }
+    h.Reset();
+  }
+}
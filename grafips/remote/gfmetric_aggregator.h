@@ -0,0 +1,126 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFMETRIC_AGGREGATOR_H_
+#define REMOTE_GFMETRIC_AGGREGATOR_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "os/gftraits.h"
+#include "remote/gfmetric.h"
+
+namespace Grafips {
+
+// Distribution of the samples of a metric over an interval.  Buckets
+// are log-scale, with 32 per power of two, so percentiles are within
+// about 2% of the true value.  Storage is fixed when constructed.
+// Samples <= 0 share a single bucket, and are reported as the
+// minimum.
+class StreamingHistogram : NoCopy, NoAssign, NoMove {
+ public:
+  StreamingHistogram();
+  void Add(double value);
+  void Reset();
+  uint64_t Count() const { return m_count; }
+  double Min() const { return m_min; }
+  double Max() const { return m_max; }
+  double Mean() const { return m_count ? m_sum / m_count : 0; }
+  // p in [0, 1]
+  double Percentile(double p) const;
+
+ private:
+  static int Bucket(double value);
+  static double BucketValue(int bucket);
+
+  std::vector<uint32_t> m_buckets;
+  // range of buckets that are non-zero
+  int m_low, m_high;
+  uint64_t m_count;
+  double m_min, m_max, m_sum;
+};
+
+// Summarizes every sample of a metric over an interval, so that
+// spikes between a host's samples are not lost, while bandwidth stays
+// constant.  Each metric has derived metrics, which a host activates
+// instead of the raw metric to receive statistics:
+//
+//   <path>/count <path>/min <path>/max <path>/mean <path>/p50 <path>/p99
+//
+// Not thread safe: the PublisherImpl serializes access.
+class MetricAggregator : NoCopy, NoAssign, NoMove {
+ public:
+  enum Statistic {
+    kCount, kMin, kMax, kMean, kP50, kP99, kStatisticCount
+  };
+
+  MetricAggregator();
+  ~MetricAggregator();
+  // appends the derived metrics of each description to derived
+  void AddDescriptions(const MetricDescriptionSet &descriptions,
+                       MetricDescriptionSet *derived);
+  // true if id is a derived metric, setting base to the raw metric
+  bool Base(int id, int *base) const;
+  // false if id is not a derived metric, or was already in that state
+  bool Activate(int derived_id);
+  bool Deactivate(int derived_id);
+  // true if any statistic of the raw metric is active
+  bool Aggregated(int base_id) const {
+    return m_accumulators.count(base_id) != 0;
+  }
+  void Add(const DataPoint &p);
+  // appends the active statistics of each metric with samples since
+  // the previous call, and begins a new interval.
+  void Emit(unsigned int ms, DataSet *d);
+
+ private:
+  struct Derived {
+    int base;
+    Statistic statistic;
+  };
+  struct Accumulator {
+    Accumulator() : active_count(0) {
+      for (int i = 0; i < kStatisticCount; ++i)
+        active[i] = false;
+    }
+    StreamingHistogram histogram;
+    int ids[kStatisticCount];
+    bool active[kStatisticCount];
+    int active_count;
+  };
+
+  std::map<int, Derived> m_derived;
+  // created when a statistic of the raw metric is activated
+  std::map<int, Accumulator *> m_accumulators;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFMETRIC_AGGREGATOR_H_
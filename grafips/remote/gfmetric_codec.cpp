@@ -0,0 +1,138 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfmetric_codec.h"
+
+#include "./gfsubscriber.pb.h"
+
+using Grafips::DataPoint;
+using Grafips::DataSet;
+using Grafips::MetricDecoder;
+using Grafips::MetricEncoder;
+
+typedef GrafipsProto::SubscriberInvocation::OnMetric GOnMet;
+
+static const uint64_t NANO_SECONDS_PER_MS = 1000000;
+
+// samples which only carry millisecond time are placed on the
+// nanosecond axis, so both kinds can share delta encoding.
+static uint64_t
+sample_ns(const DataPoint &p) {
+  if (p.time_ns)
+    return p.time_ns;
+  return p.time_val * NANO_SECONDS_PER_MS;
+}
+
+MetricEncoder::MetricEncoder(int version) : m_version(version) {
+}
+
+void
+MetricEncoder::Encode(const DataSet &d, GOnMet *m) {
+  if (m_version < kProtocolVersion2) {
+    for (DataSet::const_iterator i = d.begin(); i != d.end(); ++i) {
+      ::GrafipsProto::DataPoint* data = m->add_data();
+      data->set_time_val(i->time_val);
+      data->set_id(i->id);
+      data->set_data(i->data);
+    }
+    return;
+  }
+
+  if (d.empty())
+    return;
+  m->set_interned_base(m_ids.size());
+  uint64_t prev_ns = sample_ns(d.front());
+  m->set_base_time_ns(prev_ns);
+  for (DataSet::const_iterator i = d.begin(); i != d.end(); ++i) {
+    // samples from different sources are not ordered in time, so the
+    // deltas are signed.
+    const uint64_t ns = sample_ns(*i);
+    m->add_time_delta_ns(static_cast<int64_t>(ns - prev_ns));
+    prev_ns = ns;
+
+    std::map<int, unsigned int>::iterator index = m_index_by_id.find(i->id);
+    if (index == m_index_by_id.end()) {
+      const unsigned int next = m_ids.size();
+      index = m_index_by_id.insert(std::make_pair(i->id, next)).first;
+      m_ids.push_back(i->id);
+      m->add_interned_ids(i->id);
+    }
+    m->add_metric((index->second << 1) | (i->integral ? 1 : 0));
+    if (i->integral)
+      m->add_int_values(i->int_data);
+    else
+      m->add_values(i->data);
+  }
+}
+
+void
+MetricEncoder::EncodeInterned(unsigned int begin, unsigned int end,
+                              GOnMet *m) const {
+  m->set_interned_base(begin);
+  for (unsigned int i = begin; i < end && i < m_ids.size(); ++i)
+    m->add_interned_ids(m_ids[i]);
+}
+
+bool
+MetricDecoder::Decode(const GOnMet &m, DataSet *d) {
+  for (int i = 0; i < m.data_size(); ++i) {
+    const ::GrafipsProto::DataPoint &data = m.data(i);
+    d->push_back(DataPoint(static_cast<unsigned int>(data.time_val()),
+                           data.id(), data.data()));
+  }
+
+  const unsigned int base = m.interned_base();
+  if (m_ids.size() < base + m.interned_ids_size())
+    m_ids.resize(base + m.interned_ids_size(), 0);
+  for (int i = 0; i < m.interned_ids_size(); ++i)
+    m_ids[base + i] = m.interned_ids(i);
+  if (m.metric_size() != m.time_delta_ns_size())
+    return false;
+  uint64_t ns = m.base_time_ns();
+  int value = 0, int_value = 0;
+  for (int i = 0; i < m.metric_size(); ++i) {
+    ns += m.time_delta_ns(i);
+    const unsigned int index = m.metric(i) >> 1;
+    if (index >= m_ids.size())
+      return false;
+    const int id = m_ids[index];
+    if (m.metric(i) & 1) {
+      if (int_value >= m.int_values_size())
+        return false;
+      d->push_back(DataPoint(ns, id,
+                             static_cast<int64_t>(m.int_values(int_value++))));
+    } else {
+      if (value >= m.values_size())
+        return false;
+      DataPoint p(static_cast<unsigned int>(ns / NANO_SECONDS_PER_MS), id,
+                  m.values(value++));
+      p.time_ns = ns;
+      d->push_back(p);
+    }
+  }
+  return true;
+}
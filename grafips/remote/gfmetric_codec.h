@@ -0,0 +1,88 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFMETRIC_CODEC_H_
+#define REMOTE_GFMETRIC_CODEC_H_
+
+#include <map>
+#include <vector>
+
+#include "remote/gfmetric.h"
+#include "os/gftraits.h"
+
+namespace GrafipsProto {
+class SubscriberInvocation_OnMetric;
+}
+
+namespace Grafips {
+
+// Wire formats for OnMetric.  Version 1 sends each sample as a
+// DataPoint message, with a 32 bit millisecond time and a float value.
+// Version 2 sends columns: a base timestamp in nanoseconds followed by
+// delta-encoded varint timestamps, metric ids interned for the
+// session, and values packed as double or int64.
+enum {
+  kProtocolVersion1 = 1,
+  kProtocolVersion2 = 2,
+  kProtocolVersionLatest = kProtocolVersion2
+};
+
+// Encodes metrics for a session.  Interned ids are remembered between
+// calls.  Each message defines the ids it interns, so a decoder which
+// receives every message in order needs nothing else.  A decoder which
+// receives a subset of the messages must first be sent the missing
+// ids, with EncodeInterned.
+class MetricEncoder : NoCopy, NoAssign, NoMove {
+ public:
+  explicit MetricEncoder(int version);
+  void Encode(const DataSet &d,
+              GrafipsProto::SubscriberInvocation_OnMetric *m);
+  // writes interned ids [begin, end) to m, without samples
+  void EncodeInterned(unsigned int begin, unsigned int end,
+                      GrafipsProto::SubscriberInvocation_OnMetric *m) const;
+  int Version() const { return m_version; }
+  unsigned int InternedCount() const { return m_ids.size(); }
+ private:
+  const int m_version;
+  std::map<int, unsigned int> m_index_by_id;
+  std::vector<int> m_ids;
+};
+
+class MetricDecoder : NoCopy, NoAssign, NoMove {
+ public:
+  MetricDecoder() {}
+  // returns false if the message refers to an id that was never
+  // interned.
+  bool Decode(const GrafipsProto::SubscriberInvocation_OnMetric &m,
+              DataSet *d);
+ private:
+  std::vector<int> m_ids;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFMETRIC_CODEC_H_
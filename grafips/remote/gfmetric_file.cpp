@@ -0,0 +1,481 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfmetric_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "error/gflog.h"
+
+using Grafips::DataPoint;
+using Grafips::DataSet;
+using Grafips::MetricDescription;
+using Grafips::MetricDescriptionSet;
+using Grafips::MetricFileReader;
+using Grafips::MetricFileWriter;
+
+namespace {
+const char kMagic[8] = { 'G', 'R', 'A', 'F', 'I', 'P', 'S', 0 };
+const size_t kHeaderSize = sizeof(kMagic) + 4 + 8 + 8;
+const size_t kRecordHeaderSize = 8;
+
+// encoding of the value of each sample in a series
+enum ValueTag {
+  kSameValue = 0,
+  kIntegralDelta = 1,
+  kDoubleXor = 2
+};
+
+typedef std::vector<unsigned char> Buffer;
+
+void
+PutFixed32(uint32_t v, Buffer *b) {
+  for (int i = 0; i < 4; ++i)
+    b->push_back((v >> (8 * i)) & 0xff);
+}
+
+void
+PutFixed64(uint64_t v, Buffer *b) {
+  for (int i = 0; i < 8; ++i)
+    b->push_back((v >> (8 * i)) & 0xff);
+}
+
+void
+PutVarint(uint64_t v, Buffer *b) {
+  while (v >= 0x80) {
+    b->push_back((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  b->push_back(v);
+}
+
+uint64_t
+ZigZag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t
+UnZigZag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+void
+PutString(const std::string &s, Buffer *b) {
+  PutVarint(s.size(), b);
+  b->insert(b->end(), s.begin(), s.end());
+}
+
+uint64_t
+DoubleBits(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+double
+BitsDouble(uint64_t bits) {
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+// Decodes a buffer, failing on truncation rather than reading past
+// the end.
+class Cursor {
+ public:
+  Cursor(const unsigned char *p, size_t size)
+      : m_p(p), m_end(p + size), m_ok(true) {}
+  bool Ok() const { return m_ok; }
+  bool Done() const { return m_p == m_end; }
+  uint32_t Fixed32() {
+    uint64_t v = 0;
+    Fixed(4, &v);
+    return v;
+  }
+  uint64_t Fixed64() {
+    uint64_t v = 0;
+    Fixed(8, &v);
+    return v;
+  }
+  uint64_t Varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (m_p == m_end)
+        break;
+      const unsigned char c = *m_p++;
+      v |= static_cast<uint64_t>(c & 0x7f) << shift;
+      if (!(c & 0x80))
+        return v;
+    }
+    m_ok = false;
+    return 0;
+  }
+  std::string String() {
+    const uint64_t size = Varint();
+    if (!m_ok || size > static_cast<uint64_t>(m_end - m_p)) {
+      m_ok = false;
+      return std::string();
+    }
+    std::string s(reinterpret_cast<const char *>(m_p), size);
+    m_p += size;
+    return s;
+  }
+
+ private:
+  void Fixed(int bytes, uint64_t *v) {
+    if (m_end - m_p < bytes) {
+      m_ok = false;
+      return;
+    }
+    for (int i = 0; i < bytes; ++i)
+      *v |= static_cast<uint64_t>(*m_p++) << (8 * i);
+  }
+
+  const unsigned char *m_p, *m_end;
+  bool m_ok;
+};
+
+bool
+CompareId(const DataPoint &a, const DataPoint &b) {
+  return a.id < b.id;
+}
+
+}  // namespace
+
+MetricFileWriter::MetricFileWriter() : m_fd(-1), m_bytes(0) {
+}
+
+MetricFileWriter::~MetricFileWriter() {
+  Close();
+}
+
+void
+MetricFileWriter::Close() {
+  if (m_fd >= 0)
+    close(m_fd);
+  m_fd = -1;
+}
+
+bool
+MetricFileWriter::Open(const std::string &path) {
+  m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (m_fd < 0) {
+    GFLOGF("MetricFileWriter: could not open %s: %s", path.c_str(),
+           strerror(errno));
+    return false;
+  }
+  struct timespec t;
+  clock_gettime(CLOCK_REALTIME, &t);
+  m_buf.assign(kMagic, kMagic + sizeof(kMagic));
+  PutFixed32(kMetricFileVersion, &m_buf);
+  PutFixed64(get_ns_time(), &m_buf);
+  PutFixed64(static_cast<uint64_t>(t.tv_sec) * 1000000000ULL + t.tv_nsec,
+             &m_buf);
+  const ssize_t written = write(m_fd, m_buf.data(), m_buf.size());
+  if (written != static_cast<ssize_t>(m_buf.size()))
+    return false;
+  m_bytes = written;
+  return true;
+}
+
+bool
+MetricFileWriter::WriteRecord(MetricFileRecord type) {
+  // m_buf holds the payload, after space for the record header
+  const uint32_t length = m_buf.size() - kRecordHeaderSize;
+  Buffer header;
+  PutFixed32(type, &header);
+  PutFixed32(length, &header);
+  std::copy(header.begin(), header.end(), m_buf.begin());
+  size_t offset = 0;
+  while (offset < m_buf.size()) {
+    const ssize_t written = write(m_fd, m_buf.data() + offset,
+                                  m_buf.size() - offset);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0) {
+      GFLOGF("MetricFileWriter: write failed: %s", strerror(errno));
+      return false;
+    }
+    offset += written;
+  }
+  m_bytes += m_buf.size();
+  return true;
+}
+
+bool
+MetricFileWriter::WriteDescriptions(const MetricDescriptionSet &desc) {
+  if (m_fd < 0)
+    return false;
+  m_buf.assign(kRecordHeaderSize, 0);
+  PutVarint(desc.size(), &m_buf);
+  for (MetricDescriptionSet::const_iterator i = desc.begin();
+       i != desc.end(); ++i) {
+    PutFixed32(i->id(), &m_buf);
+    PutVarint(i->type, &m_buf);
+    PutString(i->path, &m_buf);
+    PutString(i->display_name, &m_buf);
+    PutString(i->help_text, &m_buf);
+  }
+  return WriteRecord(kDescriptionsRecord);
+}
+
+bool
+MetricFileWriter::WriteChunk(const DataSet &d) {
+  if (m_fd < 0)
+    return false;
+  if (d.empty())
+    return true;
+  m_sorted = d;
+  // stable, so each series remains in time order
+  std::stable_sort(m_sorted.begin(), m_sorted.end(), CompareId);
+
+  m_index.clear();
+  m_series.clear();
+  unsigned int series_count = 0;
+  DataSet::const_iterator i = m_sorted.begin();
+  while (i != m_sorted.end()) {
+    const int id = i->id;
+    const size_t offset = m_series.size();
+    const uint64_t begin_ns = i->time_ns;
+    uint64_t end_ns = begin_ns, prev_ns = begin_ns, prev_bits = 0;
+    int64_t prev_int = 0;
+    bool prev_integral = false;
+    uint64_t samples = 0;
+    for (; i != m_sorted.end() && i->id == id; ++i, ++samples) {
+      const uint64_t dt = ZigZag(static_cast<int64_t>(i->time_ns - prev_ns));
+      prev_ns = i->time_ns;
+      end_ns = std::max(end_ns, i->time_ns);
+      const uint64_t bits = DoubleBits(i->data);
+      if (samples && i->integral == prev_integral &&
+          (i->integral ? i->int_data == prev_int : bits == prev_bits)) {
+        PutVarint(dt << 2 | kSameValue, &m_series);
+      } else if (i->integral) {
+        PutVarint(dt << 2 | kIntegralDelta, &m_series);
+        PutVarint(ZigZag(i->int_data - prev_int), &m_series);
+      } else {
+        PutVarint(dt << 2 | kDoubleXor, &m_series);
+        PutVarint(bits ^ prev_bits, &m_series);
+      }
+      prev_integral = i->integral;
+      if (i->integral)
+        prev_int = i->int_data;
+      else
+        prev_bits = bits;
+    }
+    PutFixed32(id, &m_index);
+    PutVarint(samples, &m_index);
+    PutVarint(begin_ns, &m_index);
+    PutVarint(end_ns - begin_ns, &m_index);
+    PutVarint(offset, &m_index);
+    PutVarint(m_series.size() - offset, &m_index);
+    ++series_count;
+  }
+
+  m_buf.assign(kRecordHeaderSize, 0);
+  Buffer count;
+  PutVarint(series_count, &count);
+  PutVarint(count.size() + m_index.size(), &m_buf);
+  m_buf.insert(m_buf.end(), count.begin(), count.end());
+  m_buf.insert(m_buf.end(), m_index.begin(), m_index.end());
+  m_buf.insert(m_buf.end(), m_series.begin(), m_series.end());
+  return WriteRecord(kChunkRecord);
+}
+
+MetricFileReader::MetricFileReader()
+    : m_file(NULL), m_start_ns(0), m_start_realtime_ns(0) {
+}
+
+MetricFileReader::~MetricFileReader() {
+  if (m_file)
+    fclose(m_file);
+}
+
+bool
+MetricFileReader::Open(const std::string &path) {
+  m_file = fopen(path.c_str(), "rb");
+  if (!m_file)
+    return false;
+  unsigned char header[kHeaderSize];
+  if (fread(header, 1, sizeof(header), m_file) != sizeof(header) ||
+      memcmp(header, kMagic, sizeof(kMagic)) != 0)
+    return false;
+  Cursor c(header + sizeof(kMagic), sizeof(header) - sizeof(kMagic));
+  if (c.Fixed32() != kMetricFileVersion)
+    return false;
+  m_start_ns = c.Fixed64();
+  m_start_realtime_ns = c.Fixed64();
+
+  // Only the record headers, descriptions and chunk indexes are read.
+  // Series data is skipped.
+  if (fseeko(m_file, 0, SEEK_END) != 0)
+    return false;
+  const uint64_t file_size = ftello(m_file);
+  uint64_t offset = kHeaderSize;
+  std::map<int, MetricDescription> descriptions;
+  Buffer buf;
+  while (true) {
+    unsigned char record[kRecordHeaderSize];
+    if (fseeko(m_file, offset, SEEK_SET) != 0 ||
+        fread(record, 1, sizeof(record), m_file) != sizeof(record))
+      break;
+    Cursor r(record, sizeof(record));
+    const uint32_t type = r.Fixed32();
+    const uint32_t length = r.Fixed32();
+    offset += kRecordHeaderSize;
+    if (offset + length > file_size)
+      break;
+    if (type == kDescriptionsRecord) {
+      buf.resize(length);
+      if (fread(buf.data(), 1, length, m_file) != length)
+        break;
+      Cursor d(buf.data(), buf.size());
+      const uint64_t count = d.Varint();
+      for (uint64_t i = 0; i < count && d.Ok(); ++i) {
+        d.Fixed32();
+        const MetricType t = static_cast<MetricType>(d.Varint());
+        const std::string path = d.String();
+        const std::string display_name = d.String();
+        const std::string help_text = d.String();
+        if (!d.Ok())
+          break;
+        MetricDescription desc(path, help_text, display_name, t);
+        descriptions[desc.id()] = desc;
+      }
+    } else if (type == kChunkRecord) {
+      if (!ReadIndex(offset, length))
+        break;
+    }
+    offset += length;
+  }
+
+  for (std::map<int, MetricDescription>::const_iterator i =
+           descriptions.begin(); i != descriptions.end(); ++i)
+    m_descriptions.push_back(i->second);
+  return true;
+}
+
+bool
+MetricFileReader::ReadIndex(uint64_t offset, uint32_t length) {
+  // the index length is a varint of at most 10 bytes
+  unsigned char prefix[10];
+  const size_t prefix_size = fread(prefix, 1, std::min<size_t>(
+      sizeof(prefix), length), m_file);
+  Cursor p(prefix, prefix_size);
+  const uint64_t index_length = p.Varint();
+  if (!p.Ok())
+    return false;
+  // bytes of the length prefix
+  size_t varint_size = 1;
+  for (uint64_t v = index_length; v >= 0x80; v >>= 7)
+    ++varint_size;
+  if (varint_size + index_length > length)
+    return false;
+  Buffer index(index_length);
+  if (fseeko(m_file, offset + varint_size, SEEK_SET) != 0 ||
+      fread(index.data(), 1, index.size(), m_file) != index.size())
+    return false;
+
+  const uint64_t series_base = offset + varint_size + index_length;
+  Cursor c(index.data(), index.size());
+  const uint64_t count = c.Varint();
+  for (uint64_t i = 0; i < count && c.Ok(); ++i) {
+    Series s;
+    s.id = static_cast<int>(c.Fixed32());
+    s.samples = c.Varint();
+    s.begin_ns = c.Varint();
+    s.end_ns = s.begin_ns + c.Varint();
+    s.offset = series_base + c.Varint();
+    s.length = c.Varint();
+    if (!c.Ok() || s.offset + s.length > offset + length)
+      return false;
+    m_series.push_back(s);
+    Summary &summary = m_summaries[s.id];
+    if (!summary.samples || s.begin_ns < summary.begin_ns)
+      summary.begin_ns = s.begin_ns;
+    summary.end_ns = std::max(summary.end_ns, s.end_ns);
+    summary.samples += s.samples;
+  }
+  return c.Ok();
+}
+
+bool
+MetricFileReader::Read(uint64_t begin_ns, uint64_t end_ns,
+                       const std::set<int> &ids, DataSet *d) {
+  Buffer buf;
+  for (std::vector<Series>::const_iterator s = m_series.begin();
+       s != m_series.end(); ++s) {
+    if (s->end_ns < begin_ns || s->begin_ns >= end_ns)
+      continue;
+    if (!ids.empty() && !ids.count(s->id))
+      continue;
+    buf.resize(s->length);
+    if (fseeko(m_file, s->offset, SEEK_SET) != 0 ||
+        fread(buf.data(), 1, buf.size(), m_file) != buf.size())
+      return false;
+    Cursor c(buf.data(), buf.size());
+    uint64_t time_ns = s->begin_ns, bits = 0;
+    int64_t value = 0;
+    bool integral = false;
+    for (uint64_t i = 0; i < s->samples; ++i) {
+      const uint64_t tag = c.Varint();
+      time_ns += UnZigZag(tag >> 2);
+      switch (tag & 3) {
+        case kSameValue:
+          break;
+        case kIntegralDelta:
+          value += UnZigZag(c.Varint());
+          integral = true;
+          break;
+        case kDoubleXor:
+          bits ^= c.Varint();
+          integral = false;
+          break;
+        default:
+          return false;
+      }
+      if (!c.Ok())
+        return false;
+      if (time_ns < begin_ns || time_ns >= end_ns)
+        continue;
+      if (integral)
+        d->push_back(DataPoint(time_ns, s->id, value));
+      else
+        d->push_back(DataPoint(static_cast<unsigned int>(time_ns / 1000000),
+                               s->id, BitsDouble(bits)));
+      d->back().time_ns = time_ns;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,142 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFMETRIC_FILE_H_
+#define REMOTE_GFMETRIC_FILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "os/gftraits.h"
+#include "remote/gfmetric.h"
+
+namespace Grafips {
+
+// Recordings of metric samples are appended to a file as records:
+//
+//   file:         "GRAFIPS\0" fixed32 version fixed64 start_ns
+//                 fixed64 start_realtime_ns record...
+//   record:       fixed32 type fixed32 length payload[length]
+//   descriptions: varint count { fixed32 id varint type string path
+//                 string display_name string help_text }...
+//   chunk:        varint index_length index series...
+//   index:        varint count { fixed32 id varint samples varint begin_ns
+//                 varint end_ns - begin_ns varint offset varint length }...
+//
+// Integers are little-endian, and strings are prefixed with a varint
+// length.  Each chunk holds the samples of an interval.  Its index
+// gives the time range and location of each metric's series, so a
+// reader may skip data without decoding it.  A series encodes each
+// sample as a varint of the zigzag time delta, tagged with the
+// encoding of the value: unchanged, a zigzag delta of an integral
+// value, or the xor of the double with the previous value.
+//
+// Times are CLOCK_MONOTONIC_RAW nanoseconds, like get_ns_time().
+// A truncated final record, left by a process which did not exit
+// cleanly, is ignored by the reader.
+enum MetricFileRecord {
+  kDescriptionsRecord = 1,
+  kChunkRecord = 2
+};
+
+static const int kMetricFileVersion = 1;
+
+// Appends records to a new recording.  Writes are not buffered: each
+// record is written with a single call, so a concurrent reader sees
+// only whole records, apart from a final record in progress.
+class MetricFileWriter : NoCopy, NoAssign, NoMove {
+ public:
+  MetricFileWriter();
+  ~MetricFileWriter();
+  // truncates an existing file
+  bool Open(const std::string &path);
+  bool WriteDescriptions(const MetricDescriptionSet &descriptions);
+  // samples must have time_ns set.  Samples of each metric must be in
+  // time order.
+  bool WriteChunk(const DataSet &d);
+  // later writes fail
+  void Close();
+  uint64_t BytesWritten() const { return m_bytes; }
+
+ private:
+  bool WriteRecord(MetricFileRecord type);
+
+  int m_fd;
+  uint64_t m_bytes;
+  std::vector<unsigned char> m_buf, m_index, m_series;
+  DataSet m_sorted;
+};
+
+class MetricFileReader : NoCopy, NoAssign, NoMove {
+ public:
+  // per metric summary, from the chunk indexes
+  struct Summary {
+    Summary() : samples(0), begin_ns(0), end_ns(0) {}
+    uint64_t samples;
+    uint64_t begin_ns, end_ns;
+  };
+  typedef std::map<int, Summary> SummaryMap;
+
+  MetricFileReader();
+  ~MetricFileReader();
+  // reads the header, descriptions, and chunk indexes
+  bool Open(const std::string &path);
+  uint64_t StartNs() const { return m_start_ns; }
+  uint64_t StartRealtimeNs() const { return m_start_realtime_ns; }
+  const MetricDescriptionSet &Descriptions() const { return m_descriptions; }
+  const SummaryMap &Summaries() const { return m_summaries; }
+  // appends the samples in [begin_ns, end_ns) of the given metrics, or
+  // of every metric if ids is empty.  Only the series which overlap
+  // the range are read.
+  bool Read(uint64_t begin_ns, uint64_t end_ns, const std::set<int> &ids,
+            DataSet *d);
+
+ private:
+  struct Series {
+    int id;
+    uint64_t samples, begin_ns, end_ns;
+    // position in the file
+    uint64_t offset, length;
+  };
+
+  bool ReadIndex(uint64_t offset, uint32_t length);
+
+  FILE *m_file;
+  uint64_t m_start_ns, m_start_realtime_ns;
+  MetricDescriptionSet m_descriptions;
+  SummaryMap m_summaries;
+  std::vector<Series> m_series;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFMETRIC_FILE_H_
@@ -0,0 +1,106 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfmetric_history.h"
+
+#include <assert.h>
+
+using Grafips::DataPoint;
+using Grafips::DataSet;
+using Grafips::MetricHistory;
+
+MetricHistory::MetricHistory(int resolution_ms)
+    : m_resolution_ms(resolution_ms > 0 ? resolution_ms : 1) {
+}
+
+MetricHistory::~MetricHistory() {
+  for (std::map<int, Ring *>::iterator i = m_rings.begin();
+       i != m_rings.end(); ++i)
+    delete i->second;
+}
+
+void
+MetricHistory::SetResolution(int resolution_ms) {
+  assert(m_rings.empty());
+  m_resolution_ms = resolution_ms > 0 ? resolution_ms : 1;
+}
+
+void
+MetricHistory::Track(int id, int seconds) {
+  if (seconds <= 0 || Tracked(id))
+    return;
+  const unsigned int slots =
+      (seconds * 1000 + m_resolution_ms - 1) / m_resolution_ms;
+  m_rings[id] = new Ring(slots);
+}
+
+void
+MetricHistory::Add(const DataPoint &p) {
+  std::map<int, Ring *>::iterator i = m_rings.find(p.id);
+  if (i == m_rings.end())
+    return;
+  Ring &r = *i->second;
+  const unsigned int bucket = p.time_val / m_resolution_ms;
+  Slot &s = r.slots[bucket % r.slots.size()];
+  if (s.empty || s.bucket != bucket) {
+    s.min = p;
+    s.max = p;
+    s.bucket = bucket;
+    s.empty = false;
+  } else if (p.data < s.min.data) {
+    s.min = p;
+  } else if (p.data > s.max.data) {
+    s.max = p;
+  }
+  if (r.empty || bucket > r.newest) {
+    r.newest = bucket;
+    r.empty = false;
+  }
+}
+
+void
+MetricHistory::Replay(DataSet *d) const {
+  for (std::map<int, Ring *>::const_iterator i = m_rings.begin();
+       i != m_rings.end(); ++i) {
+    const Ring &r = *i->second;
+    if (r.empty)
+      continue;
+    const unsigned int size = r.slots.size();
+    const unsigned int oldest = r.newest >= size ? r.newest - size + 1 : 0;
+    for (unsigned int bucket = oldest; bucket <= r.newest; ++bucket) {
+      const Slot &s = r.slots[bucket % size];
+      if (s.empty || s.bucket != bucket)
+        continue;
+      const DataPoint &first =
+          s.min.time_val <= s.max.time_val ? s.min : s.max;
+      const DataPoint &second = &first == &s.min ? s.max : s.min;
+      d->push_back(first);
+      if (second.time_val != first.time_val || second.data != first.data)
+        d->push_back(second);
+    }
+  }
+}
@@ -0,0 +1,79 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFMETRIC_HISTORY_H_
+#define REMOTE_GFMETRIC_HISTORY_H_
+
+#include <map>
+#include <vector>
+
+#include "os/gftraits.h"
+#include "remote/gfmetric.h"
+
+namespace Grafips {
+
+// Records recent samples of selected metrics, so that a host which
+// connects after an event can still see it.  Samples are kept at a
+// reduced resolution: each slot of a metric's ring retains the
+// minimum and maximum sample within resolution_ms, so spikes and dips
+// survive.  Memory for a metric is fixed when it is tracked.
+//
+// Not thread safe: the PublisherImpl serializes access.
+class MetricHistory : NoCopy, NoAssign, NoMove {
+ public:
+  explicit MetricHistory(int resolution_ms);
+  ~MetricHistory();
+  // must be called before any metric is tracked
+  void SetResolution(int resolution_ms);
+  // begins recording id, retaining at least the given number of seconds
+  void Track(int id, int seconds);
+  bool Tracked(int id) const { return m_rings.count(id) != 0; }
+  void Add(const DataPoint &p);
+  // appends the retained samples of each tracked metric, oldest first
+  void Replay(DataSet *d) const;
+
+ private:
+  struct Slot {
+    Slot() : bucket(0), empty(true) {}
+    DataPoint min, max;
+    unsigned int bucket;
+    bool empty;
+  };
+  struct Ring {
+    explicit Ring(int size) : slots(size), newest(0), empty(true) {}
+    std::vector<Slot> slots;
+    unsigned int newest;
+    bool empty;
+  };
+
+  unsigned int m_resolution_ms;
+  std::map<int, Ring *> m_rings;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFMETRIC_HISTORY_H_
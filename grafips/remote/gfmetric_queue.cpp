@@ -0,0 +1,60 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfmetric_queue.h"
+
+using Grafips::MetricQueue;
+
+MetricQueue::MetricQueue(MetricSinkInterface *target, int capacity)
+    : m_target(target), m_queue(capacity), m_dropped(0) {
+}
+
+MetricQueue::~MetricQueue() {
+}
+
+void
+MetricQueue::OnMetric(const DataSet &d) {
+  for (DataSet::const_iterator i = d.begin(); i != d.end(); ++i) {
+    if (!m_queue.Push(*i))
+      ++m_dropped;
+  }
+}
+
+void
+MetricQueue::OnDescriptions(const MetricDescriptionSet &descriptions) {
+  m_target->OnDescriptions(descriptions);
+}
+
+void
+MetricQueue::Drain() {
+  m_drained.clear();
+  DataPoint p;
+  while (m_queue.Pop(&p))
+    m_drained.push_back(p);
+  if (!m_drained.empty())
+    m_target->OnMetric(m_drained);
+}
@@ -0,0 +1,72 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFMETRIC_QUEUE_H_
+#define REMOTE_GFMETRIC_QUEUE_H_
+
+#include <atomic>
+
+#include "os/gfspsc_queue.h"
+#include "os/gftraits.h"
+#include "remote/gfimetric_sink.h"
+#include "remote/gfmetric.h"
+
+namespace Grafips {
+
+// MetricQueue decouples sources that publish on the application's
+// render thread from the publisher.  Metrics are pushed onto a
+// lock-free queue, and the publisher thread forwards them to the
+// target with Drain().  The render thread never blocks: if the queue
+// is full, the data point is dropped and counted.
+//
+// Descriptions change rarely, and are forwarded to the target
+// immediately.
+class MetricQueue : public MetricSinkInterface,
+                    NoCopy, NoAssign, NoMove {
+ public:
+  explicit MetricQueue(MetricSinkInterface *target, int capacity = 4096);
+  ~MetricQueue();
+
+  // called only by the render thread
+  void OnMetric(const DataSet &d);
+  void OnDescriptions(const MetricDescriptionSet &descriptions);
+
+  // called only by the publisher thread
+  void Drain();
+
+  int64_t DroppedCount() const { return m_dropped; }
+
+ private:
+  MetricSinkInterface *m_target;
+  SpscQueue<DataPoint> m_queue;
+  DataSet m_drained;
+  std::atomic<int64_t> m_dropped;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFMETRIC_QUEUE_H_
@@ -0,0 +1,128 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfmetric_recorder.h"
+
+#include <unistd.h>
+
+#include <string>
+
+using Grafips::DataSet;
+using Grafips::MetricDescriptionSet;
+using Grafips::MetricRecorder;
+using Grafips::ScopedLock;
+
+MetricRecorder::MetricRecorder()
+    : Thread("MetricRecorder"), m_last_chunk_ms(get_ms_time()),
+      m_running(true), m_closed(false), m_dropped(0) {
+  m_pending.reserve(kChunkSamples);
+  m_writing.reserve(kChunkSamples);
+}
+
+MetricRecorder::~MetricRecorder() {
+}
+
+bool
+MetricRecorder::Open(const std::string &path) {
+  return m_writer.Open(path);
+}
+
+void
+MetricRecorder::OnMetric(const DataSet &d) {
+  ScopedLock s(&m_protect);
+  size_t count = d.size();
+  if (m_pending.size() + count > kMaxPending) {
+    count = kMaxPending - m_pending.size();
+    m_dropped += d.size() - count;
+  }
+  m_pending.insert(m_pending.end(), d.begin(), d.begin() + count);
+}
+
+void
+MetricRecorder::OnDescriptions(const MetricDescriptionSet &descriptions) {
+  ScopedLock s(&m_protect);
+  m_pending_descriptions.insert(m_pending_descriptions.end(),
+                                descriptions.begin(), descriptions.end());
+}
+
+void
+MetricRecorder::Run() {
+  while (m_running) {
+    usleep(kPollMs * 1000);
+    WriteChunk(false);
+  }
+  WriteChunk(true);
+}
+
+void
+MetricRecorder::Stop() {
+  m_running = false;
+}
+
+void
+MetricRecorder::Close() {
+  if (m_closed)
+    return;
+  m_closed = true;
+  Stop();
+  Join();
+  m_writer.Close();
+}
+
+void
+MetricRecorder::WriteChunk(bool force) {
+  const unsigned int ms = get_ms_time();
+  {
+    ScopedLock s(&m_protect);
+    if (!force && m_pending.size() < kChunkSamples &&
+        ms - m_last_chunk_ms < kChunkMs)
+      return;
+    m_last_chunk_ms = ms;
+    m_writing.swap(m_pending);
+    m_writing_descriptions.swap(m_pending_descriptions);
+  }
+
+  if (!m_writing_descriptions.empty())
+    m_writer.WriteDescriptions(m_writing_descriptions);
+  m_writing_descriptions.clear();
+
+  // Most samples carry only a 32 bit millisecond time, which wraps
+  // every 49 days.  The wrap is resolved against the current time,
+  // as samples are at most a few seconds old.
+  const uint64_t now_ns = get_ns_time();
+  const uint64_t now_ms = now_ns / 1000000;
+  for (DataSet::iterator i = m_writing.begin(); i != m_writing.end(); ++i) {
+    if (i->time_ns)
+      continue;
+    uint64_t t = (now_ms & ~0xffffffffULL) | i->time_val;
+    if (t > now_ms + 0x80000000ULL && t >= 0x100000000ULL)
+      t -= 0x100000000ULL;
+    i->time_ns = t * 1000000;
+  }
+  m_writer.WriteChunk(m_writing);
+  m_writing.clear();
+}
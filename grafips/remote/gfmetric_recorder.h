@@ -0,0 +1,87 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFMETRIC_RECORDER_H_
+#define REMOTE_GFMETRIC_RECORDER_H_
+
+#include <atomic>
+#include <string>
+
+#include "os/gfmutex.h"
+#include "os/gfthread.h"
+#include "os/gftraits.h"
+#include "remote/gfimetric_sink.h"
+#include "remote/gfmetric.h"
+#include "remote/gfmetric_file.h"
+
+namespace Grafips {
+
+// Records every sample delivered to it to a file, for runs without a
+// connected host.  OnMetric only copies samples into a buffer.  The
+// recorder's thread writes the buffer as a chunk (see MetricFileWriter)
+// every kChunkMs, or sooner if it grows large.  If the disk does not
+// keep up, samples beyond kMaxPending are dropped and counted.
+class MetricRecorder : public MetricSinkInterface, public Thread {
+ public:
+  MetricRecorder();
+  ~MetricRecorder();
+  // must succeed before Start()
+  bool Open(const std::string &path);
+  void OnMetric(const DataSet &d);
+  void OnDescriptions(const MetricDescriptionSet &descriptions);
+  void Run();
+  // writes buffered samples, and ends the thread
+  void Stop();
+  // after Start(): stops and joins the thread, and closes the file.
+  // Samples delivered later are not written.  May be called more
+  // than once.
+  void Close();
+  uint64_t DroppedSamples() const { return m_dropped; }
+
+ private:
+  static const unsigned int kChunkMs = 1000;
+  static const unsigned int kPollMs = 50;
+  static const size_t kChunkSamples = 64 * 1024;
+  static const size_t kMaxPending = 1024 * 1024;
+
+  // writes a chunk if one is due, or unconditionally if force is set
+  void WriteChunk(bool force);
+
+  MetricFileWriter m_writer;
+  // filled by OnMetric, and swapped with m_writing by the thread
+  DataSet m_pending, m_writing;
+  MetricDescriptionSet m_pending_descriptions, m_writing_descriptions;
+  unsigned int m_last_chunk_ms;
+  std::atomic<bool> m_running;
+  bool m_closed;
+  std::atomic<uint64_t> m_dropped;
+  Mutex m_protect;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFMETRIC_RECORDER_H_
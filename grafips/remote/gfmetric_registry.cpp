@@ -0,0 +1,179 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfmetric_registry.h"
+
+#include <fnmatch.h>
+
+#include <string>
+#include <vector>
+
+#include "error/gflog.h"
+
+using Grafips::MetricRegistry;
+using Grafips::ScopedLock;
+
+namespace {
+// first position of id in the table.  Ids are already hashes, but
+// similar paths have similar hashes.
+unsigned int
+TableStart(int id) {
+  return static_cast<unsigned int>(id) * 2654435761u;
+}
+}  // namespace
+
+MetricRegistry &
+MetricRegistry::Instance() {
+  // never destroyed, as threads describe and look up metrics until
+  // the process exits
+  static MetricRegistry *registry = new MetricRegistry;
+  return *registry;
+}
+
+MetricRegistry::MetricRegistry() : m_table_count(0) {
+  for (int i = 0; i < kTableSize; ++i)
+    m_table[i].store(NULL, std::memory_order_relaxed);
+}
+
+int
+MetricRegistry::Hash(const std::string &path) {
+  int hash = 0;
+  for (unsigned int i = 0; i < path.length(); ++i) {
+    const char c = path[i];
+    hash = 31 * hash + c;
+  }
+  return hash;
+}
+
+MetricRegistry::Entry *
+MetricRegistry::Lookup(int id) const {
+  unsigned int h = TableStart(id);
+  for (int probe = 0; probe < kTableSize; ++probe, ++h) {
+    Entry *e = m_table[h % kTableSize].load(std::memory_order_acquire);
+    if (e == NULL)
+      return NULL;
+    if (e->id == id)
+      return e;
+  }
+  return NULL;
+}
+
+int
+MetricRegistry::Intern(const std::string &path) {
+  const int id = Hash(path);
+  std::string existing;
+  bool full;
+  {
+    ScopedLock l(&m_protect);
+    std::unordered_map<std::string, int>::const_iterator p =
+        m_slot_by_path.find(path);
+    if (p != m_slot_by_path.end())
+      return m_entries[p->second]->id;
+
+    const Entry *other = Lookup(id);
+    full = (m_table_count == kMaxMetrics);
+    const bool collides = (other != NULL || id == kInvalidId || full);
+    if (other != NULL)
+      existing = other->path;
+    // rejected paths are remembered, so the collision is logged once
+    Entry *e = new Entry;
+    e->path = path;
+    e->id = collides ? kInvalidId : id;
+    e->slot = m_entries.size();
+    e->owner.store(NULL, std::memory_order_relaxed);
+    e->index.store(-1, std::memory_order_relaxed);
+    m_slot_by_path[path] = e->slot;
+    m_entries.push_back(e);
+    if (!collides) {
+      unsigned int h = TableStart(id);
+      while (m_table[h % kTableSize].load(std::memory_order_relaxed))
+        ++h;
+      // publishes the entry to Lookup()
+      m_table[h % kTableSize].store(e, std::memory_order_release);
+      ++m_table_count;
+      return id;
+    }
+  }
+  if (full) {
+    GFLOGF("metric %s is not published: the registry holds %d metrics",
+           path.c_str(), kMaxMetrics);
+  } else {
+    GFLOGF("metric %s has the id of %s, and is not published", path.c_str(),
+           existing.c_str());
+  }
+  return kInvalidId;
+}
+
+int
+MetricRegistry::Slot(int id) const {
+  const Entry *e = Lookup(id);
+  return e == NULL ? -1 : e->slot;
+}
+
+void
+MetricRegistry::Bind(int id, const void *owner, int index) {
+  ScopedLock l(&m_protect);
+  Entry *e = Lookup(id);
+  if (e == NULL)
+    return;
+  // the index is valid before Find() sees the owner
+  e->index.store(index, std::memory_order_relaxed);
+  e->owner.store(owner, std::memory_order_release);
+}
+
+void
+MetricRegistry::Unbind(const void *owner) {
+  ScopedLock l(&m_protect);
+  for (std::vector<Entry *>::iterator e = m_entries.begin();
+       e != m_entries.end(); ++e) {
+    if ((*e)->owner.load(std::memory_order_relaxed) != owner)
+      continue;
+    (*e)->owner.store(NULL, std::memory_order_release);
+    (*e)->index.store(-1, std::memory_order_relaxed);
+  }
+}
+
+bool
+MetricRegistry::Find(int id, const void *owner, int *index) const {
+  const Entry *e = Lookup(id);
+  if (e == NULL || owner == NULL ||
+      e->owner.load(std::memory_order_acquire) != owner)
+    return false;
+  *index = e->index.load(std::memory_order_relaxed);
+  return true;
+}
+
+void
+MetricRegistry::Match(const std::string &pattern,
+                      std::vector<int> *ids) const {
+  ScopedLock l(&m_protect);
+  for (std::vector<Entry *>::const_iterator e = m_entries.begin();
+       e != m_entries.end(); ++e)
+    if ((*e)->id != kInvalidId &&
+        fnmatch(pattern.c_str(), (*e)->path.c_str(), 0) == 0)
+      ids->push_back((*e)->id);
+}
@@ -0,0 +1,108 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFMETRIC_REGISTRY_H_
+#define REMOTE_GFMETRIC_REGISTRY_H_
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "os/gfmutex.h"
+#include "os/gftraits.h"
+
+namespace Grafips {
+
+// Interns metric paths for the life of the process.  The id of a
+// metric is the hash of its path, which hosts compute from the
+// descriptions they receive, so it can't be changed; the registry
+// computes it once, when the path is first described, rather than at
+// each use.  A path whose hash is held by a different path is
+// rejected, as samples of the two could not be told apart.
+//
+// Each id is also given a dense slot, in order of interning.  A
+// source may bind its metrics to an index within the source, and find
+// the index of an id in constant time.  Find() takes no lock, so
+// activations on the skeleton thread do not contend with descriptions
+// created on other threads.
+class MetricRegistry : NoCopy, NoAssign, NoMove {
+ public:
+  // the id of paths which collide
+  static const int kInvalidId = 0;
+  // paths interned beyond this are not published
+  static const int kMaxMetrics = 16 * 1024;
+
+  static MetricRegistry &Instance();
+  // id of path, or kInvalidId if another path has its hash
+  int Intern(const std::string &path);
+  // slot of id, or -1 if it has not been interned
+  int Slot(int id) const;
+  // associates id with an index of owner
+  void Bind(int id, const void *owner, int index);
+  // releases the ids bound by owner, which is being destroyed
+  void Unbind(const void *owner);
+  // false if owner has not bound id.  Lock free.
+  bool Find(int id, const void *owner, int *index) const;
+  // appends the ids of interned paths which match the fnmatch(3)
+  // pattern, eg "cpu/core/*".  '*' matches across '/'.
+  void Match(const std::string &pattern, std::vector<int> *ids) const;
+
+  static int Hash(const std::string &path);
+
+ private:
+  MetricRegistry();
+
+  // Entries are never freed, so Find() may hold one without the lock.
+  // owner and index are written under the lock.
+  struct Entry {
+    std::string path;
+    int id;
+    int slot;
+    std::atomic<const void *> owner;
+    std::atomic<int> index;
+  };
+  // open addressing, at most half full
+  static const int kTableSize = 2 * kMaxMetrics;
+
+  // the entry of id, or NULL.  Lock free.
+  Entry *Lookup(int id) const;
+
+  std::unordered_map<std::string, int> m_slot_by_path;
+  // by slot
+  std::vector<Entry *> m_entries;
+  // entries with valid ids, by hash of the id.  Written under the
+  // lock; read without it.
+  std::atomic<Entry *> m_table[kTableSize];
+  int m_table_count;
+  // descriptions are created on every thread
+  mutable Mutex m_protect;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFMETRIC_REGISTRY_H_
@@ -31,10 +31,15 @@
 
 #include "sources/gfimetric_source.h"
 #include "remote/gfisubscriber.h"
+#include "remote/gfmetric_registry.h"
 
+using Grafips::MetricRegistry;
 using Grafips::PublisherImpl;
 
-PublisherImpl::PublisherImpl() : m_subscriber(NULL) {}
+PublisherImpl::PublisherImpl()
+    : m_subscriber(NULL), m_recorder(NULL), m_flush_ms(0), m_last_flush_ms(0),
+      m_aggregate_ms(0), m_last_aggregate_ms(0),
+      m_history(kDefaultHistoryResolutionMs) {}
 
 PublisherImpl::~PublisherImpl() {
   while (!m_descriptions_by_metric_id.empty()) {
@@ -44,47 +49,224 @@ PublisherImpl::~PublisherImpl() {
 }
 
 void
-PublisherImpl::RegisterSource(MetricSourceInterface *p) {
-  std::vector<MetricDescription> desc;
+PublisherImpl::RegisterSource(MetricSourceInterface *p,
+                              MetricSinkInterface *sink) {
   m_sources.push_back(p);
 
-  p->Subscribe(this);
+  p->Subscribe(sink ? sink : this);
 }
 
 void
 PublisherImpl::OnMetric(const DataSet &d) {
-  if (m_subscriber)
-    m_subscriber->OnMetric(d);
+  ScopedLock s(&m_protect);
+  if (m_recorder)
+    m_recorder->OnMetric(d);
+  for (DataSet::const_iterator i = d.begin(); i != d.end(); ++i) {
+    m_history.Add(*i);
+    if (!m_subscriber)
+      continue;
+    if (m_aggregator.Aggregated(i->id))
+      m_aggregator.Add(*i);
+    // samples of metrics which are only aggregated or recorded are
+    // not sent
+    if (m_raw_active.count(i->id))
+      m_pending.push_back(*i);
+  }
+}
+
+void
+PublisherImpl::Flush() {
+  std::vector<int> activate;
+  {
+    ScopedLock s(&m_protect);
+    activate.swap(m_kept_inactive);
+  }
+  for (unsigned int i = 0; i < activate.size(); ++i)
+    for (unsigned int j = 0; j < m_sources.size(); ++j)
+      m_sources[j]->Activate(activate[i]);
+
+  ScopedLock s(&m_protect);
+  if (!m_subscriber)
+    return;
+  const unsigned int ms = get_ms_time();
+  if (m_aggregate_ms &&
+      ms - m_last_aggregate_ms >= static_cast<unsigned int>(m_aggregate_ms)) {
+    m_last_aggregate_ms = ms;
+    m_aggregator.Emit(ms, &m_pending);
+  }
+  if (m_pending.empty())
+    return;
+  if (ms - m_last_flush_ms < static_cast<unsigned int>(m_flush_ms))
+    return;
+  m_last_flush_ms = ms;
+  m_subscriber->OnMetric(m_pending);
+  m_pending.clear();
+}
+
+void
+PublisherImpl::SetFlushInterval(int flush_ms) {
+  ScopedLock s(&m_protect);
+  m_flush_ms = flush_ms;
+}
+
+void
+PublisherImpl::SetAggregationInterval(int aggregate_ms) {
+  ScopedLock s(&m_protect);
+  m_aggregate_ms = aggregate_ms;
+}
+
+void
+PublisherImpl::RecordHistory(const std::string &path, int seconds) {
+  ScopedLock s(&m_protect);
+  m_history_paths[path] = seconds;
+}
+
+void
+PublisherImpl::SetHistoryResolution(int resolution_ms) {
+  ScopedLock s(&m_protect);
+  m_history.SetResolution(resolution_ms);
+}
+
+void
+PublisherImpl::KeepActive(const std::string &path) {
+  ScopedLock s(&m_protect);
+  m_kept_paths.insert(path);
+}
+
+void
+PublisherImpl::SetRecorder(MetricSinkInterface *recorder) {
+  ScopedLock s(&m_protect);
+  m_recorder = recorder;
+}
+
+bool
+PublisherImpl::ActivateLocked(int id, int *base) {
+  *base = id;
+  if (m_aggregator.Base(id, base)) {
+    if (!m_aggregator.Activate(id))
+      return false;
+  } else if (!m_raw_active.insert(id).second) {
+    return false;
+  }
+  return m_source_activations[*base]++ == 0;
+}
+
+bool
+PublisherImpl::DeactivateLocked(int id, int *base) {
+  *base = id;
+  if (m_aggregator.Base(id, base)) {
+    if (!m_aggregator.Deactivate(id))
+      return false;
+  } else if (!m_raw_active.erase(id)) {
+    return false;
+  }
+  if (--m_source_activations[*base])
+    return false;
+  m_source_activations.erase(*base);
+  return true;
 }
 
 void
 PublisherImpl::Activate(int id) {
+  int base;
+  bool activate;
+  {
+    ScopedLock s(&m_protect);
+    activate = ActivateLocked(id, &base);
+  }
+  if (!activate)
+    return;
   for (unsigned int i = 0; i < m_sources.size(); ++i) {
-    m_sources[i]->Activate(id);
+    m_sources[i]->Activate(base);
   }
 }
 
 void
 PublisherImpl::Deactivate(int id) {
-  for (unsigned int i = 0; i < m_sources.size(); ++i) {
-    m_sources[i]->Deactivate(id);
+  int base;
+  bool deactivate;
+  {
+    ScopedLock s(&m_protect);
+    deactivate = DeactivateLocked(id, &base);
   }
-  m_subscriber->Clear(id);
+  if (deactivate) {
+    for (unsigned int i = 0; i < m_sources.size(); ++i) {
+      m_sources[i]->Deactivate(base);
+    }
+  }
+  ScopedLock s(&m_protect);
+  // samples queued before the deactivation would re-populate the
+  // cleared graph
+  for (DataSet::iterator i = m_pending.begin(); i != m_pending.end(); ) {
+    if (i->id == id)
+      i = m_pending.erase(i);
+    else
+      ++i;
+  }
+  if (m_subscriber)
+    m_subscriber->Clear(id);
+}
+
+void
+PublisherImpl::Match(const std::string &pattern, std::vector<int> *ids) {
+  std::vector<int> interned;
+  MetricRegistry::Instance().Match(pattern, &interned);
+  ScopedLock s(&m_protect);
+  for (unsigned int i = 0; i < interned.size(); ++i)
+    if (m_descriptions_by_metric_id.count(interned[i]))
+      ids->push_back(interned[i]);
 }
 
 void
 PublisherImpl::Subscribe(SubscriberInterface *s) {
+  ScopedLock l(&m_protect);
   m_subscriber = s;
-  std::vector<MetricDescription> descriptions;
-  OnDescriptions(descriptions);
+  PublishDescriptions();
+  DataSet history;
+  m_history.Replay(&history);
+  m_subscriber->OnHistory(history);
 }
 
 void
 PublisherImpl::OnDescriptions(const std::vector<MetricDescription> &desc) {
+  ScopedLock s(&m_protect);
   for (unsigned int i = 0; i < desc.size(); ++i) {
-    m_descriptions_by_metric_id[desc[i].id()] = new MetricDescription(desc[i]);
+    // the path collides with another, and can't be told apart
+    if (desc[i].id() == MetricRegistry::kInvalidId)
+      continue;
+    MetricDescription *&existing = m_descriptions_by_metric_id[desc[i].id()];
+    delete existing;
+    existing = new MetricDescription(desc[i]);
+
+    const int id = desc[i].id();
+    std::map<std::string, int>::const_iterator h =
+        m_history_paths.find(desc[i].path);
+    if (h != m_history_paths.end())
+      m_history.Track(id, h->second);
+    if ((h != m_history_paths.end() || m_kept_paths.count(desc[i].path)) &&
+        m_kept_active.insert(id).second &&
+        m_source_activations[id]++ == 0)
+      m_kept_inactive.push_back(id);
+  }
+  if (m_recorder)
+    m_recorder->OnDescriptions(desc);
+  if (m_aggregate_ms) {
+    MetricDescriptionSet derived;
+    m_aggregator.AddDescriptions(desc, &derived);
+    for (unsigned int i = 0; i < derived.size(); ++i) {
+      if (derived[i].id() == MetricRegistry::kInvalidId)
+        continue;
+      MetricDescription *&existing =
+          m_descriptions_by_metric_id[derived[i].id()];
+      delete existing;
+      existing = new MetricDescription(derived[i]);
+    }
   }
+  PublishDescriptions();
+}
 
+void
+PublisherImpl::PublishDescriptions() {
   std::vector<MetricDescription> all_descriptions;
   if (m_subscriber) {
     for (MetricDescriptionMap::iterator i = m_descriptions_by_metric_id.begin();
@@ -30,15 +30,24 @@
 
 #include <vector>
 #include <map>
+#include <set>
+#include <string>
 
 #include "remote/gfmetric.h"
+#include "remote/gfmetric_aggregator.h"
+#include "remote/gfmetric_history.h"
 #include "remote/gfipublisher.h"
 #include "remote/gfimetric_sink.h"
 #include "os/gftraits.h"
+#include "os/gfmutex.h"
 
 namespace Grafips {
 class MetricSourceInterface;
 class SubscriberInterface;
+
+// Hosts may activate a metric to receive every sample, or activate
+// its derived metrics (see MetricAggregator) to receive statistics
+// for each aggregation interval.
 class PublisherImpl : public PublisherInterface,
                       public MetricSinkInterface,
                       NoCopy, NoAssign, NoMove {
@@ -47,16 +56,78 @@ class PublisherImpl : public PublisherInterface,
 
   PublisherImpl();
   ~PublisherImpl();
-  void RegisterSource(MetricSourceInterface *p);
+  // metrics published by the source are delivered to sink, which
+  // defaults to the publisher itself.  Sources that publish on the
+  // render thread are registered with a MetricQueue as the sink.
+  void RegisterSource(MetricSourceInterface *p,
+                      MetricSinkInterface *sink = NULL);
+  // metrics are accumulated, and sent to the subscriber as a single
+  // message by Flush()
   void OnMetric(const DataSet &d);
+  // sends accumulated metrics, if at least flush_ms has elapsed since
+  // the previous send.
+  void Flush();
+  void SetFlushInterval(int flush_ms);
+  // interval over which derived statistics are computed.  0 publishes
+  // no derived metrics.  Must be called before sources are registered.
+  void SetAggregationInterval(int aggregate_ms);
+  // Samples of the metric at path are recorded whether or not a host
+  // has activated it, and the most recent seconds are sent to each
+  // new subscriber.  Must be called before sources are registered.
+  void RecordHistory(const std::string &path, int seconds);
+  static const int kDefaultHistoryResolutionMs = 100;
+  void SetHistoryResolution(int resolution_ms);
+  // the metric at path is published whether or not a host has
+  // activated it.  Must be called before sources are registered.
+  void KeepActive(const std::string &path);
+  // every sample and description received by the publisher is also
+  // delivered to recorder.  Must be called before sources are
+  // registered.
+  void SetRecorder(MetricSinkInterface *recorder);
   void Activate(int id);
   void Deactivate(int id);
+  void Match(const std::string &pattern, std::vector<int> *ids);
   void OnDescriptions(const std::vector<MetricDescription> &descriptions);
  private:
+  void PublishDescriptions();
+  // Records the activation of a raw or derived metric.  Returns true
+  // if the sources must begin publishing the raw metric, base.
+  bool ActivateLocked(int id, int *base);
+  // true if the sources may stop publishing the raw metric, base.
+  bool DeactivateLocked(int id, int *base);
+
   SubscriberInterface *m_subscriber;
+  MetricSinkInterface *m_recorder;
+  DataSet m_pending;
+  int m_flush_ms;
+  unsigned int m_last_flush_ms;
+  int m_aggregate_ms;
+  unsigned int m_last_aggregate_ms;
+  MetricAggregator m_aggregator;
+  // raw metrics activated by hosts
+  std::set<int> m_raw_active;
+  // for each raw metric, the number of activated raw and derived
+  // metrics which it provides.
+  std::map<int, int> m_source_activations;
+  MetricHistory m_history;
+  // seconds of history to record, by metric path
+  std::map<std::string, int> m_history_paths;
+  // paths of metrics which remain active without a host
+  std::set<std::string> m_kept_paths;
+  // ids of metrics which remain active for the life of the publisher
+  std::set<int> m_kept_active;
+  // kept metrics which the sources have not yet been asked to
+  // publish.  Activated by Flush, as descriptions arrive while
+  // sources hold their locks.
+  std::vector<int> m_kept_inactive;
   typedef std::map <int, MetricDescription*> MetricDescriptionMap;
   MetricDescriptionMap m_descriptions_by_metric_id;
   std::vector<MetricSourceInterface *> m_sources;
+
+  // metrics are published by the publisher thread, while
+  // descriptions and subscriptions arrive on the render and
+  // skeleton threads.
+  Mutex m_protect;
 };
 
 }  // namespace Grafips
@@ -27,125 +27,425 @@
 
 #include "remote/gfpublisher_skel.h"
 
-#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
-#include <google/protobuf/io/coded_stream.h>
+#include <assert.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <string.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <vector>
 
+#include "./gfcontrol.pb.h"
 #include "./gfpublisher.pb.h"
+#include "controls/gfcontrol.h"
+#include "controls/gfcontrol_stub.h"
 #include "error/gferror.h"
 #include "error/gflog.h"
 #include "os/gfsocket.h"
 #include "remote/gfipublisher.h"
+#include "remote/gfmetric.h"
+#include "remote/gfsession.h"
+#include "remote/gfsubscriber_fanout.h"
 #include "remote/gfsubscriber_stub.h"
 
-using Grafips::Error;
-using Grafips::NoError;
+using Grafips::ControlSubscriberStub;
+using Grafips::DropPolicy;
 using Grafips::PublisherSkeleton;
-using Grafips::Raise;
-using Grafips::WARN;
-using Grafips::kSocketWriteFail;
+using Grafips::ScopedLock;
+using Grafips::ServerSocket;
+using Grafips::SessionWriter;
+using Grafips::SubscriberFanout;
+using Grafips::SubscriberStub;
 
-PublisherSkeleton::PublisherSkeleton(int port, PublisherInterface *target)
-    : Thread("PublisherSkeleton"), m_server(new ServerSocket(port)),
-      m_socket(NULL), m_target(target), m_subscriber(NULL) {
+namespace {
+// default send queue for each host
+const size_t kQueueBytes = 1024 * 1024;
+// while a host is behind, queued messages are retried at this
+// interval.  Not every transport can signal that it is writable.
+const int kRetryMs = 2;
+}  // namespace
+
+PublisherSkeleton::PublisherSkeleton(int port, PublisherInterface *target,
+                                     ControlRouterTarget *controls)
+    : PublisherSkeleton(new ServerSocket(port, kBacklog), target, controls) {
+}
+
+PublisherSkeleton::PublisherSkeleton(ServerSocket *server,
+                                     PublisherInterface *target,
+                                     ControlRouterTarget *controls)
+    : Thread("PublisherSkeleton"),
+      m_server(server),
+      m_target(target), m_controls(controls),
+      m_fanout(new SubscriberFanout),
+      m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+      m_stop_fd(eventfd(0, EFD_CLOEXEC)),
+      m_queue_bytes(kQueueBytes), m_drop_policy(kDropOldest),
+      m_wake_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      m_session_count(0), m_setup_ns(0) {
+  assert(m_epoll_fd != -1);
+  assert(m_stop_fd != -1);
+  assert(m_wake_fd != -1);
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = m_server->Fd();
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_server->Fd(), &ev);
+  ev.data.fd = m_stop_fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_stop_fd, &ev);
+  ev.data.fd = m_wake_fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &ev);
 }
 
 PublisherSkeleton::~PublisherSkeleton() {
-  if (m_socket)
-    delete m_socket;
-  if (m_server)
-    delete m_server;
-  if (m_subscriber)
-    delete m_subscriber;
+  while (!m_connections.empty())
+    CloseConnection(m_connections.begin()->first);
+  delete m_fanout;
+  delete m_server;
+  close(m_wake_fd);
+  close(m_stop_fd);
+  close(m_epoll_fd);
+}
+
+void
+PublisherSkeleton::SetSendQueue(size_t max_bytes, DropPolicy policy) {
+  m_queue_bytes = max_bytes;
+  m_drop_policy = policy;
+}
+
+void
+PublisherSkeleton::Stop() {
+  const uint64_t val = 1;
+  const ssize_t result = write(m_stop_fd, &val, sizeof(val));
+  assert(result == sizeof(val));
+  (void) result;
 }
 
 void
 PublisherSkeleton::Run() {
-  m_socket = m_server->Accept();
-  delete m_server;
-  m_server = NULL;
+  static const int kMaxEvents = 16;
+  struct epoll_event events[kMaxEvents];
+  while (true) {
+    int timeout = -1;
+    {
+      ScopedLock l(&m_blocked_protect);
+      if (!m_blocked.empty())
+        timeout = kRetryMs;
+    }
+    const int count = epoll_wait(m_epoll_fd, events, kMaxEvents, timeout);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      GFLOGF("PublisherSkeleton epoll_wait failed: %s", strerror(errno));
+      return;
+    }
+    for (int i = 0; i < count; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == m_stop_fd)
+        return;
+      if (fd == m_wake_fd) {
+        uint64_t val;
+        const ssize_t result = read(m_wake_fd, &val, sizeof(val));
+        (void) result;
+        continue;
+      }
+      if (fd == m_server->Fd()) {
+        Accept();
+        continue;
+      }
+      ConnectionMap::iterator c = m_connections.find(fd);
+      if (c == m_connections.end())
+        continue;
+      if (!OnReadable(&c->second))
+        CloseConnection(fd);
+    }
+    DrainBlocked();
+  }
+}
+
+void
+PublisherSkeleton::DrainBlocked() {
+  // Writers are only destroyed on this thread, so the copy remains
+  // valid.  Drain() calls OnDrained(), which takes m_blocked_protect.
+  std::vector<SessionWriter *> blocked;
+  {
+    ScopedLock l(&m_blocked_protect);
+    blocked.assign(m_blocked.begin(), m_blocked.end());
+  }
+  for (std::vector<SessionWriter *>::iterator i = blocked.begin();
+       i != blocked.end(); ++i)
+    // a closed host is detected when its connection is read
+    (*i)->Drain();
+}
+
+void
+PublisherSkeleton::OnBlocked(SessionWriter *writer) {
+  ScopedLock l(&m_blocked_protect);
+  const bool was_empty = m_blocked.empty();
+  m_blocked.insert(writer);
+  if (was_empty) {
+    // interrupt epoll_wait, to begin retrying
+    const uint64_t val = 1;
+    const ssize_t result = write(m_wake_fd, &val, sizeof(val));
+    (void) result;
+  }
+}
+
+void
+PublisherSkeleton::OnDrained(SessionWriter *writer) {
+  ScopedLock l(&m_blocked_protect);
+  m_blocked.erase(writer);
+}
+
+void
+PublisherSkeleton::Accept() {
+  Socket *s = m_server->Accept();
+  if (s == NULL) {
+    GFLOG("PublisherSkeleton failed to accept host");
+    return;
+  }
+  const int fd = s->Fd();
+  Connection &c = m_connections[fd];
+  c.socket = s;
+  c.writer = new SessionWriter(s);
+  c.writer->EnableSendQueue(m_queue_bytes, m_drop_policy, this);
+  c.accept_ns = get_ns_time();
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  GFLOGF("PublisherSkeleton accepted host: %s", s->Address().c_str());
+}
+
+bool
+PublisherSkeleton::OnReadable(Connection *c) {
+  unsigned char chunk[4096];
+  const int bytes = c->socket->ReadSome(chunk, sizeof(chunk));
+  if (bytes <= 0) {
+    // host is closed, stop processing
+    return false;
+  }
+  c->buf.insert(c->buf.end(), chunk, chunk + bytes);
 
-  std::vector<unsigned char> buf;
-  bool running = true;
-  while (running) {
+  // dispatch each complete message
+  size_t offset = 0;
+  while (c->buf.size() - offset >= sizeof(uint32_t)) {
     uint32_t msg_len;
-    if (!m_socket->Read(&msg_len)) {
-      // host is closed, stop processing
-      break;
-    }
-    // std::cout << "read len: " << msg_len << std::endl;
-    buf.resize(msg_len);
-    if (!m_socket->ReadVec(&buf)) {
-      // host is closed, stop processing
+    memcpy(&msg_len, c->buf.data() + offset, sizeof(msg_len));
+    if (c->buf.size() - offset - sizeof(msg_len) < msg_len)
       break;
+    const unsigned char *msg = c->buf.data() + offset + sizeof(msg_len);
+    offset += sizeof(msg_len) + msg_len;
+
+    int channel = kPublisherChannel;
+    if (c->writer->Multiplexed()) {
+      if (msg_len == 0)
+        return false;
+      channel = *msg++;
+      --msg_len;
     }
 
-    // for (int i = 0; i < msg_len; ++i)
-    // std::cout << " " << (int) buf[i] << " ";
-    // std::cout << std::endl;
-
-    const size_t buf_size = buf.size();
-    google::protobuf::io::ArrayInputStream array_in(buf.data(), buf_size);
-    google::protobuf::io::CodedInputStream coded_in(&array_in);
-
-    GrafipsProto::PublisherInvocation m;
-    using google::protobuf::io::CodedInputStream;
-    // typedef google::protobuf::io::CodedInputStream::Limit Limit;
-    CodedInputStream::Limit msg_limit = coded_in.PushLimit(buf_size);
-    m.ParseFromCodedStream(&coded_in);
-    coded_in.PopLimit(msg_limit);
-
-    using GrafipsProto::PublisherInvocation;
-    switch (m.method()) {
-      case PublisherInvocation::kFlush: {
-        if (!m_socket->Write((uint32_t)0)) {
-          // host is closed, stop processing
-          running = false;
-        }
+    switch (channel) {
+      case kPublisherChannel: {
+        GrafipsProto::PublisherInvocation m;
+        m.ParseFromArray(msg, msg_len);
+        if (!OnMessage(c, m))
+          return false;
         break;
       }
-      case PublisherInvocation::kActivate: {
-        typedef GrafipsProto::PublisherInvocation_Activate Activate;
-        const Activate& args= m.activateargs();
-        m_target->Activate(args.id());
+      case kControlChannel: {
+        GrafipsControlProto::ControlInvocation m;
+        m.ParseFromArray(msg, msg_len);
+        if (!OnControlMessage(c, m))
+          return false;
         break;
       }
-      case PublisherInvocation::kDeactivate: {
-        typedef GrafipsProto::PublisherInvocation_Deactivate Deactivate;
-        const Deactivate& args= m.deactivateargs();
-        m_target->Deactivate(args.id());
+      default:
+        // flush responses from the host need no action
         break;
+    }
+  }
+  c->buf.erase(c->buf.begin(), c->buf.begin() + offset);
+  return true;
+}
+
+bool
+PublisherSkeleton::OnMessage(Connection *c,
+                             const GrafipsProto::PublisherInvocation &m) {
+  using GrafipsProto::PublisherInvocation;
+  switch (m.method()) {
+    case PublisherInvocation::kFlush: {
+      // host is closed, stop processing
+      return c->writer->WriteFlushResponse(kPublisherChannel);
+    }
+    case PublisherInvocation::kActivate: {
+      typedef GrafipsProto::PublisherInvocation_Activate Activate;
+      const Activate& args= m.activateargs();
+      if (!args.has_pattern()) {
+        OnActivate(c, args.id());
+        return true;
       }
-      case PublisherInvocation::kSubscribe: {
-        assert(m_subscriber == NULL);
-        typedef GrafipsProto::PublisherInvocation_Subscribe Subscribe;
-        const Subscribe& args = m.subscribeargs();
-        m_subscriber = new SubscriberStub(m_socket->Address(), args.port());
-        m_target->Subscribe(m_subscriber);
-        break;
+      std::vector<int> ids;
+      m_target->Match(args.pattern(), &ids);
+      for (unsigned int i = 0; i < ids.size(); ++i)
+        OnActivate(c, ids[i]);
+      return true;
+    }
+    case PublisherInvocation::kDeactivate: {
+      typedef GrafipsProto::PublisherInvocation_Deactivate Deactivate;
+      const Deactivate& args= m.deactivateargs();
+      if (!args.has_pattern()) {
+        OnDeactivate(c, args.id());
+        return true;
       }
-      default: {
-        assert(false);
-        running = false;
-        break;
+      std::vector<int> ids;
+      m_target->Match(args.pattern(), &ids);
+      for (unsigned int i = 0; i < ids.size(); ++i)
+        OnDeactivate(c, ids[i]);
+      return true;
+    }
+    case PublisherInvocation::kSubscribe: {
+      if (c->subscriber != NULL)
+        return false;
+      typedef GrafipsProto::PublisherInvocation_Subscribe Subscribe;
+      const Subscribe& args = m.subscribeargs();
+      const int latest = kProtocolVersionLatest;
+      const int version = std::max(static_cast<int>(kProtocolVersion1),
+                                   std::min(args.protocol_version(), latest));
+      if (args.multiplexed()) {
+        c->writer->SetMultiplexed(true);
+        c->subscriber = new SubscriberStub(c->writer, version);
+      } else {
+        c->subscriber = new SubscriberStub(c->socket->Address(), args.port(),
+                                           version);
+        c->subscriber->EnableSendQueue(m_queue_bytes, m_drop_policy, this);
       }
+      m_setup_ns = get_ns_time() - c->accept_ns;
+      ++m_session_count;
+      m_fanout->AddSubscriber(c->subscriber);
+      for (std::set<int>::const_iterator i = c->active.begin();
+           i != c->active.end(); ++i)
+        m_fanout->SetActive(c->subscriber, *i, true);
+      // publishes descriptions to the new subscriber
+      m_target->Subscribe(m_fanout);
+      return true;
     }
+    default: {
+      assert(false);
+      return false;
+    }
+  }
+}
+
+bool
+PublisherSkeleton::OnControlMessage(
+    Connection *c, const GrafipsControlProto::ControlInvocation &m) {
+  using GrafipsControlProto::ControlInvocation;
+  if (!m_controls)
+    return false;
+  switch (m.method()) {
+    case ControlInvocation::kSet: {
+      const ControlInvocation::Set& args = m.setargs();
+      m_controls->Set(args.key(), args.value());
+      return true;
+    }
+    case ControlInvocation::kSubscribe: {
+      if (c->control_subscriber != NULL)
+        return false;
+      c->control_subscriber = new ControlSubscriberStub(c->writer);
+      m_controls->Subscribe(c->control_subscriber);
+      return true;
+    }
+    case ControlInvocation::kFlush: {
+      // host is closed, stop processing
+      return c->writer->WriteFlushResponse(kControlChannel);
+    }
+    default: {
+      assert(false);
+      return false;
+    }
+  }
+}
+
+void
+PublisherSkeleton::OnActivate(Connection *c, int id) {
+  if (!c->active.insert(id).second)
+    return;
+  if (c->subscriber)
+    m_fanout->SetActive(c->subscriber, id, true);
+  if (m_activation_count[id]++ == 0)
+    m_target->Activate(id);
+}
+
+void
+PublisherSkeleton::OnDeactivate(Connection *c, int id) {
+  if (!c->active.erase(id))
+    return;
+  if (c->subscriber) {
+    m_fanout->SetActive(c->subscriber, id, false);
+    c->subscriber->Clear(id);
+  }
+  if (--m_activation_count[id] == 0) {
+    m_activation_count.erase(id);
+    m_target->Deactivate(id);
   }
+}
 
-  // clean up subscriber stub
-  if (m_subscriber) {
-    m_subscriber->Close();
+void
+PublisherSkeleton::CloseConnection(int fd) {
+  ConnectionMap::iterator i = m_connections.find(fd);
+  if (i == m_connections.end())
+    return;
+  Connection &c = i->second;
+  // metrics used only by this host are no longer sampled
+  for (std::set<int>::const_iterator id = c.active.begin();
+       id != c.active.end(); ++id) {
+    if (--m_activation_count[*id] == 0) {
+      m_activation_count.erase(*id);
+      m_target->Deactivate(*id);
+    }
   }
+  if (c.subscriber) {
+    m_fanout->RemoveSubscriber(c.subscriber);
+    c.subscriber->Close();
+    delete c.subscriber;
+    --m_session_count;
+  }
+  if (c.control_subscriber) {
+    m_controls->Unsubscribe(c.control_subscriber);
+    delete c.control_subscriber;
+  }
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  GFLOGF("PublisherSkeleton closed host: %s", c.socket->Address().c_str());
+  delete c.writer;
+  delete c.socket;
+  m_connections.erase(i);
 }
 
 void
 PublisherSkeleton::Flush() const {
-  if (m_subscriber)
-    m_subscriber->Flush();
+  m_fanout->Flush();
 }
 
 int
 PublisherSkeleton::GetPort() const {
   return m_server->GetPort();
 }
+
+void
+PublisherSkeleton::SessionStats(int *sessions, float *setup_ms) const {
+  *sessions = m_session_count;
+  *setup_ms = m_setup_ns / 1000000.0;
+}
+
+void
+PublisherSkeleton::TransportCounts(uint64_t *messages,
+                                   uint64_t *syscalls) const {
+  m_fanout->TransportCounts(messages, syscalls);
+}
+
+uint64_t
+PublisherSkeleton::DroppedSamples() const {
+  return m_fanout->DroppedSamples();
+}
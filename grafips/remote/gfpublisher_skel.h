@@ -28,34 +28,126 @@
 #ifndef REMOTE_GFPUBLISHER_SKEL_H_
 #define REMOTE_GFPUBLISHER_SKEL_H_
 
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "os/gfmutex.h"
 #include "os/gfthread.h"
+#include "remote/gfsession.h"
+#include "remote/gfsend_queue.h"
 
 namespace GrafipsProto {
 class PublisherInvocation;
 }
 
+namespace GrafipsControlProto {
+class ControlInvocation;
+}
+
 namespace Grafips {
+class ControlRouterTarget;
+class ControlSubscriberStub;
 class ServerSocket;
 class Socket;
 class PublisherInterface;
+class SubscriberFanout;
 class SubscriberStub;
 
-class PublisherSkeleton : public Thread {
+// Serves any number of hosts from a single event loop thread.  Each
+// host activates its own set of metrics.  The publisher samples the
+// union of the sets, and the SubscriberFanout delivers each host's
+// subset.  Hosts may disconnect and reconnect at any time.
+//
+// Hosts which request a multiplexed session also send control
+// requests on the same connection, which are delivered to controls.
+//
+// Writes to hosts never block the publisher.  Each host has a bounded
+// send queue, which the event loop drains as the host reads.
+class PublisherSkeleton : public Thread, public SessionWriterListener {
  public:
-  PublisherSkeleton(int port, PublisherInterface *target);
+  PublisherSkeleton(int port, PublisherInterface *target,
+                    ControlRouterTarget *controls = NULL);
+  // hosts which have connected, but not yet been accepted
+  static const int kBacklog = 16;
+
+  // listens on server, which may be any transport (see gftransport.h).
+  // Takes ownership of server.
+  PublisherSkeleton(ServerSocket *server, PublisherInterface *target,
+                    ControlRouterTarget *controls = NULL);
   ~PublisherSkeleton();
+  // size and overflow policy of the send queue for each host that
+  // connects after the call
+  void SetSendQueue(size_t max_bytes, DropPolicy policy);
+  // causes Run() to return
   void Stop();
   void Run();
   void Flush() const;
   int GetPort() const;
+  // see SubscriberStub::TransportCounts
+  void TransportCounts(uint64_t *messages, uint64_t *syscalls) const;
+  // number of subscribed hosts, and the time in ms from accepting the
+  // most recent host to being ready to publish to it.
+  void SessionStats(int *sessions, float *setup_ms) const;
+  // see SubscriberFanout::DroppedSamples
+  uint64_t DroppedSamples() const;
+
+  // SessionWriterListener, called by any thread
+  void OnBlocked(SessionWriter *writer);
+  void OnDrained(SessionWriter *writer);
+
  private:
+  struct Connection {
+    Connection() : socket(NULL), writer(NULL), accept_ns(0),
+                   subscriber(NULL), control_subscriber(NULL) {}
+    Socket *socket;
+    SessionWriter *writer;
+    uint64_t accept_ns;
+    // partially received messages
+    std::vector<unsigned char> buf;
+    // on Subscribe(), this member is created to send publications
+    // remotely
+    SubscriberStub *subscriber;
+    ControlSubscriberStub *control_subscriber;
+    std::set<int> active;
+  };
+  typedef std::map<int, Connection> ConnectionMap;
+
+  void Accept();
+  // returns false if the connection should be closed
+  bool OnReadable(Connection *c);
+  bool OnMessage(Connection *c, const GrafipsProto::PublisherInvocation &m);
+  bool OnControlMessage(Connection *c,
+                        const GrafipsControlProto::ControlInvocation &m);
+  void OnActivate(Connection *c, int id);
+  void OnDeactivate(Connection *c, int id);
+  void CloseConnection(int fd);
+  // writes queued messages to hosts that are behind
+  void DrainBlocked();
+
   ServerSocket *m_server;
-  Socket *m_socket;
   PublisherInterface *m_target;
-  bool m_running;
+  ControlRouterTarget *m_controls;
+  SubscriberFanout *m_fanout;
+  ConnectionMap m_connections;
+  // number of connections that have activated each metric
+  std::map<int, int> m_activation_count;
+  int m_epoll_fd, m_stop_fd;
+
+  size_t m_queue_bytes;
+  DropPolicy m_drop_policy;
+  // writers with queued messages.  m_wake_fd is signaled when the set
+  // becomes non-empty.
+  std::set<SessionWriter *> m_blocked;
+  Mutex m_blocked_protect;
+  int m_wake_fd;
 
-  // on Subscribe(), this member is created to send publications remotely
-  SubscriberStub *m_subscriber;
+  // read by the publisher thread
+  std::atomic<int> m_session_count;
+  std::atomic<uint64_t> m_setup_ns;
 };
 }  // namespace Grafips
 
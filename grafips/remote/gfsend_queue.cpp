@@ -0,0 +1,188 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfsend_queue.h"
+
+#include <string.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <vector>
+
+using Grafips::DropPolicy;
+using Grafips::SendQueue;
+
+namespace {
+// bounds the bookkeeping for many small messages
+const size_t kMaxMessages = 1024;
+// largest stride for kDownsample
+const unsigned int kMaxStride = 64;
+}  // namespace
+
+bool
+Grafips::ParseDropPolicy(const char *name, DropPolicy *policy) {
+  if (strcmp(name, "oldest") == 0)
+    *policy = kDropOldest;
+  else if (strcmp(name, "newest") == 0)
+    *policy = kDropNewest;
+  else if (strcmp(name, "downsample") == 0)
+    *policy = kDownsample;
+  else
+    return false;
+  return true;
+}
+
+SendQueue::SendQueue(size_t max_bytes, DropPolicy policy)
+    : m_messages(kMaxMessages), m_first(0), m_count(0), m_bytes(0),
+      m_sent(0), m_max_bytes(max_bytes), m_policy(policy), m_stride(1),
+      m_sequence(0), m_dropped(0) {
+  // typical metric batches fit without reallocation
+  const size_t reserve = std::min<size_t>(max_bytes / kMaxMessages, 4096);
+  for (std::vector<Message>::iterator i = m_messages.begin();
+       i != m_messages.end(); ++i)
+    i->data.reserve(reserve);
+}
+
+bool
+SendQueue::Fits(size_t bytes) const {
+  if (m_count == m_messages.size())
+    return false;
+  // a message larger than the queue is accepted when the queue is
+  // empty, so that a small queue cannot block all publication.
+  return m_count == 0 || m_bytes + bytes <= m_max_bytes;
+}
+
+void
+SendQueue::Drop(size_t i) {
+  m_dropped += At(i).samples;
+  m_bytes -= At(i).data.size();
+  // shift later messages forward.  Swapping keeps each slot's storage.
+  for (size_t j = i; j + 1 < m_count; ++j) {
+    At(j).data.swap(At(j + 1).data);
+    At(j).samples = At(j + 1).samples;
+  }
+  --m_count;
+}
+
+void
+SendQueue::DropOldest(size_t bytes) {
+  size_t i = FirstDroppable();
+  while (!Fits(bytes) && i < m_count) {
+    if (At(i).samples)
+      Drop(i);
+    else
+      ++i;
+  }
+}
+
+void
+SendQueue::Thin() {
+  bool drop = false;
+  size_t i = FirstDroppable();
+  while (i < m_count) {
+    if (At(i).samples) {
+      if (drop) {
+        Drop(i);
+        drop = false;
+        continue;
+      }
+      drop = true;
+    }
+    ++i;
+  }
+}
+
+bool
+SendQueue::Push(const void *header, int header_size,
+                const void *buf, int size, int samples) {
+  const size_t bytes = header_size + size;
+  if (samples) {
+    if (m_policy == kDownsample && (m_sequence++ % m_stride) != 0) {
+      m_dropped += samples;
+      return true;
+    }
+    if (!Fits(bytes)) {
+      switch (m_policy) {
+        case kDropOldest:
+          DropOldest(bytes);
+          break;
+        case kDropNewest:
+          break;
+        case kDownsample:
+          Thin();
+          m_stride = std::min(m_stride * 2, kMaxStride);
+          break;
+      }
+    }
+    if (!Fits(bytes)) {
+      m_dropped += samples;
+      return true;
+    }
+  } else {
+    // metric messages are dropped to make room for anything else
+    DropOldest(bytes);
+    if (!Fits(bytes))
+      return false;
+  }
+
+  Message &m = At(m_count);
+  const unsigned char *h = reinterpret_cast<const unsigned char *>(header);
+  const unsigned char *b = reinterpret_cast<const unsigned char *>(buf);
+  m.data.assign(h, h + header_size);
+  m.data.insert(m.data.end(), b, b + size);
+  m.samples = samples;
+  m_bytes += bytes;
+  ++m_count;
+  return true;
+}
+
+int
+SendQueue::Front(struct iovec *iov, int max_count) const {
+  int count = 0;
+  for (size_t i = 0; i < m_count && count < max_count; ++i, ++count) {
+    const Message &m = At(i);
+    const size_t offset = (i == 0) ? m_sent : 0;
+    iov[count].iov_base = const_cast<unsigned char *>(m.data.data()) + offset;
+    iov[count].iov_len = m.data.size() - offset;
+  }
+  return count;
+}
+
+void
+SendQueue::Pop(size_t bytes) {
+  m_sent += bytes;
+  while (m_count && m_sent >= At(0).data.size()) {
+    const size_t size = At(0).data.size();
+    m_sent -= size;
+    m_bytes -= size;
+    m_first = (m_first + 1) % m_messages.size();
+    --m_count;
+  }
+  // the subscriber has caught up
+  if (m_bytes < m_max_bytes / 4)
+    m_stride = 1;
+}
@@ -0,0 +1,117 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFSEND_QUEUE_H_
+#define REMOTE_GFSEND_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "os/gftraits.h"
+
+struct iovec;
+
+namespace Grafips {
+
+// What to do with metric messages when a subscriber's queue is full.
+enum DropPolicy {
+  // discard queued metric messages, oldest first, to make room
+  kDropOldest,
+  // discard the message being queued
+  kDropNewest,
+  // discard every other queued metric message, and then queue only one
+  // of every N new ones until the subscriber catches up.  The host
+  // still sees the whole interval, at reduced resolution.
+  kDownsample
+};
+
+// Parses "oldest", "newest" or "downsample".
+bool ParseDropPolicy(const char *name, DropPolicy *policy);
+
+// Messages waiting to be written to a subscriber that is not keeping
+// up.  Storage is allocated when the queue is created, and is bounded
+// in bytes and in messages.
+//
+// Messages carrying samples may be dropped.  Other messages
+// (descriptions, flush responses, control changes) are always kept,
+// and fail the queue if they do not fit.  Not thread safe.
+class SendQueue : NoCopy, NoAssign, NoMove {
+ public:
+  SendQueue(size_t max_bytes, DropPolicy policy);
+
+  // samples is the number of data points in the message, or 0 if the
+  // message must be delivered.  Returns false if a message that must
+  // be delivered does not fit.
+  bool Push(const void *header, int header_size,
+            const void *buf, int size, int samples);
+  bool Empty() const { return m_count == 0; }
+  // Fills iov with the unwritten bytes of the oldest messages.
+  // Returns the number of entries used.
+  int Front(struct iovec *iov, int max_count) const;
+  // bytes at the front of the queue were written
+  void Pop(size_t bytes);
+
+  size_t Bytes() const { return m_bytes; }
+  uint64_t DroppedSamples() const { return m_dropped; }
+
+ private:
+  struct Message {
+    std::vector<unsigned char> data;
+    int samples;
+  };
+  Message &At(size_t i) {
+    return m_messages[(m_first + i) % m_messages.size()];
+  }
+  const Message &At(size_t i) const {
+    return m_messages[(m_first + i) % m_messages.size()];
+  }
+  bool Fits(size_t bytes) const;
+  // removes the i'th queued message, counting its samples as dropped
+  void Drop(size_t i);
+  // drops queued metric messages, oldest first, until bytes fit
+  void DropOldest(size_t bytes);
+  // drops every other queued metric message
+  void Thin();
+  // the first message which may be dropped: not partially written
+  size_t FirstDroppable() const { return m_sent ? 1 : 0; }
+
+  std::vector<Message> m_messages;
+  size_t m_first, m_count, m_bytes;
+  // bytes of the first message that have been written
+  size_t m_sent;
+  const size_t m_max_bytes;
+  const DropPolicy m_policy;
+  // when downsampling, one of every m_stride metric messages is queued
+  unsigned int m_stride, m_sequence;
+  uint64_t m_dropped;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFSEND_QUEUE_H_
@@ -0,0 +1,206 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfsession.h"
+
+#include <string.h>
+#include <sys/uio.h>
+
+#include <vector>
+
+#include "os/gfsocket.h"
+
+using Grafips::DropPolicy;
+using Grafips::ScopedLock;
+using Grafips::SendQueue;
+using Grafips::SessionWriter;
+using Grafips::SessionWriterListener;
+
+namespace {
+// queued messages written by a single system call
+const int kMaxIov = 64;
+}  // namespace
+
+SessionWriter::SessionWriter(Socket *socket)
+    : m_socket(socket), m_multiplexed(false), m_queue(NULL),
+      m_listener(NULL), m_blocked(false), m_failed(false) {
+}
+
+SessionWriter::~SessionWriter() {
+  ScopedLock s(&m_protect);
+  if (m_blocked && m_listener)
+    m_listener->OnDrained(this);
+  delete m_queue;
+}
+
+void
+SessionWriter::EnableSendQueue(size_t max_bytes, DropPolicy policy,
+                               SessionWriterListener *listener) {
+  ScopedLock s(&m_protect);
+  if (m_queue)
+    return;
+  m_queue = new SendQueue(max_bytes, policy);
+  m_listener = listener;
+}
+
+void
+SessionWriter::SetMultiplexed(bool multiplexed) {
+  ScopedLock s(&m_protect);
+  m_multiplexed = multiplexed;
+}
+
+bool
+SessionWriter::Multiplexed() const {
+  ScopedLock s(&m_protect);
+  return m_multiplexed;
+}
+
+bool
+SessionWriter::Write(SessionChannel channel,
+                     const std::vector<unsigned char> &buf, int samples) {
+  unsigned char header[sizeof(uint32_t) + 1];
+  ScopedLock s(&m_protect);
+  uint32_t size = buf.size();
+  int header_size = sizeof(size);
+  if (m_multiplexed) {
+    ++size;
+    header[header_size++] = channel;
+  }
+  memcpy(header, &size, sizeof(size));
+  return WriteLocked(header, header_size, buf.data(), buf.size(), samples);
+}
+
+bool
+SessionWriter::WriteFlushResponse(SessionChannel channel) {
+  const uint32_t response = 0;
+  ScopedLock s(&m_protect);
+  if (!m_multiplexed)
+    return WriteLocked(NULL, 0, &response, sizeof(response), 0);
+  unsigned char header[sizeof(uint32_t) + 1];
+  const uint32_t size = sizeof(response) + 1;
+  memcpy(header, &size, sizeof(size));
+  header[sizeof(size)] = channel;
+  return WriteLocked(header, sizeof(header), &response, sizeof(response), 0);
+}
+
+bool
+SessionWriter::WriteLocked(const void *header, int header_size,
+                           const void *buf, int size, int samples) {
+  if (!m_queue)
+    return m_socket->Write(header, header_size, buf, size);
+  if (m_failed || !DrainLocked())
+    return false;
+
+  if (m_queue->Empty()) {
+    // usually the socket accepts the whole message, and it is not
+    // copied.
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<void *>(header);
+    iov[0].iov_len = header_size;
+    iov[1].iov_base = const_cast<void *>(buf);
+    iov[1].iov_len = size;
+    const int written = m_socket->WriteSome(iov, 2);
+    if (written < 0) {
+      m_failed = true;
+      return false;
+    }
+    if (written == header_size + size)
+      return true;
+    // the remainder of a partially written message must be delivered
+    if (written == 0) {
+      m_queue->Push(header, header_size, buf, size, samples);
+    } else if (written < header_size) {
+      m_queue->Push(reinterpret_cast<const char *>(header) + written,
+                    header_size - written, buf, size, 0);
+    } else {
+      const int offset = written - header_size;
+      m_queue->Push(NULL, 0, reinterpret_cast<const char *>(buf) + offset,
+                    size - offset, 0);
+    }
+  } else if (!m_queue->Push(header, header_size, buf, size, samples)) {
+    // the host is not reading even the messages that cannot be dropped
+    m_failed = true;
+    return false;
+  }
+
+  if (!m_blocked) {
+    m_blocked = true;
+    if (m_listener)
+      m_listener->OnBlocked(this);
+  }
+  return true;
+}
+
+bool
+SessionWriter::Drain() {
+  ScopedLock s(&m_protect);
+  if (!m_queue)
+    return true;
+  if (m_failed)
+    return false;
+  return DrainLocked();
+}
+
+bool
+SessionWriter::DrainLocked() {
+  struct iovec iov[kMaxIov];
+  while (!m_queue->Empty()) {
+    const int count = m_queue->Front(iov, kMaxIov);
+    const int written = m_socket->WriteSome(iov, count);
+    if (written < 0) {
+      m_failed = true;
+      return false;
+    }
+    if (written == 0)
+      return true;
+    m_queue->Pop(written);
+  }
+  if (m_blocked) {
+    m_blocked = false;
+    if (m_listener)
+      m_listener->OnDrained(this);
+  }
+  return true;
+}
+
+bool
+SessionWriter::Pending() const {
+  ScopedLock s(&m_protect);
+  return m_queue && !m_queue->Empty();
+}
+
+uint64_t
+SessionWriter::SendCount() const {
+  ScopedLock s(&m_protect);
+  return m_socket->SendCount();
+}
+
+uint64_t
+SessionWriter::DroppedSamples() const {
+  ScopedLock s(&m_protect);
+  return m_queue ? m_queue->DroppedSamples() : 0;
+}
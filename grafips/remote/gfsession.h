@@ -0,0 +1,124 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFSESSION_H_
+#define REMOTE_GFSESSION_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "os/gfmutex.h"
+#include "os/gftraits.h"
+#include "remote/gfsend_queue.h"
+
+namespace Grafips {
+class SessionWriter;
+class Socket;
+
+// A host that sets multiplexed in its Subscribe request uses a single
+// connection for the whole session.  Every subsequent message, in
+// either direction, is framed as:
+//
+//   uint32 size | uint8 channel | payload (size - 1 bytes)
+//
+// Hosts that do not set multiplexed use the legacy framing (uint32
+// size | payload), and receive publications and control changes on
+// connections that the target opens back to the host.
+enum SessionChannel {
+  // PublisherInvocation from the host, flush responses from the target
+  kPublisherChannel = 0,
+  // SubscriberInvocation from the target
+  kSubscriberChannel = 1,
+  // ControlInvocation from the host, flush responses from the target
+  kControlChannel = 2,
+  // ControlInvocation (OnControlChanged) from the target
+  kControlSubscriberChannel = 3
+};
+
+// Notified when a SessionWriter with a send queue has messages that
+// the socket would not accept.  Called with the writer's lock held.
+class SessionWriterListener {
+ public:
+  virtual ~SessionWriterListener() {}
+  // writer->Drain() must be called until the queue is empty
+  virtual void OnBlocked(SessionWriter *writer) = 0;
+  // the queue is empty, or the writer is being destroyed
+  virtual void OnDrained(SessionWriter *writer) = 0;
+};
+
+// Writes framed messages to a socket that is shared by several stubs,
+// possibly on different threads.  Does not take ownership of the
+// socket.
+//
+// By default, writes block until the socket accepts the message.
+// With a send queue, writes never block: messages the socket does not
+// accept are queued, and metric messages are dropped according to the
+// queue's policy if the host falls too far behind.
+class SessionWriter : NoCopy, NoAssign, NoMove {
+ public:
+  explicit SessionWriter(Socket *socket);
+  ~SessionWriter();
+  void EnableSendQueue(size_t max_bytes, DropPolicy policy,
+                       SessionWriterListener *listener);
+  void SetMultiplexed(bool multiplexed);
+  bool Multiplexed() const;
+  // false if the socket is closed.  samples is the number of data
+  // points in a metric message that may be dropped, or 0.
+  bool Write(SessionChannel channel, const std::vector<unsigned char> &buf,
+             int samples = 0);
+  // the response to a flush request is a zero uint32.
+  bool WriteFlushResponse(SessionChannel channel);
+  // writes queued messages without blocking.  false if the socket is
+  // closed.
+  bool Drain();
+  bool Pending() const;
+  // see Socket::SendCount
+  uint64_t SendCount() const;
+  // metric samples dropped by the send queue
+  uint64_t DroppedSamples() const;
+
+ private:
+  bool WriteLocked(const void *header, int header_size,
+                   const void *buf, int size, int samples);
+  bool DrainLocked();
+
+  Socket *m_socket;
+  bool m_multiplexed;
+  // NULL unless EnableSendQueue() was called
+  SendQueue *m_queue;
+  SessionWriterListener *m_listener;
+  // the listener has been told that the writer is blocked
+  bool m_blocked;
+  // the socket returned an error
+  bool m_failed;
+  mutable Mutex m_protect;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFSESSION_H_
@@ -0,0 +1,257 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "remote/gfsubscriber_fanout.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "./gfsubscriber.pb.h"
+#include "error/gferror.h"
+#include "error/gflog.h"
+#include "remote/gfsubscriber_stub.h"
+
+using Grafips::DataSet;
+using Grafips::ErrorHandler;
+using Grafips::ErrorInterface;
+using Grafips::MetricEncoder;
+using Grafips::ScopedLock;
+using Grafips::SubscriberFanout;
+using Grafips::SubscriberStub;
+using Grafips::kSocketWriteFail;
+
+namespace {
+// A subscriber that has gone away must not stop publication to the
+// others.
+class DetectFailedSubscriber : public ErrorHandler {
+ public:
+  DetectFailedSubscriber() : m_failed(false) {}
+  bool OnError(const ErrorInterface &e) {
+    if (e.Type() != kSocketWriteFail)
+      return false;
+    GFLOGF("SubscriberFanout: %s", e.ToString());
+    m_failed = true;
+    return true;
+  }
+  bool Failed() const { return m_failed; }
+ private:
+  bool m_failed;
+};
+}  // namespace
+
+typedef GrafipsProto::SubscriberInvocation GSubInv;
+
+SubscriberFanout::SubscriberFanout()
+    : m_v1_encoder(kProtocolVersion1), m_v2_encoder(kProtocolVersion2),
+      m_removed_messages(0), m_removed_syscalls(0), m_removed_dropped(0) {
+}
+
+SubscriberFanout::~SubscriberFanout() {
+}
+
+void
+SubscriberFanout::AddSubscriber(SubscriberStub *s) {
+  ScopedLock l(&m_protect);
+  m_subscriptions.push_back(Subscription(s));
+}
+
+void
+SubscriberFanout::RemoveSubscriber(SubscriberStub *s) {
+  ScopedLock l(&m_protect);
+  for (SubscriptionList::iterator i = m_subscriptions.begin();
+       i != m_subscriptions.end(); ++i) {
+    if (i->stub != s)
+      continue;
+    uint64_t messages, syscalls;
+    s->TransportCounts(&messages, &syscalls);
+    m_removed_messages += messages;
+    m_removed_syscalls += syscalls;
+    m_removed_dropped += s->DroppedSamples();
+    m_subscriptions.erase(i);
+    return;
+  }
+}
+
+void
+SubscriberFanout::SetActive(SubscriberStub *s, int id, bool active) {
+  ScopedLock l(&m_protect);
+  for (SubscriptionList::iterator i = m_subscriptions.begin();
+       i != m_subscriptions.end(); ++i) {
+    if (i->stub != s)
+      continue;
+    if (active)
+      i->active.insert(id);
+    else
+      i->active.erase(id);
+    return;
+  }
+}
+
+void
+SubscriberFanout::Encode(const DataSet &d, int version,
+                         std::vector<unsigned char> *buf,
+                         unsigned int *interned_base,
+                         unsigned int *interned_end) {
+  MetricEncoder *encoder = &m_v1_encoder;
+  if (version >= kProtocolVersion2)
+    encoder = &m_v2_encoder;
+  GSubInv m;
+  m.set_method(GSubInv::kOnMetric);
+  *interned_base = encoder->InternedCount();
+  encoder->Encode(d, m.mutable_onmetricargs());
+  *interned_end = encoder->InternedCount();
+  SubscriberStub::Serialize(m, buf);
+}
+
+void
+SubscriberFanout::Write(Subscription *s, const std::vector<unsigned char> &buf,
+                        int samples, unsigned int interned_base,
+                        unsigned int interned_end) {
+  DetectFailedSubscriber handler;
+  if (s->stub->Version() >= kProtocolVersion2 &&
+      s->interned < interned_base) {
+    // the subscriber did not receive some of the ids interned by
+    // batches that were filtered from it.
+    GSubInv m;
+    m.set_method(GSubInv::kOnMetric);
+    m_v2_encoder.EncodeInterned(s->interned, interned_base,
+                                m.mutable_onmetricargs());
+    std::vector<unsigned char> interned_buf;
+    SubscriberStub::Serialize(m, &interned_buf);
+    s->stub->WriteSerialized(interned_buf);
+  }
+  // a batch which interns ids must be delivered, or later batches
+  // could not be decoded.
+  if (interned_end > interned_base)
+    samples = 0;
+  if (!handler.Failed())
+    s->stub->WriteSerialized(buf, samples);
+  s->interned = std::max(s->interned, interned_end);
+  s->failed = handler.Failed();
+}
+
+void
+SubscriberFanout::OnMetric(const DataSet &d) {
+  ScopedLock l(&m_protect);
+  bool encoded[kProtocolVersionLatest + 1] = { false };
+  unsigned int interned_base[kProtocolVersionLatest + 1],
+      interned_end[kProtocolVersionLatest + 1];
+  DataSet filtered;
+  for (SubscriptionList::iterator s = m_subscriptions.begin();
+       s != m_subscriptions.end(); ++s) {
+    if (s->failed)
+      continue;
+    filtered.clear();
+    for (DataSet::const_iterator i = d.begin(); i != d.end(); ++i) {
+      if (s->active.count(i->id))
+        filtered.push_back(*i);
+    }
+    if (filtered.empty())
+      continue;
+
+    const int version = s->stub->Version();
+    if (filtered.size() != d.size()) {
+      unsigned int base, end;
+      Encode(filtered, version, &m_buf, &base, &end);
+      Write(&(*s), m_buf, filtered.size(), base, end);
+      continue;
+    }
+
+    if (!encoded[version]) {
+      Encode(d, version, &m_shared_buf[version],
+             &interned_base[version], &interned_end[version]);
+      encoded[version] = true;
+    }
+    Write(&(*s), m_shared_buf[version], d.size(), interned_base[version],
+          interned_end[version]);
+  }
+}
+
+void
+SubscriberFanout::OnDescriptions(const MetricDescriptionSet &descriptions) {
+  ScopedLock l(&m_protect);
+  SubscriberStub::SerializeDescriptions(descriptions, &m_buf);
+  for (SubscriptionList::iterator s = m_subscriptions.begin();
+       s != m_subscriptions.end(); ++s) {
+    if (s->failed)
+      continue;
+    DetectFailedSubscriber handler;
+    s->stub->WriteSerialized(m_buf);
+    s->failed = handler.Failed();
+  }
+}
+
+void
+SubscriberFanout::OnHistory(const DataSet &d) {
+  ScopedLock l(&m_protect);
+  for (SubscriptionList::iterator s = m_subscriptions.begin();
+       s != m_subscriptions.end(); ++s) {
+    if (s->replayed)
+      continue;
+    s->replayed = true;
+    if (s->failed || d.empty())
+      continue;
+    unsigned int base, end;
+    Encode(d, s->stub->Version(), &m_buf, &base, &end);
+    Write(&(*s), m_buf, d.size(), base, end);
+  }
+}
+
+void
+SubscriberFanout::Flush() const {
+  ScopedLock l(&m_protect);
+  for (SubscriptionList::const_iterator s = m_subscriptions.begin();
+       s != m_subscriptions.end(); ++s) {
+    if (!s->failed)
+      s->stub->Flush();
+  }
+}
+
+void
+SubscriberFanout::TransportCounts(uint64_t *messages,
+                                  uint64_t *syscalls) const {
+  ScopedLock l(&m_protect);
+  *messages = m_removed_messages;
+  *syscalls = m_removed_syscalls;
+  for (SubscriptionList::const_iterator s = m_subscriptions.begin();
+       s != m_subscriptions.end(); ++s) {
+    uint64_t m, c;
+    s->stub->TransportCounts(&m, &c);
+    *messages += m;
+    *syscalls += c;
+  }
+}
+
+uint64_t
+SubscriberFanout::DroppedSamples() const {
+  ScopedLock l(&m_protect);
+  uint64_t dropped = m_removed_dropped;
+  for (SubscriptionList::const_iterator s = m_subscriptions.begin();
+       s != m_subscriptions.end(); ++s)
+    dropped += s->stub->DroppedSamples();
+  return dropped;
+}
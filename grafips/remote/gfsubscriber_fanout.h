@@ -0,0 +1,105 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef REMOTE_GFSUBSCRIBER_FANOUT_H_
+#define REMOTE_GFSUBSCRIBER_FANOUT_H_
+
+#include <stdint.h>
+
+#include <set>
+#include <vector>
+
+#include "remote/gfisubscriber.h"
+#include "remote/gfmetric_codec.h"
+#include "os/gftraits.h"
+#include "os/gfmutex.h"
+
+namespace Grafips {
+class SubscriberStub;
+
+// Distributes publications to any number of subscribers.  Each
+// subscriber receives only the metrics it has activated.  A batch is
+// serialized once for each wire format, and the buffer is shared by
+// every subscriber that has activated all of the metrics in it.
+class SubscriberFanout : public SubscriberInterface,
+                         NoCopy, NoAssign, NoMove {
+ public:
+  SubscriberFanout();
+  ~SubscriberFanout();
+
+  // the fanout does not take ownership of subscribers
+  void AddSubscriber(SubscriberStub *s);
+  void RemoveSubscriber(SubscriberStub *s);
+  void SetActive(SubscriberStub *s, int id, bool active);
+
+  // Clear is sent by the owner of each subscriber as it deactivates a
+  // metric, so the publisher's Clear is not forwarded.
+  void Clear(int) {}
+  void OnMetric(const DataSet &d);
+  void OnDescriptions(const MetricDescriptionSet &descriptions);
+  // sent only to subscribers added since the previous call
+  void OnHistory(const DataSet &d);
+  void Flush() const;
+
+  // see SubscriberStub::TransportCounts.  Includes subscribers that
+  // have been removed.
+  void TransportCounts(uint64_t *messages, uint64_t *syscalls) const;
+  // see SubscriberStub::DroppedSamples.  Includes subscribers that
+  // have been removed.
+  uint64_t DroppedSamples() const;
+
+ private:
+  struct Subscription {
+    explicit Subscription(SubscriberStub *s)
+        : stub(s), interned(0), replayed(false), failed(false) {}
+    SubscriberStub *stub;
+    std::set<int> active;
+    // number of v2 interned ids the subscriber has received
+    unsigned int interned;
+    // true once the subscriber has received history
+    bool replayed;
+    bool failed;
+  };
+  typedef std::vector<Subscription> SubscriptionList;
+
+  void Write(Subscription *s, const std::vector<unsigned char> &buf,
+             int samples, unsigned int interned_base,
+             unsigned int interned_end);
+  void Encode(const DataSet &d, int version, std::vector<unsigned char> *buf,
+              unsigned int *interned_base, unsigned int *interned_end);
+
+  SubscriptionList m_subscriptions;
+  MetricEncoder m_v1_encoder, m_v2_encoder;
+  uint64_t m_removed_messages, m_removed_syscalls, m_removed_dropped;
+  std::vector<unsigned char> m_shared_buf[kProtocolVersionLatest + 1],
+    m_buf;
+  mutable Mutex m_protect;
+};
+
+}  // namespace Grafips
+
+#endif  // REMOTE_GFSUBSCRIBER_FANOUT_H_
@@ -43,15 +43,19 @@ using Grafips::WARN;
 using Grafips::kSocketWriteFail;
 
 SubscriberStub::SubscriberStub(const std::string &address,
-                               int port)
-    : m_socket(new Socket(address, port)) {
+                               int port, int version)
+    : m_socket(new Socket(address, port)),
+      m_writer(new SessionWriter(m_socket)),
+      m_message_count(0), m_send_count(0), m_dropped(0), m_encoder(version) {
+}
+
+SubscriberStub::SubscriberStub(SessionWriter *writer, int version)
+    : m_socket(NULL), m_writer(writer), m_message_count(0), m_send_count(0),
+      m_dropped(0), m_encoder(version) {
 }
 
 SubscriberStub::~SubscriberStub() {
-  if (m_socket) {
-    delete m_socket;
-    m_socket = NULL;
-  }
+  Close();
 }
 
 void
@@ -60,6 +64,17 @@ SubscriberStub::Flush() const {
     m.set_method(GrafipsProto::SubscriberInvocation::kFlush);
     WriteMessage(m);
 
+    // on a multiplexed session, the response is read by the skeleton
+    if (!m_socket)
+      return;
+    // the request may be queued behind publications
+    while (m_writer->Pending()) {
+      if (!m_writer->Drain())
+        break;
+      // wait for the subscriber to read, rather than polling
+      if (m_writer->Pending() && !m_socket->WaitWritable())
+        break;
+    }
     uint32_t response;
     m_socket->Read(&response);
     assert(response == 0);
@@ -78,52 +93,75 @@ SubscriberStub::Clear(int id) {
 
 typedef GrafipsProto::SubscriberInvocation GSubInv;
 void
-SubscriberStub::WriteMessage(const GSubInv &m) const {
+SubscriberStub::Serialize(const GSubInv &m,
+                          std::vector<unsigned char> *buf) {
+    // framing is added by the SessionWriter, so the serialized message
+    // can be shared by sessions with different framing.
     const uint32_t write_size = m.ByteSize();
+    buf->resize(write_size);
+    google::protobuf::io::ArrayOutputStream array_out(buf->data(),
+                                                      write_size);
+    google::protobuf::io::CodedOutputStream coded_out(&array_out);
+    m.SerializeToCodedStream(&coded_out);
+}
+
+void
+SubscriberStub::WriteMessage(const GSubInv &m, int samples) const {
     ScopedLock s(&m_protect);
-    if (!m_socket) {
-      Raise(Error(kSocketWriteFail, ERROR,
-                  "SubscriberStub wrote to closed socket"));
-      return;
-    }
+    Serialize(m, &m_buf);
+    WriteLocked(m_buf, samples);
+}
 
-    if (!m_socket->Write(write_size)) {
+void
+SubscriberStub::WriteSerialized(const std::vector<unsigned char> &buf,
+                                int samples) const {
+    ScopedLock s(&m_protect);
+    WriteLocked(buf, samples);
+}
+
+void
+SubscriberStub::WriteLocked(const std::vector<unsigned char> &buf,
+                            int samples) const {
+    if (!m_writer) {
       Raise(Error(kSocketWriteFail, ERROR,
                   "SubscriberStub wrote to closed socket"));
       return;
     }
 
-    m_buf.resize(write_size);
-    google::protobuf::io::ArrayOutputStream array_out(m_buf.data(), write_size);
-    google::protobuf::io::CodedOutputStream coded_out(&array_out);
-    m.SerializeToCodedStream(&coded_out);
-    if (!m_socket->Write(m_buf.data(), write_size)) {
+    ++m_message_count;
+    if (!m_writer->Write(kSubscriberChannel, buf, samples)) {
       Raise(Error(kSocketWriteFail, ERROR,
                   "SubscriberStub wrote to closed socket"));
       return;
     }
 }
 
-typedef GrafipsProto::SubscriberInvocation::OnMetric GOnMet;
 void
 SubscriberStub::OnMetric(const DataSet &d) {
     GrafipsProto::SubscriberInvocation m;
     m.set_method(GrafipsProto::SubscriberInvocation::kOnMetric);
-    GOnMet * args = m.mutable_onmetricargs();
-    for (DataSet::const_iterator i = d.begin(); i != d.end(); ++i) {
-        ::GrafipsProto::DataPoint* data = args->add_data();
-        data->set_time_val(i->time_val);
-        data->set_id(i->id);
-        data->set_data(i->data);
-    }
+    const unsigned int interned = m_encoder.InternedCount();
+    m_encoder.Encode(d, m.mutable_onmetricargs());
 
-    WriteMessage(m);
+    // a message which interns ids must not be dropped, or later
+    // messages could not be decoded.
+    WriteMessage(m, m_encoder.InternedCount() == interned ? d.size() : 0);
     // asynchronous, no response
 }
 
-typedef GrafipsProto::SubscriberInvocation::OnDescriptions GOnDesc;
 void
 SubscriberStub::OnDescriptions(const std::vector<MetricDescription> &desc) {
+    ScopedLock s(&m_protect);
+    SerializeDescriptions(desc, &m_buf);
+    WriteLocked(m_buf, 0);
+    // asynchronous, no response
+}
+
+typedef GrafipsProto::SubscriberInvocation::OnDescriptions GOnDesc;
+void
+SubscriberStub::SerializeDescriptions(
+    const std::vector<MetricDescription> &desc,
+    std::vector<unsigned char> *buf) {
     GrafipsProto::SubscriberInvocation m;
     m.set_method(GrafipsProto::SubscriberInvocation::kOnDescriptions);
     GOnDesc * args = m.mutable_ondescriptionsargs();
@@ -136,13 +174,47 @@ SubscriberStub::OnDescriptions(const std::vector<MetricDescription> &desc) {
         pdesc->set_type((::GrafipsProto::MetricType)i->type);
         pdesc->set_enabled(i->enabled);
     }
-    WriteMessage(m);
-    // asynchronous, no response
+    Serialize(m, buf);
 }
 
 void
 SubscriberStub::Close() {
   ScopedLock s(&m_protect);
-  delete m_socket;
-  m_socket = NULL;
+  if (!m_writer)
+    return;
+  m_send_count += m_writer->SendCount();
+  m_dropped += m_writer->DroppedSamples();
+  // a multiplexed session's writer and socket belong to the skeleton
+  if (m_socket) {
+    delete m_writer;
+    delete m_socket;
+    m_socket = NULL;
+  }
+  m_writer = NULL;
+}
+
+void
+SubscriberStub::TransportCounts(uint64_t *messages, uint64_t *syscalls) const {
+  ScopedLock s(&m_protect);
+  *messages = m_message_count;
+  *syscalls = m_send_count;
+  if (m_writer)
+    *syscalls += m_writer->SendCount();
+}
+
+uint64_t
+SubscriberStub::DroppedSamples() const {
+  ScopedLock s(&m_protect);
+  uint64_t dropped = m_dropped;
+  if (m_writer)
+    dropped += m_writer->DroppedSamples();
+  return dropped;
+}
+
+void
+SubscriberStub::EnableSendQueue(size_t max_bytes, DropPolicy policy,
+                                SessionWriterListener *listener) {
+  ScopedLock s(&m_protect);
+  if (m_socket && m_writer)
+    m_writer->EnableSendQueue(max_bytes, policy, listener);
 }
@@ -28,11 +28,15 @@
 #ifndef REMOTE_GFSUBSCRIBER_STUB_H_
 #define REMOTE_GFSUBSCRIBER_STUB_H_
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
 #include "os/gfsocket.h"
 #include "remote/gfisubscriber.h"
+#include "remote/gfmetric_codec.h"
+#include "remote/gfsession.h"
 #include "os/gftraits.h"
 #include "os/gfmutex.h"
 
@@ -45,16 +49,51 @@ namespace Grafips {
 class SubscriberStub : public SubscriberInterface,
                        NoCopy, NoAssign, NoMove {
  public:
-  SubscriberStub(const std::string &address, int port);
+  // version is the wire format negotiated with the subscriber.  Opens
+  // a connection to the subscriber.
+  SubscriberStub(const std::string &address, int port,
+                 int version = kProtocolVersion1);
+  // writes to a multiplexed session connection
+  SubscriberStub(SessionWriter *writer, int version);
   ~SubscriberStub();
   void Clear(int id);
   void OnMetric(const DataSet &d);
   void OnDescriptions(const std::vector<MetricDescription> &descriptions);
+  void OnHistory(const DataSet &d) { OnMetric(d); }
   void Flush() const;
   void Close();
+  // queues messages to a subscriber that opened its own connection,
+  // see SessionWriter::EnableSendQueue.  Multiplexed sessions share
+  // the queue of the session's writer.
+  void EnableSendQueue(size_t max_bytes, DropPolicy policy,
+                       SessionWriterListener *listener);
+
+  // counts of messages written, and the send() calls needed to write
+  // them, since the stub was created
+  void TransportCounts(uint64_t *messages, uint64_t *syscalls) const;
+  // metric samples dropped because the subscriber fell behind
+  uint64_t DroppedSamples() const;
+  int Version() const { return m_encoder.Version(); }
+
+  // A message can be serialized once, and written to several stubs.
+  static void Serialize(const GrafipsProto::SubscriberInvocation &m,
+                        std::vector<unsigned char> *buf);
+  static void SerializeDescriptions(
+      const std::vector<MetricDescription> &descriptions,
+      std::vector<unsigned char> *buf);
+  // samples is the number of data points in a metric message which
+  // may be dropped, or 0.
+  void WriteSerialized(const std::vector<unsigned char> &buf,
+                       int samples = 0) const;
  private:
-  void WriteMessage(const GrafipsProto::SubscriberInvocation&m) const;
+  void WriteMessage(const GrafipsProto::SubscriberInvocation&m,
+                    int samples = 0) const;
+  void WriteLocked(const std::vector<unsigned char> &buf, int samples) const;
+  // NULL for multiplexed sessions
   mutable Socket *m_socket;
+  mutable SessionWriter *m_writer;
+  mutable uint64_t m_message_count, m_send_count, m_dropped;
+  MetricEncoder m_encoder;
   mutable std::vector<unsigned char> m_buf;
   mutable Mutex m_protect;
 };
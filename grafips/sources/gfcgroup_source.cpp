@@ -0,0 +1,302 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfcgroup_source.h"
+
+#include <string.h>
+
+#include <sstream>
+#include <string>
+
+#include "os/gfproc_file.h"
+#include "remote/gfimetric_sink.h"
+
+using Grafips::CgroupSource;
+using Grafips::ProcFile;
+using Grafips::ScopedLock;
+
+namespace {
+const struct {
+  const char *path, *display, *help;
+  Grafips::MetricType type;
+} kMetrics[] = {
+  { "cgroup/nr_throttled", "Cgroup Throttled Periods/s",
+    "CFS periods in which the cgroup exhausted its cpu quota, per second",
+    Grafips::GR_METRIC_RATE },
+  { "cgroup/throttled_ms", "Cgroup Throttled ms/s",
+    "Time the cgroup was throttled by its cpu quota, in ms per second",
+    Grafips::GR_METRIC_RATE },
+  { "cgroup/memory_current", "Cgroup Memory MB",
+    "Memory charged to the cgroup", Grafips::GR_METRIC_AVERAGE },
+  { "cgroup/memory_events", "Cgroup Memory Events/s",
+    "Memory high, max and oom events of the cgroup, per second",
+    Grafips::GR_METRIC_RATE },
+  { "cgroup/throttled_frame_ms", "Throttled Frame ms",
+    "Longest frame of each interval in which the cgroup was throttled",
+    Grafips::GR_METRIC_AVERAGE },
+};
+
+// Opens a file of a cgroup.  Within a cgroup namespace, or when the
+// container's cgroup is mounted at the root, /proc/self/cgroup
+// describes a path which is not visible, so the mount point is tried
+// as well.
+ProcFile *
+OpenCgroupFile(const std::string &mount, const std::string &path,
+               const char *file) {
+  ProcFile *f = new ProcFile(mount + path + "/" + file);
+  if (f->IsOpen())
+    return f;
+  delete f;
+  f = new ProcFile(mount + "/" + file);
+  if (f->IsOpen())
+    return f;
+  delete f;
+  return NULL;
+}
+}  // namespace
+
+CgroupSource::CgroupSource(const std::string &cgroup_root,
+                           const std::string &self_cgroup)
+    : m_v2(false), m_cpu_stat(NULL), m_memory_current(NULL),
+      m_memory_events(NULL), m_last_throttled(0), m_last_throttled_us(0),
+      m_last_memory_events(0), m_last_ns(0), m_last_swap_ns(0),
+      m_max_frame_ns(0), m_sink(NULL) {
+  for (int i = 0; i < kMetricCount; ++i)
+    m_ids[i] = 0;
+  Open(cgroup_root, self_cgroup);
+
+  const bool available[kMetricCount] = {
+    m_cpu_stat != NULL, m_cpu_stat != NULL, m_memory_current != NULL,
+    m_memory_events != NULL, m_cpu_stat != NULL
+  };
+  for (int i = 0; i < kMetricCount; ++i) {
+    if (!available[i])
+      continue;
+    m_descriptions.push_back(MetricDescription(
+        kMetrics[i].path, kMetrics[i].help, kMetrics[i].display,
+        kMetrics[i].type));
+    m_ids[i] = m_descriptions.back().id();
+  }
+}
+
+CgroupSource::~CgroupSource() {
+  delete m_cpu_stat;
+  delete m_memory_current;
+  delete m_memory_events;
+}
+
+void
+CgroupSource::Open(const std::string &cgroup_root,
+                   const std::string &self_cgroup) {
+  ProcFile self(self_cgroup);
+  if (!self.Read())
+    return;
+  // lines are <hierarchy>:<controllers>:<path>.  The v2 hierarchy
+  // has no controllers.  On hybrid systems, v1 controllers take
+  // precedence over the v2 hierarchy.
+  std::string v2_path, cpu_mount, cpu_path, memory_mount, memory_path;
+  bool have_v2 = false;
+  std::istringstream lines(self.Data());
+  std::string line;
+  while (std::getline(lines, line)) {
+    const size_t first = line.find(':');
+    const size_t second = line.find(':', first + 1);
+    if (first == std::string::npos || second == std::string::npos)
+      continue;
+    const std::string controllers = line.substr(first + 1,
+                                                second - first - 1);
+    const std::string path = line.substr(second + 1);
+    if (controllers.empty()) {
+      have_v2 = true;
+      v2_path = path;
+      continue;
+    }
+    std::istringstream tokens(controllers);
+    std::string controller;
+    while (std::getline(tokens, controller, ',')) {
+      // the mount point is named for the controllers of the hierarchy
+      if (controller == "cpu") {
+        cpu_mount = cgroup_root + "/" + controllers;
+        cpu_path = path;
+      } else if (controller == "memory") {
+        memory_mount = cgroup_root + "/" + controllers;
+        memory_path = path;
+      }
+    }
+  }
+
+  if (cpu_mount.empty() && memory_mount.empty()) {
+    if (!have_v2)
+      return;
+    m_v2 = true;
+    cpu_mount = memory_mount = cgroup_root;
+    cpu_path = memory_path = v2_path;
+  }
+  if (!cpu_mount.empty())
+    m_cpu_stat = OpenCgroupFile(cpu_mount, cpu_path, "cpu.stat");
+  if (!memory_mount.empty()) {
+    m_memory_current = OpenCgroupFile(
+        memory_mount, memory_path,
+        m_v2 ? "memory.current" : "memory.usage_in_bytes");
+    m_memory_events = OpenCgroupFile(
+        memory_mount, memory_path,
+        m_v2 ? "memory.events" : "memory.failcnt");
+  }
+
+  // counters accumulate from the creation of the cgroup
+  if (m_cpu_stat && !ReadCpuStat(&m_last_throttled, &m_last_throttled_us)) {
+    delete m_cpu_stat;
+    m_cpu_stat = NULL;
+  }
+  if (m_memory_events && !ReadMemoryEvents(&m_last_memory_events)) {
+    delete m_memory_events;
+    m_memory_events = NULL;
+  }
+}
+
+bool
+CgroupSource::ReadCpuStat(uint64_t *throttled, uint64_t *throttled_us) {
+  if (!m_cpu_stat->Read())
+    return false;
+  int64_t nr_throttled, throttled_time;
+  if (!m_cpu_stat->Value("nr_throttled", &nr_throttled))
+    return false;
+  if (m_v2) {
+    if (!m_cpu_stat->Value("throttled_usec", &throttled_time))
+      return false;
+  } else {
+    // ns in v1
+    if (!m_cpu_stat->Value("throttled_time", &throttled_time))
+      return false;
+    throttled_time /= 1000;
+  }
+  *throttled = nr_throttled;
+  *throttled_us = throttled_time;
+  return true;
+}
+
+bool
+CgroupSource::ReadMemoryEvents(uint64_t *events) {
+  if (!m_v2)
+    return m_memory_events->ReadUint(events);
+  if (!m_memory_events->Read())
+    return false;
+  static const char *kEvents[] = { "high", "max", "oom" };
+  *events = 0;
+  for (unsigned int i = 0; i < sizeof(kEvents) / sizeof(kEvents[0]); ++i) {
+    int64_t count;
+    if (m_memory_events->Value(kEvents[i], &count))
+      *events += count;
+  }
+  return true;
+}
+
+void
+CgroupSource::OnFrame() {
+  const uint64_t now_ns = get_ns_time();
+  if (m_last_swap_ns) {
+    const uint64_t frame_ns = now_ns - m_last_swap_ns;
+    if (frame_ns > m_max_frame_ns)
+      m_max_frame_ns = frame_ns;
+  }
+  m_last_swap_ns = now_ns;
+}
+
+void
+CgroupSource::Subscribe(MetricSinkInterface *sink) {
+  {
+    ScopedLock s(&m_protect);
+    m_sink = sink;
+  }
+  sink->OnDescriptions(m_descriptions);
+}
+
+void
+CgroupSource::Activate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.insert(id);
+}
+
+void
+CgroupSource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.erase(id);
+}
+
+void
+CgroupSource::Poll(unsigned int ms) {
+  ScopedLock s(&m_protect);
+  if (m_active_ids.empty()) {
+    // the next rates start from fresh counts
+    m_last_ns = 0;
+    return;
+  }
+
+  const uint64_t now_ns = get_ns_time();
+  const double elapsed_s = m_last_ns ? (now_ns - m_last_ns) / 1e9 : 0;
+  m_last_ns = now_ns;
+  // longest frame since the last poll
+  const uint64_t max_frame_ns = m_max_frame_ns.exchange(0);
+
+  DataSet dset;
+  uint64_t throttled, throttled_us;
+  if (m_cpu_stat && ReadCpuStat(&throttled, &throttled_us)) {
+    const uint64_t periods = throttled >= m_last_throttled ?
+                             throttled - m_last_throttled : 0;
+    const uint64_t us = throttled_us >= m_last_throttled_us ?
+                        throttled_us - m_last_throttled_us : 0;
+    m_last_throttled = throttled;
+    m_last_throttled_us = throttled_us;
+    if (elapsed_s > 0) {
+      if (Active(kNrThrottled))
+        dset.push_back(DataPoint(ms, m_ids[kNrThrottled],
+                                 periods / elapsed_s));
+      if (Active(kThrottledMs))
+        dset.push_back(DataPoint(ms, m_ids[kThrottledMs],
+                                 us / 1e3 / elapsed_s));
+      if (Active(kThrottledFrameMs))
+        dset.push_back(DataPoint(ms, m_ids[kThrottledFrameMs],
+                                 periods ? max_frame_ns / 1e6 : 0.0));
+    }
+  }
+
+  uint64_t bytes;
+  if (Active(kMemoryCurrent) && m_memory_current->ReadUint(&bytes))
+    dset.push_back(DataPoint(ms, m_ids[kMemoryCurrent],
+                             bytes / (1024.0 * 1024.0)));
+
+  uint64_t events;
+  if (m_memory_events && ReadMemoryEvents(&events)) {
+    const uint64_t delta = events >= m_last_memory_events ?
+                           events - m_last_memory_events : 0;
+    m_last_memory_events = events;
+    if (elapsed_s > 0 && Active(kMemoryEvents))
+      dset.push_back(DataPoint(ms, m_ids[kMemoryEvents], delta / elapsed_s));
+  }
+  if (!dset.empty() && m_sink)
+    m_sink->OnMetric(dset);
+}
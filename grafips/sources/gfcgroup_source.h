@@ -0,0 +1,102 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFCGROUP_SOURCE_H_
+#define SOURCES_GFCGROUP_SOURCE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <set>
+#include <string>
+
+#include "os/gfmutex.h"
+#include "sources/gfimetric_source.h"
+
+namespace Grafips {
+class ProcFile;
+
+// Publishes the cpu throttling and memory of the cgroup which
+// contains the process, for renderers in containers with cpu quotas.
+// Both cgroup v1 controllers and the v2 unified hierarchy are
+// supported.
+//
+//   cgroup/nr_throttled        CFS periods throttled, per second
+//   cgroup/throttled_ms        ms throttled, per second
+//   cgroup/memory_current      memory charged to the cgroup, in MB
+//   cgroup/memory_events       high, max and oom events per second
+//                              (v2), or limit failures (v1)
+//   cgroup/throttled_frame_ms  the longest frame of each interval in
+//                              which the cgroup was throttled, and 0
+//                              otherwise.  Hitches caused by quota
+//                              show here as well as in gl/frame_time.
+class CgroupSource : public PolledSourceInterface {
+ public:
+  explicit CgroupSource(const std::string &cgroup_root = "/sys/fs/cgroup",
+                        const std::string &self_cgroup =
+                        "/proc/self/cgroup");
+  ~CgroupSource();
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+  void Poll(unsigned int ms);
+  // called on each swap, on the render thread
+  void OnFrame();
+
+ private:
+  enum Metric {
+    kNrThrottled, kThrottledMs, kMemoryCurrent, kMemoryEvents,
+    kThrottledFrameMs, kMetricCount
+  };
+
+  // finds the cpu and memory directories of the cgroup, and opens
+  // their files
+  void Open(const std::string &cgroup_root, const std::string &self_cgroup);
+  bool ReadCpuStat(uint64_t *throttled, uint64_t *throttled_us);
+  bool ReadMemoryEvents(uint64_t *events);
+  bool Active(int metric) const {
+    return m_ids[metric] != 0 && m_active_ids.count(m_ids[metric]);
+  }
+
+  bool m_v2;
+  ProcFile *m_cpu_stat, *m_memory_current, *m_memory_events;
+  uint64_t m_last_throttled, m_last_throttled_us, m_last_memory_events;
+  // time of the last read of the counters, or 0 if they are not
+  // current
+  uint64_t m_last_ns;
+  // written by the render thread
+  uint64_t m_last_swap_ns;
+  std::atomic<uint64_t> m_max_frame_ns;
+  int m_ids[kMetricCount];
+  std::set<int> m_active_ids;
+  MetricSinkInterface *m_sink;
+  MetricDescriptionSet m_descriptions;
+  Mutex m_protect;
+};
+}  // namespace Grafips
+
+#endif  // SOURCES_GFCGROUP_SOURCE_H_
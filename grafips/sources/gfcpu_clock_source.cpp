@@ -27,20 +27,23 @@
 
 #include "sources/gfcpu_clock_source.h"
 
+#include <ctype.h>
 #include <dirent.h>
-#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 
+#include "os/gfproc_file.h"
 #include "remote/gfimetric_sink.h"
 
 using Grafips::CpuFreqSource;
+using Grafips::ProcFile;
+using Grafips::ScopedLock;
 
+namespace {
 // Convenience class to clean up DIR resources on exit;
 class ScopedDirClose {
  public:
@@ -50,98 +53,213 @@ class ScopedDirClose {
   DIR *m_d;
 };
 
-CpuFreqSource::CpuFreqSource()
-    : m_sink(NULL), m_last_publish_ms(0) {
-  // open handles
-  static const char *base_dir = "/sys/devices/system/cpu";
-  DIR * base_dir_h = opendir(base_dir);
-  if (!base_dir_h)
-    return;
-  ScopedDirClose d(base_dir_h);
-
-  struct dirent *current_cpu_dir = readdir(base_dir_h);
-  while (NULL != current_cpu_dir) {
-    if (strncmp("cpu", current_cpu_dir->d_name, 3) == 0) {
-      const std::string core_file_name = std::string(base_dir) + "/"
-                                        + current_cpu_dir->d_name
-                                        + "/cpufreq/cpuinfo_cur_freq";
-
-      const int core_freq_handle = open(core_file_name.c_str(), O_RDONLY);
-      if (core_freq_handle == -1)
-        break;
-      m_core_freq_handles.push_back(core_freq_handle);
-
-      // all cores move together on haswell.  Break here to limit core
-      // frequency metric to a single value.  Uncomment if bdw/skl and
-      // later allow cores to scale individually.
-      break;
+// parses the number following prefix in a directory name, eg "cpu12"
+bool
+ParseIndex(const char *name, const char *prefix, int *index) {
+  const size_t len = strlen(prefix);
+  if (strncmp(name, prefix, len) != 0 || !isdigit(name[len]))
+    return false;
+  *index = atoi(name + len);
+  return true;
+}
+}  // namespace
+
+CpuFreqSource::CpuFreqSource(const std::string &sys_path)
+    : m_sink(NULL), m_last_trans_ns(0) {
+  for (int i = 0; i < kSummaryCount; ++i)
+    m_summary_ids[i] = 0;
+  Enumerate(sys_path);
+}
+
+CpuFreqSource::~CpuFreqSource() {
+  for (auto core = m_cores.begin(); core != m_cores.end(); ++core)
+    delete core->freq;
+  for (auto policy = m_policies.begin(); policy != m_policies.end();
+       ++policy)
+    delete policy->total_trans;
+}
+
+void
+CpuFreqSource::Enumerate(const std::string &sys_path) {
+  // cores scale independently on recent platforms, and are published
+  // individually.
+  std::vector<int> cpus;
+  DIR *base_dir_h = opendir(sys_path.c_str());
+  if (base_dir_h) {
+    ScopedDirClose d(base_dir_h);
+    struct dirent *entry;
+    while ((entry = readdir(base_dir_h)) != NULL) {
+      int cpu;
+      if (ParseIndex(entry->d_name, "cpu", &cpu))
+        cpus.push_back(cpu);
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  for (auto cpu = cpus.begin(); cpu != cpus.end(); ++cpu) {
+    std::stringstream dir;
+    dir << sys_path << "/cpu" << *cpu << "/cpufreq/";
+    ProcFile *freq = new ProcFile(dir.str() + "cpuinfo_cur_freq");
+    if (!freq->IsOpen()) {
+      delete freq;
+      freq = new ProcFile(dir.str() + "scaling_cur_freq");
+    }
+    if (!freq->IsOpen()) {
+      delete freq;
+      continue;
     }
+    std::stringstream path, name;
+    path << "cpu/core/" << *cpu << "/frequency";
+    name << "CPU" << *cpu << " Frequency kHz";
+    m_descriptions.push_back(MetricDescription(
+        path.str(), "Current frequency of the core", name.str(),
+        GR_METRIC_RATE));
+    Core core = { *cpu, freq, m_descriptions.back().id() };
+    m_cores.push_back(core);
+  }
 
-    current_cpu_dir = readdir(base_dir_h);
+  // stats are kept per policy, which may span several cores
+  std::vector<int> policies;
+  const std::string policy_dir = sys_path + "/cpufreq";
+  DIR *policy_dir_h = opendir(policy_dir.c_str());
+  if (policy_dir_h) {
+    ScopedDirClose d(policy_dir_h);
+    struct dirent *entry;
+    while ((entry = readdir(policy_dir_h)) != NULL) {
+      int policy;
+      if (ParseIndex(entry->d_name, "policy", &policy))
+        policies.push_back(policy);
+    }
   }
-  for (unsigned int i = 0; i < m_core_freq_handles.size(); ++i) {
+  std::sort(policies.begin(), policies.end());
+  for (auto policy = policies.begin(); policy != policies.end(); ++policy) {
+    std::stringstream trans_path;
+    trans_path << policy_dir << "/policy" << *policy
+               << "/stats/total_trans";
+    // absent without CONFIG_CPU_FREQ_STAT, or with intel_pstate
+    ProcFile *total_trans = new ProcFile(trans_path.str());
+    uint64_t trans;
+    if (!total_trans->ReadUint(&trans)) {
+      delete total_trans;
+      continue;
+    }
     std::stringstream path, name;
-    path << "cpu/core/" << i << "/frequency";
-    name << "CPU" << i << " frequency";
-    static const char *desc = "Displays current frequency of core";
-
-    m_descriptions.push_back(MetricDescription(path.str(),
-                                               name.str(),
-                                               desc,
-                                               GR_METRIC_RATE));
-    m_index_to_id[i] = m_descriptions.back().id();
+    path << "cpu/policy/" << *policy << "/transitions";
+    name << "CPU Policy " << *policy << " Transitions/s";
+    m_descriptions.push_back(MetricDescription(
+        path.str(), "Frequency transitions of the cpufreq policy, per second",
+        name.str(), GR_METRIC_RATE));
+    Policy p = { *policy, total_trans, trans, m_descriptions.back().id() };
+    m_policies.push_back(p);
   }
-}
 
-CpuFreqSource::~CpuFreqSource() {
-  for (auto handle = m_core_freq_handles.begin();
-       handle != m_core_freq_handles.end(); ++handle)
-    close(*handle);
+  if (!m_cores.empty()) {
+    static const struct {
+      const char *path, *display, *help;
+    } kSummaries[] = {
+      { "cpu/frequency/min", "CPU Min Frequency kHz",
+        "Frequency of the slowest core" },
+      { "cpu/frequency/max", "CPU Max Frequency kHz",
+        "Frequency of the fastest core" },
+      { "cpu/frequency/mean", "CPU Mean Frequency kHz",
+        "Mean frequency across cores" },
+    };
+    for (int i = kMin; i <= kMean; ++i) {
+      m_descriptions.push_back(MetricDescription(
+          kSummaries[i].path, kSummaries[i].help, kSummaries[i].display,
+          GR_METRIC_RATE));
+      m_summary_ids[i] = m_descriptions.back().id();
+    }
+  }
+  if (!m_policies.empty()) {
+    m_descriptions.push_back(MetricDescription(
+        "cpu/frequency/transitions",
+        "Frequency transitions of all cpufreq policies, per second",
+        "CPU Frequency Transitions/s", GR_METRIC_RATE));
+    m_summary_ids[kTransitions] = m_descriptions.back().id();
+  }
 }
 
 void
 CpuFreqSource::Subscribe(MetricSinkInterface *sink) {
-  m_sink = sink;
+  {
+    ScopedLock s(&m_protect);
+    m_sink = sink;
+  }
   sink->OnDescriptions(m_descriptions);
 }
 
 void
 CpuFreqSource::Activate(int id) {
+  ScopedLock s(&m_protect);
   m_active_ids.emplace(id);
 }
 
 void
 CpuFreqSource::Deactivate(int id) {
-  auto i = m_active_ids.find(id);
-  if (i == m_active_ids.end())
-    return;
-  m_active_ids.erase(i);
+  ScopedLock s(&m_protect);
+  m_active_ids.erase(id);
 }
 
 void
-CpuFreqSource::Poll() {
-  const unsigned int ms = get_ms_time();
-  if (ms - m_last_publish_ms < 300)
-    return;
+CpuFreqSource::Poll(unsigned int ms) {
+  ScopedLock s(&m_protect);
   if (!m_sink)
     return;
-  m_last_publish_ms = ms;
+  if (m_active_ids.empty()) {
+    // the next transition rate starts from a fresh count
+    m_last_trans_ns = 0;
+    return;
+  }
 
+  // every core is read at each poll, so that the summaries are
+  // consistent with the per-core metrics.
   DataSet dset;
-  for (unsigned int i = 0; i < m_core_freq_handles.size(); ++i) {
-    const int id = m_index_to_id[i];
-    if (m_active_ids.find(id) == m_active_ids.end())
+  double min_freq = 0, max_freq = 0, sum_freq = 0;
+  int count = 0;
+  for (auto core = m_cores.begin(); core != m_cores.end(); ++core) {
+    uint64_t khz;
+    // fails while the core is offline
+    if (!core->freq->ReadUint(&khz))
       continue;
+    const double freq = khz;
+    if (count == 0 || freq < min_freq)
+      min_freq = freq;
+    if (count == 0 || freq > max_freq)
+      max_freq = freq;
+    sum_freq += freq;
+    ++count;
+    if (Active(core->id))
+      dset.push_back(DataPoint(ms, core->id, freq));
+  }
+  if (count > 0) {
+    const double summaries[] = { min_freq, max_freq, sum_freq / count };
+    for (int i = kMin; i <= kMean; ++i)
+      if (Active(m_summary_ids[i]))
+        dset.push_back(DataPoint(ms, m_summary_ids[i], summaries[i]));
+  }
 
-    const int fh = m_core_freq_handles[i];
-    lseek(fh, 0, SEEK_SET);
-    const ssize_t bytes = read(fh, m_buf, BUF_SIZE - 1);
-    if (bytes < 0)
+  const uint64_t now_ns = get_ns_time();
+  const double elapsed_s = m_last_trans_ns ?
+                           (now_ns - m_last_trans_ns) / 1e9 : 0;
+  m_last_trans_ns = now_ns;
+  uint64_t total = 0;
+  for (auto policy = m_policies.begin(); policy != m_policies.end();
+       ++policy) {
+    uint64_t trans;
+    if (!policy->total_trans->ReadUint(&trans))
       continue;
-    m_buf[bytes] = '\0';
-    int freq = atoi(m_buf);
-    dset.push_back(DataPoint(ms, m_index_to_id[i], freq));
+    // stats/reset clears the count
+    const uint64_t delta = trans >= policy->last_trans ?
+                           trans - policy->last_trans : 0;
+    policy->last_trans = trans;
+    total += delta;
+    if (elapsed_s > 0 && Active(policy->id))
+      dset.push_back(DataPoint(ms, policy->id, delta / elapsed_s));
   }
-  if (!dset.empty() && m_sink)
+  if (elapsed_s > 0 && Active(m_summary_ids[kTransitions]))
+    dset.push_back(DataPoint(ms, m_summary_ids[kTransitions],
+                             total / elapsed_s));
+
+  if (!dset.empty())
     m_sink->OnMetric(dset);
 }
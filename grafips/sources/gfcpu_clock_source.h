@@ -28,10 +28,13 @@
 #ifndef SOURCES_GFCPU_CLOCK_SOURCE_H_
 #define SOURCES_GFCPU_CLOCK_SOURCE_H_
 
-#include <map>
+#include <stdint.h>
+
 #include <set>
+#include <string>
 #include <vector>
 
+#include "os/gfmutex.h"
 #include "sources/gfimetric_source.h"
 
 // TODO(majanes) this control uses sysfs, which is apparently
@@ -41,27 +44,56 @@
 
 namespace Grafips {
 class MetricSinkInterface;
+class ProcFile;
 
-// GlSource produces metrics based on the GL API
-class CpuFreqSource : public MetricSourceInterface {
+// Publishes the frequency of each core, in kHz, and the min, max and
+// mean across cores at each poll.  cpuinfo_cur_freq is read where
+// permitted (it is root-only on most kernels), and scaling_cur_freq
+// otherwise.  Frequency transitions per second are published for
+// each cpufreq policy which keeps stats, and in total.
+//
+//   cpu/core/<n>/frequency
+//   cpu/frequency/{min,max,mean,transitions}
+//   cpu/policy/<n>/transitions
+class CpuFreqSource : public PolledSourceInterface {
  public:
-  CpuFreqSource();
+  explicit CpuFreqSource(const std::string &sys_path =
+                         "/sys/devices/system/cpu");
   ~CpuFreqSource();
   void Subscribe(MetricSinkInterface *sink);
   void Activate(int id);
   void Deactivate(int id);
-  void Poll();
+  void Poll(unsigned int ms);
+
  private:
+  enum Summary {
+    kMin, kMax, kMean, kTransitions, kSummaryCount
+  };
+  struct Core {
+    int cpu;
+    ProcFile *freq;
+    int id;
+  };
+  struct Policy {
+    int policy;
+    ProcFile *total_trans;
+    uint64_t last_trans;
+    int id;
+  };
+
+  void Enumerate(const std::string &sys_path);
+  bool Active(int id) const { return m_active_ids.count(id) != 0; }
+
   MetricSinkInterface *m_sink;
-  unsigned int m_last_publish_ms;
-  int m_frame_count;
+  // time of the last read of transition counts, or 0 if they are
+  // not current
+  uint64_t m_last_trans_ns;
+  std::vector<Core> m_cores;
+  std::vector<Policy> m_policies;
+  int m_summary_ids[kSummaryCount];
   std::set<int> m_active_ids;
-  std::vector<int> m_core_freq_handles;
-  // reverse lookup for activate
-  std::map<int, int> m_index_to_id;
   MetricDescriptionSet m_descriptions;
-  static const int BUF_SIZE = 100;
-  char m_buf[BUF_SIZE];
+  Mutex m_protect;
 };
 }  // end namespace Grafips
 
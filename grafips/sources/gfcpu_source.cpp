@@ -27,106 +27,231 @@
 
 #include "sources/gfcpu_source.h"
 
-#include <assert.h>
+#include <dirent.h>
 #include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <sstream>
+#include <string>
 #include <vector>
 
+#include "remote/gfmetric_registry.h"
 #include "remote/gfpublisher.h"
 
 using Grafips::CpuSource;
+using Grafips::MetricRegistry;
+using Grafips::ProcFile;
 
-static const int READ_BUF_SIZE = 4096;
+namespace {
+const size_t kCpuListSize = 4096;
+// bounds the core table if /proc/stat is malformed
+const uint64_t kMaxCores = 1 << 16;
 
-CpuSource::CpuSource() : m_metric_sink(NULL),
-                         m_last_publish_ms(0),
-                         m_running(true) {
-    m_cpu_info_handle = open("/proc/stat", O_RDONLY);
-    m_buf.resize(READ_BUF_SIZE);
-    Refresh();
+// reads a sysfs file holding a single integer
+bool
+ReadSysInt(const std::string &path, int *value) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL)
+    return false;
+  const bool read = (fscanf(f, "%d", value) == 1);
+  fclose(f);
+  return read;
+}
+
+// parses a sysfs cpu list, such as "0-3,8,10-11"
+void
+ParseCpuList(const char *p, std::vector<int> *cpus) {
+  while (*p) {
+    char *end;
+    const long first = strtol(p, &end, 10);
+    if (end == p)
+      return;
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; ++cpu)
+      cpus->push_back(cpu);
+    if (*p != ',')
+      return;
+    ++p;
+  }
+}
+}  // namespace
+
+CpuSource::CpuLine::CpuLine()
+    : active(0), total(0), utilization(0), present(false), node(-1),
+      socket(-1) {
+  memset(counters, 0, sizeof(counters));
+}
+
+CpuSource::CpuSource(const std::string &stat_path)
+    : m_stat_file(stat_path), m_metric_sink(NULL), m_sysId(0),
+      m_described_cores(0), m_running(true) {
+  Refresh();
 }
 
 CpuSource::~CpuSource() {
-    close(m_cpu_info_handle);
+  MetricRegistry::Instance().Unbind(this);
 }
 
 void
 CpuSource::Refresh() {
-    // seek will refresh the data in the proc file
-    lseek(m_cpu_info_handle, 0, SEEK_SET);
-
-    const ssize_t bytes = read(m_cpu_info_handle, m_buf.data(), m_buf.size());
-    assert(bytes > 0);
-    m_buf[bytes] = '\0';
-
-    char *linesaveptr, *wordsaveptr;
-    char *line = strtok_r(m_buf.data(), "\n", &linesaveptr);
-    assert(line != NULL);
-    while (true) {
-        // parse line
-        char *word = strtok_r(line, " ", &wordsaveptr);
-        assert(word != NULL);
-        if (0 != strncmp("cpu", word, 3))
-            // cpu lines expected at front of /proc/stat
-            break;
-
-        if (0 == strncmp("cpu", word, 5)) {
-            ParseCpuLine(&m_systemStats, &wordsaveptr);
-        } else {
-            unsigned int core = atoi(&(word[3]));
-            if (core >= m_core_stats.size())
-                m_core_stats.resize(core + 1);
-            ParseCpuLine(&(m_core_stats[core]), &wordsaveptr);
-        }
+  // /proc/stat exceeds a page on large machines
+  if (!m_stat_file.Read())
+    return;
+
+  const unsigned int core_count = m_core_stats.size();
+  Parse(m_stat_file.Data(), m_stat_file.End());
+  if (m_core_stats.size() > core_count)
+    ReadTopology(core_count);
+}
 
-        // advance to next line
-        line = strtok_r(NULL, "\n", &linesaveptr);
+void
+CpuSource::Parse(const char *p, const char *end) {
+  for (std::vector<CpuLine>::iterator i = m_core_stats.begin();
+       i != m_core_stats.end(); ++i)
+    i->present = false;
+
+  // cpu lines are at the front of /proc/stat: "cpu" for the system,
+  // then "cpu<N>" for each online core.  Older kernels have fewer
+  // fields, which are left 0.
+  uint64_t counters[kFieldCount];
+  while (end - p > 3 && memcmp(p, "cpu", 3) == 0) {
+    p += 3;
+    CpuLine *line = &m_systemStats;
+    if (*p >= '0' && *p <= '9') {
+      const uint64_t core = ProcFile::ParseUint(&p, end);
+      if (core >= kMaxCores)
+        break;
+      if (core >= m_core_stats.size())
+        m_core_stats.resize(core + 1);
+      line = &m_core_stats[core];
     }
+    for (int i = 0; i < kFieldCount; ++i)
+      counters[i] = ProcFile::ParseUint(&p, end);
+    Update(counters, line);
+
+    p = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (p == NULL)
+      break;
+    ++p;
+  }
 }
 
 void
-CpuSource::ParseCpuLine(CpuLine *dest, char **savePtr) {
-    static const int COUNT_STAT_ITEMS = 10;
-    CpuLine current;
-    int *current_item = &(current.user);
-
-    for (int i = 0; i < COUNT_STAT_ITEMS; ++i, ++current_item) {
-        const char *num = strtok_r(NULL, " ", savePtr);
-        assert(num != NULL);
-        *current_item = atoi(num);
-    }
+CpuSource::Update(const uint64_t *counters, CpuLine *line) {
+  uint64_t delta[kFieldCount];
+  bool reset = false;
+  for (int i = 0; i < kFieldCount; ++i) {
+    // counters of a core may restart when it is brought online
+    if (counters[i] < line->counters[i])
+      reset = true;
+    delta[i] = counters[i] - line->counters[i];
+  }
+  memcpy(line->counters, counters, sizeof(line->counters));
+  line->present = true;
+  if (reset) {
+    line->active = line->total = 0;
+    line->utilization = 0;
+    return;
+  }
+
+  // guest time is included in user and nice
+  line->active = delta[kUser] + delta[kNice] + delta[kSystem] +
+                 delta[kIrq] + delta[kSoftirq];
+  line->total = line->active + delta[kIdle] + delta[kIowait] + delta[kSteal];
+  line->utilization = line->total ? 100.0 * line->active / line->total : 0;
+}
 
-    CpuLine delta;
-    int *prev_item = &(dest->user);
-    int *delta_item = &(delta.user);
-    current_item = &(current.user);
+void
+CpuSource::ReadTopology(unsigned int first_core) {
+  for (unsigned int core = first_core; core < m_core_stats.size(); ++core) {
+    std::stringstream path;
+    path << "/sys/devices/system/cpu/cpu" << core
+         << "/topology/physical_package_id";
+    int socket;
+    if (ReadSysInt(path.str(), &socket) && socket >= 0)
+      m_core_stats[core].socket = socket;
+  }
 
-    for (int i = 0; i < COUNT_STAT_ITEMS;
-         ++i, ++current_item, ++prev_item, ++delta_item) {
-        *delta_item = *current_item - *prev_item;
+  DIR *nodes = opendir("/sys/devices/system/node");
+  if (nodes != NULL) {
+    struct dirent *entry;
+    while ((entry = readdir(nodes)) != NULL) {
+      int node;
+      if (sscanf(entry->d_name, "node%d", &node) != 1)
+        continue;
+      std::string list_path = std::string("/sys/devices/system/node/") +
+                              entry->d_name + "/cpulist";
+      FILE *f = fopen(list_path.c_str(), "r");
+      if (f == NULL)
+        continue;
+      std::vector<char> list(kCpuListSize);
+      if (fgets(list.data(), list.size(), f) != NULL) {
+        std::vector<int> cpus;
+        ParseCpuList(list.data(), &cpus);
+        for (std::vector<int>::const_iterator cpu = cpus.begin();
+             cpu != cpus.end(); ++cpu) {
+          if (*cpu >= static_cast<int>(first_core) &&
+              *cpu < static_cast<int>(m_core_stats.size()))
+            m_core_stats[*cpu].node = node;
+        }
+      }
+      fclose(f);
     }
+    closedir(nodes);
+  }
 
-    const float active = delta.user + delta.nice + delta.system +
-                         delta.irq + delta.softirq + delta.guest +
-                         delta.guest_nice;
-    const float total = active + delta.idle + delta.iowait + delta.steal;
-    if (total == 0) {
-        current.utilization = 0;
-    } else {
-        current.utilization = active / total * 100.0;
-        assert(current.utilization <= 100);
-        assert(current.utilization >= 0);
+  m_nodes.clear();
+  m_sockets.clear();
+  for (unsigned int core = 0; core < m_core_stats.size(); ++core) {
+    const CpuLine &line = m_core_stats[core];
+    if (line.node >= 0) {
+      if (line.node >= static_cast<int>(m_nodes.size()))
+        m_nodes.resize(line.node + 1);
+      m_nodes[line.node].cores.push_back(core);
+    }
+    if (line.socket >= 0) {
+      if (line.socket >= static_cast<int>(m_sockets.size()))
+        m_sockets.resize(line.socket + 1);
+      m_sockets[line.socket].cores.push_back(core);
     }
-    memcpy(dest, &current, sizeof(CpuLine));
+  }
+  // a single node or socket duplicates the system metric
+  if (m_nodes.size() < 2)
+    m_nodes.clear();
+  if (m_sockets.size() < 2)
+    m_sockets.clear();
+}
+
+void
+CpuSource::GroupUtilization(std::vector<CpuGroup> *groups) {
+  for (std::vector<CpuGroup>::iterator g = groups->begin();
+       g != groups->end(); ++g) {
+    uint64_t active = 0, total = 0;
+    for (std::vector<int>::const_iterator core = g->cores.begin();
+         core != g->cores.end(); ++core) {
+      const CpuLine &line = m_core_stats[*core];
+      if (!line.present)
+        continue;
+      active += line.active;
+      total += line.total;
+    }
+    g->utilization = total ? 100.0 * active / total : 0;
+  }
 }
 
 bool
 CpuSource::IsActivated() const {
-    return !m_active_cores.empty();
+  return !m_active.empty();
 }
 
 void
@@ -148,6 +273,7 @@ CpuSource::GetDescriptions(std::vector<MetricDescription> *descriptions) {
                                             "activity for the system",
                                             "CPU Busy", GR_METRIC_PERCENT));
   m_sysId = descriptions->back().id();
+  AddTarget(m_sysId, kSystemTarget, 0);
 
   for (unsigned int i = 0; i < m_core_stats.size(); ++i) {
     std::stringstream s, name;
@@ -160,69 +286,124 @@ CpuSource::GetDescriptions(std::vector<MetricDescription> *descriptions) {
                                               GR_METRIC_PERCENT));
     if (m_ids.size() <= i)
       m_ids.push_back(descriptions->back().id());
+    AddTarget(m_ids[i], kCoreTarget, i);
+  }
+  m_described_cores = m_core_stats.size();
+
+  for (unsigned int i = 0; i < m_nodes.size(); ++i) {
+    std::stringstream s, name;
+    s << "cpu/node/" << i << "/utilization";
+    name << "CPU Node " << i << " Busy";
+    descriptions->push_back(MetricDescription(s.str(),
+                                              "Displays percent cpu "
+                                              "activity for the NUMA node",
+                                              name.str(),
+                                              GR_METRIC_PERCENT));
+    m_nodes[i].id = descriptions->back().id();
+    AddTarget(m_nodes[i].id, kNodeTarget, i);
+  }
+
+  for (unsigned int i = 0; i < m_sockets.size(); ++i) {
+    std::stringstream s, name;
+    s << "cpu/socket/" << i << "/utilization";
+    name << "CPU Socket " << i << " Busy";
+    descriptions->push_back(MetricDescription(s.str(),
+                                              "Displays percent cpu "
+                                              "activity for the socket",
+                                              name.str(),
+                                              GR_METRIC_PERCENT));
+    m_sockets[i].id = descriptions->back().id();
+    AddTarget(m_sockets[i].id, kSocketTarget, i);
   }
 }
 
+void
+CpuSource::AddTarget(int id, TargetType type, int index) {
+  if (id == MetricRegistry::kInvalidId)
+    return;
+  int slot;
+  // descriptions are regenerated when cores come online
+  if (MetricRegistry::Instance().Find(id, this, &slot)) {
+    m_targets[slot].type = type;
+    m_targets[slot].index = index;
+    return;
+  }
+  const Target t = { type, index, id, false };
+  m_targets.push_back(t);
+  MetricRegistry::Instance().Bind(id, this, m_targets.size() - 1);
+}
+
 void
 CpuSource::Activate(int id) {
+  int slot;
+  if (!MetricRegistry::Instance().Find(id, this, &slot))
+    return;
   ScopedLock s(&m_protect);
-    if (id == m_sysId) {
-        m_active_cores.insert(-1);
-        return;
-    }
-    for (unsigned int i = 0; i < m_ids.size(); ++i) {
-        if (m_ids[i] == id) {
-            m_active_cores.insert(i);
-            return;
-        }
-    }
+  if (m_targets[slot].active)
+    return;
+  m_targets[slot].active = true;
+  m_active.push_back(slot);
 }
 
 void
 CpuSource::Deactivate(int id) {
+  int slot;
+  if (!MetricRegistry::Instance().Find(id, this, &slot))
+    return;
   ScopedLock s(&m_protect);
-    if (id == m_sysId) {
-        m_active_cores.erase(-1);
-        return;
-    }
-    for (unsigned int i = 0; i < m_ids.size(); ++i) {
-        if (m_ids[i] == id) {
-            m_active_cores.erase(i);
-            return;
-        }
-    }
+  if (!m_targets[slot].active)
+    return;
+  m_targets[slot].active = false;
+  m_active.erase(std::find(m_active.begin(), m_active.end(), slot));
 }
 
 void
-CpuSource::Poll() {
+CpuSource::Poll(unsigned int ms) {
   ScopedLock s(&m_protect);
-    if (!IsActivated())
-        return;
-
-    const unsigned int ms = get_ms_time();
-    if (ms - m_last_publish_ms < 300)
-        return;
-    m_last_publish_ms = ms;
+  if (!IsActivated())
+    return;
 
-    Refresh();
-    Publish(ms);
+  Refresh();
+  if (m_core_stats.size() > m_described_cores && m_metric_sink) {
+    // cores were brought online
+    std::vector<MetricDescription> descriptions;
+    GetDescriptions(&descriptions);
+    m_metric_sink->OnDescriptions(descriptions);
+  }
+  Publish(ms);
 }
 
 void
 CpuSource::Publish(unsigned int ms) {
-    if (!m_metric_sink)
-        return;
-
-    DataSet d;
-
-    if (m_active_cores.count(-1) != 0)
-        d.push_back(DataPoint(ms, m_sysId, m_systemStats.utilization));
-
-    for (unsigned int i = 0; i < m_ids.size(); ++i) {
-        if (m_active_cores.count(i) == 0)
-            continue;
-        d.push_back(DataPoint(ms, m_ids[i], m_core_stats[i].utilization));
+  if (!m_metric_sink)
+    return;
+
+  GroupUtilization(&m_nodes);
+  GroupUtilization(&m_sockets);
+
+  DataSet d;
+  for (std::vector<int>::const_iterator a = m_active.begin();
+       a != m_active.end(); ++a) {
+    const Target &t = m_targets[*a];
+    const int id = t.id;
+    switch (t.type) {
+      case kSystemTarget:
+        d.push_back(DataPoint(ms, id, m_systemStats.utilization));
+        break;
+      case kCoreTarget:
+        if (m_core_stats[t.index].present)
+          d.push_back(DataPoint(ms, id, m_core_stats[t.index].utilization));
+        break;
+      case kNodeTarget:
+        if (t.index < static_cast<int>(m_nodes.size()))
+          d.push_back(DataPoint(ms, id, m_nodes[t.index].utilization));
+        break;
+      case kSocketTarget:
+        if (t.index < static_cast<int>(m_sockets.size()))
+          d.push_back(DataPoint(ms, id, m_sockets[t.index].utilization));
+        break;
     }
+  }
+  if (!d.empty())
     m_metric_sink->OnMetric(d);
 }
-
@@ -28,80 +28,106 @@
 #ifndef SOURCES_GFCPU_SOURCE_H_
 #define SOURCES_GFCPU_SOURCE_H_
 
-#include <set>
+#include <stdint.h>
+
+#include <string>
 #include <vector>
 
 #include "sources/gfimetric_source.h"
 #include "remote/gfpublisher.h"
 #include "os/gfthread.h"
 #include "os/gfmutex.h"
+#include "os/gfproc_file.h"
 
 namespace Grafips {
 
-class CpuSource : public MetricSourceInterface {
+// Publishes the utilization of the system, each core, and each NUMA
+// node and socket (on machines with more than one), from /proc/stat.
+// Cores which are offline are not published.  Cores brought online
+// after the source was subscribed are described when they appear.
+class CpuSource : public PolledSourceInterface {
  public:
   void stop();
 
-  CpuSource();
+  // stat_path may be replaced to parse a synthetic file
+  explicit CpuSource(const std::string &stat_path = "/proc/stat");
   ~CpuSource();
 
   void Subscribe(MetricSinkInterface *sink);
   void Activate(int id);
   void Deactivate(int id);
-  void Poll();
+  void Poll(unsigned int ms);
 
   friend class CpuSourceFixture;
 
   MetricSinkInterface *MetricSink() { return m_metric_sink; }
 
  private:
+  enum CpuField {
+    kUser, kNice, kSystem, kIdle, kIowait, kIrq, kSoftirq, kSteal,
+    kGuest, kGuestNice, kFieldCount
+  };
+
   struct CpuLine {
-    CpuLine() : user(0), nice(0), system(0), idle(0),
-                iowait(0), irq(0), softirq(0), steal(0),
-                guest(0), guest_nice(0), utilization(0) {}
-
-    int user;
-    int nice;
-    int system;
-    int idle;
-    int iowait;
-    int irq;
-    int softirq;
-    int steal;
-    int guest;
-    int guest_nice;
+    CpuLine();
+    // cumulative jiffies, from /proc/stat
+    uint64_t counters[kFieldCount];
+    // jiffies since the previous refresh
+    uint64_t active, total;
+    float utilization;
+    // false if the core was absent from the last refresh
+    bool present;
+    // -1 if unknown
+    int node, socket;
+  };
+
+  // cores which share a NUMA node or a socket
+  struct CpuGroup {
+    CpuGroup() : id(0), utilization(0) {}
+    std::vector<int> cores;
+    int id;
     float utilization;
   };
 
+  enum TargetType { kSystemTarget, kCoreTarget, kNodeTarget, kSocketTarget };
+  struct Target {
+    TargetType type;
+    int index;
+    int id;
+    bool active;
+  };
+
   void GetDescriptions(std::vector<MetricDescription> *descriptions);
+  void AddTarget(int id, TargetType type, int index);
   bool IsActivated() const;
   void Refresh();
-  void ParseCpuLine(CpuLine *dest, char **savePtr);
+  void Parse(const char *p, const char *end);
+  static void Update(const uint64_t *counters, CpuLine *line);
+  void ReadTopology(unsigned int first_core);
+  void GroupUtilization(std::vector<CpuGroup> *groups);
   void Publish(unsigned int ms);
 
-  // file handle for /proc/stat
-  int m_cpu_info_handle;
+  // /proc/stat
+  ProcFile m_stat_file;
 
   // data structures to store the parsed line
   CpuLine m_systemStats;
   std::vector<CpuLine> m_core_stats;
-
-  // stable buffer for reading
-  std::vector<char> m_buf;
+  std::vector<CpuGroup> m_nodes, m_sockets;
 
   // receives updates
   MetricSinkInterface *m_metric_sink;
 
-  // tracks subscriptions
-  std::set<int> m_active_cores;
+  // slots in m_targets of the active metrics
+  std::vector<int> m_active;
 
-  // translates metric ids to offsets
+  // translates metric ids to the cpu, core or group they describe
   int m_sysId;
   std::vector<int> m_ids;
-
-  // rate limits publication.  cpu metrics in sysfs are not accurate when
-  // polled faster than 500ms interval
-  unsigned int m_last_publish_ms;
+  // indexed by the slot bound in the MetricRegistry
+  std::vector<Target> m_targets;
+  // number of cores which have been described
+  unsigned int m_described_cores;
 
   bool m_running;
   Mutex m_protect;
@@ -0,0 +1,618 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfgl_memory_source.h"
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <algorithm>
+#include <map>
+
+#include "remote/gfimetric_sink.h"
+#include "sources/gfgpu_perf_functions.h"
+
+using Grafips::GlMemorySource;
+using Grafips::MetricDescription;
+using Grafips::MetricDescriptionSet;
+using Grafips::PerfFunctions;
+using Grafips::ScopedLock;
+
+static const float BYTES_PER_MB = 1024.0 * 1024.0;
+
+static const MetricDescriptionSet k_metrics = {
+  MetricDescription("gl/memory/textures",
+                    "estimated memory held by textures, in megabytes",
+                    "Texture Memory",
+                    Grafips::GR_METRIC_COUNT),
+  MetricDescription("gl/memory/buffers",
+                    "estimated memory held by buffer objects, in megabytes",
+                    "Buffer Memory",
+                    Grafips::GR_METRIC_COUNT),
+  MetricDescription("gl/memory/renderbuffers",
+                    "estimated memory held by renderbuffers, in megabytes",
+                    "Renderbuffer Memory",
+                    Grafips::GR_METRIC_COUNT),
+  MetricDescription("gl/memory/allocated_per_frame",
+                    "megabytes of textures, buffers and renderbuffers "
+                    "allocated per frame",
+                    "Allocated MB/Frame",
+                    Grafips::GR_METRIC_AVERAGE),
+  MetricDescription("gl/memory/freed_per_frame",
+                    "megabytes of textures, buffers and renderbuffers "
+                    "deleted or respecified per frame",
+                    "Freed MB/Frame",
+                    Grafips::GR_METRIC_AVERAGE)
+};
+
+static const int ktextures_id = k_metrics[0].id();
+static const int kbuffers_id = k_metrics[1].id();
+static const int krenderbuffers_id = k_metrics[2].id();
+static const int kallocated_id = k_metrics[3].id();
+static const int kfreed_id = k_metrics[4].id();
+
+namespace {
+
+// bits per texel for uncompressed formats.  Unsized formats are
+// estimated with the layout a driver would typically choose, and
+// 3-component formats are assumed to be padded to 4 components.
+int
+texel_bits(GLenum internal_format) {
+  switch (internal_format) {
+    case 1:
+    case GL_ALPHA:
+    case GL_ALPHA8:
+    case GL_INTENSITY:
+    case GL_INTENSITY8:
+    case GL_LUMINANCE:
+    case GL_LUMINANCE8:
+    case GL_RED:
+    case GL_R8:
+    case GL_R8I:
+    case GL_R8UI:
+    case GL_R8_SNORM:
+    case GL_STENCIL_INDEX8:
+      return 8;
+    case 2:
+    case GL_LUMINANCE_ALPHA:
+    case GL_LUMINANCE8_ALPHA8:
+    case GL_RG:
+    case GL_RG8:
+    case GL_RG8I:
+    case GL_RG8UI:
+    case GL_RG8_SNORM:
+    case GL_R16:
+    case GL_R16F:
+    case GL_R16I:
+    case GL_R16UI:
+    case GL_R16_SNORM:
+    case GL_RGB565:
+    case GL_RGB5_A1:
+    case GL_RGBA4:
+    case GL_DEPTH_COMPONENT16:
+      return 16;
+    case GL_RGBA16:
+    case GL_RGBA16F:
+    case GL_RGBA16I:
+    case GL_RGBA16UI:
+    case GL_RGBA16_SNORM:
+    case GL_RGB16:
+    case GL_RGB16F:
+    case GL_RGB16I:
+    case GL_RGB16UI:
+    case GL_RGB16_SNORM:
+    case GL_RG32F:
+    case GL_RG32I:
+    case GL_RG32UI:
+    case GL_DEPTH32F_STENCIL8:
+      return 64;
+    case GL_RGB32F:
+    case GL_RGB32I:
+    case GL_RGB32UI:
+      return 96;
+    case GL_RGBA32F:
+    case GL_RGBA32I:
+    case GL_RGBA32UI:
+      return 128;
+    default:
+      // GL_RGBA8, GL_DEPTH24_STENCIL8, GL_R32F, etc
+      return 32;
+  }
+}
+
+// block compressed formats are stored in 4x4 texel blocks.  Returns
+// the size of a block, or 0 if the format is not block compressed.
+int
+block_bytes(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_SIGNED_RED_RGTC1:
+    case GL_COMPRESSED_RGB8_ETC2:
+    case GL_COMPRESSED_SRGB8_ETC2:
+    case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+    case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+    case GL_COMPRESSED_R11_EAC:
+    case GL_COMPRESSED_SIGNED_R11_EAC:
+      return 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_RG_RGTC2:
+    case GL_COMPRESSED_SIGNED_RG_RGTC2:
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+    case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+    case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+    case GL_COMPRESSED_RGBA8_ETC2_EAC:
+    case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+    case GL_COMPRESSED_RG11_EAC:
+    case GL_COMPRESSED_SIGNED_RG11_EAC:
+    case GL_COMPRESSED_RGBA_ASTC_4x4_KHR:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+uint64_t
+image_bytes(GLenum internal_format, int width, int height, int depth) {
+  const uint64_t w = std::max(width, 1);
+  const uint64_t h = std::max(height, 1);
+  const uint64_t d = std::max(depth, 1);
+  const int block = block_bytes(internal_format);
+  if (block)
+    return ((w + 3) / 4) * ((h + 3) / 4) * d * block;
+  return w * h * d * texel_bits(internal_format) / 8;
+}
+
+// returns the enum that queries the texture bound to target, or 0
+// for proxy and unknown targets, which do not allocate memory.
+GLenum
+texture_binding(GLenum target) {
+  switch (target) {
+    case GL_TEXTURE_1D:
+      return GL_TEXTURE_BINDING_1D;
+    case GL_TEXTURE_2D:
+      return GL_TEXTURE_BINDING_2D;
+    case GL_TEXTURE_3D:
+      return GL_TEXTURE_BINDING_3D;
+    case GL_TEXTURE_1D_ARRAY:
+      return GL_TEXTURE_BINDING_1D_ARRAY;
+    case GL_TEXTURE_2D_ARRAY:
+      return GL_TEXTURE_BINDING_2D_ARRAY;
+    case GL_TEXTURE_RECTANGLE:
+      return GL_TEXTURE_BINDING_RECTANGLE;
+    case GL_TEXTURE_CUBE_MAP:
+    case GL_TEXTURE_CUBE_MAP_POSITIVE_X:
+    case GL_TEXTURE_CUBE_MAP_NEGATIVE_X:
+    case GL_TEXTURE_CUBE_MAP_POSITIVE_Y:
+    case GL_TEXTURE_CUBE_MAP_NEGATIVE_Y:
+    case GL_TEXTURE_CUBE_MAP_POSITIVE_Z:
+    case GL_TEXTURE_CUBE_MAP_NEGATIVE_Z:
+      return GL_TEXTURE_BINDING_CUBE_MAP;
+    case GL_TEXTURE_CUBE_MAP_ARRAY:
+      return GL_TEXTURE_BINDING_CUBE_MAP_ARRAY;
+    case GL_TEXTURE_2D_MULTISAMPLE:
+      return GL_TEXTURE_BINDING_2D_MULTISAMPLE;
+    case GL_TEXTURE_2D_MULTISAMPLE_ARRAY:
+      return GL_TEXTURE_BINDING_2D_MULTISAMPLE_ARRAY;
+    default:
+      return 0;
+  }
+}
+
+GLenum
+buffer_binding(GLenum target) {
+  switch (target) {
+    case GL_ARRAY_BUFFER:
+      return GL_ARRAY_BUFFER_BINDING;
+    case GL_ELEMENT_ARRAY_BUFFER:
+      return GL_ELEMENT_ARRAY_BUFFER_BINDING;
+    case GL_PIXEL_PACK_BUFFER:
+      return GL_PIXEL_PACK_BUFFER_BINDING;
+    case GL_PIXEL_UNPACK_BUFFER:
+      return GL_PIXEL_UNPACK_BUFFER_BINDING;
+    case GL_UNIFORM_BUFFER:
+      return GL_UNIFORM_BUFFER_BINDING;
+    case GL_TEXTURE_BUFFER:
+      return GL_TEXTURE_BUFFER_BINDING;
+    case GL_TRANSFORM_FEEDBACK_BUFFER:
+      return GL_TRANSFORM_FEEDBACK_BUFFER_BINDING;
+    case GL_COPY_READ_BUFFER:
+      return GL_COPY_READ_BUFFER_BINDING;
+    case GL_COPY_WRITE_BUFFER:
+      return GL_COPY_WRITE_BUFFER_BINDING;
+    case GL_DRAW_INDIRECT_BUFFER:
+      return GL_DRAW_INDIRECT_BUFFER_BINDING;
+    case GL_DISPATCH_INDIRECT_BUFFER:
+      return GL_DISPATCH_INDIRECT_BUFFER_BINDING;
+    case GL_SHADER_STORAGE_BUFFER:
+      return GL_SHADER_STORAGE_BUFFER_BINDING;
+    case GL_ATOMIC_COUNTER_BUFFER:
+      return GL_ATOMIC_COUNTER_BUFFER_BINDING;
+    case GL_QUERY_BUFFER:
+      return GL_QUERY_BUFFER_BINDING;
+    default:
+      return 0;
+  }
+}
+
+// queries the name of the object bound for the binding enum.
+// Allocations are infrequent, so the query is cheaper than wrapping
+// every glBind* entry point.
+unsigned int
+bound_object(GLenum binding) {
+  GLint name = 0;
+  PerfFunctions::GetIntegerv(binding, &name);
+  return name;
+}
+
+// texture images are keyed by level and cube face
+int
+image_key(GLenum target, int level) {
+  int face = 0;
+  if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X &&
+      target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+    face = target - GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+  return level * 6 + face;
+}
+
+}  // namespace
+
+GlMemorySource::GlMemorySource(int ms_interval)
+    : m_sink(NULL), m_next_group(0), m_current(NULL), m_texture_bytes(0),
+      m_buffer_bytes(0), m_renderbuffer_bytes(0), m_allocated_bytes(0),
+      m_freed_bytes(0), m_frame_count(0), m_ms_interval(ms_interval),
+      m_last_publish_ms(0) {
+}
+
+GlMemorySource::~GlMemorySource() {
+}
+
+void
+GlMemorySource::Subscribe(MetricSinkInterface *sink) {
+  ScopedLock s(&m_protect);
+  m_sink = sink;
+  sink->OnDescriptions(k_metrics);
+}
+
+void
+GlMemorySource::Activate(int id) {
+  ScopedLock s(&m_protect);
+  for (auto i = k_metrics.begin(); i != k_metrics.end(); ++i) {
+    if (i->id() == id) {
+      m_active_ids.insert(id);
+      return;
+    }
+  }
+}
+
+void
+GlMemorySource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.erase(id);
+}
+
+void
+GlMemorySource::OnContext(void *context) {
+  ScopedLock s(&m_protect);
+  if (context == NULL) {
+    m_current = NULL;
+    return;
+  }
+  m_current = &Group(context)->objects;
+}
+
+GlMemorySource::ShareGroup *
+GlMemorySource::Group(void *context) {
+  auto group = m_group_by_context.find(context);
+  if (group != m_group_by_context.end())
+    return &m_groups[group->second];
+  const int id = m_next_group++;
+  m_group_by_context[context] = id;
+  ShareGroup *g = &m_groups[id];
+  g->contexts = 1;
+  return g;
+}
+
+void
+GlMemorySource::OnCreateContext(void *context, void *share_context) {
+  if (context == NULL)
+    // creation failed
+    return;
+  // the address of a destroyed context may be reused
+  OnDestroyContext(context);
+
+  ScopedLock s(&m_protect);
+  if (share_context == NULL) {
+    Group(context);
+    return;
+  }
+  Group(share_context);
+  const int id = m_group_by_context[share_context];
+  m_group_by_context[context] = id;
+  ++m_groups[id].contexts;
+}
+
+void
+GlMemorySource::OnDestroyContext(void *context) {
+  ScopedLock s(&m_protect);
+  auto group = m_group_by_context.find(context);
+  if (group == m_group_by_context.end())
+    return;
+  const int id = group->second;
+  m_group_by_context.erase(group);
+  ShareGroup &g = m_groups[id];
+  if (--g.contexts > 0)
+    return;
+  FreeObjects(g.objects);
+  if (m_current == &g.objects)
+    m_current = NULL;
+  m_groups.erase(id);
+}
+
+void
+GlMemorySource::FreeObjects(const ContextObjects &objects) {
+  for (auto t = objects.textures.begin(); t != objects.textures.end(); ++t) {
+    for (auto i = t->second.begin(); i != t->second.end(); ++i) {
+      Free(i->second);
+      m_texture_bytes -= i->second;
+    }
+  }
+  for (auto b = objects.buffers.begin(); b != objects.buffers.end(); ++b) {
+    Free(b->second);
+    m_buffer_bytes -= b->second;
+  }
+  for (auto r = objects.renderbuffers.begin();
+       r != objects.renderbuffers.end(); ++r) {
+    Free(r->second);
+    m_renderbuffer_bytes -= r->second;
+  }
+}
+
+void
+GlMemorySource::Allocate(uint64_t bytes) {
+  m_allocated_bytes += bytes;
+}
+
+void
+GlMemorySource::Free(uint64_t bytes) {
+  m_freed_bytes += bytes;
+}
+
+void
+GlMemorySource::SetImage(unsigned int texture, int key, uint64_t bytes) {
+  uint64_t &image = m_current->textures[texture][key];
+  Free(image);
+  m_texture_bytes -= image;
+  image = bytes;
+  Allocate(bytes);
+  m_texture_bytes += bytes;
+}
+
+void
+GlMemorySource::SetObject(std::map<unsigned int, uint64_t> *objects,
+                          unsigned int name, uint64_t bytes,
+                          uint64_t *total) {
+  uint64_t &object = (*objects)[name];
+  Free(object);
+  *total -= object;
+  object = bytes;
+  Allocate(bytes);
+  *total += bytes;
+}
+
+void
+GlMemorySource::DeleteObjects(std::map<unsigned int, uint64_t> *objects,
+                              int n, const unsigned int *names,
+                              uint64_t *total) {
+  for (int i = 0; i < n; ++i) {
+    auto object = objects->find(names[i]);
+    if (object == objects->end())
+      continue;
+    Free(object->second);
+    *total -= object->second;
+    objects->erase(object);
+  }
+}
+
+void
+GlMemorySource::OnTexImage(unsigned int target, int level,
+                           unsigned int internal_format,
+                           int width, int height, int depth, int samples) {
+  ScopedLock s(&m_protect);
+  if (!m_current)
+    return;
+  const GLenum binding = texture_binding(target);
+  if (!binding)
+    return;
+  const uint64_t bytes = image_bytes(internal_format, width, height, depth) *
+                         std::max(samples, 1);
+  SetImage(bound_object(binding), image_key(target, level), bytes);
+}
+
+void
+GlMemorySource::OnCompressedTexImage(unsigned int target, int level,
+                                     int image_size) {
+  ScopedLock s(&m_protect);
+  if (!m_current)
+    return;
+  const GLenum binding = texture_binding(target);
+  if (!binding)
+    return;
+  SetImage(bound_object(binding), image_key(target, level), image_size);
+}
+
+void
+GlMemorySource::OnTexStorage(unsigned int target, int levels,
+                             unsigned int internal_format,
+                             int width, int height, int depth, int samples) {
+  ScopedLock s(&m_protect);
+  if (!m_current)
+    return;
+  const GLenum binding = texture_binding(target);
+  if (!binding)
+    return;
+  const unsigned int texture = bound_object(binding);
+
+  // immutable storage replaces any images previously specified for
+  // the texture.
+  ImageSizes &images = m_current->textures[texture];
+  for (auto i = images.begin(); i != images.end(); ++i) {
+    Free(i->second);
+    m_texture_bytes -= i->second;
+  }
+  images.clear();
+
+  // the faces of a cube map are accounted to the face 0 image of
+  // each level.  Array layers do not shrink with the level.
+  const int faces = (target == GL_TEXTURE_CUBE_MAP) ? 6 : 1;
+  for (int level = 0; level < levels; ++level) {
+    const int w = std::max(width >> level, 1);
+    const int h = (target == GL_TEXTURE_1D_ARRAY) ? height :
+                  std::max(height >> level, 1);
+    const int d = (target == GL_TEXTURE_3D) ? std::max(depth >> level, 1) :
+                  depth;
+    const uint64_t bytes = image_bytes(internal_format, w, h, d) * faces *
+                           std::max(samples, 1);
+    SetImage(texture, image_key(target, level), bytes);
+  }
+}
+
+void
+GlMemorySource::OnBufferData(unsigned int target, int64_t size) {
+  ScopedLock s(&m_protect);
+  if (!m_current)
+    return;
+  const GLenum binding = buffer_binding(target);
+  if (!binding)
+    return;
+  const unsigned int buffer = bound_object(binding);
+  if (buffer == 0)
+    // no buffer bound, the call generates an error
+    return;
+  SetObject(&m_current->buffers, buffer, size, &m_buffer_bytes);
+}
+
+void
+GlMemorySource::OnNamedBufferData(unsigned int buffer, int64_t size) {
+  ScopedLock s(&m_protect);
+  if (!m_current || buffer == 0)
+    return;
+  SetObject(&m_current->buffers, buffer, size, &m_buffer_bytes);
+}
+
+void
+GlMemorySource::OnRenderbufferStorage(unsigned int target, int samples,
+                                      unsigned int internal_format,
+                                      int width, int height) {
+  ScopedLock s(&m_protect);
+  if (!m_current || target != GL_RENDERBUFFER)
+    return;
+  const unsigned int renderbuffer = bound_object(GL_RENDERBUFFER_BINDING);
+  if (renderbuffer == 0)
+    return;
+  const uint64_t bytes = image_bytes(internal_format, width, height, 1) *
+                         std::max(samples, 1);
+  SetObject(&m_current->renderbuffers, renderbuffer, bytes,
+            &m_renderbuffer_bytes);
+}
+
+void
+GlMemorySource::OnDeleteTextures(int n, const unsigned int *textures) {
+  ScopedLock s(&m_protect);
+  if (!m_current)
+    return;
+  for (int i = 0; i < n; ++i) {
+    auto texture = m_current->textures.find(textures[i]);
+    if (texture == m_current->textures.end())
+      continue;
+    for (auto image = texture->second.begin();
+         image != texture->second.end(); ++image) {
+      Free(image->second);
+      m_texture_bytes -= image->second;
+    }
+    m_current->textures.erase(texture);
+  }
+}
+
+void
+GlMemorySource::OnDeleteBuffers(int n, const unsigned int *buffers) {
+  ScopedLock s(&m_protect);
+  if (!m_current)
+    return;
+  DeleteObjects(&m_current->buffers, n, buffers, &m_buffer_bytes);
+}
+
+void
+GlMemorySource::OnDeleteRenderbuffers(int n,
+                                      const unsigned int *renderbuffers) {
+  ScopedLock s(&m_protect);
+  if (!m_current)
+    return;
+  DeleteObjects(&m_current->renderbuffers, n, renderbuffers,
+                &m_renderbuffer_bytes);
+}
+
+void
+GlMemorySource::glSwapBuffers() {
+  ScopedLock s(&m_protect);
+  if (m_active_ids.empty() || !m_sink) {
+    // churn is only meaningful for the interval being published
+    m_allocated_bytes = 0;
+    m_freed_bytes = 0;
+    m_frame_count = 0;
+    return;
+  }
+
+  ++m_frame_count;
+  const unsigned int ms = get_ms_time();
+  if (ms - m_last_publish_ms < static_cast<unsigned int>(m_ms_interval))
+    return;
+  m_last_publish_ms = ms;
+
+  DataSet d;
+  if (m_active_ids.count(ktextures_id))
+    d.push_back(DataPoint(ms, ktextures_id, m_texture_bytes / BYTES_PER_MB));
+  if (m_active_ids.count(kbuffers_id))
+    d.push_back(DataPoint(ms, kbuffers_id, m_buffer_bytes / BYTES_PER_MB));
+  if (m_active_ids.count(krenderbuffers_id))
+    d.push_back(DataPoint(ms, krenderbuffers_id,
+                          m_renderbuffer_bytes / BYTES_PER_MB));
+  if (m_active_ids.count(kallocated_id))
+    d.push_back(DataPoint(ms, kallocated_id,
+                          m_allocated_bytes / BYTES_PER_MB / m_frame_count));
+  if (m_active_ids.count(kfreed_id))
+    d.push_back(DataPoint(ms, kfreed_id,
+                          m_freed_bytes / BYTES_PER_MB / m_frame_count));
+  m_allocated_bytes = 0;
+  m_freed_bytes = 0;
+  m_frame_count = 0;
+
+  m_sink->OnMetric(d);
+}
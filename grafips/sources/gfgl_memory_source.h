@@ -0,0 +1,124 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFGL_MEMORY_SOURCE_H_
+#define SOURCES_GFGL_MEMORY_SOURCE_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+
+#include "sources/gfimetric_source.h"
+#include "os/gfmutex.h"
+
+namespace Grafips {
+class MetricSinkInterface;
+
+// GlMemorySource estimates the gpu memory held by the application.
+// The GL wrappers report texture, buffer and renderbuffer allocations
+// and deletions for the current context, which are accounted to its
+// share group.  The size of each object is
+// estimated from its dimensions, levels, samples and internal format,
+// because the driver does not expose the real footprint.
+class GlMemorySource : public MetricSourceInterface {
+ public:
+  explicit GlMemorySource(int ms_interval = 300);
+  ~GlMemorySource();
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+
+  void OnContext(void *context);
+  // share_context is NULL, or the context whose objects are shared
+  void OnCreateContext(void *context, void *share_context);
+  // frees the objects of the share group, if context was its last
+  void OnDestroyContext(void *context);
+  void OnTexImage(unsigned int target, int level, unsigned int internal_format,
+                  int width, int height, int depth, int samples);
+  void OnCompressedTexImage(unsigned int target, int level, int image_size);
+  void OnTexStorage(unsigned int target, int levels,
+                    unsigned int internal_format,
+                    int width, int height, int depth, int samples);
+  void OnBufferData(unsigned int target, int64_t size);
+  void OnNamedBufferData(unsigned int buffer, int64_t size);
+  void OnRenderbufferStorage(unsigned int target, int samples,
+                             unsigned int internal_format,
+                             int width, int height);
+  void OnDeleteTextures(int n, const unsigned int *textures);
+  void OnDeleteBuffers(int n, const unsigned int *buffers);
+  void OnDeleteRenderbuffers(int n, const unsigned int *renderbuffers);
+  void glSwapBuffers();
+
+ private:
+  // objects are named per share group, so an object may be deleted
+  // by any context which shares with the one that created it.
+  // Texture images are keyed by level and cube face, so that
+  // respecifying a single level replaces the previous estimate for
+  // that level.
+  typedef std::map<int, uint64_t> ImageSizes;
+  struct ContextObjects {
+    std::map<unsigned int, ImageSizes> textures;
+    std::map<unsigned int, uint64_t> buffers;
+    std::map<unsigned int, uint64_t> renderbuffers;
+  };
+  struct ShareGroup {
+    ShareGroup() : contexts(0) {}
+    ContextObjects objects;
+    int contexts;
+  };
+
+  // the share group of context, which is created for contexts that
+  // were not seen by OnCreateContext
+  ShareGroup *Group(void *context);
+  void FreeObjects(const ContextObjects &objects);
+
+  void SetImage(unsigned int texture, int key, uint64_t bytes);
+  void SetObject(std::map<unsigned int, uint64_t> *objects,
+                 unsigned int name, uint64_t bytes, uint64_t *total);
+  void DeleteObjects(std::map<unsigned int, uint64_t> *objects,
+                     int n, const unsigned int *names, uint64_t *total);
+  void Allocate(uint64_t bytes);
+  void Free(uint64_t bytes);
+
+  MetricSinkInterface *m_sink;
+  std::map<void *, int> m_group_by_context;
+  std::map<int, ShareGroup> m_groups;
+  int m_next_group;
+  ContextObjects *m_current;
+  uint64_t m_texture_bytes, m_buffer_bytes, m_renderbuffer_bytes;
+
+  // churn since the last publication
+  uint64_t m_allocated_bytes, m_freed_bytes;
+  int m_frame_count;
+  const int m_ms_interval;
+  unsigned int m_last_publish_ms;
+  std::set<int> m_active_ids;
+  Mutex m_protect;
+};
+}  // end namespace Grafips
+#endif  // SOURCES_GFGL_MEMORY_SOURCE_H_
@@ -27,19 +27,24 @@
 
 #include "sources/gfgl_source.h"
 
+#include <GL/gl.h>
+#include <GL/glext.h>
 #include <assert.h>
 
 #include <string>
 
 #include "remote/gfpublisher.h"
 #include "remote/gfimetric_sink.h"
+#include "sources/gfgpu_perf_functions.h"
 
 using Grafips::GlSource;
 using Grafips::MetricDescriptionSet;
 using Grafips::MetricDescription;
 using Grafips::MetricType;
+using Grafips::PerfFunctions;
+using Grafips::ScopedLock;
+using Grafips::get_ns_time;
 
-const int NANO_SECONDS_PER_SEC = 1000000000;
 const int NANO_SECONDS_PER_MS = 1000000;
 static const MetricDescriptionSet k_metrics = {
   MetricDescription("gl/fps",
@@ -50,18 +55,41 @@ static const MetricDescriptionSet k_metrics = {
                     "measures the time spent rendering the "
                     "frame in milliseconds",
                     "Frame Time",
-                    Grafips::GR_METRIC_COUNT)
+                    Grafips::GR_METRIC_COUNT),
+  MetricDescription("gl/cpu_frame_time",
+                    "measures the time the application spends between "
+                    "swaps, excluding time blocked in the swap, in "
+                    "milliseconds",
+                    "CPU Frame Time",
+                    Grafips::GR_METRIC_COUNT),
+  MetricDescription("gl/gpu_frame_time",
+                    "measures the time the gpu spends executing the "
+                    "frame, from a time elapsed query, in milliseconds",
+                    "GPU Frame Time",
+                    Grafips::GR_METRIC_COUNT),
+  MetricDescription("gl/gpu_busy_percent",
+                    "percentage of the frame time spent executing on "
+                    "the gpu",
+                    "GPU Busy",
+                    Grafips::GR_METRIC_PERCENT)
 };
 
 static const int kfps_id = k_metrics[0].id();
 static const int kframe_time_id = k_metrics[1].id();
+static const int kcpu_frame_time_id = k_metrics[2].id();
+static const int kgpu_frame_time_id = k_metrics[3].id();
+static const int kgpu_busy_id = k_metrics[4].id();
 
 GlSource::GlSource(int ms_interval)
-    : m_sink(NULL), m_last_time_ns(0), m_frame_count(0),
+    : m_current_context(NULL), m_ring(NULL), m_sink(NULL), m_last_time_ns(0),
+      m_frame_begin_ns(0), m_prev_swap_ns(0),
+      m_gpu_time_ns(0), m_frame_count(0), m_gpu_frame_count(0),
       m_ms_interval(ms_interval) {
 }
 
 GlSource::~GlSource() {
+  // query objects belong to the application's context, which may not
+  // be current.  They are released with the context.
 }
 
 void
@@ -83,25 +111,181 @@ GlSource::GetDescriptions(MetricDescriptionSet *descriptions) {
 
 void
 GlSource::Activate(int id) {
+  ScopedLock s(&m_protect);
   m_active_ids.insert(id);
 }
 
 void
 GlSource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
   m_active_ids.erase(id);
 }
 
 void
-GlSource::glSwapBuffers() {
+GlSource::OnContext(void *context) {
+  ScopedLock s(&m_protect);
+  m_current_context = context;
+  m_ring = context ? &m_rings[context] : NULL;
+}
+
+void
+GlSource::OnDestroyContext(void *context) {
+  ScopedLock s(&m_protect);
+  auto ring = m_rings.find(context);
+  if (ring == m_rings.end())
+    return;
+  if (context == m_current_context) {
+    if (!ring->second.queries.empty())
+      PerfFunctions::DeleteQueries(ring->second.queries.size(),
+                                   ring->second.queries.data());
+    m_ring = NULL;
+  }
+  // otherwise the queries are freed with the context
+  m_rings.erase(ring);
+}
+
+bool
+GlSource::GpuTimingActive() const {
+  return (m_active_ids.count(kgpu_frame_time_id) ||
+          m_active_ids.count(kgpu_busy_id));
+}
+
+void
+GlSource::BeginGpuFrame() {
+  if (!m_ring || m_ring->in_frame)
+    return;
+
+  if (m_ring->queries.empty()) {
+    if (!m_ring->checked) {
+      m_ring->checked = true;
+      m_ring->supported = PerfFunctions::HasTimerQuery();
+    }
+    if (!m_ring->supported)
+      return;
+    m_ring->queries.resize(kQueryRingSize);
+    PerfFunctions::GenQueries(kQueryRingSize, m_ring->queries.data());
+  }
+
+  if (m_ring->count == kQueryRingSize)
+    // gpu is too far behind, skip this frame rather than stall
+    return;
+
+  const int slot = (m_ring->first + m_ring->count) % kQueryRingSize;
+  PerfFunctions::BeginElapsedQuery(m_ring->queries[slot]);
+  m_ring->in_frame = true;
+}
+
+void
+GlSource::EndGpuFrame() {
+  if (!m_ring || !m_ring->in_frame)
+    return;
+  PerfFunctions::EndElapsedQuery();
+  ++m_ring->count;
+  m_ring->in_frame = false;
+}
+
+void
+GlSource::CollectGpuFrames() {
+  if (!m_ring)
+    return;
+  while (m_ring->count > 0) {
+    const unsigned int q = m_ring->queries[m_ring->first];
+    GLint available = 0;
+    PerfFunctions::GetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE,
+                                    &available);
+    if (!available)
+      break;
+
+    GLuint64 elapsed_ns = 0;
+    PerfFunctions::GetQueryObjectui64v(q, GL_QUERY_RESULT, &elapsed_ns);
+    m_gpu_time_ns += elapsed_ns;
+    ++m_gpu_frame_count;
+    // results lag the cpu by a few frames
+    if (Active(kgpu_frame_time_id))
+      m_frame_points.push_back(
+          DataPoint(get_ms_time(), kgpu_frame_time_id,
+                    static_cast<double>(elapsed_ns) / NANO_SECONDS_PER_MS));
+
+    m_ring->first = (m_ring->first + 1) % kQueryRingSize;
+    --m_ring->count;
+  }
+}
+
+void
+GlSource::DropGpuFrames() {
+  // The query of a frame in progress keeps its slot.  Pending results
+  // are discarded when the queries are reused.
+  for (auto i = m_rings.begin(); i != m_rings.end(); ++i) {
+    QueryRing *ring = &i->second;
+    ring->first = (ring->first + ring->count) % kQueryRingSize;
+    ring->count = 0;
+  }
+}
+
+void
+GlSource::ResetInterval() {
+  m_frame_count = 0;
+  m_gpu_frame_count = 0;
+  m_gpu_time_ns = 0;
+}
+
+void
+GlSource::OnSwapBuffers() {
+  ScopedLock s(&m_protect);
+  // A query begun by the previous swap is ended even if its metrics
+  // were deactivated since, so the application may begin its own
+  // GL_TIME_ELAPSED queries.
+  EndGpuFrame();
   if (m_active_ids.empty())
     return;
 
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
-  const uint64_t current_time_ns = ts.tv_sec * NANO_SECONDS_PER_SEC
-                                   + ts.tv_nsec;
+  if (m_frame_begin_ns) {
+    const uint64_t cpu_frame_ns = get_ns_time() - m_frame_begin_ns;
+    if (Active(kcpu_frame_time_id))
+      m_frame_points.push_back(
+          DataPoint(get_ms_time(), kcpu_frame_time_id,
+                    static_cast<double>(cpu_frame_ns) / NANO_SECONDS_PER_MS));
+  }
+}
+
+void
+GlSource::glSwapBuffers() {
+  ScopedLock s(&m_protect);
+  if (m_active_ids.empty()) {
+    // start a new interval on the next activation
+    m_last_time_ns = 0;
+    m_frame_begin_ns = 0;
+    m_prev_swap_ns = 0;
+    m_frame_points.clear();
+    DropGpuFrames();
+    ResetInterval();
+    return;
+  }
+
+  const uint64_t current_time_ns = get_ns_time();
+  m_frame_begin_ns = current_time_ns;
+
+  if (GpuTimingActive()) {
+    CollectGpuFrames();
+    BeginGpuFrame();
+  } else {
+    DropGpuFrames();
+  }
+
+  if (m_prev_swap_ns && Active(kframe_time_id))
+    m_frame_points.push_back(
+        DataPoint(get_ms_time(), kframe_time_id,
+                  static_cast<double>(current_time_ns - m_prev_swap_ns) /
+                  NANO_SECONDS_PER_MS));
+  m_prev_swap_ns = current_time_ns;
+  if (!m_frame_points.empty()) {
+    m_sink->OnMetric(m_frame_points);
+    m_frame_points.clear();
+  }
+
   if (!m_last_time_ns) {
     m_last_time_ns = current_time_ns;
+    ResetInterval();
     return;
   }
 
@@ -114,7 +298,6 @@ GlSource::glSwapBuffers() {
 
   const float frame_time_ms = frame_time_ns / NANO_SECONDS_PER_MS /
                               m_frame_count;
-  m_frame_count = 0;
 
   DataSet d;
   const unsigned int ms = get_ms_time();
@@ -122,10 +305,21 @@ GlSource::glSwapBuffers() {
     const float fps = 1000.0 / frame_time_ms;
     d.push_back(DataPoint(ms, kfps_id, fps));
   }
-  if (m_active_ids.find(kframe_time_id) !=  m_active_ids.end()) {
-    d.push_back(DataPoint(ms, kframe_time_id, frame_time_ms));
+  if (m_gpu_frame_count) {
+    // gpu results lag the cpu by a few frames, which is acceptable
+    // for an average over the interval.
+    const float gpu_frame_time_ms = static_cast<float>(m_gpu_time_ns) /
+                                    NANO_SECONDS_PER_MS / m_gpu_frame_count;
+    if (m_active_ids.find(kgpu_busy_id) !=  m_active_ids.end()) {
+      float busy = gpu_frame_time_ms / frame_time_ms * 100.0;
+      if (busy > 100.0)
+        busy = 100.0;
+      d.push_back(DataPoint(ms, kgpu_busy_id, busy));
+    }
   }
+  ResetInterval();
 
-  m_sink->OnMetric(d);
+  if (!d.empty())
+    m_sink->OnMetric(d);
   m_last_time_ns = current_time_ns;
 }
@@ -28,9 +28,12 @@
 #ifndef SOURCES_GFGL_SOURCE_H_
 #define SOURCES_GFGL_SOURCE_H_
 
+#include <map>
 #include <set>
+#include <vector>
 
 #include "sources/gfimetric_source.h"
+#include "os/gfmutex.h"
 
 namespace Grafips {
 class MetricSinkInterface;
@@ -43,14 +46,58 @@ class GlSource : public MetricSourceInterface {
   void Subscribe(MetricSinkInterface *sink);
   void Activate(int id);
   void Deactivate(int id);
+  void OnContext(void *context);
+  // releases the queries of a context which is being destroyed
+  void OnDestroyContext(void *context);
+  // called before the application's swap, to end the frame
+  void OnSwapBuffers();
+  // called after the application's swap, to begin the next frame
   void glSwapBuffers();
  private:
   void GetDescriptions(MetricDescriptionSet *descriptions);
+  bool GpuTimingActive() const;
+  void BeginGpuFrame();
+  void EndGpuFrame();
+  void CollectGpuFrames();
+  // discards the frames which have not been collected, when gpu
+  // timing stops, so they are not published on reactivation
+  void DropGpuFrames();
+  void ResetInterval();
+  bool Active(int id) const { return m_active_ids.count(id) != 0; }
+
+  // A GL_TIME_ELAPSED query around each frame measures the time the
+  // gpu spends executing it, rather than the time between two points
+  // in the command stream, which includes the gpu waiting for the
+  // application.  Results are read back several frames later, once
+  // they are available, so the application is never stalled.  Query
+  // objects belong to the context that created them, so each context
+  // recycles its own ring of them, and a frame is skipped if the ring
+  // is full.
+  struct QueryRing {
+    QueryRing() : first(0), count(0), in_frame(false), checked(false),
+                  supported(false) {}
+    std::vector<unsigned int> queries;
+    int first, count;
+    bool in_frame;
+    // true once the context's support for timer queries is known
+    bool checked, supported;
+  };
+  static const int kQueryRingSize = 8;
+  std::map<void *, QueryRing> m_rings;
+  void *m_current_context;
+  // ring of the current context, or NULL
+  QueryRing *m_ring;
 
   MetricSinkInterface *m_sink;
-  uint64_t m_last_time_ns;
-  int m_frame_count, m_ms_interval;
+  // Frame times are published for every frame, so the publisher can
+  // aggregate them without losing spikes.  FPS and GPU busy are
+  // published once per interval.
+  DataSet m_frame_points;
+  uint64_t m_last_time_ns, m_frame_begin_ns, m_prev_swap_ns;
+  uint64_t m_gpu_time_ns;
+  int m_frame_count, m_gpu_frame_count, m_ms_interval;
   std::set<int> m_active_ids;
+  Mutex m_protect;
 };
 }  // end namespace Grafips
 #endif  // SOURCES_GFGL_SOURCE_H_
@@ -31,7 +31,9 @@
 #include <GL/glext.h>
 #include <GL/glx.h>
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <dlfcn.h>
 
 using Grafips::PerfFunctions;
@@ -139,6 +141,66 @@ static const PFNGLGETINTEGERV *p_glGetIntegerv = NULL;
 typedef void (PFNGLDISABLE)(GLenum pname);
 static const PFNGLDISABLE *p_glDisable = NULL;
 
+// timer queries are optional, they are not asserted in Init()
+typedef void (PFNGLGENQUERIES)(GLsizei n, GLuint *ids);
+static const PFNGLGENQUERIES *p_glGenQueries = NULL;
+
+typedef void (PFNGLDELETEQUERIES)(GLsizei n, const GLuint *ids);
+static const PFNGLDELETEQUERIES *p_glDeleteQueries = NULL;
+
+typedef void (PFNGLBEGINQUERYTARGET)(GLenum target, GLuint id);
+static const PFNGLBEGINQUERYTARGET *p_glBeginQuery = NULL;
+
+typedef void (PFNGLENDQUERYTARGET)(GLenum target);
+static const PFNGLENDQUERYTARGET *p_glEndQuery = NULL;
+
+typedef void (PFNGLGETQUERYOBJECTIV)(GLuint id, GLenum pname, GLint *params);
+static const PFNGLGETQUERYOBJECTIV *p_glGetQueryObjectiv = NULL;
+
+typedef void (PFNGLGETQUERYOBJECTUI64V)(GLuint id, GLenum pname,
+                                        GLuint64 *params);
+static const PFNGLGETQUERYOBJECTUI64V *p_glGetQueryObjectui64v = NULL;
+
+typedef const GLubyte *(PFNGLGETSTRING)(GLenum name);
+static const PFNGLGETSTRING *p_glGetString = NULL;
+
+typedef const GLubyte *(PFNGLGETSTRINGI)(GLenum name, GLuint index);
+static const PFNGLGETSTRINGI *p_glGetStringi = NULL;
+
+// true if the current context supports the extension.  Core
+// profiles do not provide GL_EXTENSIONS to glGetString, so contexts
+// of version 3 or later are queried by index.
+bool
+HasExtension(const char *extension, bool indexed) {
+  if (indexed) {
+    if (!p_glGetStringi)
+      return false;
+    GLint count = 0;
+    p_glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+      const char *name = reinterpret_cast<const char *>(
+          p_glGetStringi(GL_EXTENSIONS, i));
+      if (name && strcmp(name, extension) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  const char *extensions = reinterpret_cast<const char *>(
+      p_glGetString(GL_EXTENSIONS));
+  if (!extensions)
+    return false;
+  // match whole names, not the prefix of a longer name
+  const size_t len = strlen(extension);
+  for (const char *p = strstr(extensions, extension); p != NULL;
+       p = strstr(p + len, extension)) {
+    if ((p == extensions || p[-1] == ' ') &&
+        (p[len] == ' ' || p[len] == '\0'))
+      return true;
+  }
+  return false;
+}
+
 }  // namespace
 
 void
@@ -310,6 +372,32 @@ PerfFunctions::Init(void *lookup_fn) {
   name = reinterpret_cast<const GLubyte*>("glDisable");
   p_glDisable = reinterpret_cast<PFNGLDISABLE*>(get_proc(name));
   assert(p_glDisable);
+
+  name = reinterpret_cast<const GLubyte*>("glGenQueries");
+  p_glGenQueries = reinterpret_cast<PFNGLGENQUERIES*>(get_proc(name));
+
+  name = reinterpret_cast<const GLubyte*>("glDeleteQueries");
+  p_glDeleteQueries = reinterpret_cast<PFNGLDELETEQUERIES*>(get_proc(name));
+
+  name = reinterpret_cast<const GLubyte*>("glBeginQuery");
+  p_glBeginQuery = reinterpret_cast<PFNGLBEGINQUERYTARGET*>(get_proc(name));
+
+  name = reinterpret_cast<const GLubyte*>("glEndQuery");
+  p_glEndQuery = reinterpret_cast<PFNGLENDQUERYTARGET*>(get_proc(name));
+
+  name = reinterpret_cast<const GLubyte*>("glGetQueryObjectiv");
+  p_glGetQueryObjectiv =
+      reinterpret_cast<PFNGLGETQUERYOBJECTIV*>(get_proc(name));
+
+  name = reinterpret_cast<const GLubyte*>("glGetQueryObjectui64v");
+  p_glGetQueryObjectui64v =
+      reinterpret_cast<PFNGLGETQUERYOBJECTUI64V*>(get_proc(name));
+
+  name = reinterpret_cast<const GLubyte*>("glGetString");
+  p_glGetString = reinterpret_cast<PFNGLGETSTRING*>(get_proc(name));
+
+  name = reinterpret_cast<const GLubyte*>("glGetStringi");
+  p_glGetStringi = reinterpret_cast<PFNGLGETSTRINGI*>(get_proc(name));
 }
 
 void
@@ -499,3 +587,59 @@ void
 PerfFunctions::Disable(GLenum cap) {
   p_glDisable(cap);
 }
+
+bool
+PerfFunctions::HasTimerQuery() {
+  // glXGetProcAddress returns a stub for any gl name, so the entry
+  // points do not show that the context supports them.
+  if (!(p_glGenQueries && p_glDeleteQueries && p_glBeginQuery &&
+        p_glEndQuery && p_glGetQueryObjectiv && p_glGetQueryObjectui64v &&
+        p_glGetString))
+    return false;
+
+  const char *version = reinterpret_cast<const char *>(
+      p_glGetString(GL_VERSION));
+  if (!version)
+    return false;
+  static const char kEsPrefix[] = "OpenGL ES";
+  if (strncmp(version, kEsPrefix, strlen(kEsPrefix)) == 0)
+    return HasExtension("GL_EXT_disjoint_timer_query", false);
+
+  int major = 0, minor = 0;
+  if (sscanf(version, "%d.%d", &major, &minor) != 2)
+    return false;
+  if (major > 3 || (major == 3 && minor >= 3))
+    return true;
+  return HasExtension("GL_ARB_timer_query", major >= 3);
+}
+
+void
+PerfFunctions::GenQueries(GLsizei n, GLuint *ids) {
+  p_glGenQueries(n, ids);
+}
+
+void
+PerfFunctions::DeleteQueries(GLsizei n, const GLuint *ids) {
+  p_glDeleteQueries(n, ids);
+}
+
+void
+PerfFunctions::BeginElapsedQuery(GLuint id) {
+  p_glBeginQuery(GL_TIME_ELAPSED, id);
+}
+
+void
+PerfFunctions::EndElapsedQuery() {
+  p_glEndQuery(GL_TIME_ELAPSED);
+}
+
+void
+PerfFunctions::GetQueryObjectiv(GLuint id, GLenum pname, GLint *params) {
+  p_glGetQueryObjectiv(id, pname, params);
+}
+
+void
+PerfFunctions::GetQueryObjectui64v(GLuint id, GLenum pname,
+                                   GLuint64 *params) {
+  p_glGetQueryObjectui64v(id, pname, params);
+}
@@ -98,6 +98,18 @@ class PerfFunctions {
   static void GetIntegerv(GLenum pname, GLint *params);
   static void Disable(GLenum cap);
 
+  // ARB_timer_query, which may not be supported by the driver.
+  // HasTimerQuery checks the current context, from its version and
+  // extensions.
+  static bool HasTimerQuery();
+  static void GenQueries(GLsizei n, GLuint *ids);
+  static void DeleteQueries(GLsizei n, const GLuint *ids);
+  // GL_TIME_ELAPSED query around the commands between the calls
+  static void BeginElapsedQuery(GLuint id);
+  static void EndElapsedQuery();
+  static void GetQueryObjectiv(GLuint id, GLenum pname, GLint *params);
+  static void GetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params);
+
  private:
   PerfFunctions();
   static bool m_is_initialized;
@@ -36,11 +36,13 @@
 #include <map>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "error/gflog.h"
 #include "os/gftraits.h"
 #include "remote/gfimetric_sink.h"
+#include "remote/gfmetric_registry.h"
 #include "sources/gfgpu_perf_functions.h"
 
 using Grafips::DataPoint;
@@ -56,20 +58,24 @@ using Grafips::PerfFunctions;
 using Grafips::PerfMetricSet;
 using Grafips::ScopedLock;
 using Grafips::get_ms_time;
+using Grafips::get_ns_time;
 
 namespace {
 
+// a group which is sampled alone publishes at this interval
+const unsigned int kPublishMs = 300;
+
 class PerfMetric : public NoCopy, NoAssign {
  public:
-  PerfMetric(int query_id, int counter_num, MetricSinkInterface *sink);
+  PerfMetric(int query_id, int counter_num);
   ~PerfMetric() { delete m_grafips_desc; }
   void AppendDescription(MetricDescriptionSet *descriptions, bool enabled);
-  bool Activate(int id);
-  bool Deactivate(int id);
-  void Publish(const std::vector<unsigned char> &data, int frame_count);
+  int id() const { return m_grafips_desc->id(); }
+  // appends the counter value to d
+  void Publish(const std::vector<unsigned char> &data, int frame_count,
+               DataSet *d);
  private:
   const int m_query_id, m_counter_num;
-  MetricSinkInterface *m_sink;
   GLuint m_offset, m_data_size, m_type,
     m_data_type;
   GLuint64 m_max_value;
@@ -77,60 +83,107 @@ class PerfMetric : public NoCopy, NoAssign {
   MetricDescription *m_grafips_desc;
 };
 
+// The counters of a single INTEL_performance_query.  Only one query
+// may be measured at a time, so the frames are divided into slices,
+// each of which is measured by one of the active groups.
 class PerfMetricGroup : public NoCopy, NoAssign {
  public:
   PerfMetricGroup(int query_id, MetricSinkInterface *sink);
   ~PerfMetricGroup();
-  void AppendDescriptions(MetricDescriptionSet *descriptions, bool enabled);
+  void AppendDescriptions(MetricDescriptionSet *descriptions);
+  // appends the ids of the counters in the group
+  void AppendIds(std::vector<int> *ids) const;
   bool Activate(int id);
   bool Deactivate(int id);
-  void SwapBuffers();
+  bool IsActive() const { return !m_active_metric_indices.empty(); }
+
+  // begins a query, which measures frames until EndSlice
+  void BeginSlice();
+  void Frame() { ++m_frame_count; }
+  int slice_frames() const { return m_frame_count; }
+  unsigned int slice_ms() const { return get_ms_time() - m_slice_start_ms; }
+  // ends the query begun by BeginSlice.  frame counts the frames of
+  // every group, to find the share of them that the slice measured.
+  void EndSlice(int frame);
+  // publishes the queries which have produced results
+  void Collect();
+  // ends and deletes the queries.  Requires the context of the
+  // queries, so is called by the render thread.
+  void Flush();
 
  private:
-  const std::string m_query_name;
+
+  std::string m_query_name;
   const int m_query_id;
+  MetricSinkInterface *m_sink;
   unsigned int m_data_size;
   unsigned int m_number_counters;
   unsigned int m_capabilities_mask;
   std::vector<unsigned char> m_data_buf;
 
   std::vector<PerfMetric *> m_metrics;
+  // offset in m_metrics of each metric id
+  std::unordered_map<int, int> m_index_by_id;
 
   // indicates offset in m_metrics of active metrics
   std::vector<int> m_active_metric_indices;
 
+  // percent of frames measured by the group
+  MetricDescription m_coverage;
+
   // represent queries that have not produced results
   struct ExtantQuery {
-    ExtantQuery(int _h, int _f) : handle(_h), frames(_f) {}
+    ExtantQuery(int _h, int _f, float _c)
+        : handle(_h), frames(_f), coverage(_c) {}
     unsigned int handle;
     int frames;
+    float coverage;
   };
   std::vector<ExtantQuery> m_extant_query_handles;
   // represent query handles that can be reused
   std::vector<unsigned int> m_free_query_handles;
   unsigned int m_current_query_handle;
   int m_frame_count;
-  int m_last_publish_ms;
+  unsigned int m_slice_start_ms;
+  // frame at the end of the previous slice, or -1
+  int m_last_slice_frame;
 };
 }  // namespace
 
 class PerfMetricSet : public NoCopy, NoAssign {
  public:
-  explicit PerfMetricSet(MetricSinkInterface *sink);
+  PerfMetricSet(MetricSinkInterface *sink, int slice_frames);
   ~PerfMetricSet();
   void GetDescriptions(MetricDescriptionSet *descriptions);
-  void Activate(int id, MetricSinkInterface *sink);
-  void Deactivate(int id, MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
   void SwapBuffers();
  private:
+  // begins a slice of the active group after m_sampling_group
+  void NextSlice();
+
   std::vector<PerfMetricGroup *> m_metric_groups;
-  int m_active_group;
-  int m_active_count;
+  // offsets in m_metric_groups of the groups which provide each id
+  std::unordered_map<int, std::vector<int> > m_groups_by_id;
+  // offset in m_metric_groups of the group which measures each
+  // active id
+  std::unordered_map<int, int> m_group_by_active_id;
+  // offsets in m_metric_groups of groups with active metrics, in the
+  // order they are sampled
+  std::vector<int> m_active_groups;
+  // offset in m_metric_groups of the group being measured, or -1
+  int m_sampling_group;
+  // offsets in m_metric_groups of groups whose last metric was
+  // deactivated.  Deactivate is called by the publisher, which has no
+  // GL context, so the queries are deleted at the next swap.
+  std::vector<int> m_flush_groups;
+  const int m_slice_frames;
+  int m_frame;
 };
 
 
 GpuPerfSource::GpuPerfSource()
-    : m_sink(NULL), m_metrics(NULL) {
+    : m_sink(NULL), m_metrics(NULL), m_slice_frames(kDefaultSliceFrames) {
 }
 
 GpuPerfSource::~GpuPerfSource() {
@@ -158,14 +211,21 @@ void
 GpuPerfSource::Activate(int id) {
   ScopedLock l(&m_protect);
   if (m_metrics)
-    m_metrics->Activate(id, m_sink);
+    m_metrics->Activate(id);
 }
 
 void
 GpuPerfSource::Deactivate(int id) {
   ScopedLock l(&m_protect);
   if (m_metrics)
-    m_metrics->Deactivate(id, m_sink);
+    m_metrics->Deactivate(id);
+}
+
+void
+GpuPerfSource::SetSliceFrames(int frames) {
+  ScopedLock l(&m_protect);
+  if (frames > 0)
+    m_slice_frames = frames;
 }
 
 void
@@ -175,7 +235,7 @@ GpuPerfSource::MakeContextCurrent() {
   if (m_metrics != NULL)
     return;
 
-  m_metrics = new PerfMetricSet(m_sink);
+  m_metrics = new PerfMetricSet(m_sink, m_slice_frames);
 
   MetricDescriptionSet descriptions;
   GetDescriptions(&descriptions);
@@ -189,9 +249,8 @@ GpuPerfSource::glSwapBuffers() {
     m_metrics->SwapBuffers();
 }
 
-
-PerfMetricSet::PerfMetricSet(MetricSinkInterface *sink)
-    : m_active_group(-1), m_active_count(0) {
+PerfMetricSet::PerfMetricSet(MetricSinkInterface *sink, int slice_frames)
+    : m_sampling_group(-1), m_slice_frames(slice_frames), m_frame(0) {
   unsigned int query_id = 0;
   PerfFunctions::GetFirstQueryId(&query_id);
 
@@ -210,6 +269,13 @@ PerfMetricSet::PerfMetricSet(MetricSinkInterface *sink)
   for (auto i = query_ids.begin(); i != query_ids.end(); ++i) {
     m_metric_groups.push_back(new PerfMetricGroup(*i, sink));
   }
+
+  for (unsigned int i = 0; i < m_metric_groups.size(); ++i) {
+    std::vector<int> ids;
+    m_metric_groups[i]->AppendIds(&ids);
+    for (auto id = ids.begin(); id != ids.end(); ++id)
+      m_groups_by_id[*id].push_back(i);
+  }
 }
 
 PerfMetricSet::~PerfMetricSet() {
@@ -220,92 +286,118 @@ PerfMetricSet::~PerfMetricSet() {
 }
 
 void
-PerfMetricSet::Activate(int id, MetricSinkInterface *sink) {
-  if (m_active_group != -1) {
-    if (m_metric_groups[m_active_group]->Activate(id)) {
-      GFLOGF("Activated metric: %d in group: %d", id, m_active_group);
-      ++m_active_count;
-    } else {
-      GFLOGF("Could not activate metric %d, it is not in the enabled group %d",
-             id, m_active_group);
-    }
+PerfMetricSet::Activate(int id) {
+  if (m_group_by_active_id.count(id))
+    return;
+  auto groups = m_groups_by_id.find(id);
+  if (groups == m_groups_by_id.end())
     return;
-  }
 
-  for (unsigned int i = 0; i < m_metric_groups.size(); ++i) {
-    if (!m_metric_groups[i]->Activate(id))
-      continue;
+  // Several QueryIds may provide a single metric.  Prefer a group
+  // which is already sampled, so the frames are shared by as few
+  // groups as possible.
+  int group = groups->second.front();
+  for (auto i = groups->second.begin(); i != groups->second.end(); ++i) {
+    if (m_metric_groups[*i]->IsActive()) {
+      group = *i;
+      break;
+    }
+  }
 
-    // else
-    m_active_group = i;
-    m_active_count = 1;
-    GFLOGF("Enabling group %d for metric: %d", m_active_group, id);
+  PerfMetricGroup *g = m_metric_groups[group];
+  if (!g->IsActive()) {
+    m_active_groups.push_back(group);
+    GFLOGF("Sampling group %d for metric: %d, %d groups share the counters",
+           group, id, static_cast<int>(m_active_groups.size()));
+  }
+  g->Activate(id);
+  m_group_by_active_id[id] = group;
+}
 
-    assert(sink);
-    MetricDescriptionSet desc;
-    GetDescriptions(&desc);
-    sink->OnDescriptions(desc);
+void
+PerfMetricSet::Deactivate(int id) {
+  auto active = m_group_by_active_id.find(id);
+  if (active == m_group_by_active_id.end())
+    return;
+  const int group = active->second;
+  m_group_by_active_id.erase(active);
 
+  PerfMetricGroup *g = m_metric_groups[group];
+  g->Deactivate(id);
+  if (g->IsActive())
     return;
+
+  for (auto i = m_active_groups.begin(); i != m_active_groups.end(); ++i) {
+    if (*i == group) {
+      m_active_groups.erase(i);
+      break;
+    }
   }
+  m_flush_groups.push_back(group);
+  // the next swap ends the group's query, and begins another
+  if (m_sampling_group == group)
+    m_sampling_group = -1;
 }
 
 void
-PerfMetricSet::Deactivate(int id, MetricSinkInterface *sink) {
-  if (m_active_group == -1)
-    return;
-  if (m_metric_groups[m_active_group]->Deactivate(id) == true) {
-    --m_active_count;
-    if (0 == m_active_count) {
-      m_active_group = -1;
-
-      assert(sink);
-      MetricDescriptionSet desc;
-      GetDescriptions(&desc);
-      sink->OnDescriptions(desc);
+PerfMetricSet::NextSlice() {
+  int next = 0;
+  for (unsigned int i = 0; i < m_active_groups.size(); ++i) {
+    if (m_active_groups[i] == m_sampling_group) {
+      next = (i + 1) % m_active_groups.size();
+      break;
     }
   }
+  m_sampling_group = m_active_groups[next];
+  m_metric_groups[m_sampling_group]->BeginSlice();
 }
 
 void
 PerfMetricSet::SwapBuffers() {
-  if (m_active_group != -1)
-    m_metric_groups[m_active_group]->SwapBuffers();
+  // a group which was activated again since it was flagged is also
+  // flushed, as it is not sampled until the following NextSlice.
+  for (auto i = m_flush_groups.begin(); i != m_flush_groups.end(); ++i)
+    m_metric_groups[*i]->Flush();
+  m_flush_groups.clear();
+
+  if (m_active_groups.empty())
+    return;
+
+  ++m_frame;
+  if (m_sampling_group == -1) {
+    NextSlice();
+    return;
+  }
+
+  PerfMetricGroup *g = m_metric_groups[m_sampling_group];
+  g->Frame();
+  // A group measured alone publishes at a fixed interval.  Otherwise
+  // the query moves to the next group after m_slice_frames frames.
+  if (m_active_groups.size() > 1) {
+    if (g->slice_frames() < m_slice_frames)
+      return;
+  } else if (g->slice_ms() < kPublishMs) {
+    return;
+  }
+
+  g->EndSlice(m_frame);
+  NextSlice();
+  for (auto i = m_active_groups.begin(); i != m_active_groups.end(); ++i)
+    m_metric_groups[*i]->Collect();
 }
 
 void
 PerfMetricSet::GetDescriptions(MetricDescriptionSet *desc) {
   MetricDescriptionSet all_descriptions;
+  for (auto i = m_metric_groups.begin(); i != m_metric_groups.end(); ++i)
+    (*i)->AppendDescriptions(&all_descriptions);
 
-  for (int i = 0; i < static_cast<int>(m_metric_groups.size()); ++i) {
-    bool group_enabled = true;
-    if (m_active_group != -1) {
-      // only metrics in the active group are enabled
-      group_enabled = m_active_group == i;
-    }
-    m_metric_groups[i]->AppendDescriptions(&all_descriptions,
-                                           group_enabled);
-  }
-
-  // filter out duplicates, preferring the duplicate which is enabled.
-  // Several QueryIds may provide a single metric, but only one of
-  // them may be enabled.  The metric should be enabled if it can be
-  // activated by the enabled group.
+  // filter out duplicates: several QueryIds may provide a single
+  // metric.
   std::map<std::string, MetricDescription*> filter;
   for (auto i = all_descriptions.begin(); i != all_descriptions.end(); ++i) {
-    auto duplicate = filter.find(i->path);
-    if (duplicate == filter.end()) {
-      // new description, save the description in the filter
+    if (filter.find(i->path) == filter.end())
       filter[i->path] = &(*i);
-      continue;
-    }
-    if (duplicate->second->enabled) {
-      // this metric is already enabled
-      continue;
-    }
-    if (i->enabled) {
-      duplicate->second->enabled = true;
-    }
   }
 
   for (auto i = filter.begin(); i != filter.end(); ++i) {
@@ -314,8 +406,9 @@ PerfMetricSet::GetDescriptions(MetricDescriptionSet *desc) {
 }
 
 PerfMetricGroup::PerfMetricGroup(int query_id, MetricSinkInterface *sink)
-    : m_query_id(query_id), m_current_query_handle(GL_INVALID_VALUE),
-      m_frame_count(0), m_last_publish_ms(0) {
+    : m_query_id(query_id), m_sink(sink),
+      m_current_query_handle(GL_INVALID_VALUE),
+      m_frame_count(0), m_slice_start_ms(0), m_last_slice_frame(-1) {
 
   static GLint max_name_len = 0;
   if (max_name_len == 0)
@@ -327,117 +420,131 @@ PerfMetricGroup::PerfMetricGroup(int query_id, MetricSinkInterface *sink)
                               query_name.size(), query_name.data(),
                               &m_data_size, &m_number_counters,
                               &number_instances, &m_capabilities_mask);
+  m_query_name = query_name.data();
   m_data_buf.resize(m_data_size);
   for (unsigned int counter_num = 1; counter_num <= m_number_counters;
        ++counter_num) {
-    m_metrics.push_back(new PerfMetric(m_query_id, counter_num, sink));
+    m_metrics.push_back(new PerfMetric(m_query_id, counter_num));
+    const int id = m_metrics.back()->id();
+    if (id != Grafips::MetricRegistry::kInvalidId)
+      m_index_by_id[id] = m_metrics.size() - 1;
   }
+
+  m_coverage = MetricDescription("gpu/intel/coverage/" + m_query_name,
+                                 "Displays the percent of frames measured "
+                                 "by the query, which shares the GPU "
+                                 "counters with the other active queries",
+                                 m_query_name + " Coverage",
+                                 Grafips::GR_METRIC_PERCENT);
 }
 
 PerfMetricGroup::~PerfMetricGroup() {
+  Flush();
   while (!m_metrics.empty()) {
     delete(m_metrics.back());
     m_metrics.pop_back();
   }
 }
 
+void
+PerfMetricGroup::AppendIds(std::vector<int> *ids) const {
+  for (auto i = m_index_by_id.begin(); i != m_index_by_id.end(); ++i)
+    ids->push_back(i->first);
+}
+
 bool
 PerfMetricGroup::Activate(int id) {
-  int index = 0;
-  for (auto i = m_metrics.begin(); i != m_metrics.end(); ++i, ++index) {
-    {
-      if ((*i)->Activate(id)) {
-        m_active_metric_indices.push_back(index);
-        return true;
-      }
-    }
-  }
-  return false;
+  auto i = m_index_by_id.find(id);
+  if (i == m_index_by_id.end())
+    return false;
+  m_active_metric_indices.push_back(i->second);
+  return true;
 }
 
 bool
 PerfMetricGroup::Deactivate(int id) {
-  int index = 0;
-  for (auto i = m_metrics.begin(); i != m_metrics.end(); ++i, ++index) {
-    if ((*i)->Deactivate(id)) {
-      // remove the index from the list of active indices
-      for (auto j = m_active_metric_indices.begin();
-           j != m_active_metric_indices.end(); ++j) {
-        if (*j == index) {
-          *j = m_active_metric_indices.back();
-          m_active_metric_indices.pop_back();
-          break;
-        }
-      }
-      // If last metric is disabled, then flush queries and delete
-      // them.  Also set m_current_query_handle to -1
-      for (auto extant_query = m_extant_query_handles.rbegin();
-           extant_query != m_extant_query_handles.rend(); ++extant_query) {
-        GLuint bytes_written = 0;
-        PerfFunctions::GetQueryData(extant_query->handle,
-                                    GL_PERFQUERY_WAIT_INTEL,
-                                    m_data_size, m_data_buf.data(),
-                                    &bytes_written);
-        // assert(bytes_written != 0);
-        PerfFunctions::DeleteQuery(extant_query->handle);
-      }
-      m_extant_query_handles.clear();
-      m_current_query_handle = GL_INVALID_VALUE;
-
-      for (auto free_query =m_free_query_handles.begin();
-           free_query != m_free_query_handles.end(); ++free_query)
-        PerfFunctions::DeleteQuery(*free_query);
-      m_free_query_handles.clear();
+  auto i = m_index_by_id.find(id);
+  if (i == m_index_by_id.end())
+    return false;
 
-      return true;
+  // remove the index from the list of active indices
+  for (auto j = m_active_metric_indices.begin();
+       j != m_active_metric_indices.end(); ++j) {
+    if (*j == i->second) {
+      *j = m_active_metric_indices.back();
+      m_active_metric_indices.pop_back();
+      break;
     }
   }
-  return false;
+  return true;
 }
 
 void
-PerfMetricGroup::SwapBuffers() {
-  if (m_active_metric_indices.empty())
-    return;
-
-  if (!m_last_publish_ms) {
-    m_last_publish_ms = get_ms_time();
-    return;
+PerfMetricGroup::Flush() {
+  if (m_current_query_handle != GL_INVALID_VALUE) {
+    PerfFunctions::EndQuery(m_current_query_handle);
+    PerfFunctions::DeleteQuery(m_current_query_handle);
+    m_current_query_handle = GL_INVALID_VALUE;
   }
 
-  ++m_frame_count;
-  const unsigned int ms = get_ms_time();
-  if (ms - m_last_publish_ms < 300) {
-    return;
+  for (auto extant_query = m_extant_query_handles.rbegin();
+       extant_query != m_extant_query_handles.rend(); ++extant_query) {
+    GLuint bytes_written = 0;
+    PerfFunctions::GetQueryData(extant_query->handle,
+                                GL_PERFQUERY_WAIT_INTEL,
+                                m_data_size, m_data_buf.data(),
+                                &bytes_written);
+    // assert(bytes_written != 0);
+    PerfFunctions::DeleteQuery(extant_query->handle);
   }
+  m_extant_query_handles.clear();
 
-  m_last_publish_ms = ms;
+  for (auto free_query =m_free_query_handles.begin();
+       free_query != m_free_query_handles.end(); ++free_query)
+    PerfFunctions::DeleteQuery(*free_query);
+  m_free_query_handles.clear();
 
-  if (m_current_query_handle != GL_INVALID_VALUE) {
-    PerfFunctions::EndQuery(m_current_query_handle);
-    m_extant_query_handles.push_back(ExtantQuery(m_current_query_handle,
-                                                 m_frame_count));
-    m_frame_count = 0;
-    m_current_query_handle = GL_INVALID_VALUE;
+  m_frame_count = 0;
+  m_last_slice_frame = -1;
+}
+
+void
+PerfMetricGroup::BeginSlice() {
+  if (m_free_query_handles.empty()) {
+    unsigned int query_handle;
+    PerfFunctions::CreateQuery(m_query_id, &query_handle);
+    assert(query_handle != GL_INVALID_VALUE);
+    m_free_query_handles.push_back(query_handle);
   }
 
-#ifdef NDEBUG
-#else
-  // {
-  //   static GLint max_name_len = 0;
-  //   if (max_name_len == 0)
-  //     glGetIntegerv(GL_PERFQUERY_QUERY_NAME_LENGTH_MAX_INTEL, &max_name_len);
-
-  //   std::vector<GLchar> query_name(max_name_len);
-  //   GLuint data_size, number_counters, number_instances, capabilities_mask;
-  //   PerfFunctions::GetPerfQueryInfoINTEL(m_query_id,
-  //                             query_name.size(), query_name.data(),
-  //                             &data_size, &number_counters,
-  //                             &number_instances, &capabilities_mask);
-  //   assert(number_instances == m_extant_query_handles.size());
-  // }
-#endif
+  m_current_query_handle = m_free_query_handles.back();
+  m_free_query_handles.pop_back();
+  PerfFunctions::BeginQuery(m_current_query_handle);
+  m_frame_count = 0;
+  m_slice_start_ms = get_ms_time();
+}
+
+void
+PerfMetricGroup::EndSlice(int frame) {
+  if (m_current_query_handle == GL_INVALID_VALUE)
+    return;
+  PerfFunctions::EndQuery(m_current_query_handle);
+
+  // the slice measured m_frame_count of the frames since the
+  // previous slice of this group
+  int elapsed = frame - m_last_slice_frame;
+  if (m_last_slice_frame == -1 || elapsed < m_frame_count)
+    elapsed = m_frame_count;
+  const float coverage = elapsed ? 100.0 * m_frame_count / elapsed : 100.0;
+  m_extant_query_handles.push_back(ExtantQuery(m_current_query_handle,
+                                               m_frame_count, coverage));
+  m_last_slice_frame = frame;
+  m_frame_count = 0;
+  m_current_query_handle = GL_INVALID_VALUE;
+}
 
+void
+PerfMetricGroup::Collect() {
   // reverse iteration, so we can remove entries without invalidating
   // the iterator
   for (auto extant_query = m_extant_query_handles.rbegin();
@@ -452,39 +559,35 @@ PerfMetricGroup::SwapBuffers() {
       continue;
     }
 
-    // TODO(majanes) pass bytes down to the metric for publication
+    // All counters for the query are delivered in a single batch.
+    // Counts are divided by the frames of the slice, so they remain
+    // per frame however the frames are shared between groups.
+    DataSet d;
+    d.reserve(m_active_metric_indices.size() + 1);
     for (auto i = m_active_metric_indices.begin();
          i != m_active_metric_indices.end(); ++i) {
-      m_metrics[*i]->Publish(m_data_buf, extant_query->frames);
+      m_metrics[*i]->Publish(m_data_buf, extant_query->frames, &d);
     }
+    if (m_coverage.id() != Grafips::MetricRegistry::kInvalidId)
+      d.push_back(DataPoint(get_ms_time(), m_coverage.id(),
+                            extant_query->coverage));
+    m_sink->OnMetric(d);
 
     m_free_query_handles.push_back(extant_query->handle);
     *extant_query = m_extant_query_handles.back();
     m_extant_query_handles.pop_back();
   }
-
-  if (m_free_query_handles.empty()) {
-    unsigned int query_handle;
-    PerfFunctions::CreateQuery(m_query_id, &query_handle);
-    assert(query_handle != GL_INVALID_VALUE);
-    m_free_query_handles.push_back(query_handle);
-  }
-
-  m_current_query_handle = m_free_query_handles.back();
-  m_free_query_handles.pop_back();
-  PerfFunctions::BeginQuery(m_current_query_handle);
 }
 
 void
-PerfMetricGroup::AppendDescriptions(MetricDescriptionSet *descriptions,
-                                    bool enabled) {
+PerfMetricGroup::AppendDescriptions(MetricDescriptionSet *descriptions) {
   for (auto i = m_metrics.begin(); i != m_metrics.end(); ++i)
-    (*i)->AppendDescription(descriptions, enabled);
+    (*i)->AppendDescription(descriptions, true);
+  descriptions->push_back(m_coverage);
 }
 
-PerfMetric::PerfMetric(int query_id, int counter_num, MetricSinkInterface *sink)
-    : m_query_id(query_id), m_counter_num(counter_num),
-      m_sink(sink) {
+PerfMetric::PerfMetric(int query_id, int counter_num)
+    : m_query_id(query_id), m_counter_num(counter_num) {
   static GLint max_name_len = 0, max_desc_len = 0;
   if (max_name_len == 0)
     glGetIntegerv(GL_PERFQUERY_COUNTER_NAME_LENGTH_MAX_INTEL, &max_name_len);
@@ -545,37 +648,26 @@ PerfMetric::AppendDescription(MetricDescriptionSet *desc,
   //           << std::endl;
 }
 
-bool
-PerfMetric::Activate(int id) {
-  if (id != m_grafips_desc->id())
-    return false;
-  return true;
-}
-
-bool
-PerfMetric::Deactivate(int id) {
-  if (id != m_grafips_desc->id())
-    return false;
-  return true;
-}
-
 void
 PerfMetric::Publish(const std::vector<unsigned char> &data,
-                    int frame_count) {
-  DataSet d;
-  float fval;
+                    int frame_count, DataSet *d) {
+  double fval = 0;
+  // integer counters are published without conversion to floating
+  // point, so large values are not truncated.
+  bool integral = false;
+  uint64_t ival = 0;
   const unsigned char *p_value = data.data() + m_offset;
   switch (m_data_type) {
     case GL_PERFQUERY_COUNTER_DATA_UINT32_INTEL: {
       assert(m_data_size == 4);
-      const uint32_t val = *reinterpret_cast<const uint32_t *>(p_value);
-      fval = static_cast<float>(val);
+      ival = *reinterpret_cast<const uint32_t *>(p_value);
+      integral = true;
       break;
     }
     case GL_PERFQUERY_COUNTER_DATA_UINT64_INTEL: {
       assert(m_data_size == 8);
-      const uint64_t val = *reinterpret_cast<const uint64_t *>(p_value);
-      fval = static_cast<float>(val);
+      ival = *reinterpret_cast<const uint64_t *>(p_value);
+      integral = true;
       break;
     }
     case GL_PERFQUERY_COUNTER_DATA_FLOAT_INTEL: {
@@ -585,8 +677,7 @@ PerfMetric::Publish(const std::vector<unsigned char> &data,
     }
     case GL_PERFQUERY_COUNTER_DATA_DOUBLE_INTEL: {
       assert(m_data_size == 8);
-      const double val = *reinterpret_cast<const double *>(p_value);
-      fval = static_cast<float>(val);
+      fval = *reinterpret_cast<const double *>(p_value);
       break;
     }
     case GL_PERFQUERY_COUNTER_DATA_BOOL32_INTEL:
@@ -597,10 +688,19 @@ PerfMetric::Publish(const std::vector<unsigned char> &data,
       assert(false);
   }
 
-  if (m_grafips_desc->type == Grafips::GR_METRIC_COUNT)
+  if (m_grafips_desc->type == Grafips::GR_METRIC_COUNT && frame_count > 1) {
     // count metrics are per frame
-    fval = fval / frame_count;
+    if (integral && ival % frame_count == 0) {
+      ival /= frame_count;
+    } else {
+      fval = (integral ? static_cast<double>(ival) : fval) / frame_count;
+      integral = false;
+    }
+  }
 
-  d.push_back(DataPoint(get_ms_time(), m_grafips_desc->id(), fval));
-  m_sink->OnMetric(d);
+  if (integral)
+    d->push_back(DataPoint(get_ns_time(), m_grafips_desc->id(),
+                           static_cast<int64_t>(ival)));
+  else
+    d->push_back(DataPoint(get_ms_time(), m_grafips_desc->id(), fval));
 }
@@ -41,11 +41,18 @@ class PerfMetricSet;
 // GlSource produces metrics based on the GL API
 class GpuPerfSource : public MetricSourceInterface {
  public:
+  // frames measured by each query group, when several are active
+  static const int kDefaultSliceFrames = 5;
+
   GpuPerfSource();
   ~GpuPerfSource();
   void Subscribe(MetricSinkInterface *sink);
   void Activate(int id);
   void Deactivate(int id);
+  // Only one query group may be measured at a time.  Active groups
+  // take turns, each measuring the given number of frames.  Takes
+  // effect when the context is first made current.
+  void SetSliceFrames(int frames);
   void MakeContextCurrent();
   void glSwapBuffers();
  private:
@@ -54,6 +61,7 @@ class GpuPerfSource : public MetricSourceInterface {
   MetricSinkInterface *m_sink;
   std::set<int> m_active_ids;
   PerfMetricSet *m_metrics;
+  int m_slice_frames;
   Mutex m_protect;
 };
 }  // end namespace Grafips
@@ -46,6 +46,14 @@ class MetricSourceInterface {
   virtual void Activate(int id) = 0;
   virtual void Deactivate(int id) = 0;
 };
+
+// sources which sample on the publisher thread.  The
+// SamplingScheduler calls Poll() at each tick of the source, with the
+// time of the tick, which timestamps the samples.
+class PolledSourceInterface : public MetricSourceInterface {
+ public:
+  virtual void Poll(unsigned int ms) = 0;
+};
 }  // namespace Grafips
 
 #endif  // SOURCES_GFIMETRIC_SOURCE_H_
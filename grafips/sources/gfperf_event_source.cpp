@@ -0,0 +1,308 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfperf_event_source.h"
+
+#include <asm/unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "error/gflog.h"
+#include "remote/gfimetric_sink.h"
+
+using Grafips::PerfEventSource;
+using Grafips::ScopedLock;
+
+namespace {
+struct EventInfo {
+  uint32_t type;
+  uint64_t config;
+  const char *path, *display, *help;
+  Grafips::MetricType metric_type;
+};
+
+// software events precede hardware events, so the group leader can
+// be opened without a PMU.
+const EventInfo kEvents[] = {
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "perf/task_clock",
+    "Task Clock %CPU",
+    "Cpu time of all threads, as a percent of one cpu",
+    Grafips::GR_METRIC_PERCENT },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,
+    "perf/context_switches", "Context Switches/s",
+    "Context switches of all threads, per second",
+    Grafips::GR_METRIC_RATE },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,
+    "perf/cpu_migrations", "CPU Migrations/s",
+    "Migrations of threads between cpus, per second",
+    Grafips::GR_METRIC_RATE },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "perf/page_faults",
+    "Page Faults/s", "Page faults of all threads, per second",
+    Grafips::GR_METRIC_RATE },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "perf/cycles",
+    "Cycles/s", "Cpu cycles in user space, per second",
+    Grafips::GR_METRIC_RATE },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "perf/instructions",
+    "Instructions/s", "Instructions retired in user space, per second",
+    Grafips::GR_METRIC_RATE },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "perf/cache_misses",
+    "Cache Misses/s", "Last level cache misses in user space, per second",
+    Grafips::GR_METRIC_RATE },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "perf/branch_misses",
+    "Branch Misses/s", "Mispredicted branches in user space, per second",
+    Grafips::GR_METRIC_RATE },
+};
+
+int
+perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu,
+                int group_fd, unsigned long flags) {  // NOLINT
+  return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+}  // namespace
+
+PerfEventSource::PerfEventSource()
+    : m_last_ns(0), m_active_count(0),
+      m_metric_sink(NULL) {
+  for (int i = 0; i < kMetricCount; ++i) {
+    m_ids[i] = 0;
+    m_active[i] = false;
+  }
+  for (int i = 0; i < kEventCount; ++i) {
+    m_last[i] = 0;
+    // probe each event on the calling thread, so unavailable events
+    // are never described.
+    const int fd = OpenEvent(i, 0, -1);
+    m_available[i] = (fd >= 0);
+    if (fd < 0) {
+      GFLOGF("perf event %s unavailable: %s", kEvents[i].path,
+             strerror(errno));
+      continue;
+    }
+    close(fd);
+    MetricDescription desc(kEvents[i].path, kEvents[i].help,
+                           kEvents[i].display, kEvents[i].metric_type);
+    m_ids[i] = desc.id();
+    m_descriptions.push_back(desc);
+  }
+  if (m_available[kCycles] && m_available[kInstructions]) {
+    MetricDescription desc("perf/ipc",
+                           "Instructions retired per cycle, in user space",
+                           "IPC", GR_METRIC_AVERAGE);
+    m_ids[kIpc] = desc.id();
+    m_descriptions.push_back(desc);
+  }
+}
+
+PerfEventSource::~PerfEventSource() {
+  Close();
+}
+
+int
+PerfEventSource::OpenEvent(int event, pid_t tid, int group_fd) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = kEvents[event].type;
+  attr.config = kEvents[event].config;
+  attr.inherit = 1;
+  attr.exclude_hv = 1;
+  // without CAP_PERFMON, perf_event_paranoid >= 2 restricts hardware
+  // events to user space.
+  attr.exclude_kernel = (attr.type == PERF_TYPE_HARDWARE);
+  attr.read_format = PERF_FORMAT_GROUP |
+                     PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  int fd = perf_event_open(&attr, tid, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+  if (fd < 0 && errno == EACCES && !attr.exclude_kernel) {
+    attr.exclude_kernel = 1;
+    fd = perf_event_open(&attr, tid, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+  }
+  return fd;
+}
+
+void
+PerfEventSource::Open() {
+  // counters of an existing thread are not inherited by its siblings,
+  // so each thread gets a group.
+  DIR *dir = opendir("/proc/self/task");
+  if (dir == NULL)
+    return;
+  // the main thread is listed first
+  int skipped = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const pid_t tid = atoi(entry->d_name);
+    if (tid <= 0)
+      continue;
+    if (m_groups.size() == kMaxGroups) {
+      ++skipped;
+      continue;
+    }
+    Group g;
+    for (int i = 0; i < kEventCount; ++i) {
+      if (!m_available[i])
+        continue;
+      const int fd = OpenEvent(i, tid, g.fds.empty() ? -1 : g.fds[0]);
+      if (fd < 0) {
+        // the thread exited, or the leader can't be opened
+        if (g.fds.empty())
+          break;
+        continue;
+      }
+      g.fds.push_back(fd);
+      g.events.push_back(i);
+    }
+    if (!g.fds.empty())
+      m_groups.push_back(g);
+  }
+  closedir(dir);
+  if (skipped)
+    GFLOGF("perf events: %d threads beyond the first %d are not counted",
+           skipped, kMaxGroups);
+  m_read_buf.resize(3 + kEventCount);
+
+  // start rates from the counts at the time of opening
+  m_last_ns = get_ns_time();
+  if (!Read(m_last))
+    Close();
+}
+
+void
+PerfEventSource::Close() {
+  for (std::vector<Group>::iterator g = m_groups.begin();
+       g != m_groups.end(); ++g) {
+    // siblings must be closed before the leader
+    for (int i = g->fds.size() - 1; i >= 0; --i)
+      close(g->fds[i]);
+  }
+  m_groups.clear();
+}
+
+bool
+PerfEventSource::Read(double *totals) {
+  for (int i = 0; i < kEventCount; ++i)
+    totals[i] = 0;
+  bool read_any = false;
+  for (std::vector<Group>::const_iterator g = m_groups.begin();
+       g != m_groups.end(); ++g) {
+    // { nr, time_enabled, time_running, value[nr] }
+    const ssize_t bytes = m_read_buf.size() * sizeof(uint64_t);
+    if (read(g->fds[0], m_read_buf.data(), bytes) <= 0)
+      continue;
+    const uint64_t nr = m_read_buf[0];
+    const uint64_t enabled = m_read_buf[1];
+    const uint64_t running = m_read_buf[2];
+    if (nr != g->events.size() || running == 0)
+      continue;
+    const double scale = static_cast<double>(enabled) / running;
+    for (uint64_t i = 0; i < nr; ++i)
+      totals[g->events[i]] += m_read_buf[3 + i] * scale;
+    read_any = true;
+  }
+  return read_any;
+}
+
+void
+PerfEventSource::Subscribe(MetricSinkInterface *sink) {
+  {
+    ScopedLock s(&m_protect);
+    m_metric_sink = sink;
+  }
+  sink->OnDescriptions(m_descriptions);
+}
+
+void
+PerfEventSource::Activate(int id) {
+  ScopedLock s(&m_protect);
+  for (int i = 0; i < kMetricCount; ++i) {
+    if (m_ids[i] == 0 || m_ids[i] != id || m_active[i])
+      continue;
+    m_active[i] = true;
+    ++m_active_count;
+  }
+}
+
+void
+PerfEventSource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
+  for (int i = 0; i < kMetricCount; ++i) {
+    if (m_ids[i] != id || !m_active[i])
+      continue;
+    m_active[i] = false;
+    --m_active_count;
+  }
+}
+
+void
+PerfEventSource::Poll(unsigned int ms) {
+  ScopedLock s(&m_protect);
+  if (m_active_count == 0) {
+    // counters cost a little on every context switch
+    Close();
+    return;
+  }
+  if (m_groups.empty()) {
+    Open();
+    return;
+  }
+
+  double totals[kEventCount];
+  if (!Read(totals))
+    return;
+  const uint64_t now_ns = get_ns_time();
+  const double elapsed_s = (now_ns - m_last_ns) / 1e9;
+  m_last_ns = now_ns;
+  double deltas[kEventCount];
+  for (int i = 0; i < kEventCount; ++i) {
+    // counts of exited threads are kept by their group, but a scaled
+    // estimate may step backwards.
+    deltas[i] = totals[i] > m_last[i] ? totals[i] - m_last[i] : 0;
+    m_last[i] = totals[i];
+  }
+  if (elapsed_s <= 0)
+    return;
+
+  DataSet d;
+  for (int i = 0; i < kEventCount; ++i) {
+    if (!m_active[i])
+      continue;
+    double value = deltas[i] / elapsed_s;
+    if (i == kTaskClock)
+      // nanoseconds of cpu time per second
+      value = value / 1e7;
+    d.push_back(DataPoint(ms, m_ids[i], value));
+  }
+  if (m_active[kIpc])
+    d.push_back(DataPoint(ms, m_ids[kIpc], deltas[kCycles] > 0 ?
+                          deltas[kInstructions] / deltas[kCycles] : 0.0));
+  if (!d.empty() && m_metric_sink)
+    m_metric_sink->OnMetric(d);
+}
@@ -0,0 +1,101 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFPERF_EVENT_SOURCE_H_
+#define SOURCES_GFPERF_EVENT_SOURCE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+#include "os/gfmutex.h"
+#include "sources/gfimetric_source.h"
+
+namespace Grafips {
+
+// Publishes kernel and micro-architectural counters for the process,
+// from perf_event_open(2).  Software events (task clock, context
+// switches, migrations, page faults) are available without a PMU, as
+// in VMs and containers.  Hardware events (cycles, instructions,
+// cache and branch misses) are added to the group when the PMU and
+// perf_event_paranoid allow.  Events which cannot be opened are not
+// described.
+//
+// Counters are opened when a metric is first activated, as one group
+// per existing thread, for at most kMaxGroups threads so that a
+// process with many threads does not run out of fds.  Threads created
+// later inherit the counters of their creator.  Each group is read
+// with a single read().  Counts are scaled by the fraction of time the
+// group was scheduled, for PMUs which multiplex.
+class PerfEventSource : public PolledSourceInterface {
+ public:
+  PerfEventSource();
+  ~PerfEventSource();
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+  void Poll(unsigned int ms);
+
+ private:
+  enum Event {
+    kTaskClock, kContextSwitches, kCpuMigrations, kPageFaults,
+    kCycles, kInstructions, kCacheMisses, kBranchMisses, kEventCount
+  };
+  // metrics are published for each event, and for ipc
+  enum { kIpc = kEventCount, kMetricCount };
+  // up to kEventCount fds each
+  static const int kMaxGroups = 32;
+
+  struct Group {
+    std::vector<int> fds;
+    // event counted by each value in a group read
+    std::vector<int> events;
+  };
+
+  static int OpenEvent(int event, pid_t tid, int group_fd);
+  void Open();
+  void Close();
+  // sums the scaled counts of every group
+  bool Read(double *totals);
+  bool Active(int metric) const { return m_active[metric]; }
+
+  bool m_available[kEventCount];
+  std::vector<Group> m_groups;
+  std::vector<uint64_t> m_read_buf;
+  double m_last[kEventCount];
+  uint64_t m_last_ns;
+  int m_ids[kMetricCount];
+  bool m_active[kMetricCount];
+  int m_active_count;
+  MetricSinkInterface *m_metric_sink;
+  MetricDescriptionSet m_descriptions;
+  Mutex m_protect;
+};
+}  // namespace Grafips
+
+#endif  // SOURCES_GFPERF_EVENT_SOURCE_H_
@@ -0,0 +1,184 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfpower_source.h"
+
+#include <dirent.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "error/gflog.h"
+#include "os/gfproc_file.h"
+#include "remote/gfimetric_sink.h"
+
+using Grafips::PowerSource;
+using Grafips::ProcFile;
+using Grafips::ScopedLock;
+
+PowerSource::PowerSource(const std::string &powercap_path)
+    : m_frames(0), m_last_frames(0), m_last_ns(0),
+      m_energy_per_frame_id(0), m_sink(NULL) {
+  Enumerate(powercap_path);
+}
+
+PowerSource::~PowerSource() {
+  for (auto d = m_domains.begin(); d != m_domains.end(); ++d)
+    delete d->energy;
+}
+
+void
+PowerSource::Enumerate(const std::string &powercap_path) {
+  // zones are intel-rapl:<package> and intel-rapl:<package>:<domain>.
+  // intel-rapl-mmio zones duplicate the package counters, and are
+  // skipped.
+  std::vector<std::string> zones;
+  DIR *dir = opendir(powercap_path.c_str());
+  if (dir == NULL)
+    return;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "intel-rapl:", strlen("intel-rapl:")) == 0)
+      zones.push_back(entry->d_name);
+  }
+  closedir(dir);
+  std::sort(zones.begin(), zones.end());
+
+  bool denied = false;
+  for (auto zone = zones.begin(); zone != zones.end(); ++zone) {
+    const std::string zone_path = powercap_path + "/" + *zone;
+    const std::string name = ProcFile::ReadLine(zone_path + "/name");
+    if (name.empty())
+      continue;
+    std::string label = name;
+    bool in_total = (name.compare(0, 7, "package") == 0);
+    const size_t parent_end = zone->find(':', strlen("intel-rapl:"));
+    if (parent_end != std::string::npos) {
+      // subdomains of a package are labelled by the package
+      const std::string parent = ProcFile::ReadLine(
+          powercap_path + "/" + zone->substr(0, parent_end) + "/name");
+      label = (parent.empty() ? zone->substr(0, parent_end) : parent) +
+              "/" + name;
+      in_total = false;
+    }
+    // dram energy is not included in the package domain
+    if (name == "dram")
+      in_total = true;
+
+    ProcFile *energy = new ProcFile(zone_path + "/energy_uj");
+    ProcFile max_range(zone_path + "/max_energy_range_uj");
+    Domain d;
+    d.energy = energy;
+    if (!energy->ReadUint(&d.last_uj) ||
+        !max_range.ReadUint(&d.max_range_uj)) {
+      denied = true;
+      delete energy;
+      continue;
+    }
+    d.in_total = in_total;
+    m_descriptions.push_back(MetricDescription(
+        "power/" + label + "/watts",
+        "Power consumed by the " + label + " RAPL domain",
+        "Power " + label + " W", GR_METRIC_AVERAGE));
+    d.id = m_descriptions.back().id();
+    m_domains.push_back(d);
+  }
+  if (denied)
+    GFLOG("some RAPL energy counters are unreadable, and not published");
+
+  for (auto d = m_domains.begin(); d != m_domains.end(); ++d) {
+    if (!d->in_total)
+      continue;
+    m_descriptions.push_back(MetricDescription(
+        "power/energy_per_frame_mj",
+        "Package and dram energy consumed per frame, in millijoules",
+        "Energy per Frame mJ", GR_METRIC_AVERAGE));
+    m_energy_per_frame_id = m_descriptions.back().id();
+    break;
+  }
+}
+
+void
+PowerSource::Subscribe(MetricSinkInterface *sink) {
+  {
+    ScopedLock s(&m_protect);
+    m_sink = sink;
+  }
+  sink->OnDescriptions(m_descriptions);
+}
+
+void
+PowerSource::Activate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.insert(id);
+}
+
+void
+PowerSource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.erase(id);
+}
+
+void
+PowerSource::Poll(unsigned int ms) {
+  ScopedLock s(&m_protect);
+  if (m_active_ids.empty() || m_domains.empty()) {
+    // the next interval starts from fresh counts
+    m_last_ns = 0;
+    return;
+  }
+
+  const uint64_t now_ns = get_ns_time();
+  const double elapsed_s = m_last_ns ? (now_ns - m_last_ns) / 1e9 : 0;
+  m_last_ns = now_ns;
+  const uint64_t frames = m_frames;
+  const uint64_t frame_count = frames - m_last_frames;
+  m_last_frames = frames;
+
+  DataSet dset;
+  uint64_t total_uj = 0;
+  for (auto d = m_domains.begin(); d != m_domains.end(); ++d) {
+    uint64_t uj;
+    if (!d->energy->ReadUint(&uj))
+      continue;
+    const uint64_t delta = uj >= d->last_uj ? uj - d->last_uj :
+                           uj + d->max_range_uj - d->last_uj;
+    d->last_uj = uj;
+    if (d->in_total)
+      total_uj += delta;
+    if (elapsed_s > 0 && m_active_ids.count(d->id))
+      dset.push_back(DataPoint(ms, d->id, delta / 1e6 / elapsed_s));
+  }
+  if (elapsed_s > 0 && frame_count > 0 &&
+      m_active_ids.count(m_energy_per_frame_id))
+    dset.push_back(DataPoint(ms, m_energy_per_frame_id,
+                             total_uj / 1e3 / frame_count));
+  if (!dset.empty() && m_sink)
+    m_sink->OnMetric(dset);
+}
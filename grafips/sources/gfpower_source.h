@@ -0,0 +1,94 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFPOWER_SOURCE_H_
+#define SOURCES_GFPOWER_SOURCE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "os/gfmutex.h"
+#include "sources/gfimetric_source.h"
+
+namespace Grafips {
+class ProcFile;
+
+// Publishes the power of each RAPL domain (package, core, uncore,
+// dram), from the energy counters of the powercap interface, and the
+// energy consumed per frame.
+//
+//   power/<package>/watts
+//   power/<package>/<domain>/watts
+//   power/energy_per_frame_mj   package and dram energy, divided by
+//                               the frames swapped in the interval
+//
+// Counters wrap at max_energy_range_uj.  energy_uj is root-only on
+// kernels which mitigate power side channels, in which case no
+// domains are described.
+class PowerSource : public PolledSourceInterface {
+ public:
+  explicit PowerSource(const std::string &powercap_path =
+                       "/sys/class/powercap");
+  ~PowerSource();
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+  void Poll(unsigned int ms);
+  // called on each swap
+  void OnFrame() { ++m_frames; }
+
+ private:
+  struct Domain {
+    ProcFile *energy;
+    uint64_t max_range_uj;
+    uint64_t last_uj;
+    // packages and dram, which do not overlap
+    bool in_total;
+    int id;
+  };
+
+  void Enumerate(const std::string &powercap_path);
+
+  std::vector<Domain> m_domains;
+  std::atomic<uint64_t> m_frames;
+  uint64_t m_last_frames;
+  // time of the last read of the counters, or 0 if they are not
+  // current
+  uint64_t m_last_ns;
+  int m_energy_per_frame_id;
+  std::set<int> m_active_ids;
+  MetricSinkInterface *m_sink;
+  MetricDescriptionSet m_descriptions;
+  Mutex m_protect;
+};
+}  // namespace Grafips
+
+#endif  // SOURCES_GFPOWER_SOURCE_H_
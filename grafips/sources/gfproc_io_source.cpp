@@ -0,0 +1,239 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfproc_io_source.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "error/gflog.h"
+#include "os/gfthread.h"
+#include "remote/gfimetric_sink.h"
+
+using Grafips::ProcIoSource;
+using Grafips::ScopedLock;
+using Grafips::Thread;
+
+namespace {
+const struct {
+  const char *key, *path, *display, *help;
+  Grafips::MetricType type;
+} kMetrics[] = {
+  { "rchar", "io/read_mb", "Read MB/s",
+    "Bytes passed to read calls, including those served from the page "
+    "cache, in MB per second", Grafips::GR_METRIC_RATE },
+  { "wchar", "io/write_mb", "Write MB/s",
+    "Bytes passed to write calls, in MB per second",
+    Grafips::GR_METRIC_RATE },
+  { "syscr", "io/read_syscalls", "Read Calls/s",
+    "Read system calls, per second", Grafips::GR_METRIC_RATE },
+  { "syscw", "io/write_syscalls", "Write Calls/s",
+    "Write system calls, per second", Grafips::GR_METRIC_RATE },
+  { "read_bytes", "io/disk_read_mb", "Disk Read MB/s",
+    "Bytes fetched from storage, in MB per second",
+    Grafips::GR_METRIC_RATE },
+  { "write_bytes", "io/disk_write_mb", "Disk Write MB/s",
+    "Bytes sent to storage, in MB per second", Grafips::GR_METRIC_RATE },
+  { NULL, "io/read_kb_per_frame", "Read KB/Frame",
+    "Bytes passed to read calls per frame, in KB",
+    Grafips::GR_METRIC_AVERAGE },
+  { NULL, "io/disk_read_kb_per_frame", "Disk Read KB/Frame",
+    "Bytes fetched from storage per frame, in KB",
+    Grafips::GR_METRIC_AVERAGE },
+};
+
+std::string
+TaskIoPath(pid_t tid) {
+  std::stringstream path;
+  path << "/proc/self/task/" << tid << "/io";
+  return path.str();
+}
+}  // namespace
+
+ProcIoSource::OwnThread::OwnThread(pid_t tid) : io_file(TaskIoPath(tid)) {
+  for (int i = 0; i < kCounterCount; ++i)
+    last[i] = 0;
+}
+
+ProcIoSource::ProcIoSource(const std::string &io_path)
+    : m_io_file(io_path), m_frames(0), m_last_frames(0), m_last_ns(0),
+      m_sink(NULL) {
+  for (int i = 0; i < kMetricCount; ++i)
+    m_ids[i] = 0;
+  for (int i = 0; i < kCounterCount; ++i)
+    m_exited[i] = 0;
+  // io of other processes is protected by ptrace access checks, and
+  // task io accounting may be configured out
+  if (!Read(&m_io_file, m_last)) {
+    GFLOGF("%s is unreadable, io is not published", io_path.c_str());
+    return;
+  }
+  for (int i = 0; i < kMetricCount; ++i) {
+    m_descriptions.push_back(MetricDescription(
+        kMetrics[i].path, kMetrics[i].help, kMetrics[i].display,
+        kMetrics[i].type));
+    m_ids[i] = m_descriptions.back().id();
+  }
+}
+
+ProcIoSource::~ProcIoSource() {
+  for (OwnThreadMap::iterator i = m_own_threads.begin();
+       i != m_own_threads.end(); ++i)
+    delete i->second;
+}
+
+bool
+ProcIoSource::Read(ProcFile *file, uint64_t *counts) {
+  if (!file->Read())
+    return false;
+  for (int i = 0; i < kCounterCount; ++i) {
+    int64_t count;
+    if (!file->Value(kMetrics[i].key, &count))
+      return false;
+    counts[i] = count;
+  }
+  return true;
+}
+
+void
+ProcIoSource::ReadOwnThreads(uint64_t *counts) {
+  Thread::Tids(&m_tids);
+  OwnThreadMap::iterator i = m_own_threads.begin();
+  while (i != m_own_threads.end()) {
+    if (std::find(m_tids.begin(), m_tids.end(), i->first) != m_tids.end()) {
+      ++i;
+      continue;
+    }
+    for (int c = 0; c < kCounterCount; ++c)
+      m_exited[c] += i->second->last[c];
+    delete i->second;
+    m_own_threads.erase(i++);
+  }
+
+  // the polling thread is read last, so its count includes the reads
+  // of the other threads' files
+  const pid_t self = syscall(SYS_gettid);
+  std::vector<pid_t>::iterator polling =
+      std::find(m_tids.begin(), m_tids.end(), self);
+  if (polling != m_tids.end())
+    std::iter_swap(polling, m_tids.end() - 1);
+
+  for (int c = 0; c < kCounterCount; ++c)
+    counts[c] = m_exited[c];
+  for (std::vector<pid_t>::const_iterator tid = m_tids.begin();
+       tid != m_tids.end(); ++tid) {
+    OwnThread *&t = m_own_threads[*tid];
+    if (t == NULL)
+      t = new OwnThread(*tid);
+    // a thread which can't be read keeps its previous counts
+    uint64_t thread_counts[kCounterCount];
+    if (Read(&t->io_file, thread_counts)) {
+      for (int c = 0; c < kCounterCount; ++c)
+        t->last[c] = thread_counts[c];
+    }
+    for (int c = 0; c < kCounterCount; ++c)
+      counts[c] += t->last[c];
+  }
+}
+
+void
+ProcIoSource::Subscribe(MetricSinkInterface *sink) {
+  {
+    ScopedLock s(&m_protect);
+    m_sink = sink;
+  }
+  sink->OnDescriptions(m_descriptions);
+}
+
+void
+ProcIoSource::Activate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.insert(id);
+}
+
+void
+ProcIoSource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.erase(id);
+}
+
+void
+ProcIoSource::Poll(unsigned int ms) {
+  ScopedLock s(&m_protect);
+  if (m_active_ids.empty() || m_descriptions.empty()) {
+    // the next interval starts from fresh counts
+    m_last_ns = 0;
+    return;
+  }
+
+  // read first, so that the process counts include these reads
+  uint64_t own_counts[kCounterCount];
+  ReadOwnThreads(own_counts);
+  uint64_t counts[kCounterCount];
+  if (!Read(&m_io_file, counts))
+    return;
+  for (int i = 0; i < kCounterCount; ++i)
+    counts[i] = counts[i] >= own_counts[i] ? counts[i] - own_counts[i] : 0;
+  const uint64_t now_ns = get_ns_time();
+  const double elapsed_s = m_last_ns ? (now_ns - m_last_ns) / 1e9 : 0;
+  m_last_ns = now_ns;
+  const uint64_t frames = m_frames;
+  const uint64_t frame_count = frames - m_last_frames;
+  m_last_frames = frames;
+
+  uint64_t delta[kCounterCount];
+  for (int i = 0; i < kCounterCount; ++i) {
+    delta[i] = counts[i] >= m_last[i] ? counts[i] - m_last[i] : 0;
+    m_last[i] = counts[i];
+  }
+  if (elapsed_s <= 0)
+    return;
+
+  DataSet dset;
+  for (int i = 0; i < kCounterCount; ++i) {
+    if (!m_active_ids.count(m_ids[i]))
+      continue;
+    const bool bytes = (i != kSyscr && i != kSyscw);
+    const double value = bytes ? delta[i] / (1024.0 * 1024.0) : delta[i];
+    dset.push_back(DataPoint(ms, m_ids[i], value / elapsed_s));
+  }
+  if (frame_count > 0) {
+    if (m_active_ids.count(m_ids[kReadPerFrame]))
+      dset.push_back(DataPoint(ms, m_ids[kReadPerFrame],
+                               delta[kRchar] / 1024.0 / frame_count));
+    if (m_active_ids.count(m_ids[kDiskReadPerFrame]))
+      dset.push_back(DataPoint(ms, m_ids[kDiskReadPerFrame],
+                               delta[kReadBytes] / 1024.0 / frame_count));
+  }
+  if (!dset.empty() && m_sink)
+    m_sink->OnMetric(dset);
+}
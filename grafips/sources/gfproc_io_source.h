@@ -0,0 +1,118 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFPROC_IO_SOURCE_H_
+#define SOURCES_GFPROC_IO_SOURCE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "os/gfmutex.h"
+#include "os/gfproc_file.h"
+#include "sources/gfimetric_source.h"
+
+namespace Grafips {
+
+// Publishes the io of the traced process from /proc/self/io, to line
+// up disk bursts of asset streaming with frame spikes.
+//
+//   io/read_mb, io/write_mb          bytes passed to read and write
+//                                    calls, in MB/s, including the
+//                                    page cache
+//   io/disk_read_mb, io/disk_write_mb  bytes fetched from and sent to
+//                                    storage, in MB/s
+//   io/read_syscalls, io/write_syscalls  read and write calls per
+//                                    second
+//   io/read_kb_per_frame             read bytes per frame swapped in
+//                                    the interval
+//   io/disk_read_kb_per_frame        storage reads per frame
+//
+// The io of grafips' own threads, those started by Thread, is
+// subtracted from /proc/self/task/<tid>/io.  Otherwise the preads of
+// the polled sources, the recording written by MetricRecorder, and
+// the samples sent to hosts would be reported as io of the
+// application.  The io of an exited thread is subtracted as of the
+// last poll before it exited.
+class ProcIoSource : public PolledSourceInterface {
+ public:
+  explicit ProcIoSource(const std::string &io_path = "/proc/self/io");
+  ~ProcIoSource();
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+  void Poll(unsigned int ms);
+  // called on each swap, on the render thread
+  void OnFrame() { ++m_frames; }
+
+ private:
+  // counters of /proc/self/io, in file order
+  enum Counter {
+    kRchar, kWchar, kSyscr, kSyscw, kReadBytes, kWriteBytes, kCounterCount
+  };
+  enum Metric {
+    kReadPerFrame = kCounterCount, kDiskReadPerFrame, kMetricCount
+  };
+
+  // io of a grafips thread
+  struct OwnThread {
+    explicit OwnThread(pid_t tid);
+    ProcFile io_file;
+    // counts at the last poll
+    uint64_t last[kCounterCount];
+  };
+  typedef std::map<pid_t, OwnThread *> OwnThreadMap;
+
+  static bool Read(ProcFile *file, uint64_t *counts);
+  // sums the io of the grafips threads, including those which exited
+  void ReadOwnThreads(uint64_t *counts);
+
+  ProcFile m_io_file;
+  OwnThreadMap m_own_threads;
+  std::vector<pid_t> m_tids;
+  // io of grafips threads which have exited, which remains in the
+  // process counts
+  uint64_t m_exited[kCounterCount];
+  uint64_t m_last[kCounterCount];
+  std::atomic<uint64_t> m_frames;
+  uint64_t m_last_frames;
+  // time of m_last, or 0 if it is not current
+  uint64_t m_last_ns;
+  int m_ids[kMetricCount];
+  std::set<int> m_active_ids;
+  MetricSinkInterface *m_sink;
+  MetricDescriptionSet m_descriptions;
+  Mutex m_protect;
+};
+}  // namespace Grafips
+
+#endif  // SOURCES_GFPROC_IO_SOURCE_H_
@@ -28,80 +28,120 @@
 #include "sources/gfproc_self_source.h"
 
 #include <assert.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <inttypes.h>
 
 #include "remote/gfimetric_sink.h"
 
+using Grafips::ProcFile;
 using Grafips::ProcSelfSource;
-using Grafips::StatLine;
-
-class StatLine {
- public:
-  uint64_t utime;
-  uint64_t stime;
-  int64_t cutime;
-  int64_t cstime;
-  int64_t rss;
-
-  void Parse();
-};
-
-void
-StatLine::Parse() {
-  FILE *fh = fopen("/proc/self/stat", "r");
-  fscanf(fh, "%*d (%*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %"
-         SCNu64 " %" SCNu64 " %" SCNd64 " %" SCNd64 " %*d %*d %*d "
-         "%*d %*u %*u %" SCNd64 " %*u %*u %*u %*u %*u %*u %*u %*u "
-         "%*u %*u %*u %*u %*u %*d %*d %*u %*u %*u %*u %*d %*u %*u %*u "
-         "%*u %*u %*u %*u %*d",
-         &utime, &stime, &cutime, &cstime, &rss);
-  fclose(fh);
-}
-
+using Grafips::ScopedLock;
 
+namespace {
 uint64_t
-ProcSelfSource::GetUptime() const {
-  FILE* fh = fopen("/proc/uptime", "r");
-  fseek(fh, 0, SEEK_SET);
-  uint64_t seconds, centiseconds;
-  fscanf(fh, "%" SCNu64 ".%" SCNu64, &seconds, &centiseconds);
-  fclose(fh);
-  return (seconds * m_hz) + (centiseconds * m_hz / 100);
+get_monotonic_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return static_cast<uint64_t>(t.tv_sec) * 1000000000ULL + t.tv_nsec;
 }
+}  // namespace
 
 ProcSelfSource::ProcSelfSource()
-    : m_uptime(0),
+    : m_stat_file("/proc/self/stat"),
+      m_status_file("/proc/self/status"),
       m_hz(0),
-      m_last_publish(0),
-      m_rss_id(0), m_cpu_id(0),
-      m_stat(new StatLine),
-      m_metric_sink(NULL),
-      m_rss_active(false), m_cpu_active(false) {
-  m_descriptions.push_back(
-      MetricDescription("/proc/pid/rss",
-                        "Resident set size: number  of pages the "
-                        "process has in real memory.",
-                        "Memory RSS",
-                        GR_METRIC_COUNT));
-  m_rss_id = m_descriptions.back().id();
-  m_descriptions.push_back(MetricDescription("/proc/pid/utilization",
-                                             "Process CPU Utilization",
-                                             "Process %CPU",
-                                             GR_METRIC_PERCENT));
-  m_cpu_id = m_descriptions.back().id();
+      m_last_ns(0),
+      m_active_count(0),
+      m_metric_sink(NULL) {
+  struct MetricInfo {
+    const char *path, *help, *name;
+    MetricType type;
+  };
+  static const MetricInfo kMetrics[kMetricCount] = {
+    { "/proc/pid/rss", "Resident set size: number  of pages the "
+      "process has in real memory.", "Memory RSS", GR_METRIC_COUNT },
+    { "/proc/pid/utilization", "Process CPU Utilization", "Process %CPU",
+      GR_METRIC_PERCENT },
+    { "/proc/pid/minor_faults", "Page faults per second which did not "
+      "require loading a page from disk", "Minor Faults/s",
+      GR_METRIC_RATE },
+    { "/proc/pid/major_faults", "Page faults per second which required "
+      "loading a page from disk", "Major Faults/s", GR_METRIC_RATE },
+    { "/proc/pid/threads", "Number of threads in the process",
+      "Threads", GR_METRIC_COUNT },
+    { "/proc/pid/virtual_size", "Virtual memory size of the process, "
+      "in MB", "Virtual Memory MB", GR_METRIC_COUNT },
+    { "/proc/pid/voluntary_switches", "Context switches per second "
+      "where the process blocked", "Voluntary Switches/s",
+      GR_METRIC_RATE },
+    { "/proc/pid/involuntary_switches", "Context switches per second "
+      "where the process was preempted", "Involuntary Switches/s",
+      GR_METRIC_RATE },
+  };
+  for (int i = 0; i < kMetricCount; ++i) {
+    m_descriptions.push_back(MetricDescription(kMetrics[i].path,
+                                               kMetrics[i].help,
+                                               kMetrics[i].name,
+                                               kMetrics[i].type));
+    m_ids[i] = m_descriptions.back().id();
+    m_active[i] = false;
+  }
 
   int64_t ticks = sysconf(_SC_CLK_TCK);
   assert(ticks != -1);
   m_hz = static_cast<unsigned int>(ticks);
 
-  m_stat->Parse();
-  m_uptime = GetUptime();
-  m_last_publish = get_ms_time();
+  ParseStat(&m_last);
+  ParseStatus(&m_last);
+  m_last_ns = get_monotonic_ns();
 }
 
 ProcSelfSource::~ProcSelfSource() {
-  delete m_stat;
+}
+
+bool
+ProcSelfSource::ParseStat(Sample *s) {
+  if (!m_stat_file.Read())
+    return false;
+  // The process name may contain spaces and parentheses, so fields
+  // are counted from the last ')'.
+  const char *end = m_stat_file.End();
+  const char *p = static_cast<const char *>(
+      memrchr(m_stat_file.Data(), ')', m_stat_file.Size()));
+  if (p == NULL)
+    return false;
+  ++p;
+
+  // fields as numbered in proc(5).  p is at the space before field 3.
+  int64_t fields[25] = { 0 };
+  for (int field = 3; field < 25 && p < end; ++field) {
+    while (p < end && *p == ' ')
+      ++p;
+    if (field == 3) {
+      // state is a character
+      ++p;
+      continue;
+    }
+    fields[field] = ProcFile::ParseInt(&p, end);
+  }
+  s->minor_faults = fields[10];
+  s->major_faults = fields[12];
+  s->ticks = fields[14] + fields[15] + fields[16] + fields[17];
+  s->threads = fields[20];
+  s->virtual_size = fields[23];
+  s->rss = fields[24];
+  return true;
+}
+
+bool
+ProcSelfSource::ParseStatus(Sample *s) {
+  if (!m_status_file.Read())
+    return false;
+  m_status_file.Value("voluntary_ctxt_switches", &s->voluntary_switches);
+  m_status_file.Value("nonvoluntary_ctxt_switches",
+                      &s->involuntary_switches);
+  return true;
 }
 
 void
@@ -112,50 +152,76 @@ ProcSelfSource::Subscribe(MetricSinkInterface *sink) {
 
 void
 ProcSelfSource::Activate(int id) {
-  if (id == m_cpu_id)
-    m_cpu_active = true;
-  else if (id == m_rss_id)
-    m_rss_active = true;
+  ScopedLock l(&m_protect);
+  for (int i = 0; i < kMetricCount; ++i) {
+    if (m_ids[i] == id && !m_active[i]) {
+      m_active[i] = true;
+      ++m_active_count;
+    }
+  }
 }
 
 void
 ProcSelfSource::Deactivate(int id) {
-  if (id == m_cpu_id)
-    m_cpu_active = false;
-  else if (id == m_rss_id)
-    m_rss_active = false;
+  ScopedLock l(&m_protect);
+  for (int i = 0; i < kMetricCount; ++i) {
+    if (m_ids[i] == id && m_active[i]) {
+      m_active[i] = false;
+      --m_active_count;
+    }
+  }
 }
 
 void
-ProcSelfSource::Poll() {
-  if (!m_rss_active && !m_cpu_active)
+ProcSelfSource::Poll(unsigned int current_time) {
+  ScopedLock l(&m_protect);
+  if (!m_active_count)
     return;
 
-  int current_time = get_ms_time();
-  if (current_time - m_last_publish < 300)
+  Sample current;
+  if (!ParseStat(&current))
+    return;
+  ParseStatus(&current);
+  const uint64_t current_ns = get_monotonic_ns();
+  const double elapsed_s = (current_ns - m_last_ns) / 1e9;
+  const Sample last = m_last;
+  m_last = current;
+  m_last_ns = current_ns;
+  if (elapsed_s <= 0)
     return;
 
   DataSet d;
-  m_last_publish = current_time;
-
-  const uint64_t last_usage = m_stat->utime + m_stat->stime +
-                              m_stat->cutime + m_stat->cstime;
-  m_stat->Parse();
-  if (m_cpu_active) {
-    const uint64_t current_usage = m_stat->utime + m_stat->stime +
-                                   m_stat->cutime + m_stat->cstime;
-    const float elapsed_usage = current_usage - last_usage;
-    const uint64_t uptime = GetUptime();
-    const float elapsed_uptime = uptime - m_uptime;
-
-    const float utilization = elapsed_usage / elapsed_uptime;
-    m_uptime = uptime;
-    d.push_back(DataPoint(current_time, m_cpu_id, utilization * 100.0));
-  }
-
-  if (m_rss_active) {
-    d.push_back(DataPoint(current_time, m_rss_id, m_stat->rss));
+  if (Active(kCpu)) {
+    const double cpu_s = static_cast<double>(current.ticks - last.ticks) /
+                         m_hz;
+    d.push_back(DataPoint(current_time, m_ids[kCpu],
+                          cpu_s / elapsed_s * 100.0));
   }
+  if (Active(kRss))
+    d.push_back(DataPoint(current_time, m_ids[kRss],
+                          static_cast<double>(current.rss)));
+  if (Active(kMinorFaults))
+    d.push_back(DataPoint(current_time, m_ids[kMinorFaults],
+                          (current.minor_faults - last.minor_faults) /
+                          elapsed_s));
+  if (Active(kMajorFaults))
+    d.push_back(DataPoint(current_time, m_ids[kMajorFaults],
+                          (current.major_faults - last.major_faults) /
+                          elapsed_s));
+  if (Active(kThreads))
+    d.push_back(DataPoint(current_time, m_ids[kThreads],
+                          static_cast<double>(current.threads)));
+  if (Active(kVirtualSize))
+    d.push_back(DataPoint(current_time, m_ids[kVirtualSize],
+                          current.virtual_size / (1024.0 * 1024.0)));
+  if (Active(kVoluntarySwitches))
+    d.push_back(DataPoint(current_time, m_ids[kVoluntarySwitches],
+                          (current.voluntary_switches -
+                           last.voluntary_switches) / elapsed_s));
+  if (Active(kInvoluntarySwitches))
+    d.push_back(DataPoint(current_time, m_ids[kInvoluntarySwitches],
+                          (current.involuntary_switches -
+                           last.involuntary_switches) / elapsed_s));
 
   m_metric_sink->OnMetric(d);
 }
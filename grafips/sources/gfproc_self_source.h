@@ -28,34 +28,60 @@
 #ifndef SOURCES_GFPROC_SELF_SOURCE_H_
 #define SOURCES_GFPROC_SELF_SOURCE_H_
 
-#include <stdio.h>
-#include <linux/limits.h>
+#include <stdint.h>
 
 #include <vector>
 
+#include "os/gfmutex.h"
+#include "os/gfproc_file.h"
 #include "sources/gfimetric_source.h"
 
 namespace Grafips {
-class StatLine;
-class ProcSelfSource : public MetricSourceInterface {
+
+// Publishes the resource usage of the traced process, from
+// /proc/self/stat and /proc/self/status.
+class ProcSelfSource : public PolledSourceInterface {
  public:
   ProcSelfSource();
   ~ProcSelfSource();
   void Subscribe(MetricSinkInterface *sink);
   void Activate(int id);
   void Deactivate(int id);
-  void Poll();
+  void Poll(unsigned int ms);
 
  private:
-  uint64_t GetUptime() const;
-  uint64_t m_uptime;
+  enum Metric {
+    kRss, kCpu, kMinorFaults, kMajorFaults, kThreads, kVirtualSize,
+    kVoluntarySwitches, kInvoluntarySwitches, kMetricCount
+  };
+
+  struct Sample {
+    Sample() : ticks(0), minor_faults(0), major_faults(0), threads(0),
+               virtual_size(0), rss(0), voluntary_switches(0),
+               involuntary_switches(0) {}
+    // user and system time of the process and its waited-for children
+    uint64_t ticks;
+    uint64_t minor_faults, major_faults;
+    int64_t threads, virtual_size, rss;
+    int64_t voluntary_switches, involuntary_switches;
+  };
+
+  bool ParseStat(Sample *s);
+  bool ParseStatus(Sample *s);
+  bool Active(Metric m) const { return m_active[m]; }
+
+  ProcFile m_stat_file, m_status_file;
   int m_hz;  // ticks per sec
-  int m_last_publish;
-  int m_rss_id, m_cpu_id;
-  StatLine *m_stat;
+  Sample m_last;
+  // CLOCK_MONOTONIC time of m_last
+  uint64_t m_last_ns;
+  int m_ids[kMetricCount];
+  bool m_active[kMetricCount];
+  int m_active_count;
   MetricSinkInterface *m_metric_sink;
   MetricDescriptionSet m_descriptions;
-  bool m_rss_active, m_cpu_active;
+  // activations arrive on the skeleton thread
+  Mutex m_protect;
 };
 }  // namespace Grafips
 
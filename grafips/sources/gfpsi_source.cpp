@@ -0,0 +1,284 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfpsi_source.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "error/gflog.h"
+#include "os/gfproc_file.h"
+#include "remote/gfimetric_sink.h"
+
+using Grafips::ProcFile;
+using Grafips::PsiSource;
+using Grafips::ScopedLock;
+
+namespace {
+const char *kResources[] = { "cpu", "memory", "io" };
+const char *kKinds[] = { "some", "full" };
+
+// advances *p past the next occurrence of key on the line, or to the
+// end of the line if there is none
+bool
+FindKey(const char **p, const char *end, const char *key) {
+  const size_t len = strlen(key);
+  const char *c = *p;
+  while (c + len <= end && *c != '\n') {
+    if (strncmp(c, key, len) == 0) {
+      *p = c + len;
+      return true;
+    }
+    ++c;
+  }
+  *p = c;
+  return false;
+}
+}  // namespace
+
+PsiSource::PsiSource(const std::string &proc_path)
+    : m_proc_path(proc_path), m_trigger_thread(NULL),
+      m_stop_fd(eventfd(0, EFD_CLOEXEC)), m_last_ns(0), m_sink(NULL) {
+  for (unsigned int r = 0; r < sizeof(kResources) / sizeof(kResources[0]);
+       ++r) {
+    Resource resource;
+    resource.name = kResources[r];
+    resource.pressure = new ProcFile(proc_path + "/pressure/" +
+                                     resource.name);
+    double avg10[kKindCount];
+    // unsupported when the kernel is booted with psi=0
+    if (!Parse(resource.pressure, avg10, resource.last_total)) {
+      delete resource.pressure;
+      continue;
+    }
+    for (int k = 0; k < kKindCount; ++k) {
+      const std::string prefix = "psi/" + resource.name + "/" + kKinds[k];
+      const std::string display = resource.name + " " + kKinds[k];
+      m_descriptions.push_back(MetricDescription(
+          prefix + "_avg10",
+          "Percent of the last 10s in which " +
+          std::string(k == kSome ? "some tasks" : "all non-idle tasks") +
+          " stalled on " + resource.name,
+          "PSI " + display + " avg10 %", GR_METRIC_PERCENT));
+      resource.ids[k][kAvg10] = m_descriptions.back().id();
+      m_descriptions.push_back(MetricDescription(
+          prefix + "_stall_ms",
+          "Time in which " +
+          std::string(k == kSome ? "some tasks" : "all non-idle tasks") +
+          " stalled on " + resource.name + ", in ms per second",
+          "PSI " + display + " stall ms/s", GR_METRIC_RATE));
+      resource.ids[k][kStallMs] = m_descriptions.back().id();
+    }
+    m_resources.push_back(resource);
+  }
+}
+
+PsiSource::~PsiSource() {
+  if (m_trigger_thread) {
+    const uint64_t val = 1;
+    const ssize_t result = write(m_stop_fd, &val, sizeof(val));
+    (void) result;
+    m_trigger_thread->Join();
+    delete m_trigger_thread;
+  }
+  for (auto t = m_triggers.begin(); t != m_triggers.end(); ++t)
+    close(t->fd);
+  for (auto r = m_resources.begin(); r != m_resources.end(); ++r)
+    delete r->pressure;
+  close(m_stop_fd);
+}
+
+bool
+PsiSource::Parse(ProcFile *pressure, double *avg10, uint64_t *total) {
+  if (!pressure->Read())
+    return false;
+  for (int k = 0; k < kKindCount; ++k) {
+    avg10[k] = 0;
+    total[k] = 0;
+  }
+  // lines are "<kind> avg10=<%> avg60=<%> avg300=<%> total=<us>"
+  const char *p = pressure->Data();
+  const char *end = pressure->End();
+  while (p < end) {
+    int kind = -1;
+    for (int k = 0; k < kKindCount; ++k)
+      if (strncmp(p, kKinds[k], strlen(kKinds[k])) == 0)
+        kind = k;
+    if (kind >= 0) {
+      if (FindKey(&p, end, "avg10="))
+        avg10[kind] = strtod(p, NULL);
+      if (FindKey(&p, end, "total="))
+        total[kind] = ProcFile::ParseUint(&p, end);
+    }
+    while (p < end && *p != '\n')
+      ++p;
+    ++p;
+  }
+  return true;
+}
+
+bool
+PsiSource::AddTrigger(const std::string &resource, const std::string &kind,
+                      unsigned int stall_us, unsigned int window_us) {
+  if (kind != kKinds[kSome] && kind != kKinds[kFull])
+    return false;
+  const std::string path = m_proc_path + "/pressure/" + resource;
+  const int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    GFLOGF("could not open %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  std::stringstream trigger;
+  trigger << kind << " " << stall_us << " " << window_us;
+  const std::string s = trigger.str();
+  // the kernel expects the terminating 0
+  if (write(fd, s.c_str(), s.size() + 1) < 0) {
+    GFLOGF("psi trigger \"%s\" rejected for %s: %s", s.c_str(),
+           resource.c_str(), strerror(errno));
+    close(fd);
+    return false;
+  }
+  std::stringstream display;
+  display << "PSI " << resource << " " << kind << " > "
+          << stall_us / 1000 << "ms/" << window_us / 1000 << "ms";
+  m_descriptions.push_back(MetricDescription(
+      "psi/" + resource + "/" + kind + "_trigger",
+      "Number of times the " + kind + " stall of " + resource +
+      " exceeded the threshold of the trigger, in each poll interval",
+      display.str(), GR_METRIC_COUNT));
+  Trigger t = { fd, m_descriptions.back().id(), 0 };
+  m_triggers.push_back(t);
+  return true;
+}
+
+void
+PsiSource::WaitTriggers() {
+  std::vector<struct pollfd> fds(m_triggers.size() + 1);
+  for (unsigned int i = 0; i < m_triggers.size(); ++i) {
+    fds[i].fd = m_triggers[i].fd;
+    fds[i].events = POLLPRI;
+  }
+  fds.back().fd = m_stop_fd;
+  fds.back().events = POLLIN;
+  while (true) {
+    const int count = poll(&fds[0], fds.size(), -1);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      GFLOGF("PsiSource poll failed: %s", strerror(errno));
+      return;
+    }
+    if (fds.back().revents)
+      return;
+    ScopedLock s(&m_protect);
+    for (unsigned int i = 0; i < m_triggers.size(); ++i) {
+      if (fds[i].revents & POLLERR) {
+        // the file was removed, eg with its cgroup
+        fds[i].fd = -1;
+        continue;
+      }
+      if ((fds[i].revents & POLLPRI) &&
+          m_active_ids.count(m_triggers[i].id))
+        ++m_triggers[i].events;
+    }
+  }
+}
+
+void
+PsiSource::Subscribe(MetricSinkInterface *sink) {
+  {
+    ScopedLock s(&m_protect);
+    m_sink = sink;
+    if (!m_triggers.empty() && m_trigger_thread == NULL) {
+      m_trigger_thread = new TriggerThread(this);
+      m_trigger_thread->Start();
+    }
+  }
+  sink->OnDescriptions(m_descriptions);
+}
+
+void
+PsiSource::Activate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.insert(id);
+}
+
+void
+PsiSource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.erase(id);
+}
+
+void
+PsiSource::Poll(unsigned int ms) {
+  ScopedLock s(&m_protect);
+  if (m_active_ids.empty()) {
+    // the next rates start from fresh totals, and counts from 0
+    m_last_ns = 0;
+    for (auto t = m_triggers.begin(); t != m_triggers.end(); ++t)
+      t->events = 0;
+    return;
+  }
+
+  DataSet dset;
+  for (auto t = m_triggers.begin(); t != m_triggers.end(); ++t) {
+    if (m_active_ids.count(t->id))
+      dset.push_back(DataPoint(ms, t->id, static_cast<double>(t->events)));
+    t->events = 0;
+  }
+
+  const uint64_t now_ns = get_ns_time();
+  const double elapsed_s = m_last_ns ? (now_ns - m_last_ns) / 1e9 : 0;
+  m_last_ns = now_ns;
+  for (auto r = m_resources.begin(); r != m_resources.end(); ++r) {
+    double avg10[kKindCount];
+    uint64_t total[kKindCount];
+    if (!Parse(r->pressure, avg10, total))
+      continue;
+    for (int k = 0; k < kKindCount; ++k) {
+      const uint64_t us = total[k] >= r->last_total[k] ?
+                          total[k] - r->last_total[k] : 0;
+      r->last_total[k] = total[k];
+      if (m_active_ids.count(r->ids[k][kAvg10]))
+        dset.push_back(DataPoint(ms, r->ids[k][kAvg10], avg10[k]));
+      if (elapsed_s > 0 && m_active_ids.count(r->ids[k][kStallMs]))
+        dset.push_back(DataPoint(ms, r->ids[k][kStallMs],
+                                 us / 1e3 / elapsed_s));
+    }
+  }
+  if (!dset.empty() && m_sink)
+    m_sink->OnMetric(dset);
+}
@@ -0,0 +1,122 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFPSI_SOURCE_H_
+#define SOURCES_GFPSI_SOURCE_H_
+
+#include <stdint.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "os/gfmutex.h"
+#include "os/gfthread.h"
+#include "sources/gfimetric_source.h"
+
+namespace Grafips {
+class ProcFile;
+
+// Publishes Pressure Stall Information, which shows whether tasks are
+// waiting for cpu, memory or io, rather than how busy the system is.
+// For each <resource> of cpu, memory and io:
+//
+//   psi/<resource>/some_avg10    % of the last 10s in which some task
+//                                was stalled
+//   psi/<resource>/full_avg10    % of the last 10s in which all
+//                                non-idle tasks were stalled
+//   psi/<resource>/some_stall_ms ms of some stall, per second
+//   psi/<resource>/full_stall_ms ms of full stall, per second
+//
+// Triggers added with AddTrigger() are waited on by a thread which
+// sleeps in poll(), so they cost nothing until they fire.  Each is
+// published at each poll as psi/<resource>/<kind>_trigger: the number
+// of times it fired since the previous poll.
+class PsiSource : public PolledSourceInterface {
+ public:
+  explicit PsiSource(const std::string &proc_path = "/proc");
+  ~PsiSource();
+  // Fires when the <kind> ("some" or "full") stall of <resource>
+  // exceeds stall_us within any window_us.  Must precede Subscribe().
+  // false if the kernel rejects the trigger: unprivileged triggers
+  // require a window which is a multiple of 2s.
+  bool AddTrigger(const std::string &resource, const std::string &kind,
+                  unsigned int stall_us, unsigned int window_us);
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+  void Poll(unsigned int ms);
+
+ private:
+  enum Kind { kSome, kFull, kKindCount };
+  enum Metric { kAvg10, kStallMs, kMetricCount };
+
+  struct Resource {
+    std::string name;
+    ProcFile *pressure;
+    uint64_t last_total[kKindCount];
+    int ids[kKindCount][kMetricCount];
+  };
+  struct Trigger {
+    int fd;
+    int id;
+    // events since the previous poll
+    unsigned int events;
+  };
+
+  // waits on the trigger fds, and counts their events
+  class TriggerThread : public Thread {
+   public:
+    explicit TriggerThread(PsiSource *source)
+        : Thread("grafips_psi"), m_source(source) {}
+    void Run() { m_source->WaitTriggers(); }
+   private:
+    PsiSource *m_source;
+  };
+
+  // avg10 and total of each kind.  false if the file can't be read;
+  // kinds which are not present are 0.
+  static bool Parse(ProcFile *pressure, double *avg10, uint64_t *total);
+  void WaitTriggers();
+
+  const std::string m_proc_path;
+  std::vector<Resource> m_resources;
+  std::vector<Trigger> m_triggers;
+  TriggerThread *m_trigger_thread;
+  // signaled to stop m_trigger_thread
+  int m_stop_fd;
+  // time of the last read of stall totals, or 0 if they are not
+  // current
+  uint64_t m_last_ns;
+  std::set<int> m_active_ids;
+  MetricSinkInterface *m_sink;
+  MetricDescriptionSet m_descriptions;
+  Mutex m_protect;
+};
+}  // namespace Grafips
+
+#endif  // SOURCES_GFPSI_SOURCE_H_
@@ -0,0 +1,382 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfsampling_scheduler.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "error/gflog.h"
+#include "remote/gfimetric_sink.h"
+
+using Grafips::ControlSubscriberInterface;
+using Grafips::DataSet;
+using Grafips::MetricDescriptionSet;
+using Grafips::MetricSinkInterface;
+using Grafips::MetricSourceInterface;
+using Grafips::PolledSourceInterface;
+using Grafips::SamplingScheduler;
+using Grafips::ScopedLock;
+
+namespace {
+const char *kControl = "SampleInterval";
+
+// the source that Run() is polling on this thread, or NULL
+__thread const void *polling = NULL;
+
+unsigned int
+gcd(unsigned int a, unsigned int b) {
+  while (b) {
+    const unsigned int r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+}  // namespace
+
+const unsigned int SamplingScheduler::kMaxIntervalMs;
+
+// Stands in for a source with the publisher, to learn which metrics
+// the source describes, and which of them are active.  Fields other
+// than m_sink are protected by the scheduler's m_protect.
+class SamplingScheduler::ScheduledSource : public MetricSourceInterface,
+                                           public MetricSinkInterface {
+ public:
+  ScheduledSource(SamplingScheduler *scheduler,
+                  PolledSourceInterface *source,
+                  unsigned int default_ticks, unsigned int idle_ticks)
+      : source(source), default_ticks(default_ticks),
+        idle_ticks(idle_ticks), interval(0), due(0), poll_tick(0),
+        final_poll(false), filter(false), m_scheduler(scheduler),
+        m_sink(NULL) {}
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+  void OnMetric(const DataSet &d);
+  void OnDescriptions(const MetricDescriptionSet &descriptions);
+
+  PolledSourceInterface *const source;
+  const unsigned int default_ticks, idle_ticks;
+  // paths of the metrics described by the source
+  std::map<int, std::string> paths;
+  // sample interval of each active metric, in ticks
+  std::map<int, unsigned int> active;
+  // ticks between polls, or 0 if the source is not in the wheel
+  unsigned int interval;
+  uint64_t due;
+  // tick of the most recent poll
+  uint64_t poll_tick;
+  // the last metric was deactivated, and the source has not been
+  // polled since
+  bool final_poll;
+  // some active metric is not sampled at every poll
+  bool filter;
+
+ private:
+  SamplingScheduler *m_scheduler;
+  MetricSinkInterface *m_sink;
+};
+
+void
+SamplingScheduler::ScheduledSource::Subscribe(MetricSinkInterface *sink) {
+  m_sink = sink;
+  source->Subscribe(this);
+}
+
+void
+SamplingScheduler::ScheduledSource::Activate(int id) {
+  {
+    ScopedLock l(&m_scheduler->m_protect);
+    // the publisher offers every activation to every source
+    if (!paths.count(id))
+      return;
+  }
+  source->Activate(id);
+  ScopedLock l(&m_scheduler->m_protect);
+  std::map<std::string, unsigned int>::const_iterator i =
+      m_scheduler->m_intervals.find(paths[id]);
+  active[id] = (i == m_scheduler->m_intervals.end()) ? default_ticks :
+               m_scheduler->Ticks(i->second);
+  final_poll = false;
+  m_scheduler->Reschedule(this);
+}
+
+void
+SamplingScheduler::ScheduledSource::Deactivate(int id) {
+  {
+    ScopedLock l(&m_scheduler->m_protect);
+    if (!paths.count(id))
+      return;
+  }
+  source->Deactivate(id);
+  ScopedLock l(&m_scheduler->m_protect);
+  if (!active.erase(id))
+    return;
+  if (active.empty())
+    final_poll = true;
+  m_scheduler->Reschedule(this);
+}
+
+void
+SamplingScheduler::ScheduledSource::OnMetric(const DataSet &d) {
+  DataSet due;
+  {
+    ScopedLock l(&m_scheduler->m_protect);
+    // samples published outside of Poll(), eg by a thread of the
+    // source which waits for events, are delivered unfiltered
+    if (filter && polling == this) {
+      for (DataSet::const_iterator p = d.begin(); p != d.end(); ++p) {
+        std::map<int, unsigned int>::const_iterator a = active.find(p->id);
+        if (a != active.end() && poll_tick % a->second == 0)
+          due.push_back(*p);
+      }
+      if (due.empty())
+        return;
+    }
+  }
+  // unless hosts have set intervals, every sample is due
+  m_sink->OnMetric(due.empty() ? d : due);
+}
+
+void
+SamplingScheduler::ScheduledSource::OnDescriptions(
+    const MetricDescriptionSet &descriptions) {
+  {
+    ScopedLock l(&m_scheduler->m_protect);
+    for (MetricDescriptionSet::const_iterator d = descriptions.begin();
+         d != descriptions.end(); ++d)
+      m_scheduler->OnDescription(this, d->id(), d->path);
+  }
+  m_sink->OnDescriptions(descriptions);
+}
+
+SamplingScheduler::SamplingScheduler(unsigned int tick_ms)
+    : m_tick_ms(tick_ms ? tick_ms : 1), m_start_ns(get_ns_time()),
+      m_next_tick(0), m_subscriber(NULL) {}
+
+SamplingScheduler::~SamplingScheduler() {
+  for (unsigned int i = 0; i < m_sources.size(); ++i)
+    delete m_sources[i];
+}
+
+MetricSourceInterface *
+SamplingScheduler::Schedule(PolledSourceInterface *source,
+                            unsigned int poll_ms, unsigned int idle_ms) {
+  ScopedLock l(&m_protect);
+  ScheduledSource *s = new ScheduledSource(
+      this, source, Ticks(poll_ms), idle_ms ? Ticks(idle_ms) : 0);
+  m_sources.push_back(s);
+  Reschedule(s);
+  return s;
+}
+
+unsigned int
+SamplingScheduler::Ticks(unsigned int ms) const {
+  // rounds up without overflowing ms + m_tick_ms
+  return std::max(1u, ms / m_tick_ms + (ms % m_tick_ms != 0));
+}
+
+unsigned int
+SamplingScheduler::TickMs(uint64_t tick) const {
+  return (m_start_ns + tick * m_tick_ms * 1000000ULL) / 1000000;
+}
+
+void
+SamplingScheduler::Reschedule(ScheduledSource *s) {
+  unsigned int interval = 0;
+  for (std::map<int, unsigned int>::const_iterator a = s->active.begin();
+       a != s->active.end(); ++a)
+    interval = gcd(interval, a->second);
+  s->filter = false;
+  for (std::map<int, unsigned int>::const_iterator a = s->active.begin();
+       a != s->active.end(); ++a)
+    if (a->second != interval)
+      s->filter = true;
+  if (interval == 0)
+    interval = s->final_poll ? s->default_ticks : s->idle_ticks;
+  if (interval == s->interval)
+    return;
+  Remove(s);
+  s->interval = interval;
+  if (interval)
+    Insert(s);
+}
+
+void
+SamplingScheduler::Insert(ScheduledSource *s) {
+  // the first multiple of the interval which has not been run, so
+  // that sources with the same interval are polled at the same ticks
+  s->due = (m_next_tick + s->interval - 1) / s->interval * s->interval;
+  m_wheel[s->due % kWheelSlots].push_back(s);
+}
+
+void
+SamplingScheduler::Remove(ScheduledSource *s) {
+  if (!s->interval)
+    return;
+  std::vector<ScheduledSource *> &slot = m_wheel[s->due % kWheelSlots];
+  slot.erase(std::find(slot.begin(), slot.end(), s));
+}
+
+unsigned int
+SamplingScheduler::Run() {
+  const uint64_t tick_ns = m_tick_ms * 1000000ULL;
+  const uint64_t now = (get_ns_time() - m_start_ns) / tick_ns;
+  {
+    ScopedLock l(&m_protect);
+    m_due.clear();
+    m_due_ticks.clear();
+    // after a stall of a full revolution, each slot is visited once
+    uint64_t tick = m_next_tick;
+    if (now >= tick + kWheelSlots)
+      tick = now + 1 - kWheelSlots;
+    for (; tick <= now; ++tick) {
+      std::vector<ScheduledSource *> &slot = m_wheel[tick % kWheelSlots];
+      for (unsigned int i = 0; i < slot.size(); ) {
+        ScheduledSource *s = slot[i];
+        if (s->due > now) {
+          ++i;
+          continue;
+        }
+        slot[i] = slot.back();
+        slot.pop_back();
+        // a source which fell behind is polled once, at its latest
+        // tick
+        s->poll_tick = now / s->interval * s->interval;
+        s->due = s->poll_tick + s->interval;
+        m_wheel[s->due % kWheelSlots].push_back(s);
+        m_due.push_back(s);
+        m_due_ticks.push_back(s->poll_tick);
+      }
+    }
+    m_next_tick = now + 1;
+    for (unsigned int i = 0; i < m_due.size(); ++i) {
+      if (m_due[i]->final_poll && m_due[i]->active.empty()) {
+        m_due[i]->final_poll = false;
+        Reschedule(m_due[i]);
+      }
+    }
+  }
+
+  // sources are only deleted with the scheduler, so m_due remains
+  // valid without the lock.  Sources take their own locks to poll.
+  for (unsigned int i = 0; i < m_due.size(); ++i) {
+    polling = m_due[i];
+    m_due[i]->source->Poll(TickMs(m_due_ticks[i]));
+  }
+  polling = NULL;
+
+  const uint64_t next_ns = m_start_ns + (now + 1) * tick_ns;
+  const uint64_t ns = get_ns_time();
+  return next_ns > ns ? (next_ns - ns + 999999) / 1000000 : 0;
+}
+
+bool
+SamplingScheduler::SetInterval(const std::string &path, unsigned int ms) {
+  bool described;
+  ms = std::min(ms, kMaxIntervalMs);
+  {
+    ScopedLock l(&m_protect);
+    if (ms)
+      m_intervals[path] = ms;
+    else
+      m_intervals.erase(path);
+    std::map<std::string, std::pair<ScheduledSource *, int> >::iterator m =
+        m_metrics.find(path);
+    described = (m != m_metrics.end());
+    if (described) {
+      ScheduledSource *s = m->second.first;
+      std::map<int, unsigned int>::iterator a =
+          s->active.find(m->second.second);
+      if (a != s->active.end()) {
+        a->second = ms ? Ticks(ms) : s->default_ticks;
+        Reschedule(s);
+      }
+    }
+  }
+  if (m_subscriber)
+    m_subscriber->OnControlChanged(kControl, Intervals());
+  return described;
+}
+
+void
+SamplingScheduler::OnDescription(ScheduledSource *s, int id,
+                                 const std::string &path) {
+  s->paths[id] = path;
+  m_metrics[path] = std::make_pair(s, id);
+}
+
+std::string
+SamplingScheduler::Intervals() {
+  ScopedLock l(&m_protect);
+  std::stringstream value;
+  for (std::map<std::string, unsigned int>::const_iterator i =
+           m_intervals.begin(); i != m_intervals.end(); ++i) {
+    if (i != m_intervals.begin())
+      value << ",";
+    value << i->first << ":" << i->second;
+  }
+  return value.str();
+}
+
+void
+SamplingScheduler::Set(const std::string &key, const std::string &value) {
+  // <path>:<ms>.  Paths may not contain ':'.
+  const size_t colon = value.rfind(':');
+  if (key != kControl || colon == std::string::npos) {
+    GFLOGF("SamplingScheduler::Set invalid %s", value.c_str());
+    return;
+  }
+  const std::string path = value.substr(0, colon);
+  const char *ms_value = value.c_str() + colon + 1;
+  char *end = NULL;
+  errno = 0;
+  const long ms = strtol(ms_value, &end, 10);  // NOLINT
+  if (end == ms_value || *end != '\0' || errno == ERANGE || ms < 0 ||
+      ms > static_cast<long>(kMaxIntervalMs)) {  // NOLINT
+    GFLOGF("SamplingScheduler::Set invalid interval %s, expected 0 to %u ms",
+           value.c_str(), kMaxIntervalMs);
+    return;
+  }
+  if (!SetInterval(path, ms))
+    GFLOGF("SamplingScheduler::Set %s is not a polled metric, or is not "
+           "yet described", path.c_str());
+}
+
+void
+SamplingScheduler::Subscribe(ControlSubscriberInterface *sub) {
+  m_subscriber = sub;
+  sub->OnControlChanged(kControl, Intervals());
+}
@@ -0,0 +1,126 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFSAMPLING_SCHEDULER_H_
+#define SOURCES_GFSAMPLING_SCHEDULER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "controls/gficontrol.h"
+#include "os/gfmutex.h"
+#include "os/gftraits.h"
+#include "sources/gfimetric_source.h"
+
+namespace Grafips {
+
+// Owns the polling cadence of the sources which sample on the
+// publisher thread.  Sources with active metrics are kept in a timer
+// wheel of tick_ms slots, and other sources are not visited, so the
+// cost of Run() follows the activated metrics rather than the
+// registered sources.
+//
+// Each metric has a sample interval: the default of its source, or
+// one set by a host with the "SampleInterval" control, as
+// "<path>:<ms>".  A source is polled at the greatest common divisor of
+// the intervals of its active metrics, and samples of metrics which
+// are not due are discarded.  Polls fall on multiples of their
+// interval since the scheduler started, and are timestamped with the
+// scheduled tick rather than the time of the poll, so that samples of
+// different sources line up.  Samples that a source publishes outside
+// of Poll() are not filtered.
+class SamplingScheduler : public ControlInterface,
+                          NoCopy, NoAssign, NoMove {
+ public:
+  static const unsigned int kMaxIntervalMs = 3600000;
+
+  explicit SamplingScheduler(unsigned int tick_ms = 10);
+  ~SamplingScheduler();
+  // Returns a source which wraps source, to register with the
+  // publisher in its place.  Metrics of source are sampled every
+  // poll_ms by default.  While no metric is active, source is polled
+  // every idle_ms, eg to discover new metrics, or not at all if
+  // idle_ms is 0.  After its last metric is deactivated, source is
+  // polled once more, so it can reset its counters.
+  MetricSourceInterface *Schedule(PolledSourceInterface *source,
+                                  unsigned int poll_ms,
+                                  unsigned int idle_ms = 0);
+  // Polls the sources which are due.  Returns the ms until the next
+  // tick.
+  unsigned int Run();
+  // Sets the sample interval of the metric at path, rounded up to a
+  // multiple of the tick, and limited to kMaxIntervalMs.  0 restores
+  // the default.  false if no scheduled source has described the
+  // metric.
+  bool SetInterval(const std::string &path, unsigned int ms);
+
+  // "SampleInterval" control.  0 restores the default interval.
+  // Intervals which are not a number of ms up to kMaxIntervalMs are
+  // logged and ignored.
+  void Set(const std::string &key, const std::string &value);
+  void Subscribe(ControlSubscriberInterface *sub);
+
+ private:
+  class ScheduledSource;
+  enum { kWheelSlots = 256 };
+
+  unsigned int Ticks(unsigned int ms) const;
+  // tick ms, on the clock of get_ms_time()
+  unsigned int TickMs(uint64_t tick) const;
+  // recomputes the interval of s from its active metrics, and moves
+  // it within the wheel.  Requires m_protect.
+  void Reschedule(ScheduledSource *s);
+  void Insert(ScheduledSource *s);
+  void Remove(ScheduledSource *s);
+  void OnDescription(ScheduledSource *s, int id, const std::string &path);
+  // the value of the control
+  std::string Intervals();
+
+  const unsigned int m_tick_ms;
+  const uint64_t m_start_ns;
+  // ticks before m_next_tick have been run
+  uint64_t m_next_tick;
+  std::vector<ScheduledSource *> m_wheel[kWheelSlots];
+  std::vector<ScheduledSource *> m_sources;
+  // sources due at the current tick, reused by Run()
+  std::vector<ScheduledSource *> m_due;
+  std::vector<uint64_t> m_due_ticks;
+  // intervals set by hosts, in ms, by metric path
+  std::map<std::string, unsigned int> m_intervals;
+  // scheduled source which describes each metric, by path
+  std::map<std::string, std::pair<ScheduledSource *, int> > m_metrics;
+  ControlSubscriberInterface *m_subscriber;
+  // activations arrive on the skeleton thread, and controls on the
+  // control thread
+  Mutex m_protect;
+};
+}  // namespace Grafips
+
+#endif  // SOURCES_GFSAMPLING_SCHEDULER_H_
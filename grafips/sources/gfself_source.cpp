@@ -0,0 +1,200 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfself_source.h"
+
+#include "remote/gfimetric_sink.h"
+
+using Grafips::MetricDescription;
+using Grafips::MetricDescriptionSet;
+using Grafips::ScopedLock;
+using Grafips::SelfSource;
+
+static const float NANO_SECONDS_PER_US = 1000.0;
+
+static const MetricDescriptionSet k_metrics = {
+  MetricDescription("grafips/publish_time",
+                    "mean time grafips spends on the render thread per "
+                    "frame, in microseconds",
+                    "Grafips Frame Overhead",
+                    Grafips::GR_METRIC_AVERAGE),
+  MetricDescription("grafips/publish_time_max",
+                    "longest time grafips spent on the render thread for "
+                    "a single frame in the interval, in microseconds",
+                    "Grafips Max Frame Overhead",
+                    Grafips::GR_METRIC_COUNT),
+  MetricDescription("grafips/messages",
+                    "messages per second sent to the subscriber",
+                    "Grafips Messages",
+                    Grafips::GR_METRIC_RATE),
+  MetricDescription("grafips/syscalls",
+                    "send() system calls per second made to transmit "
+                    "messages to the subscriber",
+                    "Grafips Send Calls",
+                    Grafips::GR_METRIC_RATE),
+  MetricDescription("grafips/sessions",
+                    "number of hosts subscribed to the publisher",
+                    "Grafips Sessions",
+                    Grafips::GR_METRIC_COUNT),
+  MetricDescription("grafips/session_setup_time",
+                    "milliseconds from accepting the most recent host "
+                    "connection until publications could be sent to it",
+                    "Grafips Session Setup Time",
+                    Grafips::GR_METRIC_COUNT),
+  MetricDescription("grafips/threads_per_session",
+                    "threads run by grafips, divided by the number of "
+                    "subscribed hosts",
+                    "Grafips Threads Per Session",
+                    Grafips::GR_METRIC_AVERAGE),
+  MetricDescription("grafips/dropped_samples",
+                    "samples per second discarded because the render "
+                    "thread's queue was full, or a host fell behind",
+                    "Grafips Dropped Samples",
+                    Grafips::GR_METRIC_RATE)
+};
+
+static const int kpublish_time_id = k_metrics[0].id();
+static const int kpublish_time_max_id = k_metrics[1].id();
+static const int kmessages_id = k_metrics[2].id();
+static const int ksyscalls_id = k_metrics[3].id();
+static const int ksessions_id = k_metrics[4].id();
+static const int ksetup_time_id = k_metrics[5].id();
+static const int kthreads_per_session_id = k_metrics[6].id();
+static const int kdropped_samples_id = k_metrics[7].id();
+
+SelfSource::SelfSource()
+    : m_sink(NULL), m_last_publish_ms(0), m_publish_ns(0),
+      m_publish_max_ns(0), m_publish_count(0), m_messages(0), m_syscalls(0),
+      m_last_messages(0), m_last_syscalls(0), m_dropped(0),
+      m_last_dropped(0), m_sessions(0), m_threads(0),
+      m_setup_ms(0) {
+}
+
+SelfSource::~SelfSource() {
+}
+
+void
+SelfSource::Subscribe(MetricSinkInterface *sink) {
+  m_sink = sink;
+  sink->OnDescriptions(k_metrics);
+}
+
+void
+SelfSource::Activate(int id) {
+  ScopedLock s(&m_protect);
+  for (auto i = k_metrics.begin(); i != k_metrics.end(); ++i) {
+    if (i->id() == id) {
+      m_active_ids.insert(id);
+      return;
+    }
+  }
+}
+
+void
+SelfSource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.erase(id);
+}
+
+void
+SelfSource::RecordPublishTime(uint64_t ns) {
+  m_publish_ns += ns;
+  ++m_publish_count;
+  uint64_t max = m_publish_max_ns.load();
+  while (ns > max && !m_publish_max_ns.compare_exchange_weak(max, ns)) {}
+}
+
+void
+SelfSource::RecordTransport(uint64_t messages, uint64_t syscalls) {
+  ScopedLock s(&m_protect);
+  m_messages = messages;
+  m_syscalls = syscalls;
+}
+
+void
+SelfSource::RecordSessions(int sessions, float setup_ms, int threads) {
+  ScopedLock s(&m_protect);
+  m_sessions = sessions;
+  m_setup_ms = setup_ms;
+  m_threads = threads;
+}
+
+void
+SelfSource::RecordDropped(uint64_t samples) {
+  ScopedLock s(&m_protect);
+  m_dropped = samples;
+}
+
+void
+SelfSource::Poll(unsigned int ms) {
+  ScopedLock s(&m_protect);
+  if (m_active_ids.empty() || !m_sink)
+    return;
+
+  const unsigned int elapsed_ms = ms - m_last_publish_ms;
+  if (elapsed_ms == 0)
+    return;
+  m_last_publish_ms = ms;
+
+  // a new subscriber restarts the transport counts
+  if (m_messages < m_last_messages || m_syscalls < m_last_syscalls)
+    m_last_messages = m_last_syscalls = 0;
+  const float seconds = elapsed_ms / 1000.0;
+  const float messages = (m_messages - m_last_messages) / seconds;
+  const float syscalls = (m_syscalls - m_last_syscalls) / seconds;
+  m_last_messages = m_messages;
+  m_last_syscalls = m_syscalls;
+  const float dropped = (m_dropped - m_last_dropped) / seconds;
+  m_last_dropped = m_dropped;
+
+  const uint64_t publish_ns = m_publish_ns.exchange(0);
+  const int publish_count = m_publish_count.exchange(0);
+  const uint64_t publish_max_ns = m_publish_max_ns.exchange(0);
+
+  DataSet d;
+  if (publish_count && m_active_ids.count(kpublish_time_id))
+    d.push_back(DataPoint(ms, kpublish_time_id,
+                          publish_ns / NANO_SECONDS_PER_US / publish_count));
+  if (m_active_ids.count(kpublish_time_max_id))
+    d.push_back(DataPoint(ms, kpublish_time_max_id,
+                          publish_max_ns / NANO_SECONDS_PER_US));
+  if (m_active_ids.count(kmessages_id))
+    d.push_back(DataPoint(ms, kmessages_id, messages));
+  if (m_active_ids.count(ksyscalls_id))
+    d.push_back(DataPoint(ms, ksyscalls_id, syscalls));
+  if (m_active_ids.count(ksessions_id))
+    d.push_back(DataPoint(ms, ksessions_id, m_sessions));
+  if (m_active_ids.count(ksetup_time_id))
+    d.push_back(DataPoint(ms, ksetup_time_id, m_setup_ms));
+  if (m_sessions && m_active_ids.count(kthreads_per_session_id))
+    d.push_back(DataPoint(ms, kthreads_per_session_id,
+                          static_cast<float>(m_threads) / m_sessions));
+  if (m_active_ids.count(kdropped_samples_id))
+    d.push_back(DataPoint(ms, kdropped_samples_id, dropped));
+  if (!d.empty())
+    m_sink->OnMetric(d);
+}
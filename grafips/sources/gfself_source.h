@@ -0,0 +1,81 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFSELF_SOURCE_H_
+#define SOURCES_GFSELF_SOURCE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <set>
+
+#include "sources/gfimetric_source.h"
+#include "os/gfmutex.h"
+
+namespace Grafips {
+class MetricSinkInterface;
+
+// SelfSource publishes metrics describing the cost of grafips itself.
+// Measurements may be recorded from any thread, and are published
+// when the publisher thread polls.
+class SelfSource : public PolledSourceInterface {
+ public:
+  SelfSource();
+  ~SelfSource();
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+  void Poll(unsigned int ms);
+
+  // time spent by grafips on the render thread for a single frame
+  void RecordPublishTime(uint64_t ns);
+  // running totals of messages and send() calls made by the transport
+  void RecordTransport(uint64_t messages, uint64_t syscalls);
+  // connected hosts, the time taken to set up the most recent session,
+  // and the number of threads grafips is running.
+  void RecordSessions(int sessions, float setup_ms, int threads);
+  // running total of samples discarded before reaching a host, because
+  // a queue was full
+  void RecordDropped(uint64_t samples);
+
+ private:
+  MetricSinkInterface *m_sink;
+  std::set<int> m_active_ids;
+  // tick of the last poll
+  unsigned int m_last_publish_ms;
+
+  std::atomic<uint64_t> m_publish_ns, m_publish_max_ns;
+  std::atomic<int> m_publish_count;
+  uint64_t m_messages, m_syscalls;
+  uint64_t m_last_messages, m_last_syscalls;
+  uint64_t m_dropped, m_last_dropped;
+  int m_sessions, m_threads;
+  float m_setup_ms;
+  Mutex m_protect;
+};
+}  // end namespace Grafips
+#endif  // SOURCES_GFSELF_SOURCE_H_
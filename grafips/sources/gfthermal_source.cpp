@@ -0,0 +1,258 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfthermal_source.h"
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "os/gfproc_file.h"
+#include "remote/gfimetric_sink.h"
+
+using Grafips::ProcFile;
+using Grafips::ScopedLock;
+using Grafips::ThermalSource;
+
+namespace {
+// distinct indices of directory entries which start with <prefix><n>,
+// eg temp1_input and temp1_label, in order
+std::vector<int>
+ListIndices(const std::string &dir_path, const char *prefix) {
+  std::vector<int> indices;
+  DIR *dir = opendir(dir_path.c_str());
+  if (dir == NULL)
+    return indices;
+  const size_t len = strlen(prefix);
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, prefix, len) == 0 &&
+        entry->d_name[len] >= '0' && entry->d_name[len] <= '9')
+      indices.push_back(atoi(entry->d_name + len));
+  }
+  closedir(dir);
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+  return indices;
+}
+}  // namespace
+
+ThermalSource::ThermalSource(const std::string &sys_path)
+    : m_sink(NULL) {
+  for (int i = 0; i < kThrottleCount; ++i) {
+    m_throttle_ids[i] = 0;
+    m_last_ns[i] = 0;
+  }
+  EnumerateZones(sys_path);
+  EnumerateHwmon(sys_path);
+  EnumerateThrottle(sys_path);
+}
+
+ThermalSource::~ThermalSource() {
+  for (auto s = m_sensors.begin(); s != m_sensors.end(); ++s)
+    delete s->input;
+  for (int i = 0; i < kThrottleCount; ++i)
+    for (auto c = m_throttle[i].begin(); c != m_throttle[i].end(); ++c)
+      delete c->count;
+}
+
+void
+ThermalSource::AddSensor(const std::string &input_path,
+                         const std::string &path,
+                         const std::string &display) {
+  ProcFile *input = new ProcFile(input_path);
+  int64_t millidegrees;
+  // zones of some drivers fail to read while their device sleeps
+  if (!input->ReadInt(&millidegrees)) {
+    delete input;
+    return;
+  }
+  m_descriptions.push_back(MetricDescription(
+      path, "Temperature of the " + display + " sensor, in degrees C",
+      display + " C", GR_METRIC_AVERAGE));
+  Sensor s = { input, m_descriptions.back().id() };
+  m_sensors.push_back(s);
+}
+
+void
+ThermalSource::EnumerateZones(const std::string &sys_path) {
+  const std::string thermal = sys_path + "/class/thermal";
+  const std::vector<int> zones = ListIndices(thermal, "thermal_zone");
+  for (auto zone = zones.begin(); zone != zones.end(); ++zone) {
+    std::stringstream zone_path, path;
+    zone_path << thermal << "/thermal_zone" << *zone;
+    path << "thermal/zone/" << *zone << "/temperature";
+    std::string type = ProcFile::ReadLine(zone_path.str() + "/type");
+    if (type.empty())
+      type = "thermal_zone" + std::to_string(*zone);
+    AddSensor(zone_path.str() + "/temp", path.str(), type);
+  }
+}
+
+void
+ThermalSource::EnumerateHwmon(const std::string &sys_path) {
+  const std::string class_hwmon = sys_path + "/class/hwmon";
+  const std::vector<int> hwmons = ListIndices(class_hwmon, "hwmon");
+  for (auto hwmon = hwmons.begin(); hwmon != hwmons.end(); ++hwmon) {
+    std::stringstream hwmon_path;
+    hwmon_path << class_hwmon << "/hwmon" << *hwmon;
+    const std::string name = ProcFile::ReadLine(hwmon_path.str() + "/name");
+    // temp<m>_input, labelled by temp<m>_label if present
+    const std::vector<int> temps = ListIndices(hwmon_path.str(), "temp");
+    for (auto temp = temps.begin(); temp != temps.end(); ++temp) {
+      std::stringstream prefix, path;
+      prefix << hwmon_path.str() << "/temp" << *temp;
+      path << "thermal/hwmon/" << *hwmon << "/temp" << *temp
+           << "/temperature";
+      std::string display = ProcFile::ReadLine(prefix.str() + "_label");
+      if (display.empty())
+        display = "temp" + std::to_string(*temp);
+      if (!name.empty())
+        display = name + " " + display;
+      AddSensor(prefix.str() + "_input", path.str(), display);
+    }
+  }
+}
+
+void
+ThermalSource::EnumerateThrottle(const std::string &sys_path) {
+  const std::string cpu_dir = sys_path + "/devices/system/cpu";
+  const std::vector<int> cpus = ListIndices(cpu_dir, "cpu");
+  // every cpu of a package reports the same package count
+  std::set<int64_t> packages;
+  for (auto cpu = cpus.begin(); cpu != cpus.end(); ++cpu) {
+    std::stringstream dir;
+    dir << cpu_dir << "/cpu" << *cpu << "/";
+    const std::string throttle = dir.str() + "thermal_throttle/";
+    Counter c = { new ProcFile(throttle + "core_throttle_count"), 0 };
+    if (c.count->ReadUint(&c.last))
+      m_throttle[kCoreThrottle].push_back(c);
+    else
+      delete c.count;
+
+    int64_t package = *cpu;
+    ProcFile package_id(dir.str() + "topology/physical_package_id");
+    package_id.ReadInt(&package);
+    if (!packages.insert(package).second)
+      continue;
+    c.count = new ProcFile(throttle + "package_throttle_count");
+    if (c.count->ReadUint(&c.last))
+      m_throttle[kPackageThrottle].push_back(c);
+    else
+      delete c.count;
+  }
+
+  static const struct {
+    const char *path, *display, *help;
+  } kThrottles[] = {
+    { "thermal/core_throttle", "Core Throttles/s",
+      "Thermal throttle events of all cores, per second" },
+    { "thermal/package_throttle", "Package Throttles/s",
+      "Thermal throttle events of all packages, per second" },
+  };
+  for (int i = 0; i < kThrottleCount; ++i) {
+    if (m_throttle[i].empty())
+      continue;
+    m_descriptions.push_back(MetricDescription(
+        kThrottles[i].path, kThrottles[i].help, kThrottles[i].display,
+        GR_METRIC_RATE));
+    m_throttle_ids[i] = m_descriptions.back().id();
+  }
+}
+
+void
+ThermalSource::Subscribe(MetricSinkInterface *sink) {
+  {
+    ScopedLock s(&m_protect);
+    m_sink = sink;
+  }
+  sink->OnDescriptions(m_descriptions);
+}
+
+void
+ThermalSource::Activate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.insert(id);
+}
+
+void
+ThermalSource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.erase(id);
+}
+
+void
+ThermalSource::Poll(unsigned int ms) {
+  ScopedLock s(&m_protect);
+  if (m_active_ids.empty()) {
+    // the next rate starts from fresh counts
+    for (int i = 0; i < kThrottleCount; ++i)
+      m_last_ns[i] = 0;
+    return;
+  }
+
+  DataSet dset;
+  for (auto sensor = m_sensors.begin(); sensor != m_sensors.end();
+       ++sensor) {
+    int64_t millidegrees;
+    if (m_active_ids.count(sensor->id) &&
+        sensor->input->ReadInt(&millidegrees))
+      dset.push_back(DataPoint(ms, sensor->id, millidegrees / 1000.0));
+  }
+
+  const uint64_t now_ns = get_ns_time();
+  for (int i = 0; i < kThrottleCount; ++i) {
+    // counts of an inactive throttle metric are not read, so they
+    // are stale when it is activated again
+    if (!m_active_ids.count(m_throttle_ids[i])) {
+      m_last_ns[i] = 0;
+      continue;
+    }
+    const double elapsed_s =
+        m_last_ns[i] ? (now_ns - m_last_ns[i]) / 1e9 : 0;
+    m_last_ns[i] = now_ns;
+    uint64_t events = 0;
+    for (auto c = m_throttle[i].begin(); c != m_throttle[i].end(); ++c) {
+      uint64_t count;
+      if (!c->count->ReadUint(&count))
+        continue;
+      if (count >= c->last)
+        events += count - c->last;
+      c->last = count;
+    }
+    if (elapsed_s > 0)
+      dset.push_back(DataPoint(ms, m_throttle_ids[i], events / elapsed_s));
+  }
+  if (!dset.empty() && m_sink)
+    m_sink->OnMetric(dset);
+}
@@ -0,0 +1,95 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFTHERMAL_SOURCE_H_
+#define SOURCES_GFTHERMAL_SOURCE_H_
+
+#include <stdint.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "os/gfmutex.h"
+#include "sources/gfimetric_source.h"
+
+namespace Grafips {
+class ProcFile;
+
+// Publishes temperatures and thermal throttling, to explain
+// performance which drops over a long run.
+//
+//   thermal/zone/<n>/temperature          thermal zones, in C
+//   thermal/hwmon/<n>/temp<m>/temperature hwmon sensors, in C
+//   thermal/core_throttle                 core throttle events per
+//                                         second, for all cpus
+//   thermal/package_throttle              package throttle events per
+//                                         second, for all packages
+//
+// Sensor files are kept open, and read with pread at each poll.
+class ThermalSource : public PolledSourceInterface {
+ public:
+  explicit ThermalSource(const std::string &sys_path = "/sys");
+  ~ThermalSource();
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+  void Poll(unsigned int ms);
+
+ private:
+  struct Sensor {
+    ProcFile *input;
+    int id;
+  };
+  struct Counter {
+    ProcFile *count;
+    uint64_t last;
+  };
+  enum Throttle {
+    kCoreThrottle, kPackageThrottle, kThrottleCount
+  };
+
+  void EnumerateZones(const std::string &sys_path);
+  void EnumerateHwmon(const std::string &sys_path);
+  void EnumerateThrottle(const std::string &sys_path);
+  void AddSensor(const std::string &input_path, const std::string &path,
+                 const std::string &display);
+
+  std::vector<Sensor> m_sensors;
+  std::vector<Counter> m_throttle[kThrottleCount];
+  int m_throttle_ids[kThrottleCount];
+  // time of the last read of each throttle's counts, or 0 if they are
+  // not current
+  uint64_t m_last_ns[kThrottleCount];
+  std::set<int> m_active_ids;
+  MetricSinkInterface *m_sink;
+  MetricDescriptionSet m_descriptions;
+  Mutex m_protect;
+};
+}  // namespace Grafips
+
+#endif  // SOURCES_GFTHERMAL_SOURCE_H_
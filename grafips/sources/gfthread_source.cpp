@@ -0,0 +1,311 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "sources/gfthread_source.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "error/gflog.h"
+#include "remote/gfimetric_sink.h"
+
+using Grafips::ProcFile;
+using Grafips::ScopedLock;
+using Grafips::ThreadSource;
+
+namespace {
+struct MetricInfo {
+  const char *suffix, *display, *help;
+  Grafips::MetricType type;
+};
+
+const MetricInfo kMetrics[] = {
+  { "utilization", "%CPU",
+    "Percent of time the thread ran on a cpu", Grafips::GR_METRIC_PERCENT },
+  { "wait", "Run Queue Wait %",
+    "Percent of time the thread was runnable, but waiting for a cpu",
+    Grafips::GR_METRIC_PERCENT },
+  { "sched_delay", "Sched Delay ms",
+    "Average time the thread waited for a cpu before each timeslice",
+    Grafips::GR_METRIC_AVERAGE },
+};
+
+pid_t
+current_tid() {
+  static __thread pid_t tid = 0;
+  if (!tid)
+    tid = syscall(SYS_gettid);
+  return tid;
+}
+
+const char *kRenderName = "render";
+
+std::string
+TaskPath(pid_t tid, const char *file) {
+  std::stringstream path;
+  path << "/proc/self/task/" << tid << "/" << file;
+  return path.str();
+}
+}  // namespace
+
+ThreadSource::Task::Task(pid_t tid)
+    : schedstat_file(TaskPath(tid, "schedstat")),
+      run_ns(0), wait_ns(0), timeslices(0), seen(true), fresh(true) {
+  for (int i = 0; i < kMetricCount; ++i)
+    ids[i] = 0;
+}
+
+ThreadSource::ThreadSource()
+    : m_render_tid(0), m_render_named(0), m_skipped(0), m_metric_sink(NULL),
+      m_last_ns(get_ns_time()) {
+}
+
+ThreadSource::~ThreadSource() {
+  for (TaskMap::iterator i = m_tasks.begin(); i != m_tasks.end(); ++i)
+    delete i->second;
+}
+
+void
+ThreadSource::Subscribe(MetricSinkInterface *sink) {
+  MetricDescriptionSet descriptions;
+  {
+    ScopedLock s(&m_protect);
+    m_metric_sink = sink;
+    Discover(&descriptions);
+  }
+  sink->OnDescriptions(descriptions);
+}
+
+void
+ThreadSource::Activate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.insert(id);
+}
+
+void
+ThreadSource::Deactivate(int id) {
+  ScopedLock s(&m_protect);
+  m_active_ids.erase(id);
+}
+
+void
+ThreadSource::SetRenderThread() {
+  const pid_t tid = current_tid();
+  if (m_render_tid != tid)
+    m_render_tid = tid;
+}
+
+bool
+ThreadSource::ReadSchedstat(Task *t, uint64_t *run_ns, uint64_t *wait_ns,
+                            uint64_t *timeslices) {
+  if (!t->schedstat_file.Read())
+    return false;
+  const char *p = t->schedstat_file.Data();
+  const char *end = t->schedstat_file.End();
+  *run_ns = ProcFile::ParseUint(&p, end);
+  *wait_ns = ProcFile::ParseUint(&p, end);
+  *timeslices = ProcFile::ParseUint(&p, end);
+  return true;
+}
+
+void
+ThreadSource::Describe(const std::string &name, Task *t,
+                       MetricDescriptionSet *descriptions) {
+  // comm may contain any character but '\0'
+  std::string path_name = name;
+  std::replace(path_name.begin(), path_name.end(), '/', '_');
+  std::replace(path_name.begin(), path_name.end(), ' ', '_');
+  const bool described = !m_described.insert(name).second;
+  for (int i = 0; i < kMetricCount; ++i) {
+    MetricDescription desc("thread/" + path_name + "/" + kMetrics[i].suffix,
+                           kMetrics[i].help,
+                           "Thread " + name + " " + kMetrics[i].display,
+                           kMetrics[i].type);
+    t->ids[i] = desc.id();
+    if (!described)
+      descriptions->push_back(desc);
+  }
+}
+
+std::string
+ThreadSource::UniqueName(const std::string &comm) const {
+  if (comm != kRenderName && !m_names.count(comm))
+    return comm;
+  for (int n = 2; ; ++n) {
+    std::stringstream s;
+    s << comm << "-" << n;
+    if (!m_names.count(s.str()))
+      return s.str();
+  }
+}
+
+void
+ThreadSource::Name(const std::string &name, Task *t,
+                   MetricDescriptionSet *descriptions) {
+  if (!t->name.empty())
+    m_names.erase(t->name);
+  t->name = name;
+  m_names.insert(name);
+  Describe(name, t, descriptions);
+}
+
+void
+ThreadSource::Discover(MetricDescriptionSet *descriptions) {
+  DIR *dir = opendir("/proc/self/task");
+  if (dir == NULL)
+    return;
+  for (TaskMap::iterator i = m_tasks.begin(); i != m_tasks.end(); ++i)
+    i->second->seen = false;
+  const pid_t render_tid = m_render_tid;
+  int skipped = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const pid_t tid = atoi(entry->d_name);
+    if (tid <= 0)
+      continue;
+    TaskMap::iterator found = m_tasks.find(tid);
+    Task *t = NULL;
+    if (found != m_tasks.end()) {
+      t = found->second;
+    } else if (m_tasks.size() >= kMaxThreads && tid != render_tid) {
+      ++skipped;
+      continue;
+    } else {
+      t = new Task(tid);
+      m_tasks[tid] = t;
+      ReadSchedstat(t, &t->run_ns, &t->wait_ns, &t->timeslices);
+    }
+    t->seen = true;
+  }
+  closedir(dir);
+  if (skipped != m_skipped)
+    GFLOGF("ThreadSource: %d threads beyond the first %u are not published",
+           skipped, kMaxThreads);
+  m_skipped = skipped;
+
+  TaskMap::iterator i = m_tasks.begin();
+  while (i != m_tasks.end()) {
+    if (i->second->seen) {
+      ++i;
+      continue;
+    }
+    // the name may be taken by a later thread
+    m_names.erase(i->second->name);
+    if (i->first == m_render_named)
+      m_render_named = 0;
+    delete i->second;
+    m_tasks.erase(i++);
+  }
+
+  // The render thread is named as soon as it swaps.  A thread which
+  // swapped before it is named by its comm, like any other.
+  if (render_tid != m_render_named) {
+    TaskMap::iterator render = m_tasks.find(render_tid);
+    if (render != m_tasks.end()) {
+      TaskMap::iterator previous = m_tasks.find(m_render_named);
+      if (previous != m_tasks.end()) {
+        m_names.erase(kRenderName);
+        previous->second->name.clear();
+        if (!previous->second->comm.empty())
+          Name(UniqueName(previous->second->comm), previous->second,
+               descriptions);
+      }
+      Name(kRenderName, render->second, descriptions);
+      m_render_named = render_tid;
+    }
+  }
+
+  // A thread is named at the discovery after the one which found it,
+  // so it has had time to set its comm.  Names are kept until the
+  // thread exits, so a series never follows a different thread while
+  // both exist.  tids increase as threads are created, so threads
+  // which share a comm are numbered in order of creation.
+  for (i = m_tasks.begin(); i != m_tasks.end(); ++i) {
+    Task *t = i->second;
+    if (!t->name.empty())
+      continue;
+    if (t->fresh) {
+      t->fresh = false;
+      continue;
+    }
+    t->comm = ProcFile::ReadLine(TaskPath(i->first, "comm"));
+    if (t->comm.empty())
+      // exited
+      continue;
+    Name(UniqueName(t->comm), t, descriptions);
+  }
+}
+
+void
+ThreadSource::Poll(unsigned int ms) {
+  ScopedLock s(&m_protect);
+  const bool active = !m_active_ids.empty();
+
+  MetricDescriptionSet descriptions;
+  Discover(&descriptions);
+  if (!descriptions.empty() && m_metric_sink)
+    m_metric_sink->OnDescriptions(descriptions);
+
+  // counters are read while inactive, so the first samples after an
+  // activation cover a single interval.
+  const uint64_t now_ns = get_ns_time();
+  const double elapsed_ns = now_ns - m_last_ns;
+  m_last_ns = now_ns;
+  DataSet d;
+  for (TaskMap::iterator i = m_tasks.begin(); i != m_tasks.end(); ++i) {
+    Task *t = i->second;
+    uint64_t run_ns, wait_ns, timeslices;
+    if (!ReadSchedstat(t, &run_ns, &wait_ns, &timeslices))
+      continue;
+    const uint64_t run = run_ns - t->run_ns;
+    const uint64_t wait = wait_ns - t->wait_ns;
+    const uint64_t slices = timeslices - t->timeslices;
+    t->run_ns = run_ns;
+    t->wait_ns = wait_ns;
+    t->timeslices = timeslices;
+    if (!active || elapsed_ns <= 0 || t->name.empty())
+      continue;
+    if (m_active_ids.count(t->ids[kUtilization]))
+      d.push_back(DataPoint(ms, t->ids[kUtilization],
+                            std::min(100.0, run / elapsed_ns * 100.0)));
+    if (m_active_ids.count(t->ids[kWait]))
+      d.push_back(DataPoint(ms, t->ids[kWait],
+                            std::min(100.0, wait / elapsed_ns * 100.0)));
+    if (m_active_ids.count(t->ids[kSchedDelay]))
+      d.push_back(DataPoint(ms, t->ids[kSchedDelay],
+                            slices ? wait / 1e6 / slices : 0.0));
+  }
+  if (!d.empty() && m_metric_sink)
+    m_metric_sink->OnMetric(d);
+}
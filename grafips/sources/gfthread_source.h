@@ -0,0 +1,122 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef SOURCES_GFTHREAD_SOURCE_H_
+#define SOURCES_GFTHREAD_SOURCE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "os/gfmutex.h"
+#include "os/gfproc_file.h"
+#include "sources/gfimetric_source.h"
+
+namespace Grafips {
+
+// Publishes the cpu utilization and scheduling delay of each thread
+// of the process, from /proc/self/task/<tid>/schedstat.  Threads are
+// named by their comm, shortly after they are created.  Threads which
+// share a comm are numbered in order of creation, eg "worker",
+// "worker-2".  The thread which swaps buffers is published as
+// "render", whatever its comm.  A thread keeps its name until it
+// exits, and no two threads share one.
+//
+//   thread/<name>/utilization  percent of time on a cpu
+//   thread/<name>/wait         percent of time runnable, but waiting
+//                              for a cpu
+//   thread/<name>/sched_delay  average run-queue wait before each
+//                              timeslice, in ms
+//
+// Threads are discovered as they are created, and described to the
+// sink when first seen.  Each thread holds its schedstat open, so at
+// most kMaxThreads threads are published, plus the render thread.
+class ThreadSource : public PolledSourceInterface {
+ public:
+  ThreadSource();
+  ~ThreadSource();
+  void Subscribe(MetricSinkInterface *sink);
+  void Activate(int id);
+  void Deactivate(int id);
+  void Poll(unsigned int ms);
+  // called on the thread which swaps buffers
+  void SetRenderThread();
+
+ private:
+  enum Metric {
+    kUtilization, kWait, kSchedDelay, kMetricCount
+  };
+  static const unsigned int kMaxThreads = 64;
+
+  struct Task {
+    explicit Task(pid_t tid);
+    ProcFile schedstat_file;
+    std::string comm, name;
+    // cumulative, from schedstat
+    uint64_t run_ns, wait_ns, timeslices;
+    int ids[kMetricCount];
+    bool seen;
+    // true until the discovery after the one which found the thread
+    bool fresh;
+  };
+  typedef std::map<pid_t, Task *> TaskMap;
+
+  // finds new and exited threads, and names them.  Appends
+  // descriptions of new names.
+  void Discover(MetricDescriptionSet *descriptions);
+  void Describe(const std::string &name, Task *t,
+                MetricDescriptionSet *descriptions);
+  // comm, or comm numbered to differ from the names of other threads
+  std::string UniqueName(const std::string &comm) const;
+  void Name(const std::string &name, Task *t,
+            MetricDescriptionSet *descriptions);
+  static bool ReadSchedstat(Task *t, uint64_t *run_ns, uint64_t *wait_ns,
+                            uint64_t *timeslices);
+
+  TaskMap m_tasks;
+  std::atomic<pid_t> m_render_tid;
+  // thread named "render", or 0
+  pid_t m_render_named;
+  // names of the tracked threads
+  std::set<std::string> m_names;
+  // names which have been described
+  std::set<std::string> m_described;
+  std::set<int> m_active_ids;
+  // threads which were not tracked at the last discovery
+  int m_skipped;
+  MetricSinkInterface *m_metric_sink;
+  uint64_t m_last_ns;
+  Mutex m_protect;
+};
+}  // namespace Grafips
+
+#endif  // SOURCES_GFTHREAD_SOURCE_H_
@@ -0,0 +1,184 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+// Buckets samples into per-interval statistics with MetricAggregator,
+// and checks the statistics that Emit publishes.
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "remote/gfmetric.h"
+#include "remote/gfmetric_aggregator.h"
+#include "remote/gfmetric_registry.h"
+
+using Grafips::DataPoint;
+using Grafips::DataSet;
+using Grafips::MetricAggregator;
+using Grafips::MetricDescription;
+using Grafips::MetricDescriptionSet;
+using Grafips::MetricRegistry;
+using Grafips::StreamingHistogram;
+
+namespace {
+
+bool
+Near(double value, double expected) {
+  // buckets are within about 2% of the true value
+  return fabs(value - expected) <= 0.02 * fabs(expected);
+}
+
+// the value of id in d, which must hold it once
+double
+Value(const DataSet &d, int id) {
+  int found = 0;
+  double value = 0;
+  for (DataSet::const_iterator i = d.begin(); i != d.end(); ++i) {
+    if (i->id != id)
+      continue;
+    ++found;
+    value = i->data;
+  }
+  assert(found == 1);
+  return value;
+}
+
+void
+TestHistogram() {
+  StreamingHistogram h;
+  assert(h.Count() == 0);
+  assert(h.Percentile(0.5) == 0);
+  for (int i = 1; i <= 1000; ++i)
+    h.Add(i);
+  assert(h.Count() == 1000);
+  assert(h.Min() == 1);
+  assert(h.Max() == 1000);
+  assert(h.Mean() == 500.5);
+  assert(Near(h.Percentile(0.5), 500));
+  assert(Near(h.Percentile(0.99), 990));
+  assert(Near(h.Percentile(1), 1000));
+
+  h.Reset();
+  assert(h.Count() == 0);
+  // samples <= 0 share a bucket, and are reported as the minimum
+  h.Add(-5);
+  h.Add(0);
+  h.Add(1e15);
+  assert(h.Min() == -5);
+  assert(h.Percentile(0.5) == -5);
+  // beyond the last bucket, clamped to the samples
+  assert(h.Percentile(1) > 0 && h.Percentile(1) <= 1e15);
+}
+
+void
+TestEmit() {
+  MetricDescriptionSet descriptions, derived;
+  descriptions.push_back(MetricDescription("test/aggregator/value",
+                                           "help", "Value",
+                                           Grafips::GR_METRIC_AVERAGE));
+  const int base = descriptions[0].id();
+  MetricAggregator a;
+  a.AddDescriptions(descriptions, &derived);
+  assert(derived.size() == MetricAggregator::kStatisticCount);
+
+  const int count = MetricRegistry::Hash("test/aggregator/value/count");
+  const int max = MetricRegistry::Hash("test/aggregator/value/max");
+  const int p99 = MetricRegistry::Hash("test/aggregator/value/p99");
+  int b = 0;
+  assert(a.Base(p99, &b) && b == base);
+  assert(!a.Base(base, &b));
+
+  // samples of inactive metrics are not accumulated
+  a.Add(DataPoint(0, base, 1.0));
+  assert(!a.Aggregated(base));
+  DataSet d;
+  a.Emit(0, &d);
+  assert(d.empty());
+
+  assert(a.Activate(count));
+  assert(!a.Activate(count));
+  assert(a.Activate(p99));
+  assert(a.Aggregated(base));
+  for (int i = 1; i <= 100; ++i)
+    a.Add(DataPoint(i, base, static_cast<double>(i)));
+  a.Emit(1000, &d);
+  // only the active statistics are published
+  assert(d.size() == 2);
+  assert(d[0].time_val == 1000);
+  assert(Value(d, count) == 100);
+  assert(Near(Value(d, p99), 99));
+
+  // each interval starts empty, and is not published without samples
+  d.clear();
+  a.Emit(2000, &d);
+  assert(d.empty());
+  a.Add(DataPoint(2500, base, 7.0));
+  assert(a.Activate(max));
+  a.Emit(3000, &d);
+  assert(d.size() == 3);
+  assert(Value(d, count) == 1);
+  assert(Value(d, max) == 7);
+
+  assert(a.Deactivate(count));
+  assert(!a.Deactivate(count));
+  assert(a.Deactivate(p99));
+  assert(a.Deactivate(max));
+  assert(!a.Aggregated(base));
+  a.Add(DataPoint(3500, base, 7.0));
+  d.clear();
+  a.Emit(4000, &d);
+  assert(d.empty());
+}
+
+void
+TestCollision() {
+  // "Aa" and "BB" have the same hash
+  MetricDescriptionSet descriptions, derived;
+  descriptions.push_back(MetricDescription("test/aggregator/Aa", "help",
+                                           "Aa", Grafips::GR_METRIC_COUNT));
+  descriptions.push_back(MetricDescription("test/aggregator/BB", "help",
+                                           "BB", Grafips::GR_METRIC_COUNT));
+  assert(descriptions[1].id() == MetricRegistry::kInvalidId);
+  MetricAggregator a;
+  a.AddDescriptions(descriptions, &derived);
+  assert(derived.size() == MetricAggregator::kStatisticCount);
+  for (unsigned int i = 0; i < derived.size(); ++i)
+    assert(derived[i].path.find("test/aggregator/Aa/") == 0);
+}
+
+}  // namespace
+
+int
+main() {
+  TestHistogram();
+  TestEmit();
+  TestCollision();
+  printf("PASS: gfmetric_aggregator_test\n");
+  return 0;
+}
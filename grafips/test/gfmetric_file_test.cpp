@@ -0,0 +1,226 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+// Writes a recording with MetricFileWriter and MetricRecorder, and
+// reads it back with MetricFileReader.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <set>
+#include <string>
+
+#include "remote/gfmetric.h"
+#include "remote/gfmetric_file.h"
+#include "remote/gfmetric_recorder.h"
+
+using Grafips::DataPoint;
+using Grafips::DataSet;
+using Grafips::MetricDescription;
+using Grafips::MetricDescriptionSet;
+using Grafips::MetricFileReader;
+using Grafips::MetricFileWriter;
+using Grafips::MetricRecorder;
+
+namespace {
+
+const uint64_t kMs = 1000000;
+
+std::string
+TempPath() {
+  char path[] = "/tmp/gfmetric_file_test.XXXXXX";
+  const int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  return path;
+}
+
+DataPoint
+Double(uint64_t ns, int id, double value) {
+  DataPoint p(static_cast<unsigned int>(ns / kMs), id, value);
+  p.time_ns = ns;
+  return p;
+}
+
+// the samples of id in d
+DataSet
+Series(const DataSet &d, int id) {
+  DataSet s;
+  for (DataSet::const_iterator i = d.begin(); i != d.end(); ++i)
+    if (i->id == id)
+      s.push_back(*i);
+  return s;
+}
+
+const MetricDescription *
+Find(const MetricDescriptionSet &descriptions, int id) {
+  for (MetricDescriptionSet::const_iterator i = descriptions.begin();
+       i != descriptions.end(); ++i)
+    if (i->id() == id)
+      return &*i;
+  assert(false);
+  return NULL;
+}
+
+bool
+Equal(const DataPoint &a, const DataPoint &b) {
+  return a.id == b.id && a.time_ns == b.time_ns && a.data == b.data &&
+      a.integral == b.integral && (!a.integral || a.int_data == b.int_data);
+}
+
+void
+TestRoundTrip() {
+  const std::string path = TempPath();
+  MetricDescriptionSet descriptions;
+  descriptions.push_back(MetricDescription("test/file/count", "help",
+                                           "Count",
+                                           Grafips::GR_METRIC_COUNT));
+  descriptions.push_back(MetricDescription("test/file/percent", "help",
+                                           "Percent",
+                                           Grafips::GR_METRIC_PERCENT));
+  const int count = descriptions[0].id();
+  const int percent = descriptions[1].id();
+
+  // integral values, with repeats, and doubles
+  DataSet first, second;
+  const int64_t counts[] = { 5, 5, -3, 1LL << 40, 0 };
+  const double percents[] = { 12.5, 12.5, 0.1, 99.999, 0 };
+  for (int i = 0; i < 5; ++i) {
+    first.push_back(DataPoint((100 + i) * kMs, count, counts[i]));
+    first.push_back(Double((100 + i) * kMs + 1, percent, percents[i]));
+  }
+  second.push_back(DataPoint(200 * kMs, count, static_cast<int64_t>(7)));
+
+  MetricFileWriter w;
+  assert(w.Open(path));
+  assert(w.WriteDescriptions(descriptions));
+  assert(w.WriteChunk(first));
+  assert(w.WriteChunk(second));
+  w.Close();
+  // writes fail once the file is closed
+  assert(!w.WriteChunk(second));
+
+  MetricFileReader r;
+  assert(r.Open(path));
+  assert(r.Descriptions().size() == 2);
+  assert(Find(r.Descriptions(), count)->path == "test/file/count");
+  assert(Find(r.Descriptions(), percent)->type ==
+         Grafips::GR_METRIC_PERCENT);
+  assert(r.Summaries().find(count)->second.samples == 6);
+  assert(r.Summaries().find(count)->second.begin_ns == 100 * kMs);
+  assert(r.Summaries().find(count)->second.end_ns == 200 * kMs);
+  assert(r.Summaries().find(percent)->second.samples == 5);
+
+  DataSet d;
+  assert(r.Read(0, ~0ULL, std::set<int>(), &d));
+  assert(d.size() == 11);
+  const DataSet counts_read = Series(d, count);
+  const DataSet percents_read = Series(d, percent);
+  assert(counts_read.size() == 6 && percents_read.size() == 5);
+  for (int i = 0; i < 5; ++i) {
+    assert(Equal(counts_read[i], first[2 * i]));
+    assert(Equal(percents_read[i], first[2 * i + 1]));
+  }
+  assert(Equal(counts_read[5], second[0]));
+
+  // a time range of one metric
+  std::set<int> ids;
+  ids.insert(percent);
+  d.clear();
+  assert(r.Read(101 * kMs, 103 * kMs, ids, &d));
+  assert(d.size() == 2);
+  assert(Equal(d[0], first[3]) && Equal(d[1], first[5]));
+  unlink(path.c_str());
+}
+
+void
+TestTruncated() {
+  const std::string path = TempPath();
+  DataSet d;
+  d.push_back(DataPoint(kMs, 1, static_cast<int64_t>(1)));
+  MetricFileWriter w;
+  assert(w.Open(path));
+  assert(w.WriteChunk(d));
+  w.Close();
+  // a record header, without its payload
+  FILE *f = fopen(path.c_str(), "ab");
+  const unsigned char partial[] = { 2, 0, 0, 0, 100, 0, 0, 0, 1 };
+  fwrite(partial, 1, sizeof(partial), f);
+  fclose(f);
+
+  MetricFileReader r;
+  assert(r.Open(path));
+  d.clear();
+  assert(r.Read(0, ~0ULL, std::set<int>(), &d));
+  assert(d.size() == 1);
+  unlink(path.c_str());
+}
+
+void
+TestRecorder() {
+  const std::string path = TempPath();
+  MetricDescriptionSet descriptions;
+  descriptions.push_back(MetricDescription("test/file/recorded", "help",
+                                           "Recorded",
+                                           Grafips::GR_METRIC_COUNT));
+  const int id = descriptions[0].id();
+  MetricRecorder recorder;
+  assert(recorder.Open(path));
+  recorder.Start();
+  recorder.OnDescriptions(descriptions);
+  DataSet d;
+  const uint64_t now = Grafips::get_ns_time();
+  for (int i = 0; i < 100; ++i)
+    d.push_back(DataPoint(now + i * kMs, id, static_cast<int64_t>(i)));
+  recorder.OnMetric(d);
+  // writes the buffered samples, though a chunk is not yet due
+  recorder.Close();
+  recorder.Close();
+
+  MetricFileReader r;
+  assert(r.Open(path));
+  assert(r.Descriptions().size() == 1);
+  d.clear();
+  assert(r.Read(0, ~0ULL, std::set<int>(), &d));
+  assert(d.size() == 100);
+  assert(d[99].int_data == 99);
+  assert(recorder.DroppedSamples() == 0);
+  unlink(path.c_str());
+}
+
+}  // namespace
+
+int
+main() {
+  TestRoundTrip();
+  TestTruncated();
+  TestRecorder();
+  printf("PASS: gfmetric_file_test\n");
+  return 0;
+}
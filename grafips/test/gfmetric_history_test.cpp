@@ -0,0 +1,120 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+// Records more samples than a MetricHistory ring holds, and checks
+// that Replay returns the newest, oldest first.
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "remote/gfmetric.h"
+#include "remote/gfmetric_history.h"
+
+using Grafips::DataPoint;
+using Grafips::DataSet;
+using Grafips::MetricHistory;
+
+namespace {
+
+const int kId = 1, kOther = 2, kUntracked = 3;
+
+DataPoint
+Sample(unsigned int ms, int id, double value) {
+  return DataPoint(ms, id, value);
+}
+
+void
+TestWraparound() {
+  // ten 100ms slots
+  MetricHistory h(100);
+  h.Track(kId, 1);
+  assert(h.Tracked(kId));
+  assert(!h.Tracked(kUntracked));
+  // 25 slots of samples, two in each
+  for (unsigned int ms = 0; ms < 2500; ms += 50)
+    h.Add(Sample(ms, kId, ms));
+  h.Add(Sample(100, kUntracked, 1));
+
+  DataSet d;
+  h.Replay(&d);
+  assert(d.size() == 20);
+  for (unsigned int i = 0; i < d.size(); ++i) {
+    assert(d[i].id == kId);
+    assert(d[i].time_val == 1500 + 50 * i);
+    assert(d[i].data == d[i].time_val);
+  }
+}
+
+void
+TestMinMax() {
+  MetricHistory h(100);
+  h.Track(kId, 1);
+  h.Add(Sample(10, kId, 5));
+  h.Add(Sample(20, kId, 1));
+  h.Add(Sample(30, kId, 9));
+  h.Add(Sample(40, kId, 3));
+  // a single sample in a slot is replayed once
+  h.Add(Sample(150, kId, 4));
+
+  DataSet d;
+  h.Replay(&d);
+  assert(d.size() == 3);
+  assert(d[0].time_val == 20 && d[0].data == 1);
+  assert(d[1].time_val == 30 && d[1].data == 9);
+  assert(d[2].time_val == 150 && d[2].data == 4);
+}
+
+void
+TestStale() {
+  MetricHistory h(100);
+  h.Track(kId, 1);
+  h.Track(kOther, 2);
+  h.Add(Sample(0, kId, 1));
+  h.Add(Sample(0, kOther, 1));
+  // after a gap longer than the ring, the old slots are not replayed,
+  // though the new sample is in a different slot
+  h.Add(Sample(5050, kId, 2));
+  h.Add(Sample(1950, kOther, 2));
+
+  DataSet d;
+  h.Replay(&d);
+  assert(d.size() == 3);
+  assert(d[0].id == kId && d[0].time_val == 5050);
+  assert(d[1].id == kOther && d[1].time_val == 0);
+  assert(d[2].id == kOther && d[2].time_val == 1950);
+}
+
+}  // namespace
+
+int
+main() {
+  TestWraparound();
+  TestMinMax();
+  TestStale();
+  printf("PASS: gfmetric_history_test\n");
+  return 0;
+}
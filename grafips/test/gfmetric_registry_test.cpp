@@ -0,0 +1,170 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+// Interns colliding paths in the MetricRegistry, and checks binding
+// and glob matching of ids.
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "remote/gfmetric_registry.h"
+
+using Grafips::MetricRegistry;
+
+namespace {
+
+void
+TestIntern() {
+  MetricRegistry &r = MetricRegistry::Instance();
+  const int id = r.Intern("test/registry/a");
+  assert(id == MetricRegistry::Hash("test/registry/a"));
+  assert(r.Intern("test/registry/a") == id);
+
+  // "Aa" and "BB" have the same hash.  The second path is rejected,
+  // and remains rejected.
+  const int first = r.Intern("test/registry/Aa");
+  assert(first != MetricRegistry::kInvalidId);
+  assert(r.Intern("test/registry/BB") == MetricRegistry::kInvalidId);
+  assert(r.Intern("test/registry/BB") == MetricRegistry::kInvalidId);
+  assert(r.Intern("test/registry/Aa") == first);
+
+  // slots are dense, in order of interning
+  const int b = r.Intern("test/registry/b");
+  assert(r.Slot(b) > r.Slot(first));
+  assert(r.Slot(first) > r.Slot(id));
+  assert(r.Slot(MetricRegistry::Hash("test/registry/never")) == -1);
+}
+
+void
+TestBind() {
+  MetricRegistry &r = MetricRegistry::Instance();
+  const int a = r.Intern("test/registry/bind/a");
+  const int b = r.Intern("test/registry/bind/b");
+  const int owner = 0, other = 0;
+  int index = -1;
+  assert(!r.Find(a, &owner, &index));
+  r.Bind(a, &owner, 3);
+  r.Bind(b, &owner, 4);
+  assert(r.Find(a, &owner, &index) && index == 3);
+  assert(r.Find(b, &owner, &index) && index == 4);
+  assert(!r.Find(a, &other, &index));
+  assert(!r.Find(a, NULL, &index));
+  // ids which were never interned, or were rejected, can't be bound
+  r.Bind(MetricRegistry::kInvalidId, &owner, 5);
+  assert(!r.Find(MetricRegistry::kInvalidId, &owner, &index));
+
+  r.Unbind(&owner);
+  assert(!r.Find(a, &owner, &index));
+  assert(!r.Find(b, &owner, &index));
+  r.Bind(a, &other, 6);
+  assert(r.Find(a, &other, &index) && index == 6);
+  r.Unbind(&other);
+}
+
+void
+TestMatch() {
+  MetricRegistry &r = MetricRegistry::Instance();
+  const int core0 = r.Intern("test/registry/cpu/core/0/utilization");
+  const int core1 = r.Intern("test/registry/cpu/core/1/utilization");
+  const int system = r.Intern("test/registry/cpu/system/utilization");
+  std::vector<int> ids;
+  r.Match("test/registry/cpu/core/*", &ids);
+  std::sort(ids.begin(), ids.end());
+  std::vector<int> expected;
+  expected.push_back(core0);
+  expected.push_back(core1);
+  std::sort(expected.begin(), expected.end());
+  assert(ids == expected);
+
+  // '*' matches across '/'
+  ids.clear();
+  r.Match("test/registry/cpu/*utilization", &ids);
+  assert(ids.size() == 3);
+  assert(std::find(ids.begin(), ids.end(), system) != ids.end());
+
+  // rejected paths are never matched
+  ids.clear();
+  r.Match("test/registry/BB", &ids);
+  assert(ids.empty());
+  r.Match("test/registry/Aa", &ids);
+  assert(ids.size() == 1);
+}
+
+// interns new paths while the main thread finds bound ids
+void *
+InternPaths(void *) {
+  for (int i = 0; i < 2000; ++i) {
+    std::stringstream path;
+    path << "test/registry/thread/" << i;
+    MetricRegistry::Instance().Intern(path.str());
+  }
+  return NULL;
+}
+
+void
+TestConcurrentFind() {
+  MetricRegistry &r = MetricRegistry::Instance();
+  const int owner = 0;
+  std::vector<int> ids;
+  for (int i = 0; i < 100; ++i) {
+    std::stringstream path;
+    path << "test/registry/bound/" << i;
+    ids.push_back(r.Intern(path.str()));
+    r.Bind(ids.back(), &owner, i);
+  }
+  pthread_t thread;
+  assert(pthread_create(&thread, NULL, InternPaths, NULL) == 0);
+  for (int pass = 0; pass < 200; ++pass) {
+    for (int i = 0; i < 100; ++i) {
+      int index = -1;
+      assert(r.Find(ids[i], &owner, &index) && index == i);
+    }
+  }
+  pthread_join(thread, NULL);
+  int index = -1;
+  assert(r.Slot(MetricRegistry::Hash("test/registry/thread/1999")) >= 0);
+  assert(r.Find(ids[99], &owner, &index) && index == 99);
+  r.Unbind(&owner);
+}
+
+}  // namespace
+
+int
+main() {
+  TestIntern();
+  TestBind();
+  TestMatch();
+  TestConcurrentFind();
+  printf("PASS: gfmetric_registry_test\n");
+  return 0;
+}
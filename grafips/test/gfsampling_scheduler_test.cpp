@@ -0,0 +1,245 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+// Runs a SamplingScheduler against a fake source, and checks which
+// ticks the source is polled at and which samples are delivered.
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "controls/gficontrol.h"
+#include "remote/gfimetric_sink.h"
+#include "remote/gfmetric.h"
+#include "sources/gfimetric_source.h"
+#include "sources/gfsampling_scheduler.h"
+
+using Grafips::ControlSubscriberInterface;
+using Grafips::DataPoint;
+using Grafips::DataSet;
+using Grafips::MetricDescription;
+using Grafips::MetricDescriptionSet;
+using Grafips::MetricSinkInterface;
+using Grafips::MetricSourceInterface;
+using Grafips::PolledSourceInterface;
+using Grafips::SamplingScheduler;
+
+namespace {
+
+const unsigned int kTickMs = 10;
+
+// describes <prefix>/a and <prefix>/b, and publishes a sample of each
+// active metric at each poll
+class TestSource : public PolledSourceInterface {
+ public:
+  explicit TestSource(const std::string &prefix) : m_sink(NULL) {
+    m_descriptions.push_back(MetricDescription(
+        prefix + "/a", "help", "A", Grafips::GR_METRIC_COUNT));
+    m_descriptions.push_back(MetricDescription(
+        prefix + "/b", "help", "B", Grafips::GR_METRIC_COUNT));
+    a = m_descriptions[0].id();
+    b = m_descriptions[1].id();
+  }
+  void Subscribe(MetricSinkInterface *sink) {
+    m_sink = sink;
+    sink->OnDescriptions(m_descriptions);
+  }
+  void Activate(int id) { active.insert(id); }
+  void Deactivate(int id) { active.erase(id); }
+  void Poll(unsigned int ms) {
+    polls.push_back(ms);
+    DataSet d;
+    for (std::set<int>::const_iterator i = active.begin();
+         i != active.end(); ++i)
+      d.push_back(DataPoint(ms, *i, 1.0));
+    if (!d.empty())
+      Publish(d);
+  }
+  void Publish(const DataSet &d) { m_sink->OnMetric(d); }
+
+  int a, b;
+  std::set<int> active;
+  std::vector<unsigned int> polls;
+
+ private:
+  MetricSinkInterface *m_sink;
+  MetricDescriptionSet m_descriptions;
+};
+
+class RecordingSink : public MetricSinkInterface {
+ public:
+  void OnMetric(const DataSet &d) {
+    samples.insert(samples.end(), d.begin(), d.end());
+  }
+  void OnDescriptions(const MetricDescriptionSet &) {}
+  // times of the samples of id
+  std::vector<unsigned int> Times(int id) const {
+    std::vector<unsigned int> times;
+    for (DataSet::const_iterator i = samples.begin(); i != samples.end();
+         ++i)
+      if (i->id == id)
+        times.push_back(i->time_val);
+    return times;
+  }
+  DataSet samples;
+};
+
+class ControlRecorder : public ControlSubscriberInterface {
+ public:
+  void OnControlChanged(const std::string &key, const std::string &v) {
+    assert(key == "SampleInterval");
+    value = v;
+  }
+  std::string value;
+};
+
+void
+RunFor(SamplingScheduler *s, unsigned int ms) {
+  const unsigned int start = Grafips::get_ms_time();
+  while (Grafips::get_ms_time() - start < ms)
+    usleep(s->Run() * 1000);
+}
+
+// true if times are increasing multiples of interval_ms apart
+bool
+Aligned(const std::vector<unsigned int> &times, unsigned int interval_ms) {
+  for (unsigned int i = 1; i < times.size(); ++i) {
+    const unsigned int delta = times[i] - times[i - 1];
+    if (delta == 0 || delta % interval_ms != 0)
+      return false;
+  }
+  return true;
+}
+
+void
+TestIntervals() {
+  SamplingScheduler scheduler(kTickMs);
+  TestSource source("test/scheduler/intervals");
+  RecordingSink sink;
+  MetricSourceInterface *s = scheduler.Schedule(&source, 20);
+  s->Subscribe(&sink);
+  assert(!scheduler.SetInterval("test/scheduler/missing", 40));
+  // b is sampled at every other poll
+  assert(scheduler.SetInterval("test/scheduler/intervals/b", 40));
+
+  // no metric is active, and the source has no idle interval
+  RunFor(&scheduler, 50);
+  assert(source.polls.empty());
+
+  s->Activate(source.a);
+  s->Activate(source.b);
+  // activations of other sources' metrics are ignored
+  s->Activate(source.a + 1);
+  assert(source.active.size() == 2);
+  RunFor(&scheduler, 400);
+  assert(source.polls.size() >= 2);
+  assert(Aligned(source.polls, 20));
+  const std::vector<unsigned int> a = sink.Times(source.a);
+  const std::vector<unsigned int> b = sink.Times(source.b);
+  assert(a.size() == source.polls.size());
+  assert(!b.empty() && b.size() < a.size());
+  assert(Aligned(b, 40));
+
+  // samples published outside of Poll are not filtered, even after a
+  // poll at which b was not due
+  while (sink.Times(source.b).back() == source.polls.back())
+    usleep(scheduler.Run() * 1000);
+  sink.samples.clear();
+  DataSet async;
+  async.push_back(DataPoint(source.polls.back() + kTickMs, source.b, 1.0));
+  source.Publish(async);
+  assert(sink.samples.size() == 1);
+
+  // after the last deactivation, the source is polled once more
+  s->Deactivate(source.a);
+  s->Deactivate(source.b);
+  assert(source.active.empty());
+  const size_t polls = source.polls.size();
+  RunFor(&scheduler, 100);
+  assert(source.polls.size() == polls + 1);
+}
+
+void
+TestIdle() {
+  SamplingScheduler scheduler(kTickMs);
+  TestSource idle("test/scheduler/idle"), stopped("test/scheduler/stopped");
+  RecordingSink sink;
+  scheduler.Schedule(&idle, 20, 30)->Subscribe(&sink);
+  scheduler.Schedule(&stopped, 20)->Subscribe(&sink);
+  RunFor(&scheduler, 200);
+  assert(idle.polls.size() >= 2);
+  assert(Aligned(idle.polls, 30));
+  assert(stopped.polls.empty());
+  assert(sink.samples.empty());
+}
+
+void
+TestControl() {
+  SamplingScheduler scheduler(kTickMs);
+  TestSource source("test/scheduler/control");
+  RecordingSink sink;
+  scheduler.Schedule(&source, 20)->Subscribe(&sink);
+  ControlRecorder control;
+  control.value = "unset";
+  scheduler.Subscribe(&control);
+  assert(control.value == "");
+  scheduler.Set("SampleInterval", "test/scheduler/control/a:50");
+  assert(control.value == "test/scheduler/control/a:50");
+  scheduler.Set("SampleInterval", "test/scheduler/control/b:30");
+  assert(control.value ==
+         "test/scheduler/control/a:50,test/scheduler/control/b:30");
+  // 0 restores the default
+  scheduler.Set("SampleInterval", "test/scheduler/control/a:0");
+  assert(control.value == "test/scheduler/control/b:30");
+  // malformed and out of range intervals are ignored
+  scheduler.Set("SampleInterval", "test/scheduler/control/b:-5");
+  scheduler.Set("SampleInterval", "test/scheduler/control/b:abc");
+  scheduler.Set("SampleInterval", "test/scheduler/control/b:20ms");
+  scheduler.Set("SampleInterval", "test/scheduler/control/b:");
+  scheduler.Set("SampleInterval", "test/scheduler/control/b:3600001");
+  assert(control.value == "test/scheduler/control/b:30");
+  scheduler.Set("SampleInterval", "test/scheduler/control/b:3600000");
+  assert(control.value == "test/scheduler/control/b:3600000");
+  // SetInterval limits the interval
+  scheduler.SetInterval("test/scheduler/control/b", 4294967295u);
+  assert(control.value == "test/scheduler/control/b:3600000");
+}
+
+}  // namespace
+
+int
+main() {
+  TestIntervals();
+  TestIdle();
+  TestControl();
+  printf("PASS: gfsampling_scheduler_test\n");
+  return 0;
+}
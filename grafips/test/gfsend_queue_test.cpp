@@ -0,0 +1,165 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+// Fills a SendQueue past its bound, and checks which messages each
+// DropPolicy keeps.
+
+#include <assert.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+#include <string>
+
+#include "remote/gfsend_queue.h"
+
+using Grafips::DropPolicy;
+using Grafips::SendQueue;
+
+namespace {
+
+// each message is 10 bytes, filled with its tag
+const int kMessageBytes = 10;
+
+bool
+Push(SendQueue *q, char tag, int samples) {
+  const std::string body(kMessageBytes - 1, tag);
+  return q->Push(&tag, 1, body.data(), body.size(), samples);
+}
+
+// tags of the queued messages, oldest first
+std::string
+Tags(const SendQueue &q) {
+  struct iovec iov[64];
+  const int count = q.Front(iov, 64);
+  std::string tags;
+  for (int i = 0; i < count; ++i)
+    tags += reinterpret_cast<const char *>(iov[i].iov_base)[0];
+  return tags;
+}
+
+void
+TestParse() {
+  DropPolicy p = Grafips::kDropNewest;
+  assert(Grafips::ParseDropPolicy("oldest", &p) && p == Grafips::kDropOldest);
+  assert(Grafips::ParseDropPolicy("newest", &p) && p == Grafips::kDropNewest);
+  assert(Grafips::ParseDropPolicy("downsample", &p) &&
+         p == Grafips::kDownsample);
+  assert(!Grafips::ParseDropPolicy("Oldest", &p));
+  assert(p == Grafips::kDownsample);
+}
+
+void
+TestDropOldest() {
+  SendQueue q(3 * kMessageBytes, Grafips::kDropOldest);
+  assert(q.Empty());
+  assert(Push(&q, 'a', 3) && Push(&q, 'b', 3) && Push(&q, 'c', 3));
+  assert(Push(&q, 'd', 3));
+  assert(Tags(q) == "bcd");
+  assert(q.DroppedSamples() == 3);
+  assert(q.Bytes() == 3 * kMessageBytes);
+
+  // samples are dropped to make room for messages which must be sent
+  assert(Push(&q, 'X', 0));
+  assert(Tags(q) == "cdX");
+  assert(q.DroppedSamples() == 6);
+
+  // a partially written message is kept
+  q.Pop(5);
+  assert(Push(&q, 'e', 3));
+  assert(Tags(q) == "cXe");
+  struct iovec iov[4];
+  assert(q.Front(iov, 4) == 3);
+  assert(iov[0].iov_len == kMessageBytes - 5);
+
+  q.Pop(3 * kMessageBytes - 5);
+  assert(q.Empty());
+  assert(q.Bytes() == 0);
+}
+
+void
+TestMustDeliver() {
+  SendQueue q(2 * kMessageBytes, Grafips::kDropOldest);
+  assert(Push(&q, 'X', 0) && Push(&q, 'Y', 0));
+  // neither message may be dropped, so the queue fails
+  assert(!Push(&q, 'Z', 0));
+  // and samples are dropped
+  assert(Push(&q, 'a', 3));
+  assert(Tags(q) == "XY");
+  assert(q.DroppedSamples() == 3);
+
+  // a message larger than the queue is accepted when it is empty
+  SendQueue small(kMessageBytes / 2, Grafips::kDropOldest);
+  assert(Push(&small, 'X', 0));
+  assert(Tags(small) == "X");
+}
+
+void
+TestDropNewest() {
+  SendQueue q(3 * kMessageBytes, Grafips::kDropNewest);
+  assert(Push(&q, 'a', 3) && Push(&q, 'b', 3) && Push(&q, 'c', 3));
+  assert(Push(&q, 'd', 3));
+  assert(Tags(q) == "abc");
+  assert(q.DroppedSamples() == 3);
+}
+
+void
+TestDownsample() {
+  SendQueue q(3 * kMessageBytes, Grafips::kDownsample);
+  assert(Push(&q, 'a', 1) && Push(&q, 'b', 1) && Push(&q, 'c', 1));
+  // every other queued message is dropped, and the stride doubles
+  assert(Push(&q, 'd', 1));
+  assert(Tags(q) == "acd");
+  assert(q.DroppedSamples() == 1);
+  assert(Push(&q, 'e', 1));
+  assert(Tags(q) == "ade");
+  assert(q.DroppedSamples() == 2);
+  // one of every four new messages is queued
+  assert(Push(&q, 'f', 1) && Push(&q, 'g', 1) && Push(&q, 'h', 1));
+  assert(Tags(q) == "ade");
+  assert(q.DroppedSamples() == 5);
+  assert(Push(&q, 'i', 1));
+  assert(Tags(q) == "aei");
+  assert(q.DroppedSamples() == 6);
+  // every message is queued once the subscriber catches up
+  q.Pop(3 * kMessageBytes);
+  assert(Push(&q, 'j', 1) && Push(&q, 'k', 1));
+  assert(Tags(q) == "jk");
+  assert(q.DroppedSamples() == 6);
+}
+
+}  // namespace
+
+int
+main() {
+  TestParse();
+  TestDropOldest();
+  TestMustDeliver();
+  TestDropNewest();
+  TestDownsample();
+  printf("PASS: gfsend_queue_test\n");
+  return 0;
+}
@@ -0,0 +1,137 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+// Measures the cost of refreshing and publishing CpuSource metrics on
+// a large machine, by parsing a synthetic /proc/stat with 512 cores.
+//
+// usage: gfcpu-source-bench [cores] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "remote/gfimetric_sink.h"
+#include "remote/gfmetric.h"
+#include "sources/gfcpu_source.h"
+
+using Grafips::CpuSource;
+using Grafips::DataSet;
+using Grafips::MetricDescriptionSet;
+using Grafips::MetricSinkInterface;
+
+namespace Grafips {
+// the source's friend, which may refresh and publish separately, to
+// time each
+class CpuSourceFixture {
+ public:
+  static void Refresh(CpuSource *s) { s->Refresh(); }
+  static void Publish(CpuSource *s) { s->Publish(0); }
+};
+}  // namespace Grafips
+
+using Grafips::CpuSourceFixture;
+
+namespace {
+
+class CountingSink : public MetricSinkInterface {
+ public:
+  CountingSink() : samples(0) {}
+  void OnMetric(const DataSet &d) { samples += d.size(); }
+  void OnDescriptions(const MetricDescriptionSet &d) { descriptions = d; }
+  MetricDescriptionSet descriptions;
+  long samples;
+};
+
+// counters in the format of /proc/stat, for a long running machine
+void
+WriteStat(FILE *f, int cores, int pass) {
+  const uint64_t base = 4000000000ULL + pass * 30;
+  fprintf(f, "cpu  %llu 1234 %llu 98765432100 5678 0 910 0 0 0\n",
+          static_cast<unsigned long long>(base * cores),
+          static_cast<unsigned long long>(base / 2 * cores));
+  for (int i = 0; i < cores; ++i)
+    fprintf(f, "cpu%d %llu 12 %llu 987654321 56 0 9 0 0 0\n", i,
+            static_cast<unsigned long long>(base + i),
+            static_cast<unsigned long long>(base / 2 + i));
+  fprintf(f, "intr 1234567890");
+  for (int i = 0; i < 512; ++i)
+    fprintf(f, " %d", i);
+  fprintf(f, "\nctxt 123456789\nbtime 1400000000\nprocesses 123456\n"
+          "procs_running 3\nprocs_blocked 0\nsoftirq 1 2 3 4 5 6 7 8 9 10\n");
+}
+
+double
+Now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const int cores = argc > 1 ? atoi(argv[1]) : 512;
+  const int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+
+  char path[] = "/tmp/gfcpu-source-bench-XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  FILE *f = fdopen(fd, "w");
+  WriteStat(f, cores, 0);
+  const long bytes = ftell(f);
+  fclose(f);
+
+  CpuSource source(path);
+  CountingSink sink;
+  source.Subscribe(&sink);
+  for (unsigned int i = 0; i < sink.descriptions.size(); ++i)
+    source.Activate(sink.descriptions[i].id());
+
+  double begin = Now();
+  for (int i = 0; i < iterations; ++i)
+    CpuSourceFixture::Refresh(&source);
+  const double refresh_us = (Now() - begin) / iterations * 1e6;
+
+  begin = Now();
+  for (int i = 0; i < iterations; ++i)
+    CpuSourceFixture::Publish(&source);
+  const double publish_us = (Now() - begin) / iterations * 1e6;
+
+  printf("%d cores, %ld byte /proc/stat, %u metrics\n", cores, bytes,
+         static_cast<unsigned int>(sink.descriptions.size()));
+  printf("refresh %.1f us, publish %.1f us (%ld samples)\n", refresh_us,
+         publish_us, sink.samples / iterations);
+  unlink(path);
+  return 0;
+}
@@ -0,0 +1,223 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+// Compares the latency and throughput of the grafips transports
+// (see gftransport.h).  A publisher thread writes samples at a fixed
+// rate, framed as SessionWriter frames them, and the host measures
+// the time from each write until the sample is read.
+//
+// usage: gftransport-bench [seconds per run]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "os/gfsocket.h"
+#include "os/gfthread.h"
+#include "os/gftransport.h"
+
+using Grafips::ConnectTransport;
+using Grafips::ListenTransport;
+using Grafips::ServerSocket;
+using Grafips::Socket;
+using Grafips::Thread;
+
+namespace {
+
+// roughly the size of one DataPoint in a v1 OnMetric message
+struct Sample {
+  uint64_t send_ns;
+  uint32_t id;
+  uint32_t sequence;
+  double data;
+};
+
+uint64_t
+now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+void
+wait_until(uint64_t deadline_ns) {
+  // sleep for most of the interval, and spin for the remainder, so
+  // that high rates are paced accurately.
+  static const uint64_t kSpinNs = 50000;
+  uint64_t now = now_ns();
+  if (now + kSpinNs < deadline_ns) {
+    const uint64_t sleep_ns = deadline_ns - now - kSpinNs;
+    struct timespec t;
+    t.tv_sec = sleep_ns / 1000000000ULL;
+    t.tv_nsec = sleep_ns % 1000000000ULL;
+    nanosleep(&t, NULL);
+  }
+  while (now_ns() < deadline_ns) {}
+}
+
+// Accepts one host, and writes count samples at rate per second.  A
+// rate of 0 writes as fast as possible.
+class Writer : public Thread {
+ public:
+  Writer(ServerSocket *server, int rate, int count)
+      : Thread("gftransport_bench"), m_server(server), m_rate(rate),
+        m_count(count), m_write_ns(0), m_syscalls(0) {}
+  void Run() {
+    Socket *s = m_server->Accept();
+    if (s == NULL)
+      return;
+    const uint64_t start = now_ns();
+    for (int i = 0; i < m_count; ++i) {
+      if (m_rate)
+        wait_until(start + i * 1000000000ULL / m_rate);
+      Sample sample;
+      sample.id = 1;
+      sample.sequence = i;
+      sample.data = i;
+      const uint32_t size = sizeof(sample);
+      const uint64_t before = now_ns();
+      sample.send_ns = before;
+      if (!s->Write(&size, sizeof(size), &sample, sizeof(sample)))
+        break;
+      m_write_ns += now_ns() - before;
+    }
+    m_syscalls = s->SendCount();
+    delete s;
+  }
+  // mean time spent in Write(), per sample
+  double WriteNs() const {
+    return static_cast<double>(m_write_ns) / m_count;
+  }
+  uint64_t Syscalls() const { return m_syscalls; }
+
+ private:
+  ServerSocket *m_server;
+  const int m_rate, m_count;
+  uint64_t m_write_ns, m_syscalls;
+};
+
+double
+percentile(const std::vector<uint64_t> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  const size_t i = std::min(sorted.size() - 1,
+                            static_cast<size_t>(p * sorted.size()));
+  return sorted[i] / 1000.0;
+}
+
+bool
+run(const std::string &name, const std::string &listen_spec, int rate,
+    double seconds) {
+  ServerSocket *server = ListenTransport(listen_spec, 1);
+  if (server == NULL) {
+    fprintf(stderr, "could not listen on %s\n", listen_spec.c_str());
+    return false;
+  }
+  std::string connect_spec = listen_spec;
+  if (listen_spec == "0") {
+    std::stringstream port;
+    port << server->GetPort();
+    connect_spec = port.str();
+  }
+
+  const int count = rate ? rate * seconds : 1000000;
+  Writer writer(server, rate, count);
+  writer.Start();
+  Socket *host = ConnectTransport(connect_spec);
+  if (host == NULL) {
+    fprintf(stderr, "could not connect to %s\n", connect_spec.c_str());
+    exit(-1);
+  }
+
+  std::vector<uint64_t> latency;
+  latency.reserve(count);
+  const uint64_t start = now_ns();
+  uint32_t size;
+  Sample sample;
+  while (host->Read(&size) && size == sizeof(sample) &&
+         host->Read(&sample)) {
+    latency.push_back(now_ns() - sample.send_ns);
+  }
+  const uint64_t elapsed = now_ns() - start;
+  writer.Join();
+  delete host;
+  delete server;
+
+  std::sort(latency.begin(), latency.end());
+  const double achieved = latency.size() * 1e9 / elapsed;
+  char rate_str[16];
+  if (rate)
+    snprintf(rate_str, sizeof(rate_str), "%d", rate);
+  else
+    snprintf(rate_str, sizeof(rate_str), "max");
+  printf("%-5s %8s %12.0f %9.1f %9.1f %9.1f %10.0f %12.2f\n",
+         name.c_str(), rate_str, achieved,
+         percentile(latency, 0.5), percentile(latency, 0.99),
+         percentile(latency, 1.0), writer.WriteNs(),
+         static_cast<double>(writer.Syscalls()) / latency.size());
+  return latency.size() == static_cast<size_t>(count);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  double seconds = 2;
+  if (argc > 1)
+    seconds = atof(argv[1]);
+
+  std::stringstream unix_spec, shm_spec;
+  unix_spec << "unix:/tmp/gftransport-bench-" << getpid();
+  shm_spec << "shm:bench-" << getpid();
+  struct Transport {
+    const char *name;
+    std::string spec;
+  } transports[] = {
+    { "tcp", "0" },
+    { "unix", unix_spec.str() },
+    { "shm", shm_spec.str() },
+  };
+  const int rates[] = { 1000, 10000, 100000, 0 };
+
+  printf("%-5s %8s %12s %9s %9s %9s %10s %12s\n", "", "rate",
+         "samples/s", "p50 us", "p99 us", "max us", "write ns",
+         "syscalls/smp");
+  bool complete = true;
+  for (unsigned int r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r)
+    for (unsigned int t = 0; t < sizeof(transports) / sizeof(transports[0]);
+         ++t)
+      complete &= run(transports[t].name, transports[t].spec, rates[r],
+                      seconds);
+  return complete ? 0 : -1;
+}
@@ -0,0 +1,185 @@
+// Copyright (C) Intel Corp.  2014.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+// Prints the samples in a recording made with FIPS_RECORD (see
+// gfmetric_file.h).  Only the chunks and series which match the
+// query are read.
+//
+// usage: grafips-dump [-l] [-m metric[,metric...]] [-b seconds]
+//                     [-e seconds] file
+//
+//   -l  list the recorded metrics, from the chunk indexes
+//   -m  metric paths to print.  A path ending in '/' selects every
+//       metric below it.
+//   -b  -e  time range, in seconds from the start of the recording
+//
+// Samples are printed as: seconds <tab> path <tab> value
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "remote/gfmetric.h"
+#include "remote/gfmetric_file.h"
+
+using Grafips::DataPoint;
+using Grafips::DataSet;
+using Grafips::MetricDescription;
+using Grafips::MetricDescriptionSet;
+using Grafips::MetricFileReader;
+
+namespace {
+
+void
+Usage() {
+  fprintf(stderr, "usage: grafips-dump [-l] [-m metric[,metric...]] "
+          "[-b seconds] [-e seconds] file\n");
+  exit(1);
+}
+
+bool
+Selected(const std::vector<std::string> &metrics, const std::string &path) {
+  if (metrics.empty())
+    return true;
+  for (std::vector<std::string>::const_iterator i = metrics.begin();
+       i != metrics.end(); ++i) {
+    if (path == *i)
+      return true;
+    if (!i->empty() && (*i)[i->size() - 1] == '/' &&
+        path.compare(0, i->size(), *i) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool
+CompareTime(const DataPoint &a, const DataPoint &b) {
+  return a.time_ns < b.time_ns;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  bool list = false;
+  std::vector<std::string> metrics;
+  double begin_s = -1, end_s = -1;
+  int opt;
+  while ((opt = getopt(argc, argv, "lm:b:e:")) != -1) {
+    switch (opt) {
+      case 'l':
+        list = true;
+        break;
+      case 'm': {
+        std::string arg = optarg;
+        size_t start = 0;
+        while (start <= arg.size()) {
+          size_t end = arg.find(',', start);
+          if (end == std::string::npos)
+            end = arg.size();
+          if (end > start)
+            metrics.push_back(arg.substr(start, end - start));
+          start = end + 1;
+        }
+        break;
+      }
+      case 'b':
+        begin_s = atof(optarg);
+        break;
+      case 'e':
+        end_s = atof(optarg);
+        break;
+      default:
+        Usage();
+    }
+  }
+  if (optind != argc - 1)
+    Usage();
+
+  MetricFileReader reader;
+  if (!reader.Open(argv[optind])) {
+    fprintf(stderr, "grafips-dump: could not read %s\n", argv[optind]);
+    return 1;
+  }
+
+  const uint64_t start_ns = reader.StartNs();
+  std::map<int, std::string> paths;
+  std::set<int> ids;
+  const MetricDescriptionSet &desc = reader.Descriptions();
+  for (MetricDescriptionSet::const_iterator i = desc.begin();
+       i != desc.end(); ++i) {
+    paths[i->id()] = i->path;
+    if (Selected(metrics, i->path))
+      ids.insert(i->id());
+  }
+  if (ids.empty()) {
+    fprintf(stderr, "grafips-dump: no metrics selected\n");
+    return 1;
+  }
+
+  if (list) {
+    const MetricFileReader::SummaryMap &summaries = reader.Summaries();
+    for (MetricFileReader::SummaryMap::const_iterator i = summaries.begin();
+         i != summaries.end(); ++i) {
+      if (!ids.count(i->first))
+        continue;
+      printf("%s\t%" PRIu64 " samples\t%.3f - %.3f s\n",
+             paths[i->first].c_str(), i->second.samples,
+             static_cast<int64_t>(i->second.begin_ns - start_ns) / 1e9,
+             static_cast<int64_t>(i->second.end_ns - start_ns) / 1e9);
+    }
+    return 0;
+  }
+
+  const uint64_t begin_ns = begin_s < 0 ? 0 :
+                            start_ns + static_cast<uint64_t>(begin_s * 1e9);
+  const uint64_t end_ns = end_s < 0 ? std::numeric_limits<uint64_t>::max() :
+                          start_ns + static_cast<uint64_t>(end_s * 1e9);
+  DataSet d;
+  if (!reader.Read(begin_ns, end_ns, ids, &d)) {
+    fprintf(stderr, "grafips-dump: %s is corrupt\n", argv[optind]);
+    return 1;
+  }
+  std::stable_sort(d.begin(), d.end(), CompareTime);
+  for (DataSet::const_iterator i = d.begin(); i != d.end(); ++i) {
+    const double seconds = static_cast<int64_t>(i->time_ns - start_ns) / 1e9;
+    if (i->integral)
+      printf("%.6f\t%s\t%" PRId64 "\n", seconds, paths[i->id].c_str(),
+             i->int_data);
+    else
+      printf("%.6f\t%s\t%g\n", seconds, paths[i->id].c_str(), i->data);
+  }
+  return 0;
+}